@@ -19,6 +19,7 @@
 #include <terragear/tg_unique_vec3f.hxx>
 #include <terragear/tg_unique_vec2f.hxx>
 #include <terragear/tg_shapefile.hxx>
+#include <terragear/tg_profile.hxx>
 
 #include "airport.hxx"
 #include "beznode.hxx"
@@ -327,7 +328,10 @@ void Airport::BuildBtg(const std::string& root, const string_list& elev_src )
 
     // Airport building Steps
     // 1: Build the base polygons
-    BuildBase();
+    {
+        TG_PROFILE_SCOPE( "BuildBase" );
+        BuildBase();
+    }
 
     TG_LOG(SG_GENERAL, SG_INFO, "ClipBase" );
 
@@ -363,7 +367,10 @@ void Airport::BuildBtg(const std::string& root, const string_list& elev_src )
     // CalcSmoothingSurface(root, elev_src);
     
     // chop and save the smoothing surface / airport base
-    ChopBase( root, elev_src );
+    {
+        TG_PROFILE_SCOPE( "ChopBase" );
+        ChopBase( root, elev_src );
+    }
     
     // save Base
     // TG_LOG(SG_GENERAL, SG_INFO, "Write Base" );
@@ -175,7 +175,7 @@ void Airport::BuildBase( void )
         polys_built.get_poly(AIRPORT_AREA_OUTER_BASE, j).toShapefile( poLayer );
     }
 
-    GDALClose( poDS );
+    tgPolygonSet::closeDatasource( poDS );
 #endif    
 #endif
     
@@ -0,0 +1,293 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifdef _MSC_VER
+#  include <process.h>
+#  define getpid _getpid
+#else
+#  include <unistd.h>
+#endif
+
+#include <simgear/debug/logstream.hxx>
+
+#include "airport.hxx"
+#include "helipad.hxx"
+#include "parser.hxx"
+#include "runway.hxx"
+#include "debug.hxx"
+#include "apt_index.hxx"
+
+bool AptIndexEntry::IsInside( const tgRectangle& rect ) const
+{
+    if ( points.empty() || !rect.intersects( bounds ) ) {
+        return false;
+    }
+
+    for ( unsigned int i=0; i<points.size(); i++ ) {
+        if ( rect.isInside( points[i] ) ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+AptIndex::AptIndex( const std::string& dfile, const std::string& ifile ) :
+    datafile( dfile ),
+    indexfile( ifile ),
+    sourceSize( -1 ),
+    sourceTime( -1 )
+{
+    struct stat st;
+    if ( stat( datafile.c_str(), &st ) == 0 ) {
+        sourceSize = (long)st.st_size;
+        sourceTime = (long)st.st_mtime;
+    }
+
+    if ( Load() ) {
+        TG_LOG( SG_GENERAL, SG_INFO, "Loaded index of " << entries.size() << " airports from " << indexfile );
+    } else {
+        Build();
+        Save();
+        TG_LOG( SG_GENERAL, SG_INFO, "Indexed " << entries.size() << " airports in " << datafile );
+    }
+}
+
+void AptIndex::AddEntry( const AptIndexEntry& entry )
+{
+    // first definition wins - same as the old linear scan
+    if ( icaoLookup.find( entry.icao ) == icaoLookup.end() ) {
+        icaoLookup[entry.icao] = entries.size();
+    }
+    entries.push_back( entry );
+}
+
+bool AptIndex::Load( void )
+{
+    std::ifstream in( indexfile.c_str() );
+    if ( !in.is_open() ) {
+        return false;
+    }
+
+    std::string  magic;
+    int          version;
+    long         size, mtime;
+    unsigned int count;
+
+    in >> magic >> version >> size >> mtime >> count;
+    if ( !in || magic != "TGAPTIDX" || version != APT_INDEX_VERSION ) {
+        TG_LOG( SG_GENERAL, SG_INFO, "Ignoring index " << indexfile << " - unknown format" );
+        return false;
+    }
+
+    if ( size != sourceSize || mtime != sourceTime ) {
+        TG_LOG( SG_GENERAL, SG_INFO, "Index " << indexfile << " is out of date - rebuilding" );
+        return false;
+    }
+
+    AptIndexEntry entry;
+    std::string   icao;
+    unsigned int  numPoints;
+
+    // the header has the number of entries - a short file was torn
+    for ( unsigned int n=0; n<count; n++ ) {
+        in >> icao >> entry.offset >> entry.length >> numPoints;
+        entry.points.clear();
+
+        for ( unsigned int i=0; in && i<numPoints; i++ ) {
+            double lon, lat;
+            in >> lon >> lat;
+            entry.points.push_back( SGGeod::fromDeg( lon, lat ) );
+
+            if ( i == 0 ) {
+                entry.bounds = tgRectangle( entry.points[0], entry.points[0] );
+            } else {
+                entry.bounds.expandBy( entry.points[i] );
+            }
+        }
+
+        // ids are quoted, so an empty one doesn't shift the fields
+        if ( !in || icao.size() < 2 || icao[0] != '"' || icao[icao.size()-1] != '"' ) {
+            TG_LOG( SG_GENERAL, SG_ALERT, "Index " << indexfile << " is truncated or corrupt at entry " << n << " of " << count << " - rebuilding" );
+            entries.clear();
+            icaoLookup.clear();
+            return false;
+        }
+        entry.icao = icao.substr( 1, icao.size()-2 );
+
+        AddEntry( entry );
+    }
+
+    return true;
+}
+
+void AptIndex::Build( void )
+{
+    std::ifstream in( datafile.c_str() );
+    if ( !in.is_open() )
+    {
+        TG_LOG( SG_GENERAL, SG_ALERT, "Cannot open file: " << datafile );
+        exit(-1);
+    }
+
+    entries.clear();
+    icaoLookup.clear();
+
+    AptIndexEntry   cur;
+    bool            inAirport = false;
+    std::string     str;
+    char            line[2048];
+    long            cur_pos = in.tellg();
+
+    while ( std::getline( in, str ) )
+    {
+        long next_pos = in.tellg();
+
+        strncpy( line, str.c_str(), sizeof(line)-1 );
+        line[sizeof(line)-1] = '\0';
+
+        char* def = &line[0];
+        char* tok = strtok(def, " \t\r\n");
+
+        if (tok)
+        {
+            def += strlen(tok)+1;
+            int code = atoi(tok);
+
+            switch(code)
+            {
+                case LAND_AIRPORT_CODE:
+                case SEA_AIRPORT_CODE:
+                case HELIPORT_CODE:
+                {
+                    if ( inAirport ) {
+                        cur.length = cur_pos - cur.offset;
+                        AddEntry( cur );
+                    }
+
+                    Airport airport( code, def );
+                    cur = AptIndexEntry();
+                    cur.icao   = airport.GetIcao();
+                    cur.offset = cur_pos;
+                    inAirport  = true;
+                }
+                break;
+
+                case LAND_RUNWAY_CODE:
+                    if ( inAirport ) {
+                        Runway runway( NULL, def );
+                        cur.points.push_back( runway.GetStart() );
+                        cur.points.push_back( runway.GetEnd() );
+                    }
+                    break;
+
+                case WATER_RUNWAY_CODE:
+                    if ( inAirport ) {
+                        WaterRunway runway( def );
+                        cur.points.push_back( runway.GetStart() );
+                        cur.points.push_back( runway.GetEnd() );
+                    }
+                    break;
+
+                case HELIPAD_CODE:
+                    if ( inAirport ) {
+                        Helipad helipad( def );
+                        cur.points.push_back( helipad.GetLoc() );
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+
+            if ( code == END_OF_FILE ) {
+                break;
+            }
+        }
+
+        cur_pos = next_pos;
+    }
+
+    if ( inAirport ) {
+        cur.length = cur_pos - cur.offset;
+        AddEntry( cur );
+    }
+
+    for ( unsigned int i=0; i<entries.size(); i++ ) {
+        AptIndexEntry& e = entries[i];
+        for ( unsigned int j=0; j<e.points.size(); j++ ) {
+            if ( j == 0 ) {
+                e.bounds = tgRectangle( e.points[0], e.points[0] );
+            } else {
+                e.bounds.expandBy( e.points[j] );
+            }
+        }
+    }
+}
+
+void AptIndex::Save( void ) const
+{
+    // write a file of our own, then rename it over the index - so a crash,
+    // or another run saving at the same time, never leaves a torn index
+    std::ostringstream tmp;
+    tmp << indexfile << ".new." << getpid();
+    std::string tmpfile = tmp.str();
+
+    std::ofstream out( tmpfile.c_str(), std::ios::out | std::ios::trunc );
+    if ( !out.is_open() ) {
+        TG_LOG( SG_GENERAL, SG_WARN, "Cannot write airport index " << tmpfile );
+        return;
+    }
+
+    out.precision( 10 );
+    out << "TGAPTIDX " << APT_INDEX_VERSION << " " << sourceSize << " " << sourceTime << " " << entries.size() << "\n";
+
+    for ( unsigned int i=0; i<entries.size(); i++ ) {
+        const AptIndexEntry& e = entries[i];
+
+        out << '"' << e.icao << '"' << " " << e.offset << " " << e.length << " " << e.points.size();
+        for ( unsigned int j=0; j<e.points.size(); j++ ) {
+            out << " " << e.points[j].getLongitudeDeg() << " " << e.points[j].getLatitudeDeg();
+        }
+        out << "\n";
+    }
+    out.close();
+
+    if ( !out ) {
+        TG_LOG( SG_GENERAL, SG_WARN, "Writing airport index " << tmpfile << " failed" );
+        ::remove( tmpfile.c_str() );
+        return;
+    }
+
+#ifdef _MSC_VER
+    // rename doesn't replace an existing file on windows
+    ::remove( indexfile.c_str() );
+#endif
+    if ( ::rename( tmpfile.c_str(), indexfile.c_str() ) != 0 ) {
+        TG_LOG( SG_GENERAL, SG_WARN, "Cannot rename " << tmpfile << " to " << indexfile );
+        ::remove( tmpfile.c_str() );
+    }
+}
+
+const AptIndexEntry* AptIndex::FindIcao( const std::string& icao ) const
+{
+    std::map<std::string, unsigned int>::const_iterator it = icaoLookup.find( icao );
+    if ( it == icaoLookup.end() ) {
+        return NULL;
+    }
+
+    return &entries[it->second];
+}
+
+void AptIndex::FindInRect( const tgRectangle& rect, long start_pos, std::vector<const AptIndexEntry*>& found ) const
+{
+    for ( unsigned int i=0; i<entries.size(); i++ ) {
+        if ( entries[i].offset >= start_pos && entries[i].IsInside( rect ) ) {
+            found.push_back( &entries[i] );
+        }
+    }
+}
+
@@ -0,0 +1,68 @@
+#ifndef _APT_INDEX_H_
+#define _APT_INDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <terragear/tg_rectangle.hxx>
+
+// Sidecar index of an apt.dat file.
+//
+// Finding an airport used to mean a getline scan of the whole apt.dat,
+// once per lookup.  The index is built in one pass, and saved next to
+// the work directory so later runs can reuse it.  It is rebuilt whenever
+// the size or modification time of the apt.dat no longer matches.
+//
+// For every airport we keep the byte offset and length of its definition,
+// and the points used for area selection ( runway ends and helipads ).
+
+#define APT_INDEX_VERSION   (2)
+
+class AptIndexEntry
+{
+public:
+    AptIndexEntry() : offset(0), length(0) {}
+
+    // true if a runway end or helipad lies within rect
+    bool IsInside( const tgRectangle& rect ) const;
+
+    std::string         icao;
+    long                offset;
+    long                length;
+    std::vector<SGGeod> points;
+    tgRectangle         bounds;
+};
+
+class AptIndex
+{
+public:
+    AptIndex( const std::string& datafile, const std::string& indexfile );
+
+    // lookup by ICAO id - NULL if not in the file
+    const AptIndexEntry* FindIcao( const std::string& icao ) const;
+
+    // all airports after start_pos ( in file order ) with a runway end
+    // or helipad within the rectangle
+    void FindInRect( const tgRectangle& rect, long start_pos, std::vector<const AptIndexEntry*>& found ) const;
+
+    unsigned int size( void ) const { return entries.size(); }
+
+private:
+    bool Load( void );
+    void Build( void );
+    void Save( void ) const;
+    void AddEntry( const AptIndexEntry& entry );
+
+    std::string     datafile;
+    std::string     indexfile;
+
+    // stamp of the apt.dat the index was built from
+    long            sourceSize;
+    long            sourceTime;
+
+    std::vector<AptIndexEntry>          entries;        // in file order
+    std::map<std::string, unsigned int> icaoLookup;
+};
+
+#endif
@@ -28,7 +28,7 @@
 #include <simgear/math/SGMath.hxx>
 #include <simgear/debug/logstream.hxx>
 
-#include <terragear/tg_array.hxx>
+#include <terragear/tg_array_cache.hxx>
 
 #include "global.hxx"
 #include "debug.hxx"
@@ -41,7 +41,6 @@ double tgAverageElevation( const std::string &root, const string_list elev_src,
 {
     bool done = false;
     unsigned int i;
-    tgArray array;
 
     // make a copy so our routine is non-destructive.
     std::vector<SGGeod> points = points_source;
@@ -71,28 +70,10 @@ double tgAverageElevation( const std::string &root, const string_list elev_src,
 
         if ( found_one ) {
             SGBucket b( first );
-            std::string base = b.gen_base_path();
 
-            // try the various elevation sources
-            i = 0;
-            bool found_file = false;
-            while ( !found_file && i < elev_src.size() ) {
-                std::string array_path = root + "/" + elev_src[i] + "/" + base + "/" + b.gen_index_str();
-
-                if ( array.open(array_path) ) {
-                    found_file = true;
-                    TG_LOG( SG_GENERAL, SG_DEBUG, "Using array_path = " << array_path );
-                }
-                i++;
-            }
-
-            // this will fill in a zero structure if no array data
-            // found/opened
-            array.parse( b );
-
-            // this will do a hasty job of removing voids by inserting
-            // data from the nearest neighbor (sort of)
-            array.remove_voids();
+            // the first source with an array for this bucket - or zero'd
+            // data if there isn't one.  Shared by every airport in the bucket.
+            tgArrayPtr array = tgArrayCache::instance().get( root, elev_src, b );
 
             // update all the non-updated elevations that are inside
             // this array file
@@ -101,15 +82,13 @@ double tgAverageElevation( const std::string &root, const string_list elev_src,
             for ( i = 0; i < points.size(); ++i ) {
                 if ( points[i].getElevationM() < -9000.0 ) {
                     done = false;
-                    elev = array.altitude_from_grid( points[i].getLongitudeDeg() * 3600.0,
-                                                     points[i].getLatitudeDeg() * 3600.0 );
+                    elev = array->altitude_from_grid( points[i].getLongitudeDeg() * 3600.0,
+                                                      points[i].getLatitudeDeg() * 3600.0 );
                     if ( elev > -9000 ) {
                         points[i].setElevationM( elev );
                     }
                 }
             }
-
-            array.close();
         } else {
             done = true;
         }
@@ -25,6 +25,9 @@
 
 #include <Include/version.h>
 
+#include <terragear/tg_profile.hxx>
+#include <terragear/tg_shapefile_cache.hxx>
+
 #include "scheduler.hxx"
 #include "beznode.hxx"
 #include "closedpoly.hxx"
@@ -39,7 +42,7 @@ static void usage( int argc, char **argv ) {
     TG_LOG(SG_GENERAL, SG_ALERT, "Usage: " << argv[0] << "\n--input=<apt_file>"
     << "\n--work=<work_dir>\n[ --start-id=abcd ] [ --restart-id=abcd ] [ --nudge=n ] "
     << "[--min-lon=<deg>] [--max-lon=<deg>] [--min-lat=<deg>] [--max-lat=<deg>] "
-    << "[ --airport=abcd ] [--max-slope=<decimal>] [--tile=<tile>] [--threads] [--threads=x]"
+    << "[ --airport=abcd ] [--max-slope=<decimal>] [--tile=<tile>] [--threads] [--threads=x] [--profile=<file>]"
     << "[--chunk=<chunk>] [--dem-path=<path>] [--verbose] [--help]");
 }
 
@@ -116,6 +119,7 @@ int main(int argc, char **argv)
     std::string restart_id = "";
     std::string airport_id = "";
     std::string last_apt_file = "./last_apt.txt";
+    std::string profile_file = "";
     int         num_threads    =  1;
 
     int arg_pos;
@@ -190,6 +194,11 @@ int main(int argc, char **argv)
         {
             num_threads = boost::thread::hardware_concurrency();
         }
+        else if (arg.find("--profile=") == 0)
+        {
+            profile_file = arg.substr(10);
+            tgProfile::enable();
+        }
         else if (arg.find("--debug-dir=") == 0)
         {
             debug_dir = arg.substr(12);
@@ -325,6 +334,15 @@ int main(int argc, char **argv)
         }
     }
 
+    // the choppers flushed their buckets when they went out of scope -
+    // get the cached datasources onto disk
+    tgShapefileCache::instance().closeAll();
+
+    if ( profile_file != "" )
+    {
+        tgProfile::dump( profile_file );
+    }
+
     TG_LOG(SG_GENERAL, SG_INFO, "Genapts finished successfully");
 
     return 0;
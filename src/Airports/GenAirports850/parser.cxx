@@ -4,6 +4,8 @@
 #include <simgear/misc/sgstream.hxx>
 #include <simgear/timing/timestamp.hxx>
 
+#include <terragear/tg_profile.hxx>
+
 #include "parser.hxx"
 
 bool Parser::GetAirportDefinition( char* line, std::string& icao )
@@ -211,6 +213,8 @@ void Parser::run()
             SetState(STATE_NONE);
             in.clear();
 
+            tgProfileUnit profile( icao, "genapts" );
+
             parse_start.stamp();
             log_time = time(0);
             TG_LOG( SG_GENERAL, SG_ALERT, "\n*******************************************************************" );
@@ -226,6 +230,7 @@ void Parser::run()
 
             parse_end.stamp();
             parse_time = parse_end - parse_start;
+            tgProfile::addTime( "parse", parse_time.toSecs() );
 
             // write the airport BTG
             if (cur_airport) {
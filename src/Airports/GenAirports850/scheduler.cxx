@@ -7,6 +7,7 @@
 
 #include <simgear/debug/logstream.hxx>
 #include <simgear/misc/sgstream.hxx>
+#include <simgear/misc/sg_path.hxx>
 
 #include "airport.hxx"
 #include "parser.hxx"
@@ -175,141 +176,38 @@ void Scheduler::set_debug( std::string path, std::vector<std::string> runway_def
     }
 }
 
-bool Scheduler::IsAirportDefinition( char* line, std::string icao )
-{
-    char*    tok;
-    int      code;
-    bool     match = false;
-
-    // Get the number code
-    tok = strtok(line, " \t\r\n");
-
-    if (tok)
-    {
-        line += strlen(tok)+1;
-        code = atoi(tok);
-
-        switch(code)
-        {
-            case LAND_AIRPORT_CODE:
-            case SEA_AIRPORT_CODE:
-            case HELIPORT_CODE:
-            {
-                Airport ap( code, line );
-                if ( ap.GetIcao() == icao )
-                {
-                    match = true;
-                }
-            }
-                break;
-
-            case LAND_RUNWAY_CODE:
-            case WATER_RUNWAY_CODE:
-            case HELIPAD_CODE:
-            case PAVEMENT_CODE:
-            case LINEAR_FEATURE_CODE:
-            case BOUNDRY_CODE:
-            case NODE_CODE:
-            case BEZIER_NODE_CODE:
-            case CLOSE_NODE_CODE:
-            case CLOSE_BEZIER_NODE_CODE:
-            case TERM_NODE_CODE:
-            case TERM_BEZIER_NODE_CODE:
-            case AIRPORT_VIEWPOINT_CODE:
-            case AIRPLANE_STARTUP_LOCATION_CODE:
-            case LIGHT_BEACON_CODE:
-            case WINDSOCK_CODE:
-            case TAXIWAY_SIGN:
-            case LIGHTING_OBJECT:
-            case COMM_FREQ1_CODE:
-            case COMM_FREQ2_CODE:
-            case COMM_FREQ3_CODE:
-            case COMM_FREQ4_CODE:
-            case COMM_FREQ5_CODE:
-            case COMM_FREQ6_CODE:
-            case COMM_FREQ7_CODE:
-            case END_OF_FILE :
-                break;
-        }
-    }
-
-    return match;
-}
-
 void Scheduler::AddAirport( std::string icao )
 {
-    char            line[2048];
-    long            cur_pos;
-    bool            found = false;
-    AirportInfo     ai;
+    TG_LOG( SG_GENERAL, SG_INFO, "Adding airport " << icao << " to parse list");
 
-    std::ifstream in( filename.c_str() );
-    if ( !in.is_open() )
+    const AptIndexEntry* entry = index->FindIcao( icao );
+    if ( entry )
     {
-        TG_LOG( SG_GENERAL, SG_ALERT, "Cannot open file: " << filename );
-        exit(-1);
-    }
+        TG_LOG( SG_GENERAL, SG_DEBUG, "Found airport " << icao << " at " << entry->offset );
 
-    TG_LOG( SG_GENERAL, SG_INFO, "Adding airport " << icao << " to parse list");
-    while ( !in.eof() && !found )
+        AirportInfo ai = AirportInfo( icao, entry->offset, gSnap );
+        global_workQueue.push( ai );
+    }
+    else
     {
-        // remember the position of this line
-        cur_pos = in.tellg();
-
-        // get a line
-    	in.getline(line, 2048);
-
-        // this is and airport definition - remember it
-        if ( IsAirportDefinition( line, icao ) )
-        {
-            TG_LOG( SG_GENERAL, SG_DEBUG, "Found airport " << icao << " at " << cur_pos );
-
-            ai = AirportInfo( icao, cur_pos, gSnap );
-            global_workQueue.push( ai );
-
-            found = true;
-        }
+        TG_LOG( SG_GENERAL, SG_ALERT, "Airport " << icao << " not found in " << filename );
     }
 }
 
 long Scheduler::FindAirport( std::string icao )
 {
-    char line[2048];
-    long cur_pos = 0;
-    bool found = false;
+    TG_LOG( SG_GENERAL, SG_DEBUG, "Finding airport " << icao );
 
-    std::ifstream in( filename.c_str() );
-    if ( !in.is_open() )
+    const AptIndexEntry* entry = index->FindIcao( icao );
+    if ( entry )
     {
-        TG_LOG( SG_GENERAL, SG_ALERT, "Cannot open file: " << filename );
-        exit(-1);
+        TG_LOG( SG_GENERAL, SG_DEBUG, "Found airport " << icao << " at " << entry->offset );
+        return entry->offset;
     }
-
-    TG_LOG( SG_GENERAL, SG_DEBUG, "Finding airport " << icao );
-    while ( !in.eof() && !found )
+    else
     {
-        // remember the position of this line
-        cur_pos = in.tellg();
-
-        // get a line
-    	in.getline(line, 2048);
-
-        // this is and airport definition - remember it
-        if ( IsAirportDefinition( line, icao ) )
-        {
-            TG_LOG( SG_GENERAL, SG_DEBUG, "Found airport " << line << " at " << cur_pos );
-            found = true;
-        }
+        return 0;
     }
-
-	if (found)
-	{
-		return cur_pos;
-	}
-	else
-	{
-		return 0;
-	}
 }
 
 void Scheduler::RetryAirport( AirportInfo* pai )
@@ -319,151 +217,17 @@ void Scheduler::RetryAirport( AirportInfo* pai )
 
 bool Scheduler::AddAirports( long start_pos, tgRectangle* boundingBox )
 {
-    char 	 line[2048];
-    char*	 def;
-    long 	 cur_pos;
-    long	 cur_apt_pos = 0;
-    std::string  cur_apt_name;
-    char*    tok;
-    int      code;
-    bool 	 match;
-    bool 	 done;
-
-    done  = false;
-    match = false;
-
-    // start from current position, and push all airports where a runway start or end
-    // lies within the given min/max coordinates
+    std::vector<const AptIndexEntry*> found;
 
-    std::ifstream in( filename.c_str() );
-    if ( !in.is_open() )
-    {
-        TG_LOG( SG_GENERAL, SG_ALERT, "Cannot open file: " << filename );
-        exit(-1);
-    }
+    // push all airports from start_pos on where a runway start or end
+    // ( or a helipad ) lies within the given min/max coordinates
+    index->FindInRect( *boundingBox, start_pos, found );
 
-    if (start_pos)
+    for ( unsigned int i=0; i<found.size(); i++ )
     {
-        in.seekg(start_pos, std::ios::beg);
-    }
-
-    while (!done)
-    {
-        // remember the position of this line
-        cur_pos = in.tellg();
-
-        // get a line
-        in.getline(line, 2048);
-        def = &line[0];
-
-        // Get the number code
-        tok = strtok(def, " \t\r\n");
-
-        if (tok)
-        {
-            def += strlen(tok)+1;
-            code = atoi(tok);
-
-            switch(code)
-            {
-                case LAND_AIRPORT_CODE:
-                case SEA_AIRPORT_CODE:
-                case HELIPORT_CODE:
-                {
-                    Airport* airport = new Airport( code, def );
-                    if (match)
-                    {
-                        // Start off with given snap value
-                        AirportInfo ai = AirportInfo( cur_apt_name, cur_apt_pos, gSnap );
-                        global_workQueue.push( ai );
-                    }
-                    // remember this new apt pos and name, and clear match
-                    cur_apt_pos  = cur_pos;
-                    cur_apt_name = airport->GetIcao();
-                    delete airport;
-
-                    match = false;
-                }
-                break;
-
-                case END_OF_FILE:
-                    if (match)
-                    {
-                        // Start off with given snap value
-                        AirportInfo ai = AirportInfo( cur_apt_name, cur_apt_pos, gSnap );
-                        global_workQueue.push( ai );
-                    }
-                    done = true;
-                    break;
-
-                case LAND_RUNWAY_CODE:
-                    // if the the runway start / end  coords are within the rect,
-                    // we have a winner
-                    {
-                        Runway* runway = new Runway(NULL, def);
-                        if ( boundingBox->isInside(runway->GetStart()) ) {
-                            match = true;
-                        }
-                        else if ( boundingBox->isInside(runway->GetEnd()) ) {
-                            match = true;
-                        }
-                        delete runway;
-                    }
-                    break;
-
-                case WATER_RUNWAY_CODE:
-                    // if the the runway start / end  coords are within the rect,
-                    // we have a winner
-                    {
-                        WaterRunway* runway = new WaterRunway(def);
-                        if ( boundingBox->isInside(runway->GetStart()) ) {
-                            match = true;
-                        }
-                        else if ( boundingBox->isInside(runway->GetEnd()) ) {
-                            match = true;
-                        }
-                        delete runway;
-                    }
-                    break;
-
-                case HELIPAD_CODE:
-                    // if the heliport coords are within the rect, we have
-                    // a winner
-                    {
-                        Helipad* helipad = new Helipad(def);
-                        if ( boundingBox->isInside(helipad->GetLoc()) ) {
-                            match = true;
-                        }
-                        delete helipad;
-                    }
-                    break;
-
-                case TAXIWAY_CODE:
-                case PAVEMENT_CODE:
-                case LINEAR_FEATURE_CODE:
-                case BOUNDRY_CODE:
-                case NODE_CODE:
-                case BEZIER_NODE_CODE:
-                case CLOSE_NODE_CODE:
-                case CLOSE_BEZIER_NODE_CODE:
-                case TERM_NODE_CODE:
-                case TERM_BEZIER_NODE_CODE:
-                case AIRPORT_VIEWPOINT_CODE:
-                case AIRPLANE_STARTUP_LOCATION_CODE:
-                case LIGHT_BEACON_CODE:
-                case WINDSOCK_CODE:
-                case TAXIWAY_SIGN:
-                case LIGHTING_OBJECT:
-                case COMM_FREQ1_CODE:
-                case COMM_FREQ2_CODE:
-                case COMM_FREQ3_CODE:
-                case COMM_FREQ4_CODE:
-                case COMM_FREQ5_CODE:
-                case COMM_FREQ6_CODE:
-                case COMM_FREQ7_CODE:
-                    break;
-            }
-        }
+        // Start off with given snap value
+        AirportInfo ai = AirportInfo( found[i]->icao, found[i]->offset, gSnap );
+        global_workQueue.push( ai );
     }
 
     // did we add airports to the parse list?
@@ -486,6 +250,15 @@ Scheduler::Scheduler(std::string& datafile, const std::string& root, const strin
         TG_LOG( SG_GENERAL, SG_ALERT, "Cannot open file: " << filename );
         exit(-1);
     }
+
+    // the index lives in the work dir - the apt.dat may be read only
+    std::string indexfile = work_dir + "/" + SGPath( filename ).file() + ".idx";
+    index = new AptIndex( filename, indexfile );
+}
+
+Scheduler::~Scheduler()
+{
+    delete index;
 }
 
 void Scheduler::Schedule( int num_threads, std::string& summaryfile )
@@ -12,6 +12,7 @@
 #include <simgear/threads/SGQueue.hxx>
 #include <terragear/tg_rectangle.hxx>
 #include "airport.hxx"
+#include "apt_index.hxx"
 
 #define P_STATE_INIT        (0)
 #define P_STATE_PARSE       (1)
@@ -98,6 +99,7 @@ class Scheduler
 {
 public:
     Scheduler(std::string& datafile, const std::string& root, const string_list& elev_src);
+    ~Scheduler();
 
     long            FindAirport( std::string icao );
     void            AddAirport(  std::string icao );
@@ -113,9 +115,8 @@ public:
                                                  std::vector<std::string> feature_defs );
 
 private:
-    bool            IsAirportDefinition( char* line, std::string icao );
-
     std::string     filename;
+    AptIndex*       index;
     string_list     elevation;
     std::string     work_dir;
 
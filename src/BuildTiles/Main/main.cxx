@@ -22,23 +22,19 @@
 #  include <config.h>
 #endif
 
-#ifdef _MSC_VER
-#  include <windows.h>
-#  define tgSleep(x) Sleep(x*1000)
-#else
-#  define tgSleep(x) sleep(x)
-#endif
+#include <algorithm>
 
 #include <boost/thread.hpp>
 
 #include <simgear/debug/logstream.hxx>
 #include <Include/version.h>
 
-#include <terragear/tg_mutex.hxx>
+#include <terragear/tg_array_cache.hxx>
+#include <terragear/tg_dataset_protect.hxx>
+#include <terragear/tg_profile.hxx>
+#include <terragear/tg_shapefile_cache.hxx>
 
-#include "tgconstruct_stage1.hxx"
-#include "tgconstruct_stage2.hxx"
-#include "tgconstruct_stage3.hxx"
+#include "tgconstruct_scheduler.hxx"
 #include "priorities.hxx"
 
 // display usage and exit
@@ -59,6 +55,8 @@ static void usage( const std::string& name ) {
     SG_LOG(SG_GENERAL, SG_ALERT, "  --ignore-landmass");
     SG_LOG(SG_GENERAL, SG_ALERT, "  --threads");
     SG_LOG(SG_GENERAL, SG_ALERT, "  --threads=<numthreads>");
+    SG_LOG(SG_GENERAL, SG_ALERT, "  --profile=<filename> ( .json or .csv )");
+    SG_LOG(SG_GENERAL, SG_ALERT, "  --dem-cache=<megabytes> ( default 256 )");
     SG_LOG(SG_GENERAL, SG_ALERT, " ]");
     exit(-1);
 }
@@ -96,131 +94,49 @@ std::vector<SGBucket> fillBucketList( long tile_id, const SGGeod& min, const SGG
     return bucketList;
 }
 
-void doStage3( int num_threads, std::vector<SGBucket>& bucketList, 
+void doStages( int num_threads, std::vector<SGBucket>& bucketList, 
+               int start_stage, int end_stage,
                const std::string& priorities_file,
                const std::string& work_base, const std::string& dem_base, 
                const std::string& share_base, const std::string& debug_base, 
                const std::string& output_base )
 {
-    SGLockedQueue<SGBucket> wq;
-    
-    /* fill the workqueue */
-    for (unsigned int i=0; i<bucketList.size(); i++) {
-        wq.push( bucketList[i] );
-    }
-    
-    // now create the worker threads for stage 1
-    std::vector<tgConstructThird *> constructs;    
-    tgMutex filelock;
-    
-    for (int i=0; i<num_threads; i++) {
-        tgConstructThird* construct = new tgConstructThird( priorities_file, wq, &filelock );
-        construct->setPaths( work_base, dem_base, share_base, debug_base, output_base );
-        constructs.push_back( construct );
-    }
-    
-    // start all threads
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->start();
-    }
-    // wait for workqueue to empty
-    while( wq.size() ) {
-        tgSleep( 5 );
-    }
-    // wait for all threads to complete
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->join();
-    }
-    
-    // delete the stage 1 construct objects
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        delete constructs[i];
-    }
-    constructs.clear();    
-}
-
-void doStage2( int num_threads, std::vector<SGBucket>& bucketList, 
-               const std::string& priorities_file,
-               const std::string& work_base, const std::string& dem_base, 
-               const std::string& share_base, const std::string& debug_base )
-{
-    SGLockedQueue<SGBucket> wq;
-
-    /* fill the workqueue */
-    for (unsigned int i=0; i<bucketList.size(); i++) {
-        wq.push( bucketList[i] );
-    }
-
-    // now create the worker threads for stage 1
-    std::vector<tgConstructSecond *> constructs;    
-    tgMutex filelock;
-
-    for (int i=0; i<num_threads; i++) {
-        tgConstructSecond* construct = new tgConstructSecond( priorities_file, wq, &filelock );
-        construct->setPaths( work_base, dem_base, share_base, debug_base );
-        constructs.push_back( construct );
-    }
-    
-    // start all threads
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->start();
-    }
-    // wait for workqueue to empty
-    while( wq.size() ) {
-        tgSleep( 5 );
-    }
-    // wait for all threads to complete
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->join();
-    }
-    
-    // delete the stage 1 construct objects
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        delete constructs[i];
-    }
-    constructs.clear();    
-}
-
-void doStage1( int num_threads, std::vector<SGBucket>& bucketList, 
-               const std::string& priorities_file,
-               const std::string& work_base, const std::string& dem_base, 
-               const std::string& share_base, const std::string& debug_base )
-{
-    SGLockedQueue<SGBucket> wq;
+    // all stages share one pool of workers - a tile moves on to the next
+    // stage as soon as its neighbourhood has finished the previous one
+    tgConstructScheduler scheduler( bucketList, start_stage, end_stage );
 
-    /* fill the workqueue */
-    for (unsigned int i=0; i<bucketList.size(); i++) {
-        wq.push( bucketList[i] );
-    }
+    std::vector<tgConstructWorker *> workers;
+    tgDatasetAccess tileAccess;
 
-    // now create the worker threads for stage 1
-    std::vector<tgConstructFirst *> constructs;    
-    tgMutex filelock;
+    // cores not running a worker help load the landclass polys, and look
+    // up the elevations of a tile
+    unsigned int helperThreads = std::max( 1u, boost::thread::hardware_concurrency() / (unsigned int)std::max( 1, num_threads ) );
 
     for (int i=0; i<num_threads; i++) {
-        tgConstructFirst* construct = new tgConstructFirst( priorities_file, wq, &filelock );
-        construct->setPaths( work_base, dem_base, share_base, debug_base );
-        constructs.push_back( construct );
+        tgConstructWorker* worker = new tgConstructWorker( scheduler, priorities_file, &tileAccess );
+        worker->setPaths( work_base, dem_base, share_base, debug_base, output_base );
+        worker->setHelperThreads( helperThreads );
+        workers.push_back( worker );
     }
 
     // start all threads
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->start();
-    }
-    // wait for workqueue to empty
-    while( wq.size() ) {
-        tgSleep( 5 );
+    for (unsigned int i=0; i<workers.size(); i++) {
+        workers[i]->start();
     }
-    // wait for all threads to complete
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->join();
+    // wait for all threads to complete - they exit once every task is done
+    for (unsigned int i=0; i<workers.size(); i++) {
+        workers[i]->join();
     }
 
-    // delete the stage 1 construct objects
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        delete constructs[i];
+    // delete the worker objects
+    for (unsigned int i=0; i<workers.size(); i++) {
+        delete workers[i];
     }
-    constructs.clear();    
+    workers.clear();
+
+    unsigned long hits, loads;
+    tgArrayCache::instance().getStats( hits, loads );
+    SG_LOG(SG_GENERAL, SG_INFO, "DEM cache : " << loads << " arrays loaded, " << hits << " reused");
 }
 
 int main(int argc, char **argv) {
@@ -232,12 +148,13 @@ int main(int argc, char **argv) {
     std::string debug_dir = ".";
     
     std::string priorities_file = DEFAULT_PRIORITIES_FILE;
+    std::string profile_file = "";
     
     SGGeod min, max;
     long   tile_id = -1;
     int    num_threads = 1;
     int    start_stage = 1;
-    int    end_stage   = 2;
+    int    end_stage   = TG_CONSTRUCT_NUM_STAGES;
 
     sglog().setLogLevels( SG_ALL, SG_INFO );
 
@@ -276,6 +193,11 @@ int main(int argc, char **argv) {
             num_threads = atoi( arg.substr(10).c_str() );
         } else if (arg.find("--threads") == 0) {
             num_threads = boost::thread::hardware_concurrency();
+        } else if (arg.find("--profile=") == 0) {
+            profile_file = arg.substr(10);
+            tgProfile::enable();
+        } else if (arg.find("--dem-cache=") == 0) {
+            tgArrayCache::instance().setMaxSize( (size_t)atol( arg.substr(12).c_str() ) * 1024 * 1024 );
         } else if (arg.find("--stage=") == 0) {
             start_stage = atoi( arg.substr(8).c_str() );
             end_stage   = start_stage;
@@ -332,84 +254,19 @@ int main(int argc, char **argv) {
     }
 #endif
 
-// STAGE 1
-    if ( ( start_stage <= 1 ) && ( end_stage >= 1 ) ) {
-        doStage1( num_threads, bucketList, priorities_file, work_dir, dem_dir, share_dir, debug_dir );
-    }
-    
-    if ( ( start_stage <= 2 ) && ( end_stage >= 2 ) ) {
-        doStage2( num_threads, bucketList, priorities_file, work_dir, dem_dir, share_dir, debug_dir );
-    }
-    
-// STAGE 2    
-#if 0    
-    /* fill the workqueue */
-    for (unsigned int i=0; i<bucketList.size(); i++) {
-        wq.push( bucketList[i] );
-    }
-
-    for (int i=0; i<num_threads; i++) {
-        TGConstruct* construct = new TGConstruct( areas, 2, wq, &filelock );
-        //construct->set_cover( cover );
-        construct->set_paths( work_dir, dem_dir, share_dir, match_dir, output_dir );
-        construct->set_options( ignoreLandmass, nudge );
-        construct->set_debug( debug_dir, debug_area_defs, debug_shape_defs );
-        constructs.push_back( construct );
-    }
-
-    // start all threads
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->start();
-    }
-    // wait for workqueue to empty
-    while( wq.size() ) {
-        tgSleep( 5 );
-    }
-    // wait for all threads to complete
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->join();
-    }
-    // delete the stage 2 construct objects
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        delete constructs[i];
-    }
-    constructs.clear();
-#endif
-
-// STAGE 3
-#if 0
-    /* fill the workqueue */
-    for (unsigned int i=0; i<bucketList.size(); i++) {
-        wq.push( bucketList[i] );
-    }
-
-    for (int i=0; i<num_threads; i++) {
-        TGConstruct* construct = new TGConstruct( areas, 3, wq, &filelock );
-        //construct->set_cover( cover );
-        construct->set_paths( work_dir, dem_dir, share_dir, match_dir, output_dir );
-        construct->set_options( ignoreLandmass, nudge );
-        construct->set_debug( debug_dir, debug_area_defs, debug_shape_defs );
-        constructs.push_back( construct );
+// STAGES start_stage - end_stage
+    if ( ( start_stage >= 1 ) && ( start_stage <= end_stage ) && ( end_stage <= TG_CONSTRUCT_NUM_STAGES ) ) {
+        doStages( num_threads, bucketList, start_stage, end_stage, priorities_file, work_dir, dem_dir, share_dir, debug_dir, output_dir );
+    } else {
+        SG_LOG(SG_GENERAL, SG_ALERT, "Invalid stage range " << start_stage << " - " << end_stage );
+        exit(1);
     }
 
-    // start all threads
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->start();
-    }
-    // wait for workqueue to empty
-    while( wq.size() ) {
-        tgSleep( 5 );
-    }
-    // wait for all threads to complete
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        constructs[i]->join();
-    }
-    // delete the stage 3 construct objects
-    for (unsigned int i=0; i<constructs.size(); i++) {
-        delete constructs[i];
+    tgShapefileCache::instance().closeAll();
+    
+    if ( profile_file != "" ) {
+        tgProfile::dump( profile_file );
     }
-    constructs.clear();
-#endif
 
     SG_LOG(SG_GENERAL, SG_ALERT, "[Finished successfully]");
     return 0;
@@ -0,0 +1,194 @@
+// tgconstruct_scheduler.cxx -- dependency driven scheduling of the
+//                              tg-construct stages
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <set>
+
+#include <simgear/threads/SGGuard.hxx>
+#include <simgear/debug/logstream.hxx>
+
+#include "tgconstruct_scheduler.hxx"
+
+tgConstructScheduler::tgConstructScheduler( const std::vector<SGBucket>& buckets, int startStage, int endStage ) :
+    bucketList( buckets ),
+    firstStage( startStage ),
+    lastStage( endStage ),
+    numFinished( 0 )
+{
+    std::map<long, unsigned int> tileIndex;
+    for ( unsigned int i=0; i<bucketList.size(); i++ ) {
+        tileIndex[bucketList[i].gen_index()] = i;
+    }
+
+    // find the neighbourhood of each tile that is part of this run.
+    // north and south rows may hold more than 3 buckets, as bucket
+    // widths change with latitude.
+    dependents.resize( bucketList.size() );
+    std::vector<unsigned int> numDependencies( bucketList.size(), 0 );
+
+    for ( unsigned int i=0; i<bucketList.size(); i++ ) {
+        const SGBucket&       b = bucketList[i];
+        std::vector<SGBucket> neighbours;
+
+        b.siblings( -1,  1, neighbours );
+        b.siblings(  0,  1, neighbours );
+        b.siblings(  1,  1, neighbours );
+        b.siblings( -1, -1, neighbours );
+        b.siblings(  0, -1, neighbours );
+        b.siblings(  1, -1, neighbours );
+        neighbours.push_back( b.sibling( -1, 0 ) );
+        neighbours.push_back( b.sibling(  1, 0 ) );
+
+        std::set<unsigned int> deps;
+        deps.insert( i );
+        for ( unsigned int j=0; j<neighbours.size(); j++ ) {
+            std::map<long, unsigned int>::const_iterator it = tileIndex.find( neighbours[j].gen_index() );
+            if ( it != tileIndex.end() ) {
+                deps.insert( it->second );
+            }
+        }
+
+        // tile i waits on everything in deps - so they each release it
+        for ( std::set<unsigned int>::const_iterator dit = deps.begin(); dit != deps.end(); dit++ ) {
+            dependents[*dit].push_back( i );
+        }
+        numDependencies[i] = deps.size();
+    }
+
+    numTasks = 0;
+    waitingOn.resize( TG_CONSTRUCT_NUM_STAGES );
+    for ( int s = 0; s < TG_CONSTRUCT_NUM_STAGES; s++ ) {
+        numComplete[s] = 0;
+
+        if ( s+1 >= firstStage && s+1 <= lastStage ) {
+            numTasks += bucketList.size();
+
+            if ( s+1 == firstStage ) {
+                waitingOn[s].assign( bucketList.size(), 0 );
+            } else if ( !needsNeighbours( s+1 ) ) {
+                waitingOn[s].assign( bucketList.size(), 1 );
+            } else {
+                waitingOn[s] = numDependencies;
+            }
+        }
+    }
+
+    // everything in the first stage is ready to go
+    for ( unsigned int i=0; i<bucketList.size(); i++ ) {
+        ready[firstStage-1].push_back( tgConstructTask( firstStage, i ) );
+    }
+}
+
+bool tgConstructScheduler::getTask( tgConstructTask& task )
+{
+    SGGuard<SGMutex> g(mutex);
+
+    while ( numFinished < numTasks ) {
+        for ( int s = TG_CONSTRUCT_NUM_STAGES-1; s >= 0; s-- ) {
+            if ( !ready[s].empty() ) {
+                task = ready[s].front();
+                ready[s].pop_front();
+                return true;
+            }
+        }
+
+        available.wait( mutex );
+    }
+
+    return false;
+}
+
+void tgConstructScheduler::taskComplete( const tgConstructTask& task )
+{
+    SGGuard<SGMutex> g(mutex);
+
+    numFinished++;
+    numComplete[task.stage-1]++;
+
+    SG_LOG(SG_GENERAL, SG_ALERT, bucketList[task.tile].gen_index_str() << " - Stage " << task.stage << " complete : " << numComplete[task.stage-1] << " of " << bucketList.size() << " tiles" );
+
+    if ( task.stage < lastStage ) {
+        std::vector<unsigned int>& waiting = waitingOn[task.stage];
+
+        if ( needsNeighbours( task.stage+1 ) ) {
+            const std::vector<unsigned int>& deps = dependents[task.tile];
+
+            for ( unsigned int i=0; i<deps.size(); i++ ) {
+                if ( --waiting[deps[i]] == 0 ) {
+                    pushReady( tgConstructTask( task.stage+1, deps[i] ) );
+                }
+            }
+        } else if ( --waiting[task.tile] == 0 ) {
+            pushReady( tgConstructTask( task.stage+1, task.tile ) );
+        }
+    }
+
+    if ( numFinished == numTasks ) {
+        // wake everyone up so they can exit
+        available.broadcast();
+    }
+}
+
+void tgConstructScheduler::pushReady( const tgConstructTask& task )
+{
+    ready[task.stage-1].push_back( task );
+    available.signal();
+}
+
+tgConstructWorker::tgConstructWorker( tgConstructScheduler& s, const std::string& pfile, tgDatasetAccess* a ) :
+    scheduler( s ),
+    first( pfile, a ),
+    second( pfile, a ),
+    third( pfile, a )
+{
+}
+
+void tgConstructWorker::setPaths( const std::string& work, const std::string& dem, const std::string& share, const std::string& debug, const std::string& output )
+{
+    first.setPaths( work, dem, share, debug );
+    second.setPaths( work, dem, share, debug );
+    third.setPaths( work, dem, share, debug, output );
+}
+
+void tgConstructWorker::setHelperThreads( unsigned int threads )
+{
+    first.setLoadThreads( threads );
+    second.setElevationThreads( threads );
+}
+
+void tgConstructWorker::run()
+{
+    tgConstructTask task;
+
+    while ( scheduler.getTask( task ) ) {
+        const SGBucket& b = scheduler.getBucket( task.tile );
+
+        switch( task.stage ) {
+            case 1: first.construct( b );   break;
+            case 2: second.construct( b );  break;
+            case 3: third.construct( b );   break;
+        }
+
+        scheduler.taskComplete( task );
+    }
+
+    SG_LOG(SG_GENERAL, SG_DEBUG, "Thread " << current() << " finished");
+}
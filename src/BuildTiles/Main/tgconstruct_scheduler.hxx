@@ -0,0 +1,119 @@
+// tgconstruct_scheduler.hxx -- dependency driven scheduling of the
+//                              tg-construct stages
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+
+#ifndef _TGCONSTRUCT_SCHEDULER_HXX
+#define _TGCONSTRUCT_SCHEDULER_HXX
+
+#ifndef __cplusplus
+# error This library requires C++
+#endif
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/bucket/newbucket.hxx>
+
+#include <terragear/tg_dataset_protect.hxx>
+
+#include "tgconstruct_stage1.hxx"
+#include "tgconstruct_stage2.hxx"
+#include "tgconstruct_stage3.hxx"
+
+#define TG_CONSTRUCT_NUM_STAGES (3)
+
+// a single unit of work : one stage of one tile
+struct tgConstructTask {
+    tgConstructTask() : stage(0), tile(0) {}
+    tgConstructTask( int s, unsigned int t ) : stage(s), tile(t) {}
+
+    int             stage;
+    unsigned int    tile;       // index into the scheduler bucket list
+};
+
+// Stage N of a tile reads the stage N-1 output of the tile and of its
+// ( up to 8 ) neighbours.  Rather than finishing every tile of a stage
+// before starting the next one, each task counts the neighbourhood tasks
+// it still waits on, and is released to the workers as soon as that
+// count reaches 0.  Neighbours that aren't in the bucket list are not
+// built by this run, so they aren't waited on.
+// Stage 3 only reads the stage 2 output of its own tile, so it starts as
+// soon as that tile is done.
+class tgConstructScheduler
+{
+public:
+    tgConstructScheduler( const std::vector<SGBucket>& buckets, int startStage, int endStage );
+
+    // blocks until a task is ready.  returns false once every task is done
+    bool getTask( tgConstructTask& task );
+
+    // mark task as complete, and release any tasks that were waiting on it
+    void taskComplete( const tgConstructTask& task );
+
+    const SGBucket& getBucket( unsigned int tile ) const { return bucketList[tile]; }
+
+private:
+    void pushReady( const tgConstructTask& task );
+
+    // true if the stage reads the previous stage output of the neighbours
+    static bool needsNeighbours( int stage ) { return stage != 3; }
+
+    std::vector<SGBucket>                   bucketList;
+    int                                     firstStage;
+    int                                     lastStage;
+
+    // tiles whose next stage depends on this tile ( including itself )
+    std::vector< std::vector<unsigned int> > dependents;
+
+    // per stage, per tile : number of stage-1 tasks still outstanding
+    std::vector< std::vector<unsigned int> > waitingOn;
+
+    // ready tasks - one queue per stage.  later stages are handed out first,
+    // so finished neighbourhoods drain through the pipeline instead of piling up
+    std::deque<tgConstructTask>             ready[TG_CONSTRUCT_NUM_STAGES];
+
+    unsigned int                            numTasks;
+    unsigned int                            numComplete[TG_CONSTRUCT_NUM_STAGES];
+    unsigned int                            numFinished;
+
+    SGMutex                                 mutex;
+    SGWaitCondition                         available;
+};
+
+// worker thread - one per core.  Owns one construct object per stage, so
+// it can run whichever stage the scheduler hands it next.
+class tgConstructWorker : public SGThread
+{
+public:
+    tgConstructWorker( tgConstructScheduler& s, const std::string& priorities_file, tgDatasetAccess* a );
+
+    void setPaths( const std::string& work, const std::string& dem, const std::string& share, const std::string& debug, const std::string& output );
+    void setHelperThreads( unsigned int threads );
+
+private:
+    virtual void run();
+
+    tgConstructScheduler&   scheduler;
+
+    tgConstructFirst        first;
+    tgConstructSecond       second;
+    tgConstructThird        third;
+};
+
+#endif // _TGCONSTRUCT_SCHEDULER_HXX
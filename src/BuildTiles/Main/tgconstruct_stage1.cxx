@@ -25,22 +25,26 @@
 #  include <config.h>
 #endif
 
+#include <algorithm>
+
 #include <boost/foreach.hpp>
 
 #include <simgear/misc/sg_dir.hxx>
 #include <simgear/misc/sg_path.hxx>
 #include <simgear/debug/logstream.hxx>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
-#include <terragear/tg_array.hxx>
+#include <terragear/tg_array_cache.hxx>
+#include <terragear/tg_profile.hxx>
 
 #include "tgconstruct_stage1.hxx"
 
 // Constructor
-tgConstructFirst::tgConstructFirst( const std::string& pfile, SGLockedQueue<SGBucket>& q, tgMutex* l) :
-        workQueue(q)
+tgConstructFirst::tgConstructFirst( const std::string& pfile, tgDatasetAccess* a )
 {
-    totalTiles = q.size();   
-    lock = l;
+    access = a;
+    loadThreads = 1;
 
     /* initialize tgMesh for the number of layers we have */
     if ( areaDefs.init( pfile ) ) {
@@ -49,7 +53,6 @@ tgConstructFirst::tgConstructFirst( const std::string& pfile, SGLockedQueue<SGBu
 
     std::vector<std::string> area_names = areaDefs.get_name_array();
     tileMesh.initPriorities( area_names );  
-    tileMesh.setLock( lock );
 }
 
 
@@ -65,67 +68,113 @@ void tgConstructFirst::setPaths( const std::string& work, const std::string& dem
     debugBase  = debug;
 }
 
+void tgConstructFirst::setLoadThreads( unsigned int threads ) {
+    loadThreads = threads;
+}
+
 void tgConstructFirst::safeMakeDirectory( const std::string& directory )
 {
-    lock->lock();
-    std::string dummy = directory + "/dummy";
-    SGPath sgp( dummy );
-    sgp.create_dir( 0755 );
-    lock->unlock();
+    access->MakeDirectory( directory );
 }
 
-void tgConstructFirst::run()
+void tgConstructFirst::construct( const SGBucket& b )
 {
-    unsigned int tilesComplete;
+    bucket = b;
 
-    // as long as we have feometry to parse, do so
-    while ( !workQueue.empty() ) {
-        bucket = workQueue.pop();
-        tilesComplete = totalTiles - workQueue.size();
+    tgProfileUnit profile( bucket.gen_index_str(), "stage1" );
 
-        SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Stage1 Construct in " << bucket.gen_base_path() << " tile " << tilesComplete << " of " << totalTiles << " using thread " << current() );
+    SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Stage1 Construct in " << bucket.gen_base_path() << " using thread " << SGThread::current() );
 
-        // assume non ocean tile until proven otherwise
-        isOcean = false;
+    // assume non ocean tile until proven otherwise
+    isOcean = false;
 
-        // clear mesh
-        tileMesh.clear();
+    // clear mesh
+    tileMesh.clear();
 
-        if ( !debugBase.empty() ) {
-            std::string debugPath = debugBase + "/tgconstruct_debug/stage1/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();                
-            safeMakeDirectory( debugPath );
+    if ( !debugBase.empty() ) {
+        std::string debugPath = debugBase + "/tgconstruct_debug/stage1/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();                
+        safeMakeDirectory( debugPath );
 
-            tileMesh.initDebug( debugPath );
-        }
+        tileMesh.initDebug( debugPath );
+    }
 
-        tileMesh.clipAgainstBucket( bucket );
+    tileMesh.clipAgainstBucket( bucket );
 
-        // STEP 1 - read in the polygon soup for this tile
+    // STEP 1 - read in the polygon soup for this tile
+    {
+        TG_PROFILE_SCOPE( "load landclass" );
         loadLandclassPolys( workBase );
+    }
 
-        // Step 2 - add the fitted nodes ( important elevation points )
-        // add them to the mesh - which adds them in triangulation
+    // Step 2 - add the fitted nodes ( important elevation points )
+    // add them to the mesh - which adds them in triangulation
+    {
+        TG_PROFILE_SCOPE( "load elevation" );
         loadElevation( demBase );
+    }
+
+    // generate the tile
+    tileMesh.generate();
+
+    // save the intermediate data
+    std::string sharedPath = shareBase + "/stage1/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
+    safeMakeDirectory( sharedPath );
 
-        // generate the tile
-        tileMesh.generate();
+    // only this tile's datasets are written - other tiles save in parallel
+    TG_PROFILE_SCOPE( "save stage1" );
+    access->Request( bucket.gen_index() );
+    tileMesh.save( sharedPath );
+    access->Release( bucket.gen_index() );
+}
+
+// loads the shapefiles of a tile.  Each thread takes the next file no one
+// has started, and keeps its polys in that file's slot - so they are added
+// to the mesh in file order, whichever load finishes first.
+class landclassLoader : public SGThread
+{
+public:
+    landclassLoader( const simgear::PathList& f, std::vector<tgPolygonSetList>& p, unsigned int& n, SGMutex& l ) :
+        files(f), polys(p), next(n), lock(l), profileParent( tgProfile::current() ) {}
+
+    virtual void run() {
+        tgProfileHelper profile( profileParent );
+        unsigned int    i;
+
+        while ( getNextFile( i ) ) {
+            SG_LOG(SG_GENERAL, SG_DEBUG, "load: " << files[i]);
+
+            // shapefile contains multiple polygons.
+            // read an array of them
+            tgPolygonSet::fromShapefile( files[i], polys[i] );
+        }
+    }
 
-        // save the intermediate data
-        std::string sharedPath = shareBase + "/stage1/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
-        safeMakeDirectory( sharedPath );
+private:
+    bool getNextFile( unsigned int& i ) {
+        SGGuard<SGMutex> g(lock);
 
-        lock->lock();
-        tileMesh.save( sharedPath );
-        lock->unlock();
+        if ( next >= files.size() ) {
+            return false;
+        }
+        i = next++;
+        return true;
     }
 
-    SG_LOG(SG_GENERAL, SG_DEBUG, bucket.gen_index_str() << " Thread " << current() << " finished");
+    const simgear::PathList&        files;
+    std::vector<tgPolygonSetList>&  polys;
+    unsigned int&                   next;
+    SGMutex&                        lock;
+    tgProfileRecord*                profileParent;
+};
+
+static bool pathLess( const SGPath& a, const SGPath& b )
+{
+    return a.str() < b.str();
 }
 
 int tgConstructFirst::loadLandclassPolys( const std::string& path )
 {
     std::string         poly_path;
-    tgPolygonSetList    polys;
     unsigned int        numPolys = 0;
 
     // load 2D polygons from correct path
@@ -136,23 +185,48 @@ int tgConstructFirst::loadLandclassPolys( const std::string& path )
         simgear::PathList files = d.children(simgear::Dir::TYPE_FILE);
         SG_LOG( SG_GENERAL, SG_DEBUG, files.size() << " Files in " << d.path() );
 
+        // look for .shp files to load - sorted, as the directory order
+        // depends on the filesystem
+        simgear::PathList shapefiles;
         BOOST_FOREACH(const SGPath& p, files) {
-            std::string lext = p.complete_lower_extension();
-
-            // look for .shp files to load
-            if (lext == "shp") {
-                SG_LOG(SG_GENERAL, SG_DEBUG, "load: " << p);
-
-                // shapefile contains multiple polygons.
-                // read an array of them
-                tgPolygonSet::fromShapefile( p, polys );
-                numPolys += polys.size();
-                for ( unsigned int i=0; i<polys.size(); i++ ) {
-                    std::string material = polys[i].getMeta().getMaterial();
-
-                    int area = areaDefs.get_area_priority( material );                    
-                    tileMesh.addPoly( area, polys[i] );
-                }
+            if (p.complete_lower_extension() == "shp") {
+                shapefiles.push_back( p );
+            }
+        }
+        std::sort( shapefiles.begin(), shapefiles.end(), pathLess );
+
+        std::vector<tgPolygonSetList> polys( shapefiles.size() );
+        unsigned int                  next = 0;
+        SGMutex                       nextLock;
+        unsigned int                  numThreads = std::min( loadThreads, (unsigned int)shapefiles.size() );
+
+        if ( numThreads <= 1 ) {
+            landclassLoader loader( shapefiles, polys, next, nextLock );
+            loader.run();
+        } else {
+            std::vector<landclassLoader*> loaders;
+
+            for ( unsigned int t=0; t<numThreads; t++ ) {
+                loaders.push_back( new landclassLoader( shapefiles, polys, next, nextLock ) );
+            }
+
+            for ( unsigned int t=0; t<loaders.size(); t++ ) {
+                loaders[t]->start();
+            }
+            for ( unsigned int t=0; t<loaders.size(); t++ ) {
+                loaders[t]->join();
+                delete loaders[t];
+            }
+        }
+
+        // the mesh isn't thread safe - add the polys here, in file order
+        for ( unsigned int f=0; f<polys.size(); f++ ) {
+            numPolys += polys[f].size();
+            for ( unsigned int i=0; i<polys[f].size(); i++ ) {
+                std::string material = polys[f][i].getMeta().getMaterial();
+
+                int area = areaDefs.get_area_priority( material );                    
+                tileMesh.addPoly( area, polys[f][i] );
             }
         }
 
@@ -162,36 +236,31 @@ int tgConstructFirst::loadLandclassPolys( const std::string& path )
         }
     }
 
-    SG_LOG(SG_GENERAL, SG_DEBUG, "loadLandclassPolys - loaded " << numPolys << " polys.  mesh is empty: " << tileMesh.empty() );
+    SG_LOG(SG_GENERAL, SG_DEBUG, "loadLandclassPolys - loaded " << numPolys << " polys.  mesh is empty: " << tileMesh.empty() << " using " << loadThreads << " threads" );
 
     return numPolys;
 }
 
 void tgConstructFirst::loadElevation( const std::string& path ) {        
-    std::string array_path = path + "/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
-    tgArray     array;
+    // stage 2 ( and our neighbours ) will want this array again
+    tgArrayPtr array = tgArrayCache::instance().get( path, bucket );
 
-    if ( array.open(array_path) ) {
+    if ( array ) {
         std::vector<cgalPoly_Point>  elevationPoints;
 
-        SG_LOG(SG_GENERAL, SG_DEBUG, "Opened Array file " << array_path);
-
-        array.parse( bucket );
-        array.remove_voids( );
-
-        std::vector<SGGeod> const& corner_list = array.get_corner_list();
+        std::vector<SGGeod> const& corner_list = array->get_corner_list();
         for (unsigned int i=0; i<corner_list.size(); i++) {
             elevationPoints.push_back( cgalPoly_Point(corner_list[i].getLongitudeDeg(), corner_list[i].getLatitudeDeg()) );
         }
 
-        std::vector<SGGeod> const& fit_list = array.get_fitted_list();
+        std::vector<SGGeod> const& fit_list = array->get_fitted_list();
         for (unsigned int i=0; i<fit_list.size(); i++) {
             elevationPoints.push_back( cgalPoly_Point(fit_list[i].getLongitudeDeg(), fit_list[i].getLatitudeDeg()) );
         }
 
         tileMesh.addPoints( elevationPoints );
     } else {
-        SG_LOG(SG_GENERAL, SG_INFO, "Failed to open Array file " << array_path);
+        SG_LOG(SG_GENERAL, SG_INFO, "Failed to open Array file " << path + "/" + bucket.gen_base_path() + "/" + bucket.gen_index_str());
     }
 }
 
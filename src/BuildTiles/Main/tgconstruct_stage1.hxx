@@ -29,19 +29,16 @@
 # error This library requires C++
 #endif                                   
 
-#include <simgear/threads/SGThread.hxx>
-#include <simgear/threads/SGQueue.hxx>
-
-#include <terragear/tg_mutex.hxx>
+#include <terragear/tg_dataset_protect.hxx>
 #include <terragear/mesh/tg_mesh.hxx>
 
 #include "priorities.hxx"
 
-class tgConstructFirst : public SGThread
+class tgConstructFirst
 {
 public:
     // Constructor
-    tgConstructFirst( const std::string& priorities_file, SGLockedQueue<SGBucket>& q, tgMutex* l );
+    tgConstructFirst( const std::string& priorities_file, tgDatasetAccess* a );
 
     // Destructor
     ~tgConstructFirst();
@@ -49,9 +46,13 @@ public:
     // paths
     void setPaths( const std::string& work, const std::string& dem, const std::string& share, const std::string& debug );
 
-private:
-    virtual void run();
+    // threads to load the landclass shapefiles of one tile with
+    void setLoadThreads( unsigned int threads );
+
+    // construct a single tile - called from a tgConstructWorker thread
+    void construct( const SGBucket& b );
 
+private:
     // Ocean tile or not
     bool IsOceanTile()  { return isOcean; }
 
@@ -68,10 +69,6 @@ private:
 private:
     TGAreaDefinitions           areaDefs;
     
-    // construct stage to perform
-    SGLockedQueue<SGBucket>&    workQueue;
-    unsigned int                totalTiles;
-    
     // paths
     std::string                 workBase;
     std::string                 demBase;
@@ -82,11 +79,12 @@ private:
     SGBucket                    bucket;
 
     tgMesh                      tileMesh;
+    unsigned int                loadThreads;
 
     // ocean tile?
     bool                        isOcean;
 
-    tgMutex*                    lock;
+    tgDatasetAccess*            access;
 };
 
 #endif // _CONSTRUCT_HXX
\ No newline at end of file
@@ -31,16 +31,15 @@
 #include <simgear/misc/sg_path.hxx>
 #include <simgear/debug/logstream.hxx>
 
-#include <terragear/tg_array.hxx>
+#include <terragear/tg_profile.hxx>
 
 #include "tgconstruct_stage2.hxx"
 
 // Constructor
-tgConstructSecond::tgConstructSecond( const std::string& pfile, SGLockedQueue<SGBucket>& q, tgMutex* l) :
-        workQueue(q)
+tgConstructSecond::tgConstructSecond( const std::string& pfile, tgDatasetAccess* a )
 {
-    totalTiles = q.size();
-    lock = l;
+    access = a;
+    elevationThreads = 1;
 
     /* initialize tgMesh for the number of layers we have */
     if ( areaDefs.init( pfile ) ) {
@@ -49,7 +48,6 @@ tgConstructSecond::tgConstructSecond( const std::string& pfile, SGLockedQueue<SG
 
     std::vector<std::string> area_names = areaDefs.get_name_array();
     tileMesh.initPriorities( area_names );  
-    tileMesh.setLock( lock );
 }
 
 
@@ -65,82 +63,55 @@ void tgConstructSecond::setPaths( const std::string& work, const std::string& de
     debugBase  = debug;
 }
 
+void tgConstructSecond::setElevationThreads( unsigned int threads ) {
+    elevationThreads = threads;
+}
+
 void tgConstructSecond::safeMakeDirectory( const std::string& directory )
 {
-    lock->lock();
-    std::string dummy = directory + "/dummy";
-    SGPath sgp( dummy );
-    sgp.create_dir( 0755 );
-    lock->unlock();
+    access->MakeDirectory( directory );
 }
 
-void tgConstructSecond::run()
+void tgConstructSecond::construct( const SGBucket& b )
 {
-    unsigned int tilesComplete;
+    bucket = b;
 
-    // as long as we have feometry to parse, do so
-    while ( !workQueue.empty() ) {
-        bucket = workQueue.pop();
-        tilesComplete = totalTiles - workQueue.size();
+    tgProfileUnit profile( bucket.gen_index_str(), "stage2" );
 
-        SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Stage 2 Construct in " << bucket.gen_base_path() << " tile " << tilesComplete << " of " << totalTiles << " using thread " << current() );
+    SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Stage 2 Construct in " << bucket.gen_base_path() << " using thread " << SGThread::current() );
 
-        // and clear
-        tileMesh.clear();
+    // and clear
+    tileMesh.clear();
 
-        if ( !debugBase.empty() ) {
-            std::string debugPath = debugBase + "/tgconstruct_debug/stage2/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
-            safeMakeDirectory( debugPath );
+    if ( !debugBase.empty() ) {
+        std::string debugPath = debugBase + "/tgconstruct_debug/stage2/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
+        safeMakeDirectory( debugPath );
 
-            tileMesh.initDebug( debugPath );
-        }
+        tileMesh.initDebug( debugPath );
+    }
 
-        std::string sharedStage1Base = shareBase + "/stage1/";
+    std::string sharedStage1Base = shareBase + "/stage1/";
 
-        // STEP 1 - read in the stage 1 tile mesh triangulation, and the shared edge nodes - remesh to fit shared edges
+    // STEP 1 - read in the stage 1 tile mesh triangulation, and the shared edge nodes - remesh to fit shared edges
+    {
+        TG_PROFILE_SCOPE( "load stage1" );
         isOcean = tileMesh.loadStage1( sharedStage1Base, bucket );
-
-        if ( !isOcean ) {
-#if 0
-            // Step 2 - calculate elevation
-            tileMesh.calcElevation( demBase );
-#endif
-
-            // save the intermediate data
-            std::string sharedStage2 = shareBase + "/stage2/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
-            safeMakeDirectory( sharedStage2 );
-
-            lock->lock();
-            tileMesh.save2( sharedStage2 );
-            lock->unlock();
-        }
     }
-}
-
-void tgConstructSecond::loadElevation( const std::string& path ) {        
-    std::string array_path = path + "/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
-    tgArray     array;
-
-    if ( array.open(array_path) ) {
-        std::vector<cgalPoly_Point>  elevationPoints;
 
-        SG_LOG(SG_GENERAL, SG_DEBUG, "Opened Array file " << array_path);
-
-        array.parse( bucket );
-        array.remove_voids( );
-
-        std::vector<SGGeod> const& corner_list = array.get_corner_list();
-        for (unsigned int i=0; i<corner_list.size(); i++) {
-            elevationPoints.push_back( cgalPoly_Point(corner_list[i].getLongitudeDeg(), corner_list[i].getLatitudeDeg()) );
+    if ( !isOcean ) {
+        // Step 2 - calculate elevation
+        {
+            TG_PROFILE_SCOPE( "elevation" );
+            tileMesh.calcElevation( demBase, elevationThreads );
         }
 
-        std::vector<SGGeod> const& fit_list = array.get_fitted_list();
-        for (unsigned int i=0; i<fit_list.size(); i++) {
-            elevationPoints.push_back( cgalPoly_Point(fit_list[i].getLongitudeDeg(), fit_list[i].getLatitudeDeg()) );
-        }
+        // save the intermediate data
+        std::string sharedStage2 = shareBase + "/stage2/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
+        safeMakeDirectory( sharedStage2 );
 
-        tileMesh.addPoints( elevationPoints );        
-    } else {
-        SG_LOG(SG_GENERAL, SG_INFO, "Failed to open Array file " << array_path);
+        TG_PROFILE_SCOPE( "save stage2" );
+        access->Request( bucket.gen_index() );
+        tileMesh.save2( sharedStage2 );
+        access->Release( bucket.gen_index() );
     }
-}
\ No newline at end of file
+}
@@ -29,43 +29,38 @@
 # error This library requires C++
 #endif                                   
 
-#include <simgear/threads/SGThread.hxx>
-#include <simgear/threads/SGQueue.hxx>
-
+#include <terragear/tg_dataset_protect.hxx>
 #include <terragear/mesh/tg_mesh.hxx>
 
 #include "priorities.hxx"
 
-class tgConstructSecond : public SGThread
+class tgConstructSecond
 {
 public:
     // Constructor
-    tgConstructSecond( const std::string& priorities_file, SGLockedQueue<SGBucket>& q, tgMutex* l );
+    tgConstructSecond( const std::string& priorities_file, tgDatasetAccess* a );
 
     // Destructor
     ~tgConstructSecond();
 
     // paths
     void setPaths( const std::string& work, const std::string& dem, const std::string& share, const std::string& debug );
+
+    // threads to look up the elevations of one tile with
+    void setElevationThreads( unsigned int threads );
     
-private:
-    virtual void run();
+    // construct a single tile - called from a tgConstructWorker thread
+    void construct( const SGBucket& b );
 
+private:
     // Ocean tile or not
     bool IsOceanTile()  { return isOcean; }
 
-    // Load Data
-    void loadElevation( const std::string& path );
-
     void safeMakeDirectory( const std::string& directory );
 
 private:
     TGAreaDefinitions           areaDefs;
     
-    // construct stage to perform
-    SGLockedQueue<SGBucket>&    workQueue;
-    unsigned int                totalTiles;
-    
     // paths
     std::string                 workBase;
     std::string                 demBase;
@@ -80,7 +75,9 @@ private:
     // ocean tile?
     bool                        isOcean;
 
-    tgMutex*                    lock;
+    tgDatasetAccess*            access;
+
+    unsigned int                elevationThreads;
 };
 
 #endif // _TGCONSTRUCT_SECOND_HXX
\ No newline at end of file
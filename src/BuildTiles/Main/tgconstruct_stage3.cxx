@@ -25,22 +25,25 @@
 #  include <config.h>
 #endif
 
+#include <fstream>
+#include <sstream>
+
 #include <boost/foreach.hpp>
 
 #include <simgear/misc/sg_dir.hxx>
 #include <simgear/misc/sg_path.hxx>
+#include <simgear/misc/sgstream.hxx>
 #include <simgear/debug/logstream.hxx>
 
 #include <terragear/tg_array.hxx>
+#include <terragear/tg_profile.hxx>
 
 #include "tgconstruct_stage3.hxx"
 
 // Constructor
-tgConstructThird::tgConstructThird( const std::string& pfile, SGLockedQueue<SGBucket>& q, tgMutex* l) :
-        workQueue(q)
+tgConstructThird::tgConstructThird( const std::string& pfile, tgDatasetAccess* a )
 {
-    totalTiles = q.size();   
-    lock = l;
+    access = a;
     
     /* initialize tgMesh for the number of layers we have */
     if ( areaDefs.init( pfile ) ) {
@@ -49,7 +52,6 @@ tgConstructThird::tgConstructThird( const std::string& pfile, SGLockedQueue<SGBu
 
     std::vector<std::string> area_names = areaDefs.get_name_array();
     tileMesh.initPriorities( area_names );  
-    tileMesh.setLock( lock );
 }
 
 
@@ -66,69 +68,105 @@ void tgConstructThird::setPaths( const std::string& work, const std::string& dem
     outputBase = output;
 }
 
-void tgConstructThird::run()
+void tgConstructThird::construct( const SGBucket& b )
 {
-    unsigned int tilesComplete;
+    bucket = b;
 
-    SG_LOG(SG_GENERAL, SG_ALERT, " - Construct thread started " );
-    
-    // as long as we have feometry to parse, do so
-    while ( !workQueue.empty() ) {
-        SG_LOG(SG_GENERAL, SG_ALERT, " - workqueue not empty " );
-        
-        bucket = workQueue.pop();
-
-        tilesComplete = totalTiles - workQueue.size();
-
-        // assume non ocean tile until proven otherwise
-        isOcean = false;
-
-#if 0        
-        if (   ( bucket.gen_index() != 3006851 )
-            && ( bucket.gen_index() != 3023235 )
-            && ( bucket.gen_index() != 3039619 )
-            && ( bucket.gen_index() != 3056003 )
-            && ( bucket.gen_index() != 3072387 )
-            && ( bucket.gen_index() != 3105155 )
-            && ( bucket.gen_index() != 3121539 )
-#else
-        if ( true
-#endif            
-        ) {       
-            if ( !debugBase.empty() ) {
-                SG_LOG(SG_GENERAL, SG_ALERT, " - Generate debug " );
-                
-                std::string debugPath = debugBase + "/tgconstruct_debug/stage2" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
-
-                lock->lock();
-                std::string dummy = debugPath + "/dummy";
-                SGPath sgp( dummy );
-                sgp.create_dir( 0755 );            
-                lock->unlock();
-                
-                SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Construct in " << bucket.gen_base_path() << " tile " << tilesComplete << " of " << totalTiles << " debug path is " << debugPath );
-                tileMesh.initDebug( debugPath );
-            }
-            
-            std::string sharedStage2Base = shareBase + "/stage12";
-                        
-            SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Construct in " << bucket.gen_base_path() << " tile " << tilesComplete << " of " << totalTiles << " using thread " << current() );
-
-            // STEP 1 - read in the stage 1 tile mesh triangulation, and the shared edge nodes - remesh to fit shared edges
-            loadMesh( sharedStage2Base );
-            
-            // Step 2 - calculate elevation
+    tgProfileUnit profile( bucket.gen_index_str(), "stage3" );
+
+    SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Stage 3 Construct in " << bucket.gen_base_path() << " using thread " << SGThread::current() );
+
+    tileMesh.clear();
+
+    if ( !debugBase.empty() ) {
+        std::string debugPath = debugBase + "/tgconstruct_debug/stage3/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
+        access->MakeDirectory( debugPath );
+
+        tileMesh.initDebug( debugPath );
+    }
+
+    std::string sharedStage1Base = shareBase + "/stage1";
+    std::string sharedStage2Base = shareBase + "/stage2";
+
+    // STEP 1 - read in the stage 2 tile mesh triangulation, and the stage 1
+    // arrangement to find the material of each triangle
+    bool loaded;
+    {
+        TG_PROFILE_SCOPE( "load stage2" );
+        loaded = tileMesh.loadStage2( sharedStage1Base, sharedStage2Base, bucket, isOcean );
+    }
+
+    if ( !loaded ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Stage 3 stage 2 triangulation is missing or corrupt - nothing written" );
+    } else if ( !isOcean ) {
+        // STEP 2 - shared vertex normals
+        {
+            TG_PROFILE_SCOPE( "normals" );
             tileMesh.calcFaceNormals();
-            
-            // and clear
-            tileMesh.clear();
         }
+
+        // STEP 3 - texture coordinates, and write the BTG and stg
+        std::string outPath = outputBase + "/" + bucket.gen_base_path();
+        access->MakeDirectory( outPath );
+
+        TG_PROFILE_SCOPE( "save btg" );
+        if ( tileMesh.saveBtg( outPath + "/" + bucket.gen_index_str() + ".btg.gz" ) ) {
+            writeStg( outPath );
+        } else {
+            SG_LOG(SG_GENERAL, SG_ALERT, bucket.gen_index_str() << " - Stage 3 failed to write btg to " << outPath );
+        }
+    } else {
+        SG_LOG(SG_GENERAL, SG_INFO, bucket.gen_index_str() << " - Stage 3 ocean tile - nothing to write" );
     }
+
+    // and clear
+    tileMesh.clear();
 }
 
-int tgConstructThird::loadMesh( const std::string& path )
-{    
-    tileMesh.loadStage2( path, bucket );    
-    
-    return 0;
-}
\ No newline at end of file
+// write the stg for the tile - the base terrain, and any airport objects
+// genapts left for this tile
+void tgConstructThird::writeStg( const std::string& outPath )
+{
+    std::string stgFile = outPath + "/" + bucket.gen_index_str() + ".stg";
+    std::ofstream stg( stgFile.c_str(), std::ios::out | std::ios::trunc );
+
+    if ( !stg.is_open() ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "ERROR: opening " << stgFile << " for writing!" );
+        return;
+    }
+
+    stg << "OBJECT_BASE " << bucket.gen_index_str() << ".btg\n";
+
+    std::string objBase   = workBase + "/AirportObj/" + bucket.gen_base_path();
+    std::string indexFile = objBase + "/" + bucket.gen_index_str() + ".ind";
+    sg_gzifstream in( indexFile );
+
+    if ( in.is_open() ) {
+        SG_LOG( SG_GENERAL, SG_DEBUG, "Collecting custom objects from " << indexFile );
+
+        std::string line;
+        while ( std::getline( in, line ) ) {
+            std::istringstream ss( line );
+            std::string        token, name;
+
+            if ( !( ss >> token ) ) {
+                continue;
+            }
+
+            if ( token == "OBJECT" && ( ss >> name ) ) {
+                std::string   src = objBase + "/" + name + ".gz";
+                std::string   dst = outPath + "/" + name + ".gz";
+                std::ifstream srcFile( src.c_str(), std::ios::in | std::ios::binary );
+                std::ofstream dstFile( dst.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+
+                if ( srcFile.is_open() && dstFile.is_open() && ( dstFile << srcFile.rdbuf() ) ) {
+                    stg << "OBJECT " << name << "\n";
+                } else {
+                    SG_LOG( SG_GENERAL, SG_ALERT, "Could not copy " << src << " to " << dst );
+                }
+            } else {
+                stg << line << "\n";
+            }
+        }
+    }
+}
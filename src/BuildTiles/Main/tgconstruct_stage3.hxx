@@ -29,18 +29,16 @@
 # error This library requires C++
 #endif                                   
 
-#include <simgear/threads/SGThread.hxx>
-#include <simgear/threads/SGQueue.hxx>
-
+#include <terragear/tg_dataset_protect.hxx>
 #include <terragear/mesh/tg_mesh.hxx>
 
 #include "priorities.hxx"
 
-class tgConstructThird : public SGThread
+class tgConstructThird
 {
 public:
     // Constructor
-    tgConstructThird( const std::string& priorities_file, SGLockedQueue<SGBucket>& q, tgMutex* l );
+    tgConstructThird( const std::string& priorities_file, tgDatasetAccess* a );
 
     // Destructor
     ~tgConstructThird();
@@ -48,24 +46,19 @@ public:
     // paths
     void setPaths( const std::string& work, const std::string& dem, const std::string& share, const std::string& debug, const std::string& output );
     
-private:
-    virtual void run();
+    // construct a single tile - called from a tgConstructWorker thread
+    void construct( const SGBucket& b );
 
+private:
     // Ocean tile or not
     bool IsOceanTile()  { return isOcean; }
 
-    // Load Data
-    void loadElevation( const std::string& path );
-    
-    int loadMesh( const std::string& path );
+    // Output
+    void writeStg( const std::string& outPath );
 
 private:
     TGAreaDefinitions           areaDefs;
     
-    // construct stage to perform
-    SGLockedQueue<SGBucket>&    workQueue;
-    unsigned int                totalTiles;
-    
     // paths
     std::string                 workBase;
     std::string                 demBase;
@@ -81,7 +74,7 @@ private:
     // ocean tile?
     bool                        isOcean;
 
-    tgMutex*                    lock;
+    tgDatasetAccess*            access;
 };
 
 #endif // _TGCONSTRUCT_THIRD_HXX
\ No newline at end of file
@@ -28,13 +28,18 @@
 
 #include <cstdio>
 
+#include <boost/thread.hpp>
+
 #include "tg_btg_mesh.hxx"
+#include "tg_btg_mesh_cache.hxx"
 
 #include <simgear/math/SGGeometry.hxx>
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/misc/sg_path.hxx>
 #include <simgear/io/sg_binobj.hxx>
 #include <simgear/debug/logstream.hxx>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
 #include <terragear/BucketBox.hxx>
 #include <terragear/tg_shapefile.hxx>
@@ -51,8 +56,9 @@ static void usage( const std::string name ) {
 }
 #endif
 
-// usage tglod minx, miny, maxx, maxy, level input_dir output_dir
-// 
+// usage tglod -l <level> [-f <first level>] [-j <threads>] [-c <cache size>] -S <scenery dir> -o <output dir>
+// levels first .. level are built in turn, finest ( highest ) first.
+// -c is the number of simplified tiles kept in memory for the next level
 
 // first test : malta - generate 2 level 8 ( 0.25 x 0.25 ) tiles
 //              14.00,35.75 - 14.25,36.00
@@ -176,12 +182,20 @@ collectBtgFiles(const BucketBox& bucketBox, const std::string& sceneryPath, cons
 }
 
 int
-collapseBtg(int level, const std::string& outfile, std::vector<subDivision>& subTiles)
+collapseBtg(int level, const std::string& outfile, std::vector<subDivision>& subTiles, tgBtgMeshCache& cache)
 {
     Arrays arrays;
     
     for (unsigned int i = 0; i < subTiles.size(); i++ ) {
         if ( !subTiles[i].fileName.empty() ) {
+            // the finer level tile may still be in memory
+            tgBtgObjectPtr subObj = cache.find( subTiles[i].fileName );
+            if ( subObj ) {
+                SG_LOG(SG_GENERAL, SG_INFO, "Cached tile " << subTiles[i].fileName );
+                arrays.insert(subTiles[i].min, subTiles[i].max, *subObj);
+                continue;
+            }
+
             SGBinObject binObj;
             if (!binObj.read_bin(subTiles[i].fileName)) {
                 std::cerr << "Error Reading file " << subTiles[i].fileName << std::endl;
@@ -240,50 +254,133 @@ collapseBtg(int level, const std::string& outfile, std::vector<subDivision>& sub
     SG_LOG(SG_GENERAL, SG_ALERT, "Simplifying tile " << outfile << " with ratio " << simpRatio );
 
     tgBtgSimplify( mesh, simpRatio, 0.5f, 0.5f, 0.0f, 0.0f, outfile );
-    tgWriteMeshAsBtg( mesh, SGPath(outfile) );
+    tgBtgObjectPtr obj( new SGBinObject );
+    if ( !tgWriteMeshAsBtg( mesh, SGPath(outfile), *obj ) ) {
+        std::cerr << "Error Writing file " << outfile << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // keep it for the next ( coarser ) level
+    cache.insert( outfile, level, obj );
 
     return EXIT_SUCCESS;
 }
 
+// output directories are shared by the tiles of a level
+static SGMutex dir_lock;
+
 int
-createTree(const BucketBox& bucketBox, const std::string& sceneryPath, const std::string& outPath, unsigned level)
+createTile(const BucketBox& bucketBox, const std::string& sceneryPath, const std::string& outPath, unsigned level, tgBtgMeshCache& cache)
 {
-    if (bucketBox.getStartLevel() == level) {
-        // We want an other level of indirection for paging
-        //std::list<std::string> files;   // actual files to be read as mesh for collapse
-        //std::list<SGBucket>    land;    // level 9 buckets that are non-ocean
-        //std::list<SGBucket>    ocean;   // level 9 buckets that are ocean
-        std::vector<subDivision>   subTiles;
-        
-        // collectBtgFiles collects all children BTGs - and ocean btgs where files are not found.  
-        // TODO get the ration of land / ocean to determine what simplification to use
-        bool hasLand = collectBtgFiles(bucketBox, sceneryPath, outPath, subTiles);
-        if (!hasLand) {
-            return EXIT_SUCCESS;
-        }
-                
-        std::stringstream ss;
-        ss << outPath << "/";
-        for (unsigned i = 3; i < level; i += 2) {
-            ss << bucketBox.getParentBox(i) << "/";
-        }
-        
+    std::vector<subDivision>   subTiles;
+    
+    // collectBtgFiles collects all children BTGs - and ocean btgs where files are not found.  
+    // TODO get the ration of land / ocean to determine what simplification to use
+    bool hasLand = collectBtgFiles(bucketBox, sceneryPath, outPath, subTiles);
+    if (!hasLand) {
+        return EXIT_SUCCESS;
+    }
+            
+    std::stringstream ss;
+    ss << outPath << "/";
+    for (unsigned i = 3; i < level; i += 2) {
+        ss << bucketBox.getParentBox(i) << "/";
+    }
+    
+    {
+        SGGuard<SGMutex> g(dir_lock);
         SGPath(ss.str()).create_dir(0755);
-        ss << bucketBox << ".btg.gz";
-        collapseBtg(level, ss.str(), subTiles);
-   
-        //exit(0);
+    }
+    ss << bucketBox << ".btg.gz";
+
+    return collapseBtg(level, ss.str(), subTiles, cache);
+}
+
+// collect every bucketbox of the given level
+void
+collectTree(const BucketBox& bucketBox, unsigned level, std::vector<BucketBox>& boxes)
+{
+    if (bucketBox.getStartLevel() == level) {
+        boxes.push_back(bucketBox);
     } else {
         BucketBox bucketBoxList[100];
         unsigned numTiles = bucketBox.getSubDivision(bucketBoxList, 100);
         for (unsigned i = 0; i < numTiles; ++i) {
-            if (EXIT_FAILURE == createTree(bucketBoxList[i], sceneryPath, outPath, level)) {
-                return EXIT_FAILURE;
-            }
+            collectTree(bucketBoxList[i], level, boxes);
         }
     }
-    
-    return EXIT_SUCCESS;
+}
+
+// The tiles of a level only depend on the level below, so they are
+// collapsed in parallel.  Workers take the next tile from the level list.
+static std::vector<BucketBox>   boxList;
+static unsigned int             nextBox = 0;
+static bool                     boxFailed = false;
+static SGMutex                  boxLock;
+
+static bool get_next_box( BucketBox& box )
+{
+    SGGuard<SGMutex> g(boxLock);
+
+    if ( boxFailed || nextBox >= boxList.size() ) {
+        return false;
+    }
+
+    box = boxList[nextBox++];
+    return true;
+}
+
+class LodWorker : public SGThread
+{
+public:
+    LodWorker(const std::string& scenery, const std::string& out, unsigned l, tgBtgMeshCache& c) :
+        sceneryPath(scenery), outPath(out), level(l), cache(c) {}
+
+private:
+    virtual void run();
+
+    std::string     sceneryPath;
+    std::string     outPath;
+    unsigned        level;
+    tgBtgMeshCache& cache;
+};
+
+void LodWorker::run()
+{
+    BucketBox box;
+
+    while ( get_next_box( box ) ) {
+        if ( EXIT_FAILURE == createTile(box, sceneryPath, outPath, level, cache) ) {
+            SGGuard<SGMutex> g(boxLock);
+            boxFailed = true;
+        }
+    }
+}
+
+int
+createTree(const std::string& sceneryPath, const std::string& outPath, unsigned level, int num_threads, tgBtgMeshCache& cache)
+{
+    boxList.clear();
+    nextBox   = 0;
+    boxFailed = false;
+
+    collectTree(BucketBox(-180, -90, 360, 180), level, boxList);
+
+    SG_LOG(SG_GENERAL, SG_ALERT, "Create level " << level << " : " << boxList.size() << " tiles with " << num_threads << " threads" );
+
+    std::vector<LodWorker *> workers;
+    for (int i = 0; i < num_threads; i++) {
+        LodWorker* worker = new LodWorker( sceneryPath, outPath, level, cache );
+        worker->start();
+        workers.push_back( worker );
+    }
+
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        workers[i]->join();
+        delete workers[i];
+    }
+
+    return boxFailed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 
@@ -292,9 +389,21 @@ int main(int argc, char **argv)
     std::string outfile;
     std::string sceneryPath = "/share/scenery/svn/Terrain/";
     unsigned level = ~0u;
+    unsigned first = ~0u;
+    int num_threads = boost::thread::hardware_concurrency();
+    unsigned int cache_size = 64;
     int c;
-    while ((c = getopt(argc, argv, "l:o:p:S:")) != EOF) {
+    while ((c = getopt(argc, argv, "c:f:j:l:o:p:S:")) != EOF) {
         switch (c) {
+            case 'c':
+                cache_size = atoi(optarg);
+                break;
+            case 'f':
+                first = atoi(optarg);
+                break;
+            case 'j':
+                num_threads = atoi(optarg);
+                break;
             case 'l':
                 level = atoi(optarg);
                 break;
@@ -316,9 +425,26 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
     
-    if (level <= 8) {
-        SG_LOG(SG_GENERAL, SG_ALERT, "Create level " << level );
-        return createTree(BucketBox(-180, -90, 360, 180), sceneryPath, outfile, level);
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    // build from the first ( finest ) level up to the requested one
+    if (first == ~0u) {
+        first = level;
+    }
+
+    if (level <= 8 && first <= 8 && first >= level) {
+        tgBtgMeshCache cache( cache_size );
+
+        for (unsigned l = first + 1; l-- > level; ) {
+            if (EXIT_FAILURE == createTree(sceneryPath, outfile, l, num_threads, cache)) {
+                return EXIT_FAILURE;
+            }
+
+            // level l+1 meshes have all been collapsed into level l
+            cache.purgeLevel(l + 1);
+        }
     }
 
     return 0;
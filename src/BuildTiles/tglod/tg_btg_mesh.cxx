@@ -32,11 +32,16 @@
 #include <simgear/misc/sg_path.hxx>
 #include <simgear/misc/texcoord.hxx>
 #include <simgear/debug/logstream.hxx>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
 #include <terragear/tg_shapefile.hxx>
 
 #include "tg_btg_mesh.hxx"
 
+// tiles of a level are meshed in parallel - they share the debug datasource
+static SGMutex shapefileLock;
+
 template <class HDS>
 class tgBuildBtgMesh : public CGAL::Modifier_base<HDS> {
 public:
@@ -283,7 +288,10 @@ void tgReadArraysAsMesh( const Arrays& arrays, tgBtgMesh& mesh, const std::strin
     
     sprintf( datasource, "./simp_dbg" );
     sprintf( mesh_name, "%s_%s", pathname.file().c_str(), "bad_tris" );
-    tgShapefile::FromSegmentList( m.bad_tri_segs, false, datasource, mesh_name, "mesh" );
+    {
+        SGGuard<SGMutex> g( shapefileLock );
+        tgShapefile::FromSegmentList( m.bad_tri_segs, false, datasource, mesh_name, "mesh" );
+    }
 #endif
     
     // now that the mesh has been created - set the IDs
@@ -303,7 +311,7 @@ void tgReadArraysAsMesh( const Arrays& arrays, tgBtgMesh& mesh, const std::strin
     }   
 }
 
-bool tgWriteMeshAsBtg( tgBtgMesh& p, const SGPath& outfile) 
+bool tgWriteMeshAsBtg( tgBtgMesh& p, const SGPath& outfile, SGBinObject& outobj )
 {
     typedef std::vector<tgBtgFacet_handle>          FacetList_t;
     typedef FacetList_t::iterator                   FacetList_iterator;
@@ -315,7 +323,6 @@ bool tgWriteMeshAsBtg( tgBtgMesh& p, const SGPath& outfile)
     UniqueSGVec3dSet            vertices;
     UniqueSGVec3fSet            normals;
     UniqueSGVec2fSet            texcoords;
-    SGBinObject                 outobj;
     SGBinObjectTriangle         sgboTri;
     
     // grab nodes, normals, and texture coordinates from the triangle list
@@ -392,7 +399,19 @@ bool tgWriteMeshAsBtg( tgBtgMesh& p, const SGPath& outfile)
     outobj.set_normals( normals.get_list() );
     outobj.set_texcoords( texcoords.get_list() );
     
-    return outobj.write_bin_file( outfile );
+    if ( !outobj.write_bin_file( outfile ) ) {
+        return false;
+    }
+
+    // the file has the nodes as floats, relative to the center - leave
+    // outobj exactly as read_bin will read it back
+    SGVec3d center = outobj.get_gbs_center();
+    for ( unsigned int i=0; i<wgs84_nodes.size(); i++ ) {
+        wgs84_nodes[i] = toVec3d( toVec3f( wgs84_nodes[i] - center ) );
+    }
+    outobj.set_wgs84_nodes( wgs84_nodes );
+
+    return true;
 }
 
 void tgMeshToShapefile(tgBtgMesh& mesh, const std::string& name)
@@ -159,12 +159,14 @@ typedef tgBtgMesh::Halfedge_around_vertex_circulator    tgBtgHalfedge_vertex_cir
 typedef tgBtgMesh::Halfedge_handle                      tgBtgHalfedge_handle;
 typedef tgBtgMesh::Facet_iterator                       tgBtgFacet_iterator;
 typedef tgBtgMesh::Facet_handle                         tgBtgFacet_handle;
+typedef tgBtgMesh::Facet_const_iterator                 tgBtgFacet_const_iterator;
+typedef tgBtgMesh::Halfedge_around_facet_const_circulator tgBtgHalfedge_facet_const_circulator;
 
                                                         
 
 void tgReadBtgAsMesh( const SGBinObject& inobj, tgBtgMesh& mesh );
 void tgReadArraysAsMesh( const Arrays& arrays, tgBtgMesh& mesh, const std::string& name );
-bool tgWriteMeshAsBtg( tgBtgMesh& p, const SGPath& outfile );
+bool tgWriteMeshAsBtg( tgBtgMesh& p, const SGPath& outfile, SGBinObject& outobj );
 int  tgBtgSimplify( tgBtgMesh& mesh, float stop_percentage, float volume_wgt, float boundary_wgt, float shape_wgt, double cl, const std::string& name );
 void tgMeshToShapefile( tgBtgMesh& mesh, const std::string& name );
 
@@ -0,0 +1,80 @@
+// tg_btg_mesh_cache.cxx -- bounded cache of simplified LOD meshes
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <simgear/threads/SGGuard.hxx>
+
+#include "tg_btg_mesh_cache.hxx"
+
+void tgBtgMeshCache::insert( const std::string& key, unsigned int level, tgBtgObjectPtr obj )
+{
+    SGGuard<SGMutex> g(lock);
+
+    if ( maxEntries == 0 ) {
+        return;
+    }
+
+    tgBtgMeshCacheMap::iterator it = entries.find( key );
+    if ( it != entries.end() ) {
+        lru.erase( it->second.lruPos );
+        entries.erase( it );
+    }
+
+    while ( entries.size() >= maxEntries ) {
+        entries.erase( lru.back() );
+        lru.pop_back();
+    }
+
+    lru.push_front( key );
+
+    tgBtgMeshCacheEntry& entry = entries[key];
+    entry.obj    = obj;
+    entry.level  = level;
+    entry.lruPos = lru.begin();
+}
+
+tgBtgObjectPtr tgBtgMeshCache::find( const std::string& key )
+{
+    SGGuard<SGMutex> g(lock);
+
+    tgBtgMeshCacheMap::iterator it = entries.find( key );
+    if ( it == entries.end() ) {
+        return tgBtgObjectPtr();
+    }
+
+    // move to the front
+    lru.splice( lru.begin(), lru, it->second.lruPos );
+
+    return it->second.obj;
+}
+
+void tgBtgMeshCache::purgeLevel( unsigned int level )
+{
+    SGGuard<SGMutex> g(lock);
+
+    tgBtgMeshCacheMap::iterator it = entries.begin();
+    while ( it != entries.end() ) {
+        if ( it->second.level == level ) {
+            lru.erase( it->second.lruPos );
+            entries.erase( it++ );
+        } else {
+            ++it;
+        }
+    }
+}
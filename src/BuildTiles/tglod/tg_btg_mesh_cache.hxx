@@ -0,0 +1,64 @@
+// tg_btg_mesh_cache.hxx -- bounded cache of simplified LOD meshes
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+#ifndef __TG_BTG_MESH_CACHE_HXX__
+#define __TG_BTG_MESH_CACHE_HXX__
+
+#include <list>
+#include <map>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include <simgear/threads/SGThread.hxx>
+
+#include "tg_btg_mesh.hxx"
+
+typedef boost::shared_ptr<SGBinObject>  tgBtgObjectPtr;
+
+// Simplified meshes of one level are the input of the next ( coarser )
+// level.  Rather than have the parent read back the BTG we just wrote,
+// keep the SGBinObject it was written from - as read_bin would return
+// it, so a cache hit builds exactly the same arrays as a read from disk.
+// The cache is bounded by number of meshes, and evicts the least recently
+// used one.  On a miss, the parent just reads the BTG from disk.
+class tgBtgMeshCache
+{
+public:
+    tgBtgMeshCache( unsigned int max ) : maxEntries( max ) {}
+
+    void            insert( const std::string& key, unsigned int level, tgBtgObjectPtr obj );
+    tgBtgObjectPtr  find( const std::string& key );
+
+    // drop all meshes of a level once its parent level is done
+    void            purgeLevel( unsigned int level );
+
+private:
+    struct tgBtgMeshCacheEntry {
+        tgBtgObjectPtr                      obj;
+        unsigned int                        level;
+        std::list<std::string>::iterator    lruPos;
+    };
+
+    typedef std::map<std::string, tgBtgMeshCacheEntry>  tgBtgMeshCacheMap;
+
+    unsigned int            maxEntries;
+    tgBtgMeshCacheMap       entries;
+    std::list<std::string>  lru;        // most recently used first
+    SGMutex                 lock;
+};
+
+#endif /* __TG_BTG_MESH_CACHE_HXX__ */
@@ -24,6 +24,7 @@
 #  include <config.h>
 #endif
 
+#include <cstdio>
 #include <iostream>
 
 #include <simgear/misc/sg_path.hxx>
@@ -456,6 +457,9 @@ TGDem::write_area( const string& root, SGBucket& b ) {
     }
     gzclose(fp);
 
+    // readers prefer a raw file - it would shadow the one we just wrote
+    ::remove( (path + "/" + b.gen_index_str() + ".arr.raw").c_str() );
+
     return true;
 }
 
@@ -40,8 +40,6 @@
 #  include <direct.h>
 #endif
 
-#include <boost/foreach.hpp>
-
 #include <simgear/constants.h>
 #include <simgear/io/lowlevel.hxx>
 #include <simgear/misc/sg_dir.hxx>
@@ -49,6 +47,7 @@
 
 
 #include "hgt.hxx"
+#include "zipfile.hxx"
 
 using std::cout;
 using std::endl;
@@ -57,18 +56,18 @@ using std::string;
 
 TGHgt::TGHgt( int _res ) 
 {
+    fd = NULL;
     hgt_resolution = _res;
 
     data = new short int[MAX_HGT_SIZE][MAX_HGT_SIZE];
-    output_data = new short int[MAX_HGT_SIZE][MAX_HGT_SIZE];
 }
 
 
 TGHgt::TGHgt( int _res, const SGPath &file )
 {
+    fd = NULL;
     hgt_resolution = _res;
     data = new short int[MAX_HGT_SIZE][MAX_HGT_SIZE];
-    output_data = new short int[MAX_HGT_SIZE][MAX_HGT_SIZE];
 
     TGHgt::open( file );
 }
@@ -79,55 +78,54 @@ bool
 TGHgt::open ( const SGPath &f ) {
     SGPath file_name = f;
 
+    string name = file_name.file();
+
     // open input file (or read from stdin)
     if ( file_name.str() ==  "-" ) {
-        cout << "Loading HGT data file: stdin" << endl;
+        SG_LOG( SG_GENERAL, SG_INFO, "Loading HGT data file: stdin" );
         if ( (fd = gzdopen(0, "r")) == NULL ) { // 0 == STDIN_FILENO
-            cout << "ERROR: opening stdin" << endl;
+            SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: opening stdin" );
             return false;
         }
-    } else {
-        if ( file_name.extension() == "zip" ) {
-            // extract the .zip file to /tmp and point the file name
-            // to the extracted file
-            tmp_dir = simgear::Dir::tempDir("hgt");
-            
-            cout << "Extracting " << file_name.str() << " to " << tmp_dir.path().str() << endl;
-            string command = "unzip -d \"" + tmp_dir.path().str() + "\" " + file_name.base();
-            if ( system( command.c_str() ) != -1 )
-            {
-                simgear::PathList files = tmp_dir.children(simgear::Dir::TYPE_FILE | simgear::Dir::NO_DOT_OR_DOTDOT);
-                BOOST_FOREACH(const SGPath& file, files) {
-                    string ext = file.lower_extension();
-                    if ( ext == "hgt" ) {
-                        file_name = file;
-                        break;
-                    }
-                }
-            
-                remove_tmp_file = true;
-                cout << "Proceeding with " << file_name.str() << endl;
-            } else {
-                SG_LOG(SG_GENERAL, SG_ALERT, "Failed to issue system call " << command );
-                exit(1);
+    } else if ( file_name.extension() == "zip" ) {
+        // inflate the .hgt member straight into memory - no temporary
+        // directory, so many files can be open at once
+        TGZipFile zip;
+        if ( !zip.open( file_name ) ) {
+            return false;
+        }
+
+        std::vector<std::string> members = zip.get_names();
+        bool found = false;
+        for ( unsigned int i = 0; i < members.size() && !found; i++ ) {
+            SGPath member( members[i] );
+            if ( member.lower_extension() == "hgt" ) {
+                found = zip.extract( members[i], buffer );
+                name  = member.file();
             }
         }
 
-        cout << "Loading HGT data file: " << file_name.str() << endl;
+        if ( !found ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: no hgt file in " << file_name.str() );
+            return false;
+        }
+
+        SG_LOG( SG_GENERAL, SG_INFO, "Loading HGT data file: " << file_name.str() << " ( " << name << " )" );
+    } else {
+        SG_LOG( SG_GENERAL, SG_INFO, "Loading HGT data file: " << file_name.str() );
         if ( (fd = gzopen( file_name.c_str(), "rb" )) == NULL ) {
             SGPath file_name_gz = file_name;
             file_name_gz.append( ".gz" );
             if ( (fd = gzopen( file_name_gz.c_str(), "rb" )) == NULL ) {
-                cout << "ERROR: opening " << file_name.str() << " or "
-                     << file_name_gz.str() << " for reading!" << endl;
+                SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: opening " << file_name.str() << " or "
+                        << file_name_gz.str() << " for reading!" );
                 return false;
             }
         }
     }
 
     // Determine originx/originy from file name
-    string name = file_name.file();
-    cout << "  Name = " << name << endl;
+    SG_LOG( SG_GENERAL, SG_INFO, "  Name = " << name );
     originy = atof( name.substr(1, 2).c_str() ) * 3600.0;
     if ( name.substr(0, 1) == "S" || name.substr(0, 1) == "s" ) {
         originy = -originy;
@@ -136,7 +134,7 @@ TGHgt::open ( const SGPath &f ) {
     if ( name.substr(3, 1) == "W" ||  name.substr(3, 1) == "w") {
         originx = -originx;
     }
-    cout << "  Origin = " << originx << ", " << originy << endl;
+    SG_LOG( SG_GENERAL, SG_INFO, "  Origin = " << originx << ", " << originy );
 
     return true;
 }
@@ -145,7 +143,11 @@ TGHgt::open ( const SGPath &f ) {
 // close an HGT file
 bool
 TGHgt::close () {
-    gzclose(fd);
+    if ( fd ) {
+        gzclose(fd);
+        fd = NULL;
+    }
+    std::vector<char>().swap( buffer );
     return true;
 }
 
@@ -166,16 +168,29 @@ TGHgt::load( ) {
         return false;
     }
 
-    short int *var;
+    // read the whole file at once, rather than a gzread per sample
+    size_t bytes = (size_t)size * size * sizeof(short);
+    if ( buffer.empty() ) {
+        if ( !fd ) {
+            return false;
+        }
+
+        buffer.resize( bytes );
+        if ( gzread( fd, &buffer[0], bytes ) != (int)bytes ) {
+            buffer.clear();
+            return false;
+        }
+    } else if ( buffer.size() < bytes ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "HGT data is too short for " << hgt_resolution << " arcsec" );
+        return false;
+    }
+
+    // big endian, north to south
+    const unsigned char *in = (const unsigned char *)&buffer[0];
     for ( int row = size - 1; row >= 0; --row ) {
         for ( int col = 0; col < size; ++col ) {
-            var = &data[col][row];
-            if ( gzread ( fd, var, sizeof(short) ) != sizeof(short) ) {
-                return false;
-            }
-            if ( sgIsLittleEndian() ) {
-                sgEndianSwap( (unsigned short int*)var);
-            }
+            data[col][row] = (short int)( ( in[0] << 8 ) | in[1] );
+            in += 2;
         }
     }
 
@@ -187,5 +202,4 @@ TGHgt::load( ) {
 TGHgt::~TGHgt() {
     // printf("class TGSrtmBase DEstructor called.\n");
     delete [] data;
-    delete [] output_data;
 }
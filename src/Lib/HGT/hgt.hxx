@@ -35,6 +35,7 @@
 #include <zlib.h>
 
 #include <string>
+#include <vector>
 
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/misc/sg_path.hxx>
@@ -49,11 +50,13 @@ private:
     // file pointer for input
     gzFile fd;
 
+    // the raw file, when it came out of a .zip
+    std::vector<char> buffer;
+
     int hgt_resolution;
     
     // pointers to the actual grid data allocated here
     short int (*data)[MAX_HGT_SIZE];
-    short int (*output_data)[MAX_HGT_SIZE];
 
 public:
 
@@ -65,7 +68,8 @@ public:
     // Destructor
     ~TGHgt();
 
-    // open an HGT file (use "-" if input is coming from stdin)
+    // open an HGT file (use "-" if input is coming from stdin).
+    // The .hgt in a .zip is inflated in memory.
     bool open ( const SGPath &file );
 
     // close an HGT file
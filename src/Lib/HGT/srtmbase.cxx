@@ -25,8 +25,10 @@
 #  include <config.h>
 #endif
 
+#include <cstdio>
 #include <iostream>
 #include <stdlib.h>
+#include <vector>
 #include <zlib.h>
 
 #include <simgear/compiler.h>
@@ -103,6 +105,10 @@ TGSrtmBase::write_area( const string& root, SGBucket& b ) {
     write_area_bin(array_file, start_x, start_y, min_x, min_y,
         span_x, span_y, col_step, row_step);
 
+    // a raw array file would shadow the one we just wrote
+    string raw_file = path + "/" + b.gen_index_str() + ".arr.raw";
+    ::remove( raw_file.c_str() );
+
     return true;
 }
 
@@ -132,6 +138,180 @@ bool TGSrtmBase::write_area_bin(const SGPath& aPath, int start_x, int start_y,
     return true;
 }
 
+bool
+TGSrtmBase::extract_area( SGBucket& b, TGSrtmArea& area ) const
+{
+    double min_x = ( b.get_center_lon() - 0.5 * b.get_width() ) * 3600.0;
+    double max_x = ( b.get_center_lon() + 0.5 * b.get_width() ) * 3600.0;
+
+    double min_y = ( b.get_center_lat() - 0.5 * b.get_height() ) * 3600.0;
+    double max_y = ( b.get_center_lat() + 0.5 * b.get_height() ) * 3600.0;
+
+    if ( ( min_x < originx )
+	 || ( max_x > originx + cols * col_step )
+	 || ( min_y < originy )
+	 || ( max_y > originy + rows * row_step ) ) {
+	return false;
+    }
+
+    int start_x = (int)((min_x - originx) / col_step);
+    int span_x = (int)(b.get_width() * 3600.0 / col_step);
+
+    int start_y = (int)((min_y - originy) / row_step);
+    int span_y = (int)(b.get_height() * 3600.0 / row_step);
+
+    if ( !has_non_zero_elev(start_x, span_x, start_y, span_y) ) {
+        return false;
+    }
+
+    area.min_x    = (int)min_x;
+    area.min_y    = (int)min_y;
+    area.cols     = span_x + 1;
+    area.col_step = (int)col_step;
+    area.rows     = span_y + 1;
+    area.row_step = (int)row_step;
+
+    area.samples.clear();
+    area.samples.reserve( area.cols * area.rows );
+    for ( int i = start_x; i <= start_x + span_x; ++i ) {
+	for ( int j = start_y; j <= start_y + span_y; ++j ) {
+            area.samples.push_back( height(i,j) );
+	}
+    }
+
+    return true;
+}
+
+// area files are read and written by several threads at once, and
+// sgReadError() is one flag for all of them - so every gzread and
+// gzwrite is checked here instead.  Same little endian layout as the
+// sgRead / sgWrite functions.
+static bool area_read_ints( gzFile fp, unsigned int n, int32_t* vals )
+{
+    if ( gzread( fp, vals, n * sizeof(int32_t) ) != (int)( n * sizeof(int32_t) ) ) {
+        return false;
+    }
+    if ( sgIsBigEndian() ) {
+        for ( unsigned int i = 0; i < n; ++i ) {
+            sgEndianSwap( (uint32_t*)&vals[i] );
+        }
+    }
+    return true;
+}
+
+static bool area_read_shorts( gzFile fp, unsigned int n, int16_t* vals )
+{
+    if ( gzread( fp, vals, n * sizeof(int16_t) ) != (int)( n * sizeof(int16_t) ) ) {
+        return false;
+    }
+    if ( sgIsBigEndian() ) {
+        for ( unsigned int i = 0; i < n; ++i ) {
+            sgEndianSwap( (uint16_t*)&vals[i] );
+        }
+    }
+    return true;
+}
+
+static bool area_write_ints( gzFile fp, unsigned int n, const int32_t* vals )
+{
+    std::vector<int32_t> swapped;
+    if ( sgIsBigEndian() ) {
+        swapped.assign( vals, vals + n );
+        for ( unsigned int i = 0; i < n; ++i ) {
+            sgEndianSwap( (uint32_t*)&swapped[i] );
+        }
+        vals = &swapped[0];
+    }
+    return gzwrite( fp, vals, n * sizeof(int32_t) ) == (int)( n * sizeof(int32_t) );
+}
+
+static bool area_write_shorts( gzFile fp, unsigned int n, const int16_t* vals )
+{
+    std::vector<int16_t> swapped;
+    if ( sgIsBigEndian() ) {
+        swapped.assign( vals, vals + n );
+        for ( unsigned int i = 0; i < n; ++i ) {
+            sgEndianSwap( (uint16_t*)&swapped[i] );
+        }
+        vals = &swapped[0];
+    }
+    return gzwrite( fp, vals, n * sizeof(int16_t) ) == (int)( n * sizeof(int16_t) );
+}
+
+bool TGSrtmBase::write_area_file( const SGPath& aPath, const TGSrtmArea& area )
+{
+    // write next to the file, then rename - so a crash never leaves a
+    // truncated area file to be merged with later
+    string tmp_file = aPath.str() + ".new";
+
+    gzFile fp;
+    if ( (fp = gzopen( tmp_file.c_str(), "wb9" )) == NULL ) {
+	    cout << "ERROR:  cannot open " << tmp_file << " for writing!" << endl;
+	    return false;
+    }
+
+    int32_t header[7];
+    header[0] = 0x54474152; // 'TGAR'
+    header[1] = area.min_x; header[2] = area.min_y;
+    header[3] = area.cols;  header[4] = area.col_step;
+    header[5] = area.rows;  header[6] = area.row_step;
+
+    bool ok = area_write_ints( fp, 7, header );
+
+    // one call for the whole area - not one per sample
+    if ( ok && !area.samples.empty() ) {
+        ok = area_write_shorts( fp, area.samples.size(), (const int16_t*)&area.samples[0] );
+    }
+
+    // gzclose flushes the last compressed block
+    if ( gzclose(fp) != Z_OK ) {
+        ok = false;
+    }
+
+    if ( !ok ) {
+        cout << "ERROR:  writing " << tmp_file << " failed!" << endl;
+        ::remove( tmp_file.c_str() );
+        return false;
+    }
+
+    if ( ::rename( tmp_file.c_str(), aPath.c_str() ) != 0 ) {
+        cout << "ERROR:  cannot rename " << tmp_file << " to " << aPath.str() << endl;
+        ::remove( tmp_file.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+bool TGSrtmBase::read_area_file( const SGPath& aPath, TGSrtmArea& area )
+{
+    gzFile fp;
+    if ( (fp = gzopen( aPath.c_str(), "rb" )) == NULL ) {
+        return false;
+    }
+
+    int32_t header[7];
+    if ( !area_read_ints( fp, 7, header ) || header[0] != 0x54474152 ) {
+        gzclose(fp);
+        return false;
+    }
+
+    area.min_x = header[1]; area.min_y    = header[2];
+    area.cols  = header[3]; area.col_step = header[4];
+    area.rows  = header[5]; area.row_step = header[6];
+
+    if ( area.cols <= 0 || area.rows <= 0 ) {
+        gzclose(fp);
+        return false;
+    }
+
+    area.samples.resize( area.cols * area.rows );
+    bool ok = area_read_shorts( fp, area.samples.size(), (int16_t*)&area.samples[0] );
+    gzclose(fp);
+
+    return ok;
+}
+
 bool
 TGSrtmBase::has_non_zero_elev (int start_x, int span_x,
                           int start_y, int span_y) const
@@ -30,9 +30,31 @@
 
 #include <simgear/compiler.h>
 
+#include <string>
+#include <vector>
+
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/misc/sg_dir.hxx>
 
+// SRTM marks missing samples with this
+#define SRTM_VOID (-32768)
+
+// the samples of one bucket, as they are written to the .arr.gz :
+// column by column, starting at the lower left hand corner
+struct TGSrtmArea {
+    int min_x, min_y;
+    int cols, col_step;
+    int rows, row_step;
+
+    std::vector<short> samples;
+
+    bool same_grid( const TGSrtmArea& other ) const {
+        return ( min_x == other.min_x && min_y == other.min_y &&
+                 cols == other.cols && col_step == other.col_step &&
+                 rows == other.rows && row_step == other.row_step );
+    }
+};
+
 class TGSrtmBase {
 
 protected:
@@ -64,6 +86,16 @@ public:
         int start_x, int start_y, int min_x, int min_y,
     int span_x, int span_y, int col_step, int row_step);
 
+    // copy out the area covered by the specified bucket, without
+    // writing anything.  Returns false if the bucket is not fully
+    // inside the data, or is all zero elevation.  Quiet, so it can be
+    // used from many threads at once.
+    bool extract_area( SGBucket& b, TGSrtmArea& area ) const;
+
+    // write / read back an area as a .arr.gz
+    static bool write_area_file( const SGPath& aPath, const TGSrtmArea& area );
+    static bool read_area_file( const SGPath& aPath, TGSrtmArea& area );
+
     // Informational methods
     inline double get_originx() const { return originx; }
     inline double get_originy() const { return originy; }
@@ -0,0 +1,209 @@
+// zipfile.cxx -- in memory extraction of zip archive members
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <cstring>
+#include <fstream>
+
+#include <zlib.h>
+
+#include <simgear/debug/logstream.hxx>
+
+#include "zipfile.hxx"
+
+#define ZIP_LOCAL_SIG       (0x04034b50)
+#define ZIP_CENTRAL_SIG     (0x02014b50)
+#define ZIP_END_SIG         (0x06054b50)
+
+#define ZIP_LOCAL_SIZE      (30)
+#define ZIP_CENTRAL_SIZE    (46)
+#define ZIP_END_SIZE        (22)
+
+#define ZIP_METHOD_STORED   (0)
+#define ZIP_METHOD_DEFLATED (8)
+
+// zip fields are little endian, whatever the host
+static unsigned int zip16( const unsigned char* p )
+{
+    return p[0] | ( p[1] << 8 );
+}
+
+static unsigned long zip32( const unsigned char* p )
+{
+    return (unsigned long)p[0] | ( (unsigned long)p[1] << 8 ) | ( (unsigned long)p[2] << 16 ) | ( (unsigned long)p[3] << 24 );
+}
+
+bool TGZipFile::open( const SGPath& file )
+{
+    archive.clear();
+    entries.clear();
+
+    std::ifstream in( file.c_str(), std::ios::in | std::ios::binary );
+    if ( !in.is_open() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "TGZipFile - cannot open " << file.str() );
+        return false;
+    }
+
+    in.seekg( 0, std::ios::end );
+    std::streamoff len = in.tellg();
+    in.seekg( 0, std::ios::beg );
+
+    if ( len < ZIP_END_SIZE ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "TGZipFile - " << file.str() << " is not a zip file" );
+        return false;
+    }
+
+    archive.resize( (size_t)len );
+    if ( !in.read( (char*)&archive[0], len ) ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "TGZipFile - error reading " << file.str() );
+        archive.clear();
+        return false;
+    }
+
+    // the end of central directory record is last - followed only by
+    // a comment of up to 64k
+    size_t end = 0;
+    bool   found = false;
+    size_t size = archive.size();
+    size_t lowest = ( size > ZIP_END_SIZE + 0xffff ) ? size - ZIP_END_SIZE - 0xffff : 0;
+
+    for ( size_t pos = size - ZIP_END_SIZE + 1; pos-- > lowest; ) {
+        if ( zip32( &archive[pos] ) == ZIP_END_SIG ) {
+            end   = pos;
+            found = true;
+            break;
+        }
+    }
+
+    if ( !found ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "TGZipFile - " << file.str() << " has no central directory" );
+        archive.clear();
+        return false;
+    }
+
+    unsigned int  numEntries = zip16( &archive[end + 10] );
+    unsigned long dirOffset  = zip32( &archive[end + 16] );
+    size_t        pos = dirOffset;
+
+    for ( unsigned int i = 0; i < numEntries; i++ ) {
+        if ( pos + ZIP_CENTRAL_SIZE > size || zip32( &archive[pos] ) != ZIP_CENTRAL_SIG ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "TGZipFile - " << file.str() << " has a corrupt central directory" );
+            archive.clear();
+            entries.clear();
+            return false;
+        }
+
+        unsigned int nameLen    = zip16( &archive[pos + 28] );
+        unsigned int extraLen   = zip16( &archive[pos + 30] );
+        unsigned int commentLen = zip16( &archive[pos + 32] );
+
+        Entry e;
+        e.method       = zip16( &archive[pos + 10] );
+        e.comp_size    = zip32( &archive[pos + 20] );
+        e.size         = zip32( &archive[pos + 24] );
+        e.local_offset = zip32( &archive[pos + 42] );
+
+        if ( pos + ZIP_CENTRAL_SIZE + nameLen > size ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "TGZipFile - " << file.str() << " has a corrupt central directory" );
+            archive.clear();
+            entries.clear();
+            return false;
+        }
+        e.name.assign( (const char*)&archive[pos + ZIP_CENTRAL_SIZE], nameLen );
+
+        entries.push_back( e );
+        pos += ZIP_CENTRAL_SIZE + nameLen + extraLen + commentLen;
+    }
+
+    return true;
+}
+
+std::vector<std::string> TGZipFile::get_names() const
+{
+    std::vector<std::string> names;
+
+    for ( unsigned int i = 0; i < entries.size(); i++ ) {
+        names.push_back( entries[i].name );
+    }
+
+    return names;
+}
+
+bool TGZipFile::extract( const std::string& name, std::vector<char>& out ) const
+{
+    const Entry* e = NULL;
+    for ( unsigned int i = 0; i < entries.size(); i++ ) {
+        if ( entries[i].name == name ) {
+            e = &entries[i];
+            break;
+        }
+    }
+
+    if ( !e ) {
+        return false;
+    }
+
+    // the local header repeats the name, and may have a different extra field
+    size_t pos = e->local_offset;
+    if ( pos + ZIP_LOCAL_SIZE > archive.size() || zip32( &archive[pos] ) != ZIP_LOCAL_SIG ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "TGZipFile - corrupt local header for " << name );
+        return false;
+    }
+
+    size_t dataStart = pos + ZIP_LOCAL_SIZE + zip16( &archive[pos + 26] ) + zip16( &archive[pos + 28] );
+    if ( dataStart + e->comp_size > archive.size() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "TGZipFile - truncated data for " << name );
+        return false;
+    }
+
+    out.resize( e->size );
+
+    if ( e->method == ZIP_METHOD_STORED ) {
+        if ( e->size ) {
+            memcpy( &out[0], &archive[dataStart], e->size );
+        }
+        return true;
+    } else if ( e->method != ZIP_METHOD_DEFLATED ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "TGZipFile - unsupported compression method " << e->method << " for " << name );
+        return false;
+    }
+
+    // raw deflate stream - no zlib header
+    z_stream zs;
+    memset( &zs, 0, sizeof(zs) );
+    if ( inflateInit2( &zs, -MAX_WBITS ) != Z_OK ) {
+        return false;
+    }
+
+    zs.next_in   = (Bytef*)&archive[dataStart];
+    zs.avail_in  = e->comp_size;
+    zs.next_out  = (Bytef*)( e->size ? &out[0] : NULL );
+    zs.avail_out = e->size;
+
+    int ret = inflate( &zs, Z_FINISH );
+    inflateEnd( &zs );
+
+    if ( ret != Z_STREAM_END || zs.total_out != e->size ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "TGZipFile - error inflating " << name );
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,57 @@
+// zipfile.hxx -- in memory extraction of zip archive members
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License as
+// published by the Free Software Foundation; either version 2 of the
+// License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+
+#ifndef _ZIPFILE_HXX
+#define _ZIPFILE_HXX
+
+#include <string>
+#include <vector>
+
+#include <simgear/misc/sg_path.hxx>
+
+// Minimal reader for the zip archives SRTM tiles are distributed in.
+// The archive is read into memory, and members are inflated with zlib -
+// no temporary directory, and no external unzip.  Only stored and
+// deflated members are supported ( no zip64, no encryption ).
+class TGZipFile {
+
+public:
+
+    // read the archive, and its central directory
+    bool open( const SGPath& file );
+
+    // names of all members, in archive order
+    std::vector<std::string> get_names() const;
+
+    // inflate a member
+    bool extract( const std::string& name, std::vector<char>& out ) const;
+
+private:
+
+    struct Entry {
+        std::string     name;
+        unsigned int    method;
+        unsigned long   comp_size;
+        unsigned long   size;
+        unsigned long   local_offset;
+    };
+
+    std::vector<unsigned char>  archive;
+    std::vector<Entry>          entries;
+};
+
+#endif // _ZIPFILE_HXX
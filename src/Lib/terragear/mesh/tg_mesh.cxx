@@ -1,4 +1,9 @@
+#include <set>
+
 #include <simgear/debug/logstream.hxx>
+#include <simgear/timing/timestamp.hxx>
+
+#include <terragear/tg_profile.hxx>
 
 #include "tg_mesh.hxx"
 
@@ -50,16 +55,39 @@ tgPolygonSet tgMesh::join( unsigned int priority, const tgPolygonSetMeta& meta )
     return meshArrangement.join( priority, meta );
 }
 
+const char* tgMesh::getPhaseName( tgMeshPhase phase )
+{
+    static const char* names[TG_MESH_NUM_PHASES] = {
+        "clipPolys",
+        "arrangePolys",
+        "cleanArrangement",
+        "constrainedTriangulate",
+        "prepareTds"
+    };
+
+    return names[phase];
+}
+
 void tgMesh::generate( void )
 {
+    SGTimeStamp start;
+
+    for ( unsigned int i=0; i<TG_MESH_NUM_PHASES; i++ ) {
+        phaseTime[i] = 0.0;
+    }
+
     // mesh generation from polygon soup :)
     if ( !meshArrangement.empty() ) {
         // Step 1 - clip polys against one another - highest priority first ( on top )
+        start.stamp();
         meshArrangement.clipPolys( b, clipBucket );
+        phaseTime[TG_MESH_PHASE_CLIP] = (SGTimeStamp::now() - start).toSecs();
 
         // Step 2 - insert clipped polys into an arrangement.
         // From this point on, we don't need the individual polygons.
+        start.stamp();
         meshArrangement.arrangePolys();
+        phaseTime[TG_MESH_PHASE_ARRANGE] = (SGTimeStamp::now() - start).toSecs();
 
         // step 3 - clean up the arrangement - cluster nodes that are too close - don't want
         // really small triangles blowing up the refined mesh.
@@ -68,13 +96,23 @@ void tgMesh::generate( void )
         // we should remember be checking the delta in interiorPoints to see if we have 
         // polys that don't meat this criteria.
         // and if it doesn't - what do we do?
-        meshArrangement.cleanArrangement( lock );
+        start.stamp();
+        meshArrangement.cleanArrangement();
+        phaseTime[TG_MESH_PHASE_CLEAN] = (SGTimeStamp::now() - start).toSecs();
 
         // step 4 - create constrained triangulation with arrangement edges as the constraints
+        start.stamp();
         meshTriangulation.constrainedTriangulateWithEdgeModification( meshArrangement );
+        phaseTime[TG_MESH_PHASE_TRIANGULATE] = (SGTimeStamp::now() - start).toSecs();
 
         // step 5 - prepare for serialization
+        start.stamp();
         meshTriangulation.prepareTds();
+        phaseTime[TG_MESH_PHASE_PREPARE] = (SGTimeStamp::now() - start).toSecs();
+
+        for ( unsigned int i=0; i<TG_MESH_NUM_PHASES; i++ ) {
+            tgProfile::addTime( getPhaseName( (tgMeshPhase)i ), phaseTime[i] );
+        }
     } else {
         SG_LOG(SG_GENERAL, SG_ALERT, "no source polys" );        
     }
@@ -99,137 +137,81 @@ bool tgMesh::loadStage1( const std::string& basePath, const SGBucket& bucket )
     return isOcean;
 }
 
-tgArray* tgMesh::loadElevationArray( const std::string& demBase, const SGBucket& bucket )
-{
-    std::string arrayPath = demBase + "/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
-    tgArray* array = new tgArray();
-
-    if ( array->open(arrayPath) ) {
-        SG_LOG(SG_GENERAL, SG_INFO, "Opened Array file " << arrayPath);
+void tgMesh::calcElevation( const std::string& demBase, unsigned int numThreads )
+{
+    // this tile, and every tile around it.  north and south rows may
+    // hold more than 3 buckets, as bucket widths change with latitude.
+    std::vector<SGBucket> buckets;
+    buckets.push_back( b );
+    b.siblings( -1,  1, buckets );
+    b.siblings(  0,  1, buckets );
+    b.siblings(  1,  1, buckets );
+    b.siblings( -1, -1, buckets );
+    b.siblings(  0, -1, buckets );
+    b.siblings(  1, -1, buckets );
+    buckets.push_back( b.sibling( -1, 0 ) );
+    buckets.push_back( b.sibling(  1, 0 ) );
+
+    // the arrays are shared with the neighbours, and with stage 1 - our
+    // references are released when dems goes out of scope
+    std::vector<meshElevationSource> dems;
+    std::set<long>                   seen;
+
+    for ( unsigned int i=0; i<buckets.size(); i++ ) {
+        if ( seen.insert( buckets[i].gen_index() ).second ) {
+            dems.push_back( meshElevationSource( buckets[i], tgArrayCache::instance().get( demBase, buckets[i] ) ) );
+        }
+    }
 
-        array->parse( bucket );
-        array->remove_voids( );
-        array->close();
-    } else {
-        SG_LOG(SG_GENERAL, SG_INFO, "Could not open Array file " << arrayPath);
+    if ( !dems[0].array ) {
+        SG_LOG(SG_GENERAL, SG_INFO, "tgMesh::calcElevation - no dem for " << b.gen_index_str() );
     }
 
-    return array;
+    meshTriangulation.calcElevations( dems, numThreads );
 }
 
-
-void tgMesh::calcElevation( const std::string& basePath )
+// isOcean is set if stage 1 and 2 have no triangulation for the tile.
+// returns false if the stage 2 triangulation is corrupt, or missing for
+// a tile stage 1 triangulated
+bool tgMesh::loadStage2( const std::string& stage1Path, const std::string& stage2Path, const SGBucket& bucket, bool& isOcean )
 {
-    // load this, and surrounding tile elevation data
-    std::vector<tgArray*> northArrays;
-    std::vector<SGBucket> northBuckets;
-    b.siblings( -1, 1, northBuckets );
-    b.siblings(  0, 1, northBuckets );
-    b.siblings(  1, 1, northBuckets );
-    for ( unsigned int i=0; i<northBuckets.size(); i++ ) {
-        northArrays.push_back( loadElevationArray( basePath, northBuckets[i] ) );
-    }
-
-    std::vector<tgArray*> southArrays;
-    std::vector<SGBucket> southBuckets;
-    b.siblings( -1, -1, southBuckets );
-    b.siblings(  0, -1, southBuckets );
-    b.siblings(  1, -1, southBuckets );
-    for ( unsigned int i=0; i<southBuckets.size(); i++ ) {
-        southArrays.push_back( loadElevationArray( basePath, southBuckets[i] ) );
-    }
-
-    tgArray* eastArray;
-    SGBucket eastBucket = b.sibling( 1, 0);
-    eastArray = loadElevationArray( basePath, eastBucket );
-
-    tgArray* westArray;
-    SGBucket westBucket = b.sibling(-1, 0);
-    westArray = loadElevationArray( basePath, westBucket );
-
-    tgArray* tileArray = loadElevationArray( basePath, b );
-
-    // first calc the elevation of all nodes in this tile.
-    meshTriangulation.calcTileElevations( tileArray );
-
-#if 0 // shared edges - is it needed?
-
-    // first, calc the average at the 4 corners - 
-    // each corner has 3 contributing tiles
-    // on the north and south borders, we can get different sized arrays of 
-    // buckets, depending on the widths
-    // east and west are constant.
-    unsigned int nwIndexes[2], neIndexes[2], swIndexes[2], seIndexes[2];
-    switch( northArrays.size() ) {
-        // north buckets are the same width as us
-        case 3:
-            nwIndexes[0] = 0;
-            nwIndexes[1] = 1;
-            neIndexes[0] = 1;
-            neIndexes[1] = 2;
-            break;
-
-        default:
-            SG_LOG(SG_GENERAL, SG_ALERT, "Unhandled array size " << northArrays.size() );
-            exit(0);
-            break;
-    }
-
-    switch( southArrays.size() ) {
-        // north buckets are the same width as us
-        case 3:
-            swIndexes[0] = 0;
-            swIndexes[1] = 1;
-            seIndexes[0] = 1;
-            seIndexes[1] = 2;
-            break;
+    std::string bucketPath = "/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
+    b = bucket;
+    isOcean = false;
+
+    // the stage 2 triangulation has the matched shared edges
+    switch ( meshTriangulation.loadTds( stage2Path + bucketPath ) ) {
+        case tgMeshTriangulation::TDS_CORRUPT:
+            return false;
+
+        case tgMeshTriangulation::TDS_EMPTY:
+            // stage 2 writes nothing for ocean - check stage 1 agrees
+            if ( meshTriangulation.loadTds( stage1Path + bucketPath ) != tgMeshTriangulation::TDS_EMPTY ) {
+                SG_LOG(SG_GENERAL, SG_ALERT, "tgMesh::loadStage2 - " << b.gen_index_str() << " has a stage 1 triangulation, but none from stage 2" );
+                return false;
+            }
+            isOcean = true;
+            return true;
 
         default:
-            SG_LOG(SG_GENERAL, SG_ALERT, "Unhandled array size " << northArrays.size() );
-            exit(0);
             break;
     }
 
-    #define SG_BUCKET_SW    (0)
-    #define SG_BUCKET_SE    (1)
-    #define SG_BUCKET_NE    (2)
-    #define SG_BUCKET_NW    (3)
-    SGGeod nwCorner = b.get_corner( SG_BUCKET_NW );
-    SGGeod neCorner = b.get_corner( SG_BUCKET_NE );
-    SGGeod seCorner = b.get_corner( SG_BUCKET_SE );
-    SGGeod swCorner = b.get_corner( SG_BUCKET_SW );
-
-    double elv1, elv2, elv3, elv4;
-    elv1 = northArrays[nwIndexes[0]]->altitude_from_grid( nwCorner.getLongitudeDeg() * 3600.0, nwCorner.getLatitudeDeg() * 3600.0 );
-    elv2 = northArrays[nwIndexes[1]]->altitude_from_grid( nwCorner.getLongitudeDeg() * 3600.0, nwCorner.getLatitudeDeg() * 3600.0 );
-    elv3 = westArray->altitude_from_grid( nwCorner.getLongitudeDeg() * 3600.0, nwCorner.getLatitudeDeg() * 3600.0 ); 
-    elv4 = tileArray->altitude_from_grid( nwCorner.getLongitudeDeg() * 3600.0, nwCorner.getLatitudeDeg() * 3600.0 );
-
-    SG_LOG(SG_GENERAL, SG_ALERT, "4 elevations calculated: " << elv1 << ", " << elv2 << ", " << elv3 << ", " << elv4 << ", "  );
-
-    // then the shared edges
+    // the stage 1 arrangement tells us what material each triangle is
+    meshArrangement.loadArrangement( stage1Path + bucketPath );
+    meshTriangulation.markDomains( meshArrangement );
 
-
-    // then the interior
-#endif
-
-    // now we can calc the face normals
+    return true;
 }
 
-void tgMesh::loadStage2( const std::string& basePath, const SGBucket& bucket )
+void tgMesh::calcFaceNormals( void )
 {
-    // load the stage2 triangulation as a mesh
-    std::string bucketPath = basePath + "/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
-    b = bucket;
-
-    // now load the stage1 triangulation ( and lookup locations on the edges )
-    meshSurface.loadTriangulation( basePath, bucket );
+    meshTriangulation.calcNormals();
 }
 
-
-void tgMesh::calcFaceNormals( void )
+bool tgMesh::saveBtg( const std::string& filePath ) const
 {
-
+    return meshTriangulation.saveBtg( filePath, meshArrangement );
 }
 
 
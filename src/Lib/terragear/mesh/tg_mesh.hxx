@@ -5,8 +5,8 @@
 
 #include <terragear/polygon_set/tg_polygon_def.hxx>
 #include <terragear/polygon_set/tg_polygon_set.hxx>
-#include <terragear/tg_array.hxx>
-#include <terragear/tg_mutex.hxx>
+#include <terragear/tg_array_cache.hxx>
+#include <terragear/tg_shapefile_cache.hxx>
 
 #include "tg_mesh_def.hxx"
 
@@ -16,22 +16,30 @@
 
 // next steps :
 //
-// 1) tg-construct stage3
-// 2) load stage 2 & arrangement stage1
-// 3) face normals
-// 4) point normals
-// 5) texture
-// 6) output
-// 7) yay
+// 1) elevation in stage 2
+// 2) normals across shared edges
+
+// the steps of tgMesh::generate
+typedef enum {
+    TG_MESH_PHASE_CLIP,
+    TG_MESH_PHASE_ARRANGE,
+    TG_MESH_PHASE_CLEAN,
+    TG_MESH_PHASE_TRIANGULATE,
+    TG_MESH_PHASE_PREPARE,
+    TG_MESH_NUM_PHASES
+} tgMeshPhase;
 
 class tgMesh
 {
 public:
-    tgMesh() : meshArrangement(this), meshTriangulation(this), meshSurface(this) {};
+    tgMesh() : meshArrangement(this), meshTriangulation(this), meshSurface(this) {
+        for ( unsigned int i=0; i<TG_MESH_NUM_PHASES; i++ ) {
+            phaseTime[i] = 0.0;
+        }
+    };
 
     void initDebug( const std::string& dbgRoot );
     void initPriorities( const std::vector<std::string>& priorityNames );
-    void setLock( tgMutex* l ) { lock = l; }
     void clipAgainstBucket( const SGBucket& bucket );
 
     void clear( void );
@@ -45,11 +53,16 @@ public:
 
     void generate( void );
 
+    // wall clock time ( seconds ) of each step of the last generate()
+    double getPhaseTime( tgMeshPhase phase ) const { return phaseTime[phase]; }
+    static const char* getPhaseName( tgMeshPhase phase );
+
     bool loadStage1( const std::string& path, const SGBucket& b );
-    void calcElevation( const std::string& basePath );
+    void calcElevation( const std::string& demBase, unsigned int numThreads );
 
-    void loadStage2( const std::string& path, const SGBucket& b );
+    bool loadStage2( const std::string& stage1Path, const std::string& stage2Path, const SGBucket& b, bool& isOcean );
     void calcFaceNormals( void );
+    bool saveBtg( const std::string& filePath ) const;
 
     void toShapefiles( const char* dataset ) const;
 
@@ -63,8 +76,6 @@ public:
     friend class tgMeshTriangulation;
 
 private:
-    tgArray* loadElevationArray( const std::string& demBase, const SGBucket& bucket );
-
     void saveIncidentFaces( const std::string& path, const char* layer, const std::vector<meshTriVertexHandle>& vertexes ) const;
 
     typedef enum {
@@ -75,6 +86,7 @@ private:
     } MeshLayerFields;
 
     GDALDataset* openDatasource( const std::string& datasource_name ) const;
+    void         closeDatasource( GDALDataset* poDS ) const;
     OGRLayer*    openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, MeshLayerFields lf, const char* layer_name ) const;
 
     tgMeshArrangement               meshArrangement;
@@ -82,8 +94,8 @@ private:
     tgMeshPolyhedralSurface         meshSurface;
     SGBucket                        b;
     bool                            clipBucket;
-    tgMutex*                        lock;
     std::string                     debugPath;
+    double                          phaseTime[TG_MESH_NUM_PHASES];
 };
 
 #endif /* __TG_MESH_HXX__ */
\ No newline at end of file
@@ -139,7 +139,7 @@ void tgMeshArrangement::clipPolys( const SGBucket& b, bool clipBucket )
             }
 
 #if DEBUG_MESH_CLIPPING
-            GDALClose( poDs );
+            tgPolygonSet::closeDatasource( poDs );
 #endif
 
             poly_it->setPs( current.getPs() );
@@ -150,27 +150,31 @@ void tgMeshArrangement::clipPolys( const SGBucket& b, bool clipBucket )
 
 
 // insert the polygon segments into an arrangement
+// the arrangement belongs to this tile alone - no locking needed.
+// all segments go in with a single aggregated ( sweep line ) insert,
+// rather than a zone walk for every segment.
 void tgMeshArrangement::arrangePolys( void )
 {
+    std::vector<meshArrSegment> arrSegs;
+
     for ( unsigned int i=0; i<numPriorities; i++ ) {
         std::vector<tgPolygonSet>::iterator poly_it;
         for ( poly_it = sourcePolys[i].begin(); poly_it != sourcePolys[i].end(); poly_it++ ) {
             // only add to arrangement if we have a result
             if ( !poly_it->isEmpty() ) {
                 poly_it->calcInteriorPoints();
-                arrangementInsert( poly_it );
+                collectSegments( poly_it, arrSegs );
             }
         }
     }
 
+    CGAL::insert( meshArr, arrSegs.begin(), arrSegs.end() );
+
     // then add the elevation points
-    //mesh->lock->lock();
     std::vector<cgalPoly_Point>::iterator spit;
     for ( spit = sourcePoints.begin(); spit != sourcePoints.end(); spit++ ) {
         CGAL::insert_point( meshArr, toMeshArrPoint(*spit) );
-        //CGAL::insert_point( meshArr, *spit );
     }
-    //mesh->lock->unlock();
 
 #if DEBUG_MESH_CLEANING    
     toShapefile( mesh->getDebugPath(), "arr_raw" );
@@ -179,24 +183,45 @@ void tgMeshArrangement::arrangePolys( void )
     meshPointLocation.attach( meshArr );
 }
 
+// add a face to the lookup table.  If two query points land in the same
+// face, the topology was altered too much during cleaning - the first
+// one wins.  returns false if the face was already in the table
+bool tgMeshArrangement::addFaceMeta( meshArrFaceConstHandle f, const cgalPoly_Point& qp, const tgPolygonSetMeta& meta )
+{
+    if ( metaIndex.is_defined( f ) ) {
+        SG_LOG( SG_GENERAL, SG_DEBUG, "tgMeshArrangement::addFaceMeta - face already has metadata - query point " << qp );
+        return false;
+    }
+
+    metaIndex[f] = metaLookup.size();
+    metaLookup.push_back( tgMeshFaceMeta( f, qp, meta ) );
+
+    return true;
+}
+
 // lookup a face in the arrangement from a face in the arrangement
 // seems silly, but we are looking for just faces that are in the 
 // lookup table.
 meshArrFaceConstHandle tgMeshArrangement::findPolyFace( meshArrFaceConstHandle f ) const
 {
     meshArrFaceConstHandle face = (meshArrFaceConstHandle)NULL;
-    bool found = false;
 
-    for ( unsigned int i=0; i<metaLookup.size() && !found; i++ ) {
-        if ( metaLookup[i].face == f ) {
-            face = f;
-            found = true;
-        }
+    if ( metaIndex.is_defined( f ) ) {
+        face = f;
     }
 
     return face;
 }
 
+const tgPolygonSetMeta* tgMeshArrangement::getFaceMeta( meshArrFaceConstHandle f ) const
+{
+    if ( !metaIndex.is_defined( f ) ) {
+        return NULL;
+    }
+
+    return &metaLookup[metaIndex[f]].meta;
+}
+
 // lookup a face in the arrangement from a point in the triangulation
 // need to convert the point from EPICK to EPECK
 meshArrFaceConstHandle tgMeshArrangement::findMeshFace( const meshTriPoint& tPt ) const
@@ -239,21 +264,16 @@ void tgMeshArrangement::toMeshArrSegs( const std::vector<cgalPoly_Segment>& inSe
     }
 }
 
-void tgMeshArrangement::arrangementInsert( const std::vector<tgPolygonSet>::iterator pit )
+void tgMeshArrangement::collectSegments( const std::vector<tgPolygonSet>::iterator pit, std::vector<meshArrSegment>& arrSegs ) const
 {
-    // insert the polygon boundaries ( not holes ) 
+    // collect the polygon boundaries ( not holes ) 
     // TODO - maybe we need holes, too?  - Haven't seen a need yet.
     std::vector<cgalPoly_Segment> segs;
-    std::vector<meshArrSegment>   arrSegs;
 
     pit->toSegments( segs, false );
 
     // convert poly segs to arr segs
     toMeshArrSegs( segs, arrSegs );
-
-    mesh->lock->lock();
-    CGAL::insert( meshArr, arrSegs.begin(), arrSegs.end() );
-    mesh->lock->unlock();
 }
 
 void tgMeshArrangement::loadArrangement( const std::string& path )
@@ -261,17 +281,42 @@ void tgMeshArrangement::loadArrangement( const std::string& path )
     // the arrangement is a set of polygons - with a query point so we can find the face 
     // once the arrangement is set.
     std::vector<meshArrSegment> edgelist;
+    std::vector<tgMeshFaceMeta> faces;
     std::string filePath;
 
     filePath = path + "/stage1_arrangement_faces.shp";
-    fromShapefile( filePath, edgelist );
+    fromShapefile( filePath, edgelist, faces );
 
     // add edges to arrangement
     meshArr.clear();
+    metaLookup.clear();
+    metaIndex.clear();
 
-    mesh->lock->lock();
     CGAL::insert( meshArr, edgelist.begin(), edgelist.end() );
-    mesh->lock->unlock();
+
+    // rebuild the face lookup from the saved query points
+    meshPointLocation.attach( meshArr );
+
+    unsigned int numLost = 0;
+    for ( unsigned int i=0; i<faces.size(); i++ ) {
+        CGAL::Object           obj = meshPointLocation.locate( toMeshArrPoint(faces[i].point) );
+        meshArrFaceConstHandle f;
+
+        if ( CGAL::assign(f, obj) && !f->is_unbounded() ) {
+            if ( !addFaceMeta( f, faces[i].point, faces[i].meta ) ) {
+                SG_LOG( SG_GENERAL, SG_INFO, "tgMeshArrangement::loadArrangement - query point " << faces[i].point << " shares a face with an earlier one" );
+                numLost++;
+            }
+        } else {
+            SG_LOG( SG_GENERAL, SG_INFO, "tgMeshArrangement::loadArrangement - query point " << faces[i].point << " not in a bounded face" );
+            numLost++;
+        }
+    }
+
+    // every saved face must get its own meta back
+    if ( numLost ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgMeshArrangement::loadArrangement - " << path << " : " << numLost << " of " << faces.size() << " saved faces lost their meta" );
+    }
 
     // save it so we can see it...
     // toShapefile( mesh->getDebugPath(), "stage2_arrangement" );
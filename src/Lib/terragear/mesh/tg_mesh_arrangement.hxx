@@ -1,6 +1,8 @@
 #ifndef __TG_MESH_ARRANGEMENT_HXX__
 #define __TG_MESH_ARRANGEMENT_HXX__
 
+#include <CGAL/Unique_hash_map.h>
+
 #include "tg_mesh.hxx"
 
 // forward declarations
@@ -35,6 +37,21 @@ public:
 typedef std::list<meshArrVertexHandle>    tgSharpAngleSeries;
 typedef std::vector<tgSharpAngleSeries>   tgSharpAngleSeriesList;
 
+////////////////////// snap rounding /////////////////////////////////
+typedef std::vector<meshArrPoint>         tgSnapRoundPolyline;
+typedef std::vector<tgSnapRoundPolyline>  tgSnapRoundPolylineList;
+
+// iterated snap rounding of interior disjoint segments ( arrangement edges ).
+// out gets one polyline of pixel centers per segment.
+// returns false if it didn't converge.
+bool tgSnapRound( const std::vector<meshArrSegment>& segs, double pixelSize, tgSnapRoundPolylineList& out );
+
+// the same, with CGAL::snap_rounding_2 - serialized, as it isn't threadsafe
+void tgSnapRoundCgal( const std::vector<meshArrSegment>& segs, double pixelSize, tgSnapRoundPolylineList& out );
+
+// the center of the pixel p is in
+meshArrPoint tgSnapRoundPoint( const meshArrPoint& p, double pixelSize );
+
 /////////////////////////////////////////////////////////////////////////////////////////
 
 class tgMeshArrangement
@@ -51,6 +68,7 @@ public:
     void clear( void ) {
         meshArr.clear();
         metaLookup.clear();
+        metaIndex.clear();
 
         // clear source polys
         for ( unsigned int i=0; i<numPriorities; i++ ) {
@@ -69,7 +87,7 @@ public:
     tgPolygonSet join( unsigned int priority, const tgPolygonSetMeta& meta );
 
     void clipPolys( const SGBucket& b, bool clipBucket );
-    void cleanArrangement( SGMutex* lock );
+    void cleanArrangement( void );
     void arrangePolys( void );
 
     void loadArrangement( const std::string& path );
@@ -79,10 +97,14 @@ public:
 
     meshArrFaceConstHandle findPolyFace( meshArrFaceConstHandle f ) const;
     meshArrFaceConstHandle findMeshFace( const meshArrPoint& pt) const;
+
+    // metadata of the source polygon of a face - NULL if it has none
+    const tgPolygonSetMeta* getFaceMeta( meshArrFaceConstHandle f ) const;
     meshArrFaceConstHandle findMeshFace( const meshTriPoint& pt) const;
 
 private:
-    void arrangementInsert( std::vector<tgPolygonSet>::iterator pit );
+    void collectSegments( std::vector<tgPolygonSet>::iterator pit, std::vector<meshArrSegment>& arrSegs ) const;
+    bool addFaceMeta( meshArrFaceConstHandle f, const cgalPoly_Point& qp, const tgPolygonSetMeta& meta );
 
     bool isEdgeVertex( meshArrVertexConstHandle v );
     void doClusterEdges( const tgCluster& cluster );
@@ -96,12 +118,12 @@ private:
     void doRemoveSmallAreas( void );
 
     void doRemoveAntenna( void );
-    void doRemoveSpikes( SGMutex* lock );
+    void doRemoveSpikes( void );
     void insertAngleIntoSeries( tgSharpAngleSeriesList& saSeriesList, const tgSharpAngle& a );
     void addSharpAngle( std::vector<tgSharpAngle>& angles, meshArrVertexHandle v1, meshArrVertexHandle v2, meshArrVertexHandle v3, double angle );
     void findSpikes( meshArrFaceHandle f, std::vector<tgSharpAngle>& angles, std::vector<meshArrHalfedgeHandle>& dups );
 
-    void doSnapRound( SGMutex* lock );
+    void doSnapRound( void );
 
     meshArrPoint toMeshArrPoint( const meshTriPoint& tPoint ) const {
         return meshArrPoint( tPoint.x(), tPoint.y() );
@@ -123,7 +145,7 @@ private:
     // Main APIs
 public:
     void toShapefile( const std::string& datasource, const char* layer ) const;
-    void fromShapefile( const std::string& filename, std::vector<meshArrSegment>& segments ) const;
+    void fromShapefile( const std::string& filename, std::vector<meshArrSegment>& segments, std::vector<tgMeshFaceMeta>& faces ) const;
 
 private:
     // helper - save a segment
@@ -136,7 +158,7 @@ private:
     void toShapefile( OGRLayer* poLayer, const meshArrFaceConstHandle f, const cgalPoly_Point& qp, const char* desc ) const;
 
     // helper read a face
-    void fromShapefile( const OGRFeatureDefn* poFDefn, OGRCoordinateTransformation* poCT, OGRFeature* poFeature, std::vector<meshArrSegment>& segments ) const;
+    void fromShapefile( const OGRFeatureDefn* poFDefn, OGRCoordinateTransformation* poCT, OGRFeature* poFeature, std::vector<meshArrSegment>& segments, std::vector<tgMeshFaceMeta>& faces ) const;
 
 private:
     tgMesh*                         mesh;
@@ -149,6 +171,10 @@ private:
     meshArrangement                 meshArr;
     meshArrLandmarks_pl             meshPointLocation;
     std::vector<tgMeshFaceMeta>     metaLookup;
+
+    // arrangement face -> index into metaLookup.  markDomains looks up
+    // a face per triangulation region, so this needs to be O(1)
+    CGAL::Unique_hash_map<meshArrFaceConstHandle, int> metaIndex;
 };
 
 #endif /* __TG_MESH_ARRANGEMENT_HXX__ */
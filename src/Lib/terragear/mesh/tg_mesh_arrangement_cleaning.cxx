@@ -9,6 +9,12 @@
 
 #define DEBUG_MESH_CLEANING (0)
 
+// clustering and snap rounding run on every tile thread at once - the
+// lazy exact numbers they build on must use thread safe reference counts
+#ifdef CGAL_HAS_NO_THREADS
+#error "tgMeshArrangement::cleanArrangement requires CGAL with thread support"
+#endif
+
 void tgMeshArrangement::doClusterEdges( const tgCluster& cluster )
 {
     meshArrEdgeConstIterator eit;
@@ -60,7 +66,7 @@ bool tgMeshArrangement::isEdgeVertex( meshArrVertexConstHandle v )
 
 // Use Lloyd Voronoi relaxation to cluster and 
 // remove nodes too close to one another.
-void tgMeshArrangement::cleanArrangement( SGMutex* lock )
+void tgMeshArrangement::cleanArrangement( void )
 {
     SG_LOG( SG_GENERAL, SG_DEBUG, "tgMeshArrangement::cleanArrangment : start" );
 
@@ -77,10 +83,9 @@ void tgMeshArrangement::cleanArrangement( SGMutex* lock )
         nodes.push_back( tgClusterNode( toCpPoint(vit->point()), isEdgeVertex(vit) ) );
     }
 
-    // create the cluster : not thread safe
-    lock->lock();
+    // create the cluster - tgCluster keeps no shared state, so tiles
+    // are cleaned in parallel
     tgCluster cluster( nodes, 0.0000025, mesh->debugPath );
-    lock->unlock();
 
 #if DEBUG_MESH_CLEANING
     cluster.toShapefile( mesh->getDebugPath().c_str(), "cluster" );
@@ -102,7 +107,7 @@ void tgMeshArrangement::cleanArrangement( SGMutex* lock )
 
     // clean 3 - remove skinny faces
     // doRemoveSmallAreas();
-    // doRemoveSpikes( lock );
+    // doRemoveSpikes();
 
     // clean 3
     // clustering may have moved an edge too close to a vertex - 
@@ -111,7 +116,7 @@ void tgMeshArrangement::cleanArrangement( SGMutex* lock )
     // getting them back is tricky.
     // maybe mark edges as 'special?
     // let's try without, first.
-    doSnapRound( lock );
+    doSnapRound();
 
     // clean 4
     doRemoveAntenna();
@@ -159,7 +164,7 @@ void tgMeshArrangement::cleanArrangement( SGMutex* lock )
                     if (CGAL::assign(f, obj)) {
                         // point is in face - set the material, and the query point, so we can save it
                         if ( !f->is_unbounded() ) {
-                            metaLookup.push_back( tgMeshFaceMeta(f, queryPoints[i], pit->getMeta() ) );
+                            addFaceMeta( f, queryPoints[i], pit->getMeta() );
                         } else {
                             SG_LOG( SG_GENERAL, SG_INFO, "tgMesh::tgMesh - POINT " << i << " queryPoint found on unbounded FACE!" );
 #if DEBUG_MESH_CLEANING
@@ -182,7 +187,7 @@ void tgMeshArrangement::cleanArrangement( SGMutex* lock )
     }
 
 #if DEBUG_MESH_CLEANING
-    GDALClose( poDs );    
+    mesh->closeDatasource( poDs );
 #endif
 
     SG_LOG( SG_GENERAL, SG_DEBUG, "tgMesh::cleanArrangment Complete" );
@@ -211,7 +216,7 @@ void tgMeshArrangement::cleanArrangement( SGMutex* lock )
         }
 
         // close datasource
-        GDALClose( poDS );    
+        mesh->closeDatasource( poDS );
     }
 #endif
 }
@@ -50,7 +50,7 @@ void tgMeshArrangement::toShapefile( const std::string& datasource, const char*
     }
     
     // close datasource
-    GDALClose( poDS );    
+    mesh->closeDatasource( poDS );
 }
 
 void tgMeshArrangement::toShapefile( OGRLayer* poLayer, const meshArrFaceConstHandle f, const cgalPoly_Point& qp, const char* desc ) const
@@ -141,7 +141,7 @@ void tgMeshArrangement::toShapefile( OGRLayer* poLayer, const meshArrPoint& pt,
 }
 
 
-void tgMeshArrangement::fromShapefile( const OGRFeatureDefn* poFDefn, OGRCoordinateTransformation* poCT, OGRFeature* poFeature, std::vector<meshArrSegment>& segments ) const
+void tgMeshArrangement::fromShapefile( const OGRFeatureDefn* poFDefn, OGRCoordinateTransformation* poCT, OGRFeature* poFeature, std::vector<meshArrSegment>& segments, std::vector<tgMeshFaceMeta>& faces ) const
 {
     OGRGeometry *poGeometry = poFeature->GetGeometryRef();
     if (poGeometry == NULL) {
@@ -166,6 +166,15 @@ void tgMeshArrangement::fromShapefile( const OGRFeatureDefn* poFDefn, OGRCoordin
 
             polySet.toSegments( cpSegs, false );
             toMeshArrSegs(cpSegs, segments);
+
+            // remember the query point - the face handle is looked up
+            // once the arrangement has been built
+            int lonIdx = poFDefn->GetFieldIndex( "qp_lon" );
+            int latIdx = poFDefn->GetFieldIndex( "qp_lat" );
+            if ( lonIdx >= 0 && latIdx >= 0 ) {
+                cgalPoly_Point qp( poFeature->GetFieldAsDouble( lonIdx ), poFeature->GetFieldAsDouble( latIdx ) );
+                faces.push_back( tgMeshFaceMeta( (meshArrFaceConstHandle)NULL, qp, polySet.getMeta() ) );
+            }
             break;
         }
         
@@ -182,11 +191,9 @@ void tgMeshArrangement::fromShapefile( const OGRFeatureDefn* poFDefn, OGRCoordin
     return;
 }
 
-void tgMeshArrangement::fromShapefile( const std::string& filename, std::vector<meshArrSegment>& segments ) const
+void tgMeshArrangement::fromShapefile( const std::string& filename, std::vector<meshArrSegment>& segments, std::vector<tgMeshFaceMeta>& faces ) const
 {
-    GDALAllRegister();
-    
-    GDALDataset* poDS = (GDALDataset*)GDALOpenEx( filename.c_str(), GDAL_OF_VECTOR, NULL, NULL, NULL );
+    GDALDataset* poDS = tgShapefileCache::instance().acquireForRead( filename );
     if( poDS == NULL )
     {
         SG_LOG( SG_GENERAL, SG_DEBUG, "Failed opening datasource " << filename.c_str() );
@@ -215,12 +222,12 @@ void tgMeshArrangement::fromShapefile( const std::string& filename, std::vector<
         OGRFeature* poFeature = NULL;
         while ( ( poFeature = poLayer->GetNextFeature()) != NULL )
         {
-            fromShapefile( poFDefn, poCT, poFeature, segments );
+            fromShapefile( poFDefn, poCT, poFeature, segments, faces );
             OGRFeature::DestroyFeature( poFeature );
         }
         
         OCTDestroyCoordinateTransformation ( poCT );
     }
     
-    GDALClose( poDS );    
+    mesh->closeDatasource( poDS );
 }
@@ -66,7 +66,7 @@ bool tgMeshArrangement::insetFaceEmpty( meshArrPolygon& p )
                 toShapefile( poInsetLayer, meshArrSegment( src, trg ), "seg" );
             }
         }
-        GDALClose( poDs );
+        mesh->closeDatasource( poDs );
 #endif
 
     }
@@ -138,7 +138,7 @@ bool tgMeshArrangement::removeFace( meshArrFaceHandle f )
                 char desc[32];
                 sprintf(desc, "deledge_%d", i );
                 toShapefile( poDelEdgeLayer, meshArrSegment( src, trg ), desc );
-                GDALClose( poDs );
+                mesh->closeDatasource( poDs );
 #endif
 
                 SG_LOG( SG_GENERAL, LOG_SMALLAREAS, "tgMeshArrangement::removeFace - remove edge " << i << " of " << delEdges.size() );
@@ -174,7 +174,7 @@ void tgMeshArrangement::doRemoveSmallAreas( void )
                 OGRLayer*    poSmallLayer = mesh->openLayer( poDs, wkbLineString25D, tgMesh::LAYER_FIELDS_NONE, "SmallAreas" );
                 sprintf( desc, "%lf", CGAL::to_double(poly.area() ) );
                 tgPolygonSet::toDebugShapefile( poSmallLayer, poly, desc );
-                GDALClose( poDs );
+                mesh->closeDatasource( poDs );
 #endif
 
                 SG_LOG( SG_GENERAL, LOG_SMALLAREAS, "tgMeshArrangement::doRemoveSmallAreas poly area is " << poly.area() << " which is less than " << MIN_AREA_THRESHOLD );
@@ -189,7 +189,7 @@ void tgMeshArrangement::doRemoveSmallAreas( void )
                         OGRLayer*    poIssueLayer = mesh->openLayer( poDs, wkbLineString25D, tgMesh::LAYER_FIELDS_NONE, "IssueAreas" );
                         sprintf( desc, "%lf", CGAL::to_double(poly.area() ) );
                         tgPolygonSet::toDebugShapefile( poIssueLayer, poly, "cant remove" );
-                        GDALClose( poDs );
+                        mesh->closeDatasource( poDs );
                     }
 #endif
 
@@ -203,7 +203,7 @@ void tgMeshArrangement::doRemoveSmallAreas( void )
                 OGRLayer*    poLargeLayer = mesh->openLayer( poDs, wkbLineString25D, tgMesh::LAYER_FIELDS_NONE, "LargeAreas" );
                 sprintf( desc, "%lf", CGAL::to_double(poly.area() ) );
                 tgPolygonSet::toDebugShapefile( poLargeLayer, poly, desc );
-                GDALClose( poDs );
+                mesh->closeDatasource( poDs );
 
                 SG_LOG( SG_GENERAL, LOG_SMALLAREAS, "tgMeshArrangement::doRemoveSmallAreas poly area is " << poly.area() << " which is greater than " << MIN_AREA_THRESHOLD );
 #endif
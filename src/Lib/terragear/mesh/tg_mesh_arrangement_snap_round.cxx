@@ -1,43 +1,296 @@
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
 #include <CGAL/Snap_rounding_traits_2.h>
 #include <CGAL/Snap_rounding_2.h>
 
 #include <simgear/debug/logstream.hxx>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
 #include "tg_mesh.hxx"
 
-// snap rounding looks like it causes more issues than it solves.
-// currently unused.
+// snap rounding runs at the end of cleanArrangement, after clustering,
+// to get the edges a minimum distance away from every vertex.
 // a few issues:
-// 1 - cgal translates points to the center of the pixel.  
+// 1 - cgal translates points to the center of the pixel.
 //     I wish we could snap to the sw corner of the pixel.
 //     We need to translate all points sw by 1/2 pixel size after snap rounding
 // 2 - it looks like if we are on the pixel border, we sometimes translate
 //     'the wrong way' making tile edge in the incorrect position.
-//     I found this when tile matching broke for just a few tiles 
+//     I found this when tile matching broke for just a few tiles
 //     ( I beleive this is due to fp roundoff errors )
-// 3 - CGAL snaprounding is apparently not threadsafe - I had to protect the whole 
-//     procedure with a mutex.
+// 3 - CGAL snaprounding is not threadsafe - the hot pixel ordering keeps
+//     the current segment direction in a static.  We had to protect the
+//     whole procedure with the mesh mutex, serializing every tile.
+//     Now we do our own iterated snap rounding below.  It keeps all of its
+//     state on the stack, so tiles are snap rounded in parallel.
+//     CGAL is still the fallback if ours doesn't converge, and the
+//     reference tgSnapRoundTest compares against.
+
+// Iterated snap rounding ( Halperin / Packer ), same parameters as the
+// CGAL::snap_rounding_2 call we used to make.
+// The arrangement already holds every segment end point and intersection
+// as a vertex, so the hot pixels are simply the pixels of the ( non
+// isolated ) vertices.  Each edge is rerouted through the centers of the
+// hot pixels it crosses, then each link of the result is checked again,
+// until no link crosses a hot pixel it doesn't end in.
+
+#define SR_PIXEL_SIZE   (0.0000002)
+#define SR_OFFSET       (0.0000001)
+//#define SR_OFFSET       (0)
 
-// instead of snaprounding, we remove small areas, then small angles ( spikes )
-// not as simple to code, but hopefully doesn't cause as many issues.
+// hot pixels are bucketed on a grid of SR_CELL_PIXELS x SR_CELL_PIXELS pixels
+#define SR_CELL_PIXELS  (256)
 
-typedef CGAL::Snap_rounding_traits_2<meshArrKernel> srTraits;
-typedef std::list<meshArrSegment>                   srSegmentList;
-typedef std::vector<meshArrPoint>                   srPointList;
-typedef std::list<meshArrPoint>                     srPolyline;
-typedef std::list<srPolyline>                       srPolylineList;
+// iterated snap rounding converges quickly - bail out if it doesn't
+#define SR_MAX_PASSES   (16)
 
-void tgMeshArrangement::doSnapRound( SGMutex* lock )
+typedef std::pair<long, long>                   srPixel;
+typedef std::vector<srPixel>                    srPolyline;
+typedef std::map< srPixel, srPolyline >         srPixelGrid;
+typedef meshArrKernel::Segment_2                srSegment;
+typedef meshArrKernel::Iso_rectangle_2          srRectangle;
+
+static long srFloorDiv( long a, long b )
 {
-    srSegmentList  srInputSegs;
-    srPolylineList srOutputSegs;
-    srPointList    srInputPoints;
+    return ( a >= 0 ) ? a / b : -( ( -a + b - 1 ) / b );
+}
 
-    meshArrEdgeIterator eit;
-    for ( eit = meshArr.edges_begin(); eit != meshArr.edges_end(); ++eit ) {
-        srInputSegs.push_back( eit->curve() );
+// the hot pixels of one arrangement
+class srHotPixels
+{
+public:
+    srHotPixels( double ps ) : pixelSize( ps ) {}
+
+    // pixels and centers are computed exactly as CGAL's Snap_2 does, so a
+    // point on a pixel border goes the same way in both
+    srPixel toPixel( const meshArrPoint& p ) const {
+        return srPixel( (long)floor( CGAL::to_double( p.x() / meshArr_FT( pixelSize ) ) ),
+                        (long)floor( CGAL::to_double( p.y() / meshArr_FT( pixelSize ) ) ) );
+    }
+
+    meshArrPoint toCenter( const srPixel& px ) const {
+        meshArr_FT ps( pixelSize );
+
+        return meshArrPoint( meshArr_FT( (double)px.first  ) * ps + ps / meshArr_FT( 2.0 ),
+                             meshArr_FT( (double)px.second ) * ps + ps / meshArr_FT( 2.0 ) );
+    }
+
+    void add( const meshArrPoint& p ) {
+        srPixel px = toPixel( p );
+        if ( pixels.insert( px ).second ) {
+            grid[toCell( px )].push_back( px );
+        }
+    }
+
+    // append the hot pixels crossed by seg, other than src and trg, in
+    // order from src to trg.  returns the number of pixels appended
+    unsigned int route( const meshArrSegment& seg, const srPixel& src, const srPixel& trg, srPolyline& out ) const;
+
+private:
+    srPixel toCell( const srPixel& px ) const {
+        return srPixel( srFloorDiv( px.first, SR_CELL_PIXELS ), srFloorDiv( px.second, SR_CELL_PIXELS ) );
+    }
+
+    bool crosses( const srSegment& seg, const srPixel& px ) const {
+        meshArrPoint c = toCenter( px );
+        meshArr_FT   h = meshArr_FT( pixelSize ) / meshArr_FT( 2.0 );
+        srRectangle  r( meshArrPoint( c.x() - h, c.y() - h ), meshArrPoint( c.x() + h, c.y() + h ) );
+
+        return CGAL::do_intersect( seg, r );
+    }
+
+    double              pixelSize;
+    std::set<srPixel>   pixels;
+    srPixelGrid         grid;
+};
+
+unsigned int srHotPixels::route( const meshArrSegment& seg, const srPixel& src, const srPixel& trg, srPolyline& out ) const
+{
+    std::vector< std::pair<double, srPixel> > found;
+
+    if ( src == trg ) {
+        return 0;
+    }
+
+    srSegment ks( seg.source(), seg.target() );
+
+    double sx = CGAL::to_double( seg.source().x() );
+    double sy = CGAL::to_double( seg.source().y() );
+    double tx = CGAL::to_double( seg.target().x() );
+    double ty = CGAL::to_double( seg.target().y() );
+    double dx = tx - sx;
+    double dy = ty - sy;
+
+    double xmin = std::min( sx, tx );
+    double xmax = std::max( sx, tx );
+    double cellSize = SR_CELL_PIXELS * pixelSize;
+
+    // visit the grid cells along the segment - one column at a time,
+    // with a pixel of slack for round off
+    long cx0 = srFloorDiv( (long)floor( xmin / pixelSize ) - 1, SR_CELL_PIXELS );
+    long cx1 = srFloorDiv( (long)floor( xmax / pixelSize ) + 1, SR_CELL_PIXELS );
+
+    for ( long cx = cx0; cx <= cx1; cx++ ) {
+        double lo = std::max( xmin, cx * cellSize );
+        double hi = std::min( xmax, ( cx + 1 ) * cellSize );
+        double ylo, yhi;
+
+        if ( hi < lo ) {
+            hi = lo;
+        }
+
+        if ( dx == 0.0 ) {
+            ylo = sy;
+            yhi = ty;
+        } else {
+            ylo = sy + ( lo - sx ) * dy / dx;
+            yhi = sy + ( hi - sx ) * dy / dx;
+        }
+        if ( yhi < ylo ) {
+            std::swap( ylo, yhi );
+        }
+
+        long cy0 = srFloorDiv( (long)floor( ylo / pixelSize ) - 1, SR_CELL_PIXELS );
+        long cy1 = srFloorDiv( (long)floor( yhi / pixelSize ) + 1, SR_CELL_PIXELS );
+
+        for ( long cy = cy0; cy <= cy1; cy++ ) {
+            srPixelGrid::const_iterator git = grid.find( srPixel( cx, cy ) );
+            if ( git == grid.end() ) {
+                continue;
+            }
+
+            const srPolyline& cell = git->second;
+            for ( unsigned int i=0; i<cell.size(); i++ ) {
+                const srPixel& px = cell[i];
+
+                if ( px != src && px != trg && crosses( ks, px ) ) {
+                    // order by distance along the segment
+                    double px_x = ( px.first  + 0.5 ) * pixelSize;
+                    double px_y = ( px.second + 0.5 ) * pixelSize;
+
+                    found.push_back( std::make_pair( ( px_x - sx ) * dx + ( px_y - sy ) * dy, px ) );
+                }
+            }
+        }
+    }
+
+    std::sort( found.begin(), found.end() );
+    for ( unsigned int i=0; i<found.size(); i++ ) {
+        out.push_back( found[i].second );
     }
 
+    return found.size();
+}
+
+bool tgSnapRound( const std::vector<meshArrSegment>& segs, double pixelSize, tgSnapRoundPolylineList& out )
+{
+    srHotPixels                 hotPixels( pixelSize );
+    std::vector<srPolyline>     polylines;
+
+    for ( unsigned int i=0; i<segs.size(); i++ ) {
+        hotPixels.add( segs[i].source() );
+        hotPixels.add( segs[i].target() );
+    }
+
+    // snap round : route each segment through the hot pixels it crosses
+    for ( unsigned int i=0; i<segs.size(); i++ ) {
+        srPixel    src = hotPixels.toPixel( segs[i].source() );
+        srPixel    trg = hotPixels.toPixel( segs[i].target() );
+        srPolyline pl;
+
+        pl.push_back( src );
+        hotPixels.route( segs[i], src, trg, pl );
+        pl.push_back( trg );
+
+        polylines.push_back( pl );
+    }
+
+    // iterate : the links between pixel centers may cross other hot pixels
+    int  pass    = 0;
+    bool changed = true;
+    while ( changed && pass < SR_MAX_PASSES ) {
+        changed = false;
+
+        for ( unsigned int i=0; i<polylines.size(); i++ ) {
+            const srPolyline& cur = polylines[i];
+            srPolyline        pl;
+
+            pl.push_back( cur[0] );
+            for ( unsigned int j=1; j<cur.size(); j++ ) {
+                meshArrSegment link( hotPixels.toCenter( cur[j-1] ), hotPixels.toCenter( cur[j] ) );
+
+                if ( hotPixels.route( link, cur[j-1], cur[j], pl ) ) {
+                    changed = true;
+                }
+                pl.push_back( cur[j] );
+            }
+
+            polylines[i].swap( pl );
+        }
+
+        pass++;
+    }
+
+    if ( changed ) {
+        return false;
+    }
+
+    out.clear();
+    for ( unsigned int i=0; i<polylines.size(); i++ ) {
+        tgSnapRoundPolyline pl;
+
+        for ( unsigned int j=0; j<polylines[i].size(); j++ ) {
+            pl.push_back( hotPixels.toCenter( polylines[i][j] ) );
+        }
+        out.push_back( pl );
+    }
+
+    return true;
+}
+
+typedef CGAL::Snap_rounding_traits_2<meshArrKernel>     srTraits;
+typedef std::list<meshArrSegment>                       srSegmentList;
+typedef std::list< std::list<meshArrPoint> >            srPolylineList;
+
+// CGAL snap rounding keeps state in statics - one at a time
+static SGMutex srCgalLock;
+
+void tgSnapRoundCgal( const std::vector<meshArrSegment>& segs, double pixelSize, tgSnapRoundPolylineList& out )
+{
+    srSegmentList   srInputSegs( segs.begin(), segs.end() );
+    srPolylineList  srOutputSegs;
+
+    {
+        SGGuard<SGMutex> g( srCgalLock );
+        CGAL::snap_rounding_2<srTraits, srSegmentList::const_iterator, srPolylineList>(srInputSegs.begin(), srInputSegs.end(), srOutputSegs, pixelSize, true, false, 5);
+    }
+
+    out.clear();
+    for ( srPolylineList::const_iterator plit = srOutputSegs.begin(); plit != srOutputSegs.end(); ++plit ) {
+        out.push_back( tgSnapRoundPolyline( plit->begin(), plit->end() ) );
+    }
+}
+
+meshArrPoint tgSnapRoundPoint( const meshArrPoint& p, double pixelSize )
+{
+    srHotPixels hotPixels( pixelSize );
+
+    return hotPixels.toCenter( hotPixels.toPixel( p ) );
+}
+
+void tgMeshArrangement::doSnapRound( void )
+{
+    std::vector<meshArrSegment> srInputSegs;
+    std::vector<meshArrPoint>   srInputPoints;
+    tgSnapRoundPolylineList     polylines;
+
     meshArrVertexIterator vit;
     for ( vit = meshArr.vertices_begin(); vit != meshArr.vertices_end(); ++vit ) {
         if ( vit->is_isolated() ) {
@@ -45,31 +298,31 @@ void tgMeshArrangement::doSnapRound( SGMutex* lock )
         }
     }
 
-    // snap rounding notes:
-    // 1) doesn't appear to be threadsafe
-    // 2) no way to define the origin of snapping.  so if a point is at 0,0, and pixel size is 1, new point will be at 0.5, 0.5.
-    //    We don't want this, so we translate the entire dataset back by 1/2 pixel size so 0,0 is still 0,0
-
-#define SR_OFFSET  (0.0000001)
-//#define SR_OFFSET  (0)
+    meshArrEdgeIterator eit;
+    for ( eit = meshArr.edges_begin(); eit != meshArr.edges_end(); ++eit ) {
+        srInputSegs.push_back( eit->curve() );
+    }
 
-    lock->lock();
-    CGAL::snap_rounding_2<srTraits, srSegmentList::const_iterator, srPolylineList>
-    (srInputSegs.begin(), srInputSegs.end(), srOutputSegs, 0.0000002, true, false, 5);
-    lock->unlock();
+    if ( !tgSnapRound( srInputSegs, SR_PIXEL_SIZE, polylines ) ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgMeshArrangement::doSnapRound - not converged after " << SR_MAX_PASSES << " passes - using CGAL snap rounding" );
+        tgSnapRoundCgal( srInputSegs, SR_PIXEL_SIZE, polylines );
+    }
 
+    // snap rounding has no way to define the origin of snapping.  so if a point is at 0,0, and pixel size is 1,
+    // new point will be at 0.5, 0.5. We don't want this, so we translate the entire dataset back by 1/2 pixel
+    // size so 0,0 is still 0,0
     std::vector<meshArrSegment> segs;
 
-    srPolylineList::const_iterator iter1;
-    for (iter1 = srOutputSegs.begin(); iter1 != srOutputSegs.end(); ++iter1) {
-        srPolyline::const_iterator itSrc = iter1->begin();
-        srPolyline::const_iterator itTrg = itSrc; itTrg++;
-        while (itTrg != iter1->end()) {
-            meshArrPoint src( itSrc->x() - SR_OFFSET, itSrc->y() - SR_OFFSET );
-            meshArrPoint trg( itTrg->x() - SR_OFFSET, itTrg->y() - SR_OFFSET );
+    for ( unsigned int i=0; i<polylines.size(); i++ ) {
+        const tgSnapRoundPolyline& pl = polylines[i];
+
+        for ( unsigned int j=1; j<pl.size(); j++ ) {
+            if ( pl[j-1] != pl[j] ) {
+                meshArrPoint src( pl[j-1].x() - SR_OFFSET, pl[j-1].y() - SR_OFFSET );
+                meshArrPoint trg( pl[j].x()   - SR_OFFSET, pl[j].y()   - SR_OFFSET );
 
-            segs.push_back( meshArrSegment(src, trg) );
-            itSrc++; itTrg++;
+                segs.push_back( meshArrSegment(src, trg) );
+            }
         }
     }
 
@@ -77,11 +330,9 @@ void tgMeshArrangement::doSnapRound( SGMutex* lock )
     CGAL::insert( meshArr, segs.begin(), segs.end() );
 
     // snap round the isolated vertices, too
-    srTraits srT;
     for ( unsigned int i=0; i<srInputPoints.size(); i++ ) {
-        meshArr_FT x, y;
-        srT.snap_2_object()(srInputPoints[i], 0.0000002, x, y);
+        meshArrPoint center = tgSnapRoundPoint( srInputPoints[i], SR_PIXEL_SIZE );
 
-        CGAL::insert_point( meshArr, meshArrPoint( x - SR_OFFSET, y - SR_OFFSET ) );
+        CGAL::insert_point( meshArr, meshArrPoint( center.x() - SR_OFFSET, center.y() - SR_OFFSET ) );
     }
-}
\ No newline at end of file
+}
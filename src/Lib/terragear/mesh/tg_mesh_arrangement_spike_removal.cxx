@@ -147,7 +147,7 @@ void tgMeshArrangement::insertAngleIntoSeries( tgSharpAngleSeriesList& saSeriesL
     }
 }
 
-void tgMeshArrangement::doRemoveSpikes( SGMutex* lock )
+void tgMeshArrangement::doRemoveSpikes( void )
 {
     std::vector<tgSharpAngle>           angles;
     std::vector<meshArrHalfedgeHandle>  dups;
@@ -170,7 +170,7 @@ void tgMeshArrangement::doRemoveSpikes( SGMutex* lock )
 
             toShapefile( poLayer, meshArrSegment( dups[i]->source()->point(), dups[i]->target()->point() ), "dupe" );
         }
-        GDALClose( poDs );
+        mesh->closeDatasource( poDs );
 #endif
 
         for ( unsigned int i=0; i<dups.size(); i++ ) {
@@ -200,7 +200,7 @@ void tgMeshArrangement::doRemoveSpikes( SGMutex* lock )
             toShapefile( poPointLayer, angles[i].v2->point(), "v2" );
             toShapefile( poPointLayer, angles[i].v3->point(), "v3" );
         }
-        GDALClose( poDs );
+        mesh->closeDatasource( poDs );
 #endif
 
         // now we need to check if we should combine sharp angles into a series
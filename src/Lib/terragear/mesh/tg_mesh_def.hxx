@@ -22,6 +22,8 @@
 // it will be based on EPECK.  We will create a new point class that can be 
 // constrained to a tile edge - useful during clustering and snap rounding.
 
+#include <stdint.h>
+
 #include <CGAL/Cartesian.h>
 
 // terragear custom kernel
@@ -102,6 +104,10 @@ struct tgMeshArrFaceInfo
         return arrMeshFace != (meshArrFaceConstHandle)NULL;
     }
 
+    meshArrFaceConstHandle getFace( void ) const {
+        return arrMeshFace;
+    }
+
 private:
     // internal arrangement / mesh lookup
     meshArrFaceConstHandle arrMeshFace;
@@ -166,6 +172,40 @@ typedef CGAL::Delaunay_mesh_size_criteria_2<meshTriCDT>
 typedef CGAL::Delaunay_mesher_2<meshTriCDT, meshCriteria>                                   meshRefinerWithEdgeModification;
 typedef CGAL::Delaunay_mesher_no_edge_refinement_2<meshTriCDT, meshCriteria>                meshRefinerWithoutEdgeModification;
 
+// binary stage container for the triangulation data structure.
+// the file is a header, followed by all vertex records, then all face records.
+// records are fixed size and written in native byte order, so the file can
+// be mmapped and walked in place when the next stage loads it.
+#define MESH_TDS_MAGIC          (0x54475444)    // 'TGTD'
+#define MESH_TDS_VERSION        (1)
+#define MESH_TDS_BYTE_ORDER     (0x01020304)
+
+struct meshTdsHeader {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    byteOrder;          // reads back swapped if written on other endian machine
+    uint32_t    headerSize;
+    uint32_t    numVertices;        // finite vertices only - id 0 is always the infinite vertex
+    uint32_t    numFaces;
+    uint32_t    vertexRecordSize;
+    uint32_t    faceRecordSize;
+};
+
+struct meshTdsVertexRecord {
+    int32_t     id;
+    int32_t     reserved;           // keep the doubles 8 byte aligned
+    double      x;
+    double      y;
+    double      z;
+};
+
+struct meshTdsFaceRecord {
+    int32_t     fid;
+    int32_t     vid[3];
+    int32_t     nid[3];
+    int32_t     con;                // bit i is set if edge i is constrained
+};
+
 // finally, we need a face info structure to read from the shapefile metadata - and set in the TDS for triangulation serialization
 class meshVertexInfo {
 public:
@@ -215,11 +255,22 @@ public:
         }
     }
 
+    void toRecord( meshTdsVertexRecord& rec ) const {
+        rec.id       = id;
+        rec.reserved = 0;
+        rec.x        = pt.x();
+        rec.y        = pt.y();
+        rec.z        = elevation;
+    }
+
     int          getId( void ) const    { return id; }
     meshTriPoint getPoint( void ) const { return pt; }
     double       getX( void ) const     { return pt.x(); }
     double       getY( void ) const     { return pt.y(); }
     double       getZ( void ) const     { return elevation; }
+    void         setZ( double z )       { elevation = z; }
+
+    meshTriVertexHandle getHandle( void ) const { return vh; }
 
 private:
     int                 id;         // our id
@@ -256,6 +307,19 @@ public:
         }
     }
 
+    void toRecord( meshTdsFaceRecord& rec ) const {
+        rec.fid = fid;
+        rec.con = 0;
+
+        for ( unsigned int i=0; i<3; i++ ) {
+            rec.vid[i] = vid[i];
+            rec.nid[i] = nid[i];
+            if ( con[i] ) {
+                rec.con |= (1 << i);
+            }
+        }
+    }
+
     void setNeighbors( CGAL::Unique_hash_map<meshTriTDS::Face_handle, int>& map ) {
         if ( fh != meshTriTDS::Face_handle() ) {
             for ( unsigned int i=0; i<3; i++ ) {
@@ -299,6 +363,10 @@ public:
         return fid;
     }
 
+    meshTriFaceHandle getHandle( void ) const {
+        return fh;
+    }
+
     int getVid( int i ) const {
         return vid[i];
     }
@@ -4,22 +4,18 @@
 
 #include "tg_mesh.hxx"
 
+// datasources stay open in the shapefile cache - give them back with
+// closeDatasource, never GDALClose
 GDALDataset* tgMesh::openDatasource( const std::string& datasource_name ) const
 {
-    GDALDataset*    poDS = NULL;
-    GDALDriver*     poDriver = NULL;
-    const char*     format_name = "ESRI Shapefile";
-
     SG_LOG( SG_GENERAL, SG_DEBUG, "Open Datasource: " << datasource_name );
 
-    GDALAllRegister();
-
-    poDriver = GetGDALDriverManager()->GetDriverByName( format_name );
-    if ( poDriver ) {    
-        poDS = poDriver->Create( datasource_name.c_str(), 0, 0, 0, GDT_Unknown, NULL );
-    }
+    return tgShapefileCache::instance().acquire( datasource_name );
+}
 
-    return poDS;
+void tgMesh::closeDatasource( GDALDataset* poDS ) const
+{
+    tgShapefileCache::instance().release( poDS );
 }
 
 OGRLayer* tgMesh::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, MeshLayerFields lf, const char* layer_name ) const
@@ -31,7 +27,7 @@ OGRLayer* tgMesh::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, MeshLayer
         exit(0);
     }
 
-    poLayer = poDS->GetLayerByName( layer_name );
+    poLayer = tgShapefileCache::instance().getLayer( poDS, layer_name );
     if ( !poLayer ) {
         SG_LOG(SG_GENERAL, SG_DEBUG, "tgMesh::openLayer: layer " << layer_name << " doesn't exist - create" );
 
@@ -39,6 +35,11 @@ OGRLayer* tgMesh::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, MeshLayer
         srs.SetWellKnownGeogCS("WGS84");
 
         poLayer = poDS->CreateLayer( layer_name, &srs, lt, NULL );
+        if ( !poLayer ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "Creation of layer '" << layer_name << "' failed" );
+            return NULL;
+        }
+        tgShapefileCache::instance().addLayer( poDS, layer_name, poLayer );
 
         OGRFieldDefn descriptionField( "tg_desc", OFTString );
         descriptionField.SetWidth( 128 );
@@ -49,14 +50,14 @@ OGRLayer* tgMesh::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, MeshLayer
         if ( lf == LAYER_FIELDS_ARR ) {
             OGRFieldDefn qp_lon( "qp_lon", OFTReal );
             qp_lon.SetWidth( 24 );
-            qp_lon.SetPrecision( 3 );        
+            qp_lon.SetPrecision( 16 );        
             if( poLayer->CreateField( &qp_lon ) != OGRERR_NONE ) {
                 SG_LOG( SG_GENERAL, SG_ALERT, "Creation of field 'qp_lon' failed" );
             }
 
             OGRFieldDefn qp_lat( "qp_lat", OFTReal );
             qp_lat.SetWidth( 24 );
-            qp_lat.SetPrecision( 3 );        
+            qp_lat.SetPrecision( 16 );        
             if( poLayer->CreateField( &qp_lat ) != OGRERR_NONE ) {
                 SG_LOG( SG_GENERAL, SG_ALERT, "Creation of field 'qp_lat' failed" );
             }
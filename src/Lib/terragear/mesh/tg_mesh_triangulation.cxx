@@ -240,17 +240,6 @@ void tgMeshTriangulation::markDomains( const tgMeshArrangement& arr )
     }
 }
 
-void tgMeshTriangulation::calcTileElevations( const tgArray* tileArray )
-{
-    // set point info for the 2d triangulation
-    SG_LOG(SG_GENERAL, SG_INFO, "Current elevations " );
-
-    for (meshTriCDT::Finite_vertices_iterator vit = meshTriangulation.finite_vertices_begin(); vit != meshTriangulation.finite_vertices_end(); vit++ ) {
-        vit->info().setElevation( tileArray->altitude_from_grid( vit->point().x() * 3600.0, vit->point().y() * 3600.0 ) );
-        SG_LOG(SG_GENERAL, SG_INFO, vit->info().getElevation() );
-    }
-}
-
 void tgMeshTriangulation::prepareTds( void )
 {
     // save tds just like cgal - skip first = true, need infinite vertex.
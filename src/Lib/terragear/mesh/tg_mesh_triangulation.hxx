@@ -73,11 +73,26 @@ typedef CGAL::Search_traits_adapter<findVertexData,CGAL::Nth_of_tuple_property_m
 typedef CGAL::Fuzzy_iso_box<findVertexTraits>                                                                                           findVertexFuzzyBox;
 typedef CGAL::Kd_tree<findVertexTraits>                                                                                                 findVertexTree;
 
+// a dem the elevation pass reads from - array is empty if the bucket has none
+struct meshElevationSource
+{
+    meshElevationSource( const SGBucket& b, tgArrayPtr a ) : bucket(b), array(a) {}
+
+    SGBucket    bucket;
+    tgArrayPtr  array;
+};
+
 class tgMeshTriangulation
 {
 public:
     tgMeshTriangulation( tgMesh* m ) { mesh = m; }
 
+    typedef enum {
+        TDS_LOADED  = 0,
+        TDS_EMPTY   = 1,    // no file, or no faces - ocean
+        TDS_CORRUPT = 2
+    } TdsLoad_e;
+
     void constrainedTriangulateWithEdgeModification( const tgMeshArrangement& arr );
     void constrainedTriangulateWithoutEdgeModification( const std::vector<movedNode>& movedPoints, const std::vector<meshTriPoint>& addedPoints );
 
@@ -89,6 +104,9 @@ public:
         meshTriangulation.clear();
         vertexInfo.clear();
         faceInfo.clear();
+        vertexGeod.clear();
+        vertexCart.clear();
+        vertexNormal.clear();
     }
 
     // 2d triangulation shared edge matching - save edges
@@ -104,7 +122,8 @@ public:
     void saveIncidentFaces( const std::string& path, const char* layer, const std::vector<const meshVertexInfo *>& vertexes ) const;
 
 
-    void calcTileElevations( const tgArray* array );
+    // elevation of every vertex.  dems holds the tile, and its neighbours
+    void calcElevations( const std::vector<meshElevationSource>& dems, unsigned int numThreads );
 
     // ********** Triangulation I/O **********
     // 
@@ -125,9 +144,6 @@ public:
     // helper - read vertex info from feature
     void fromShapefile( const OGRFeatureDefn* poFDefn, OGRCoordinateTransformation* poCT, OGRFeature* poFeature, std::vector<meshVertexInfo>& points ) const;
 
-    // helper - read face info from feature
-    void fromShapefile( const OGRFeatureDefn* poFDefn, OGRCoordinateTransformation* poCT, OGRFeature* poFeature, std::vector<meshFaceInfo>& faces ) const;
-
     // debug i/o
     void toShapefile( const std::string& datasource, const char* layer, const std::vector<movedNode>& nodes );
     void toShapefile( const std::string& datasource, const char* layer, const nodeMembershipTree& tree );
@@ -136,14 +152,16 @@ public:
     // loading stage 1 shared edge data
     void fromShapefile( const std::string& filename, std::vector<meshVertexInfo>& points ) const;
 
-    // loading stage 1 triangulation 
-    void fromShapefile( const std::string& filename, std::vector<meshFaceInfo>& faces ) const;
-
-    bool loadTds( const std::string& bucketPath );
+    // loading / saving stage triangulation ( binary container - see meshTdsHeader )
+    TdsLoad_e loadTds( const std::string& bucketPath );
 
     void prepareTds( void );
     void saveTds( const std::string& bucketPath ) const;
 
+    // stage 3 - shared vertex normals, then texture coordinates and the BTG
+    void calcNormals( void );
+    bool saveBtg( const std::string& filePath, const tgMeshArrangement& arr ) const;
+
 private:
     void loadStage1SharedEdge( const std::string& p, const SGBucket& b, edgeType edge, std::vector<meshVertexInfo>& points );
     void sortByLat( std::vector<meshVertexInfo>& points ) const;
@@ -177,8 +195,14 @@ private:
     CGAL::Unique_hash_map<meshTriVertexHandle, int> vertexHandleToIndexMap;
     CGAL::Unique_hash_map<meshTriFaceHandle, int>   faceHandleToIndexMap;
 
-    std::map<int, meshTriVertexHandle>              vertexIndexToHandleMap;
-    std::map<int, meshTriFaceHandle>                faceIndexToHandleMap;
+    // indexed by the saved vertex / face ids
+    std::vector<meshTriVertexHandle>                vertexIndexToHandle;
+    std::vector<meshTriFaceHandle>                  faceIndexToHandle;
+
+    // stage 3 output, indexed like vertexInfo
+    std::vector<SGGeod>                             vertexGeod;
+    std::vector<SGVec3d>                            vertexCart;
+    std::vector<SGVec3f>                            vertexNormal;
 };
 
 #endif /* __TG_MESH_TRIANGULATION_HXX__ */
\ No newline at end of file
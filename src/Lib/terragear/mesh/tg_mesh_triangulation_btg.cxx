@@ -0,0 +1,235 @@
+#include <map>
+#include <utility>
+
+#include <simgear/math/SGMath.hxx>
+#include <simgear/math/SGBox.hxx>
+#include <simgear/misc/sg_path.hxx>
+#include <simgear/misc/texcoord.hxx>
+#include <simgear/io/sg_binobj.hxx>
+#include <simgear/debug/logstream.hxx>
+
+#include <terragear/tg_unique_vec2f.hxx>
+
+#include "tg_mesh.hxx"
+
+// stage 3 output : shared vertex normals, texture coordinates and the BTG.
+// Everything works on the flat vertexInfo / faceInfo arrays built by
+// prepareTds, so each step is a single pass over the tds.
+
+// texture coordinate of a point on a textured ( runway, taxiway ) poly.
+// same mapping as tgPolygon::Texture
+static SGVec2f tpsTexCoord( const tgPolygonSetMeta& meta, const SGGeod& p )
+{
+    SGGeod ref = SGGeod::fromDeg( meta.reflon, meta.reflat );
+    double az1, az2, dist;
+
+    // distance and bearing from the reference point
+    SGGeodesy::inverse( ref, p, az1, az2, dist );
+
+    // rotate so y runs the length of the poly, and x runs crossways
+    double course = SGMiscd::normalizePeriodic( 0, 360, az2 - meta.heading );
+    double x = sin( course * SGD_DEGREES_TO_RADIANS ) * dist;
+    double y = cos( course * SGD_DEGREES_TO_RADIANS ) * dist;
+
+    float tx = (float)x / (float)meta.width * (float)(meta.maxu - meta.minu) + (float)meta.minu;
+    if ( (meta.method == tgPolygonSetMeta::TEX_BY_TPS_CLIPU) || (meta.method == tgPolygonSetMeta::TEX_BY_TPS_CLIPUV) ) {
+        if ( tx < (float)meta.min_clipu ) { tx = (float)meta.min_clipu; }
+        if ( tx > (float)meta.max_clipu ) { tx = (float)meta.max_clipu; }
+    }
+
+    float ty;
+    if ( meta.method != tgPolygonSetMeta::TEX_BY_TPS_CLIPU ) {
+        ty = (float)y / (float)meta.length * (float)(meta.maxv - meta.minv) + (float)meta.minv;
+    } else {
+        ty = (float)y / (float)meta.length + (float)meta.minv;
+    }
+    if ( (meta.method == tgPolygonSetMeta::TEX_BY_TPS_CLIPV) || (meta.method == tgPolygonSetMeta::TEX_BY_TPS_CLIPUV) ) {
+        if ( ty < (float)meta.min_clipv ) { ty = (float)meta.min_clipv; }
+        if ( ty > (float)meta.max_clipv ) { ty = (float)meta.max_clipv; }
+    }
+
+    return SGVec2f( tx, ty );
+}
+
+static bool isTps( const tgPolygonSetMeta& meta )
+{
+    return ( meta.method == tgPolygonSetMeta::TEX_BY_TPS_NOCLIP ||
+             meta.method == tgPolygonSetMeta::TEX_BY_TPS_CLIPU  ||
+             meta.method == tgPolygonSetMeta::TEX_BY_TPS_CLIPV  ||
+             meta.method == tgPolygonSetMeta::TEX_BY_TPS_CLIPUV );
+}
+
+void tgMeshTriangulation::calcNormals( void )
+{
+    // dense vertex and face ids for the current tds
+    prepareTds();
+
+    unsigned int numVertices = vertexInfo.size();
+
+    // id 0 is the infinite vertex - it gets a slot, but is never used
+    vertexGeod.resize( numVertices );
+    vertexCart.resize( numVertices );
+    vertexNormal.resize( numVertices );
+
+    for ( unsigned int i=1; i<numVertices; i++ ) {
+        vertexGeod[i] = SGGeod::fromDegM( vertexInfo[i].getX(), vertexInfo[i].getY(), vertexInfo[i].getZ() );
+        vertexCart[i] = SGVec3d::fromGeod( vertexGeod[i] );
+    }
+
+    // accumulate the face normals of every triangle in the domain onto its
+    // vertices.  The cross product isn't normalized, so each face is
+    // weighted by its area.
+    std::vector<SGVec3d> normalSum( numVertices, SGVec3d::zeros() );
+
+    for ( unsigned int i=0; i<faceInfo.size(); i++ ) {
+        const meshFaceInfo& fi = faceInfo[i];
+
+        if ( !fi.getHandle()->info().hasFace() ) {
+            continue;
+        }
+
+        int v0 = fi.getVid(0);
+        int v1 = fi.getVid(1);
+        int v2 = fi.getVid(2);
+
+        // faces are ccw in lon / lat, so the normal points up
+        SGVec3d faceNormal = cross( vertexCart[v1] - vertexCart[v0], vertexCart[v2] - vertexCart[v0] );
+
+        normalSum[v0] += faceNormal;
+        normalSum[v1] += faceNormal;
+        normalSum[v2] += faceNormal;
+    }
+
+    for ( unsigned int i=1; i<numVertices; i++ ) {
+        if ( dot( normalSum[i], normalSum[i] ) > 0.0 ) {
+            vertexNormal[i] = toVec3f( normalize( normalSum[i] ) );
+        } else {
+            // not part of any face - use the geodetic up vector
+            vertexNormal[i] = toVec3f( normalize( vertexCart[i] ) );
+        }
+    }
+}
+
+bool tgMeshTriangulation::saveBtg( const std::string& filePath, const tgMeshArrangement& arr ) const
+{
+    typedef std::map< std::string, std::vector<unsigned int> >  MaterialFaceMap;
+
+    if ( vertexNormal.size() != vertexInfo.size() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgMeshTriangulation::saveBtg - normals not calculated" );
+        return false;
+    }
+
+    // SGBinObject expects triangles sorted by material
+    MaterialFaceMap                     matFaces;
+    std::vector<const tgPolygonSetMeta*> faceMeta( faceInfo.size(), (const tgPolygonSetMeta*)NULL );
+    unsigned int                        numDropped = 0;
+
+    for ( unsigned int i=0; i<faceInfo.size(); i++ ) {
+        meshTriFaceHandle fh = faceInfo[i].getHandle();
+
+        if ( fh->info().hasFace() ) {
+            faceMeta[i] = arr.getFaceMeta( fh->info().getFace() );
+        }
+
+        if ( faceMeta[i] ) {
+            matFaces[faceMeta[i]->material].push_back( i );
+        } else {
+            numDropped++;
+        }
+    }
+
+    // a triangle without material leaves a hole in the tile
+    if ( numDropped ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgMeshTriangulation::saveBtg - " << numDropped << " of " << faceInfo.size() << " triangles have no material - not written to " << filePath );
+    }
+
+    if ( matFaces.empty() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgMeshTriangulation::saveBtg - no textured faces for " << filePath );
+        return false;
+    }
+
+    // only vertices used by a face are written - index by vertex id
+    std::vector<int>        btgIndex( vertexInfo.size(), -1 );
+    std::vector<SGVec3d>    wgs84Nodes;
+    std::vector<SGVec3f>    normals;
+    UniqueSGVec2fSet        texcoords;
+    SGBinObject             outobj;
+    SGBinObjectTriangle     sgboTri;
+    SGBox<double>           box;
+
+    for ( MaterialFaceMap::const_iterator mit = matFaces.begin(); mit != matFaces.end(); mit++ ) {
+        const std::vector<unsigned int>& faces = mit->second;
+
+        // geo referenced texture coordinates depend only on the vertex and
+        // the center latitude of the poly, so do each center latitude of the
+        // material in one call, and share them between its faces
+        typedef std::pair<double, int>  GeodeTcKey;
+
+        std::map< double, std::vector<int> >    fans;
+        std::map<GeodeTcKey, SGVec2f>           geodeTc;
+
+        for ( unsigned int f=0; f<faces.size(); f++ ) {
+            const tgPolygonSetMeta& meta = *faceMeta[faces[f]];
+
+            if ( !isTps( meta ) ) {
+                for ( unsigned int j=0; j<3; j++ ) {
+                    GeodeTcKey key( meta.center_lat, faceInfo[faces[f]].getVid(j) );
+                    if ( geodeTc.find( key ) == geodeTc.end() ) {
+                        geodeTc[key] = SGVec2f( 0.0f, 0.0f );
+                        fans[key.first].push_back( key.second );
+                    }
+                }
+            }
+        }
+
+        for ( std::map< double, std::vector<int> >::const_iterator fit = fans.begin(); fit != fans.end(); fit++ ) {
+            const std::vector<int>& fan = fit->second;
+
+            std::vector<SGVec2f> tcList = sgCalcTexCoords( fit->first, vertexGeod, fan );
+            for ( unsigned int j=0; j<fan.size(); j++ ) {
+                geodeTc[GeodeTcKey( fit->first, fan[j] )] = tcList[j];
+            }
+        }
+
+        for ( unsigned int f=0; f<faces.size(); f++ ) {
+            const meshFaceInfo&     fi   = faceInfo[faces[f]];
+            const tgPolygonSetMeta& meta = *faceMeta[faces[f]];
+
+            sgboTri.clear();
+            sgboTri.material = mit->first;
+
+            for ( unsigned int j=0; j<3; j++ ) {
+                int vid = fi.getVid(j);
+
+                if ( btgIndex[vid] < 0 ) {
+                    btgIndex[vid] = wgs84Nodes.size();
+                    wgs84Nodes.push_back( vertexCart[vid] );
+                    normals.push_back( vertexNormal[vid] );
+                    box.expandBy( vertexCart[vid] );
+                }
+
+                // one normal per node - same index
+                sgboTri.v_list.push_back( btgIndex[vid] );
+                sgboTri.n_list.push_back( btgIndex[vid] );
+
+                if ( isTps( meta ) ) {
+                    sgboTri.tc_list[0].push_back( texcoords.add( tpsTexCoord( meta, vertexGeod[vid] ) ) );
+                } else {
+                    sgboTri.tc_list[0].push_back( texcoords.add( geodeTc[GeodeTcKey( meta.center_lat, vid )] ) );
+                }
+            }
+
+            outobj.add_triangle( sgboTri );
+        }
+    }
+
+    outobj.set_gbs_center( box.getCenter() );
+    outobj.set_gbs_radius( length( box.getHalfSize() ) );
+    outobj.set_wgs84_nodes( wgs84Nodes );
+    outobj.set_normals( normals );
+    outobj.set_texcoords( texcoords.get_list() );
+
+    SG_LOG( SG_GENERAL, SG_DEBUG, "tgMeshTriangulation::saveBtg - " << wgs84Nodes.size() << " nodes, " << matFaces.size() << " materials to " << filePath );
+
+    return outobj.write_bin_file( SGPath( filePath ) );
+}
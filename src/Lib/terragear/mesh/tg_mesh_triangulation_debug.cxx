@@ -114,7 +114,7 @@ void tgMeshTriangulation::saveFlippable( const char* layer ) const
     }
 
     // close datasource
-    GDALClose( poDS );
+    mesh->closeDatasource( poDS );
 }
 
 void tgMeshTriangulation::saveConstrained( const char* layer ) const
@@ -148,7 +148,7 @@ void tgMeshTriangulation::saveConstrained( const char* layer ) const
     }
 
     // close datasource
-    GDALClose( poDS );
+    mesh->closeDatasource( poDS );
 }
 
 void tgMeshTriangulation::saveEdgeBoundingBox( const meshTriPoint& lr, const meshTriPoint& ll, const meshTriPoint& ul, const meshTriPoint& ur, const char* name ) const
@@ -174,6 +174,6 @@ void tgMeshTriangulation::saveEdgeBoundingBox( const meshTriPoint& lr, const mes
         meshTriSegment west( ul, ll );
         toShapefile( poLayer, west, "west" );
 
-        GDALClose( poDS );
+        mesh->closeDatasource( poDS );
     }
 }
\ No newline at end of file
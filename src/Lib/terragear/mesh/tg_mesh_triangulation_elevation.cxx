@@ -0,0 +1,175 @@
+#include <algorithm>
+
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/debug/logstream.hxx>
+
+#include <terragear/tg_profile.hxx>
+
+#include "tg_mesh.hxx"
+
+// stage 2 elevation pass.
+// Interior vertices read the tile's own dem.  A vertex on a shared edge
+// ( or corner ) is also a vertex of the neighbour tile, and both tiles
+// have to give it the same elevation.  So it reads every dem whose bucket
+// contains it, and takes the average - summed in bucket index order, so
+// the neighbour, with the same arrays, gets the same bits.
+
+// vertices this close to a bucket border are on the shared edge ( degrees )
+#define ELEV_EDGE_EPSILON   (0.0000001)
+
+// altitude_from_grid returns -9999 outside of the array
+#define ELEV_INVALID        (-9000.0)
+
+// don't bother starting threads for small tiles
+#define ELEV_MIN_PER_THREAD (4096)
+
+// a dem, and the bounds of its bucket
+struct meshElevationDem
+{
+    double      minLon, minLat;
+    double      maxLon, maxLat;
+    long        index;
+    tgArrayPtr  array;
+
+    bool contains( double lon, double lat ) const {
+        return ( lon >= minLon - ELEV_EDGE_EPSILON && lon <= maxLon + ELEV_EDGE_EPSILON &&
+                 lat >= minLat - ELEV_EDGE_EPSILON && lat <= maxLat + ELEV_EDGE_EPSILON );
+    }
+
+    bool operator<( const meshElevationDem& other ) const {
+        return index < other.index;
+    }
+};
+
+// returns the number of dems the elevation was averaged from
+static unsigned int meshElevationAt( const std::vector<meshElevationDem>& dems, double lon, double lat, double& elevation )
+{
+    double       sum = 0.0;
+    unsigned int num = 0;
+
+    for ( unsigned int i=0; i<dems.size(); i++ ) {
+        if ( dems[i].array && dems[i].contains( lon, lat ) ) {
+            double e = dems[i].array->altitude_from_grid( lon * 3600.0, lat * 3600.0 );
+            if ( e > ELEV_INVALID ) {
+                sum += e;
+                num++;
+            }
+        }
+    }
+
+    elevation = num ? sum / num : 0.0;
+
+    return num;
+}
+
+// looks up one contiguous range of the vertex list.  Arrays are only
+// read, and every thread writes its own slots of the output.
+class meshElevationWorker : public SGThread
+{
+public:
+    meshElevationWorker( const std::vector<meshElevationDem>& d, const std::vector<double>& x, const std::vector<double>& y,
+                         std::vector<double>& e, std::vector<unsigned int>& n, unsigned int b, unsigned int en ) :
+        dems(d), lon(x), lat(y), elevation(e), numSources(n), begin(b), end(en), profileParent( tgProfile::current() ) {}
+
+    virtual void run() {
+        tgProfileHelper profile( profileParent );
+
+        for ( unsigned int i=begin; i<end; i++ ) {
+            numSources[i] = meshElevationAt( dems, lon[i], lat[i], elevation[i] );
+        }
+    }
+
+private:
+    const std::vector<meshElevationDem>&    dems;
+    const std::vector<double>&              lon;
+    const std::vector<double>&              lat;
+    std::vector<double>&                    elevation;
+    std::vector<unsigned int>&              numSources;
+    unsigned int                            begin;
+    unsigned int                            end;
+    tgProfileRecord*                        profileParent;
+};
+
+void tgMeshTriangulation::calcElevations( const std::vector<meshElevationSource>& sources, unsigned int numThreads )
+{
+    if ( vertexInfo.empty() ) {
+        prepareTds();
+    }
+
+    // bucket bounds, in bucket index order
+    std::vector<meshElevationDem> dems;
+    for ( unsigned int i=0; i<sources.size(); i++ ) {
+        meshElevationDem dem;
+        SGGeod sw = sources[i].bucket.get_corner( SG_BUCKET_SW );
+        SGGeod ne = sources[i].bucket.get_corner( SG_BUCKET_NE );
+
+        dem.minLon = sw.getLongitudeDeg();
+        dem.minLat = sw.getLatitudeDeg();
+        dem.maxLon = ne.getLongitudeDeg();
+        dem.maxLat = ne.getLatitudeDeg();
+        dem.index  = sources[i].bucket.gen_index();
+        dem.array  = sources[i].array;
+
+        dems.push_back( dem );
+    }
+    std::sort( dems.begin(), dems.end() );
+
+    // flat copy of the positions - id 0 is the infinite vertex
+    unsigned int numVertices = vertexInfo.size();
+    std::vector<double>       lon( numVertices, 0.0 );
+    std::vector<double>       lat( numVertices, 0.0 );
+    std::vector<double>       elevation( numVertices, 0.0 );
+    std::vector<unsigned int> numSources( numVertices, 0 );
+
+    for ( unsigned int i=1; i<numVertices; i++ ) {
+        lon[i] = vertexInfo[i].getX();
+        lat[i] = vertexInfo[i].getY();
+    }
+
+    if ( numThreads > numVertices / ELEV_MIN_PER_THREAD ) {
+        numThreads = numVertices / ELEV_MIN_PER_THREAD;
+    }
+
+    if ( numThreads <= 1 ) {
+        meshElevationWorker worker( dems, lon, lat, elevation, numSources, 1, numVertices );
+        worker.run();
+    } else {
+        std::vector<meshElevationWorker*> workers;
+        unsigned int                      perThread = ( numVertices + numThreads - 1 ) / numThreads;
+
+        for ( unsigned int t=0; t<numThreads; t++ ) {
+            unsigned int begin = std::max( 1u, t * perThread );
+            unsigned int end   = std::min( numVertices, ( t + 1 ) * perThread );
+
+            workers.push_back( new meshElevationWorker( dems, lon, lat, elevation, numSources, begin, end ) );
+        }
+
+        for ( unsigned int t=0; t<workers.size(); t++ ) {
+            workers[t]->start();
+        }
+        for ( unsigned int t=0; t<workers.size(); t++ ) {
+            workers[t]->join();
+            delete workers[t];
+        }
+    }
+
+    // write back to the triangulation, and the flat vertex info
+    unsigned int numShared = 0;
+    unsigned int numNone   = 0;
+
+    for ( unsigned int i=1; i<numVertices; i++ ) {
+        vertexInfo[i].getHandle()->info().setElevation( elevation[i] );
+        vertexInfo[i].setZ( elevation[i] );
+
+        if ( numSources[i] == 0 ) {
+            numNone++;
+        } else if ( numSources[i] > 1 ) {
+            numShared++;
+        }
+    }
+
+    if ( numNone ) {
+        SG_LOG( SG_GENERAL, SG_INFO, "tgMeshTriangulation::calcElevations - " << numNone << " vertices outside of any dem - set to 0" );
+    }
+    SG_LOG( SG_GENERAL, SG_DEBUG, "tgMeshTriangulation::calcElevations - " << numVertices-1 << " vertices, " << numShared << " on shared edges, " << numThreads << " threads" );
+}
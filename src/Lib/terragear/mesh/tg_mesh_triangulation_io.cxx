@@ -1,7 +1,16 @@
+#include <fstream>
+
 #include <simgear/debug/logstream.hxx>
 #include <CGAL/Bbox_2.h>
+
+#include <terragear/tg_mapped_file.hxx>
+
 #include "tg_mesh.hxx"
 
+#define MESH_TDS_FILENAME           "stage_tds.bin"
+
+#define DEBUG_MESH_TDS_SHAPEFILE    (0)     // also write the saved tds as point / face layers in the debug path
+
 // Save a single meshTriPoint
 void tgMeshTriangulation::toShapefile( OGRLayer* poLayer, const meshTriPoint& pt, const char* desc ) const
 {    
@@ -40,7 +49,7 @@ void tgMeshTriangulation::toShapefile( const std::string& datasource, const char
     }
     
     // close datasource
-    GDALClose( poDS );        
+    mesh->closeDatasource( poDS );
 }
 
 // Load a single vector info from a shapefile, and push into given vector
@@ -72,78 +81,10 @@ void tgMeshTriangulation::fromShapefile( const OGRFeatureDefn* poFDefn, OGRCoord
     return;
 }
 
-// Load a single meshFaceInfo from a shapefile, and push into given vector
-void tgMeshTriangulation::fromShapefile( const OGRFeatureDefn* poFDefn, OGRCoordinateTransformation* poCT, OGRFeature* poFeature, std::vector<meshFaceInfo>& faces ) const
-{
-    OGRGeometry *poGeometry = poFeature->GetGeometryRef();
-    if (poGeometry == NULL) {
-        SG_LOG( SG_GENERAL, SG_INFO, "Found feature without geometry!" );
-        return;
-    }
-
-    OGRwkbGeometryType geoType = wkbFlatten(poGeometry->getGeometryType());
-    if ( geoType != wkbLineString ) {
-        SG_LOG( SG_GENERAL, SG_INFO, "Unknown feature " << geoType );
-        return;
-    }
-
-    int  fieldIdx;
-    char valueStr[128];
-    int  fid = 0;
-    int  vIdx[3];
-    int  nIdx[3];
-    int  cons[3];
-
-    switch( geoType ) {
-        case wkbLineString:
-        {
-            // we don't need the geometry - just the feature fields...
-            fieldIdx = poFeature->GetFieldIndex( "tds_fid" );
-            if ( fieldIdx >= 0 ) {
-                fid = poFeature->GetFieldAsInteger(fieldIdx);
-            }
-
-            fieldIdx = poFeature->GetFieldIndex( "tds_vidx" );
-            if ( fieldIdx >= 0 ) {
-                strncpy( valueStr, poFeature->GetFieldAsString(fieldIdx), 128 );
-                sscanf( valueStr, "%08d,%08d,%08d", &vIdx[0], &vIdx[1], &vIdx[2] );
-            } else {
-                SG_LOG( SG_GENERAL, SG_INFO, "tds_vidx NOT SET" );
-            }
-
-            fieldIdx = poFeature->GetFieldIndex( "tds_nidx" );
-            if ( fieldIdx >= 0 ) {
-                strncpy( valueStr, poFeature->GetFieldAsString(fieldIdx), 128 );
-                sscanf( valueStr, "%08d,%08d,%08d",  &nIdx[0], &nIdx[1], &nIdx[2] );
-            } else {
-                SG_LOG( SG_GENERAL, SG_INFO, "tds_nidx NOT SET" );
-            }
-
-            fieldIdx = poFeature->GetFieldIndex( "tds_cons" );
-            if ( fieldIdx >= 0 ) {
-                strncpy( valueStr, poFeature->GetFieldAsString(fieldIdx), 128 );
-                sscanf( valueStr, "%01d,%01d,%01d",   &cons[0], &cons[1], &cons[2] );
-            } else {
-                SG_LOG( SG_GENERAL, SG_INFO, "tds_nidx NOT SET" );
-            }
-
-            faces.push_back( meshFaceInfo(fid, vIdx, nIdx, cons) );
-            break;
-        }
-
-        default:
-            break;
-    }
-
-    return;
-}
-
 // load all meshTriPoints from all layers of a shapefile
 void tgMeshTriangulation::fromShapefile( const std::string& filename, std::vector<meshVertexInfo>& points ) const
 {
-    GDALAllRegister();
-
-    GDALDataset* poDS = (GDALDataset*)GDALOpenEx( filename.c_str(), GDAL_OF_VECTOR, NULL, NULL, NULL );
+    GDALDataset* poDS = tgShapefileCache::instance().acquireForRead( filename );
     if( poDS == NULL )
     {
         SG_LOG( SG_GENERAL, SG_DEBUG, "Failed opening datasource " << filename.c_str() );
@@ -179,50 +120,7 @@ void tgMeshTriangulation::fromShapefile( const std::string& filename, std::vecto
         OCTDestroyCoordinateTransformation ( poCT );
     }
 
-    GDALClose( poDS );    
-}
-
-void tgMeshTriangulation::fromShapefile( const std::string& filename, std::vector<meshFaceInfo>& faces ) const
-{
-    GDALAllRegister();
-
-    GDALDataset* poDS = (GDALDataset*)GDALOpenEx( filename.c_str(), GDAL_OF_VECTOR, NULL, NULL, NULL );
-    if( poDS == NULL )
-    {
-        SG_LOG( SG_GENERAL, SG_ALERT, "Failed opening datasource " << filename.c_str() );
-        return;
-    }
-
-    SG_LOG( SG_GENERAL, SG_DEBUG, "Processing datasource " << filename.c_str() << " with " << poDS->GetLayerCount() << " layers " );
-    for (int i=0; i<poDS->GetLayerCount(); i++) {
-        OGRLayer* poLayer = poDS->GetLayer(i);
-        assert(poLayer != NULL);
-
-        OGRFeatureDefn*         poFDefn = poLayer->GetLayerDefn();
-        OGRSpatialReference*    oSourceSRS = poLayer->GetSpatialRef();
-        std::string             layername = poFDefn->GetName();
-
-        /* setup a transformation to WGS84 */
-        if (oSourceSRS == NULL) {
-            SG_LOG( SG_GENERAL, SG_ALERT, "Layer " << layername << " has no defined spatial reference system" );
-            exit( 1 );
-        }
-
-        OGRSpatialReference oTargetSRS;
-        oTargetSRS.SetWellKnownGeogCS( "WGS84" );
-        OGRCoordinateTransformation* poCT = OGRCreateCoordinateTransformation(oSourceSRS, &oTargetSRS);
-
-        OGRFeature* poFeature = NULL;
-        while ( ( poFeature = poLayer->GetNextFeature()) != NULL )
-        {
-            fromShapefile( poFDefn, poCT, poFeature, faces );
-            OGRFeature::DestroyFeature( poFeature );
-        }
-
-        OCTDestroyCoordinateTransformation ( poCT );
-    }
-    
-    GDALClose( poDS );        
+    mesh->closeDatasource( poDS );
 }
 
 void tgMeshTriangulation::toShapefile( const std::string& datasource, const char* layer, std::vector<const meshVertexInfo *>& points ) const
@@ -239,7 +137,7 @@ void tgMeshTriangulation::toShapefile( const std::string& datasource, const char
             }
         }
 
-        GDALClose( poDS );    
+        mesh->closeDatasource( poDS );
     }
 }
 
@@ -388,7 +286,7 @@ void tgMeshTriangulation::toShapefile( const std::string& datasource, const char
                 ptNum++;
             }
         }
-        GDALClose( poDS );    
+        mesh->closeDatasource( poDS );
     }
 }
 
@@ -426,23 +324,67 @@ void tgMeshTriangulation::toShapefile( const std::string& datasource, const char
                 nmIt++;
             }
         }
-        GDALClose( poDS );    
+        mesh->closeDatasource( poDS );
     }
 }
 
 void tgMeshTriangulation::saveTds( const std::string& bucketPath ) const
 {
+    std::string   filePath = bucketPath + "/" + MESH_TDS_FILENAME;
+    std::ofstream output_file( filePath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+
+    if ( !output_file.is_open() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgMeshTriangulation::saveTds - Error opening " << filePath );
+        return;
+    }
+
+    // don't save first point : it's infinite vertex
+    unsigned int numVertices = vertexInfo.empty() ? 0 : vertexInfo.size()-1;
+
+    meshTdsHeader header;
+    header.magic            = MESH_TDS_MAGIC;
+    header.version          = MESH_TDS_VERSION;
+    header.byteOrder        = MESH_TDS_BYTE_ORDER;
+    header.headerSize       = sizeof(meshTdsHeader);
+    header.numVertices      = numVertices;
+    header.numFaces         = faceInfo.size();
+    header.vertexRecordSize = sizeof(meshTdsVertexRecord);
+    header.faceRecordSize   = sizeof(meshTdsFaceRecord);
+    output_file.write( (const char*)&header, sizeof(header) );
+
+    std::vector<meshTdsVertexRecord> vertexRecords( numVertices );
+    for (unsigned int i=0; i<numVertices; i++) {
+        vertexInfo[i+1].toRecord( vertexRecords[i] );
+    }
+    if ( !vertexRecords.empty() ) {
+        output_file.write( (const char*)&vertexRecords[0], vertexRecords.size() * sizeof(meshTdsVertexRecord) );
+    }
+
+    std::vector<meshTdsFaceRecord> faceRecords( faceInfo.size() );
+    for (unsigned int i=0; i<faceInfo.size(); i++) {
+        faceInfo[i].toRecord( faceRecords[i] );
+    }
+    if ( !faceRecords.empty() ) {
+        output_file.write( (const char*)&faceRecords[0], faceRecords.size() * sizeof(meshTdsFaceRecord) );
+    }
+
+    if ( !output_file.good() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgMeshTriangulation::saveTds - Error writing " << filePath );
+    }
+    output_file.close();
+
+#if DEBUG_MESH_TDS_SHAPEFILE
+    // the binary container isn't viewable - dump the same data to QGIS
     GDALDataset*  poDS = NULL;
     OGRLayer*     poPointLayer = NULL;
     OGRLayer*     poFaceLayer = NULL;
 
-    poDS = mesh->openDatasource( bucketPath );
+    poDS = mesh->openDatasource( mesh->getDebugPath() );
     if ( poDS ) {
         poPointLayer = mesh->openLayer( poDS, wkbPoint25D, tgMesh::LAYER_FIELDS_TDS_VERTEX, "tds_points" );
         poFaceLayer  = mesh->openLayer( poDS, wkbLineString25D, tgMesh::LAYER_FIELDS_TDS_FACE, "tds_faces" );
 
         if ( poPointLayer ) {
-            // don't save first point : it's infinite vertex
             for (unsigned int i=1; i<vertexInfo.size(); i++) {
                 toShapefile( poPointLayer, &vertexInfo[i] );
             }
@@ -452,111 +394,140 @@ void tgMeshTriangulation::saveTds( const std::string& bucketPath ) const
             for (unsigned int i=0; i<faceInfo.size(); i++) {
                 toShapefile( poFaceLayer, faceInfo[i] );
             }
-        } else {
-            SG_LOG( SG_GENERAL, SG_INFO, "tgMesh::constrainedTriangulate - saveTDS - Error openeing face layer" );            
         }
 
         // close datasource
-        GDALClose( poDS );
+        mesh->closeDatasource( poDS );
     }
+#endif
 }
 
-bool tgMeshTriangulation::loadTds( const std::string& bucketPath )
+tgMeshTriangulation::TdsLoad_e tgMeshTriangulation::loadTds( const std::string& bucketPath )
 {
-    // load the tile points
-    std::vector<meshVertexInfo>   points;
-    std::vector<meshFaceInfo>     faces;
-    std::string                   filePath;
-    bool                          hasLand = false;
+    std::string   filePath = bucketPath + "/" + MESH_TDS_FILENAME;
+    tgMappedFile  tdsFile;
+    TdsLoad_e     result = TDS_EMPTY;
 
     meshTriTDS& tds = meshTriangulation.tds();
     tds.clear();
 
-    // load vertices, and save their handles in V
-    filePath = bucketPath + "/tds_points.shp"; 
-    fromShapefile( filePath, points );
+    vertexIndexToHandle.clear();
+    faceIndexToHandle.clear();
+
+    if ( !tdsFile.open( filePath ) ) {
+        SG_LOG(SG_GENERAL, SG_DEBUG, "loadTDS - no triangulation at " << filePath );
+        return TDS_EMPTY;
+    }
 
-    filePath = bucketPath + "/tds_faces.shp"; 
-    fromShapefile( filePath, faces );
+    // validate the header before we trust any of the counts
+    const char* data = tdsFile.getData();
+    size_t      size = tdsFile.getSize();
 
-    if (!points.empty() && !faces.empty()) {
-        SG_LOG(SG_GENERAL, SG_DEBUG, "loadTDS from " << points.size() << " points and " << faces.size() << " faces" );
-        SG_LOG(SG_GENERAL, SG_DEBUG, "loadTDS - begin valid: " << tds.is_valid() << " dimension: " << tds.dimension() << " verts: " << tds.number_of_vertices() );
+    if ( size < sizeof(meshTdsHeader) ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "loadTDS - " << filePath << " is truncated" );
+        return TDS_CORRUPT;
+    }
 
-        unsigned int n = points.size();
-        unsigned int m = faces.size();
-        unsigned int i;
+    const meshTdsHeader* header = (const meshTdsHeader*)data;
+    if ( header->magic != MESH_TDS_MAGIC || header->byteOrder != MESH_TDS_BYTE_ORDER ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "loadTDS - " << filePath << " is not a triangulation file for this machine" );
+        return TDS_CORRUPT;
+    }
+    if ( header->version          != MESH_TDS_VERSION               ||
+         header->headerSize       != sizeof(meshTdsHeader)          ||
+         header->vertexRecordSize != sizeof(meshTdsVertexRecord)    ||
+         header->faceRecordSize   != sizeof(meshTdsFaceRecord) ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "loadTDS - " << filePath << " has version " << header->version << " - expected " << MESH_TDS_VERSION );
+        return TDS_CORRUPT;
+    }
+
+    unsigned int n = header->numVertices;
+    unsigned int m = header->numFaces;
+
+    if ( size < sizeof(meshTdsHeader) + (size_t)n * sizeof(meshTdsVertexRecord) + (size_t)m * sizeof(meshTdsFaceRecord) ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "loadTDS - " << filePath << " is truncated" );
+        return TDS_CORRUPT;
+    }
+
+    const meshTdsVertexRecord* vertexRecords = (const meshTdsVertexRecord*)(data + sizeof(meshTdsHeader));
+    const meshTdsFaceRecord*   faceRecords   = (const meshTdsFaceRecord*)(vertexRecords + n);
+
+    if ( n != 0 && m != 0 ) {
+        SG_LOG(SG_GENERAL, SG_DEBUG, "loadTDS from " << n << " points and " << m << " faces" );
+        SG_LOG(SG_GENERAL, SG_DEBUG, "loadTDS - begin valid: " << tds.is_valid() << " dimension: " << tds.dimension() << " verts: " << tds.number_of_vertices() );
 
         // tds dimension starts at -2 ( 0 verts )
         //                         -1 ( infinite vert )
         //                          0 ( line from infinit vert to finite vert )
         //                          1 ( three verts )
         //                          2 ( faces defined )
-        // insert verts
-        if ( n != 0 ) {
-            int index = 0;
-            hasLand = true;
-
-            tds.set_dimension(2);
+        tds.set_dimension(2);
+
+        // ids are dense - index the handles directly
+        vertexIndexToHandle.resize( n+1 );
+        faceIndexToHandle.resize( m );
+
+        // create the first ( infinite ) vertex
+        vertexIndexToHandle[0] = tds.create_vertex();
+
+        // read the rest from the records
+        for ( unsigned int i = 0; i < n; i++ ) {
+            const meshTdsVertexRecord& vr = vertexRecords[i];
+            if ( vr.id <= 0 || vr.id > (int)n ) {
+                SG_LOG(SG_GENERAL, SG_ALERT, "loadTDS - vertex id " << vr.id << " out of range in " << filePath );
+                tds.clear();
+                vertexIndexToHandle.clear();
+                faceIndexToHandle.clear();
+                return TDS_CORRUPT;
+            }
 
-            //std::vector<meshTriTDS::Vertex_handle> V(n+1);
-            //std::vector<meshTriTDS::Face_handle>   F(m);
-            vertexIndexToHandleMap.clear();
-            faceIndexToHandleMap.clear();
+            meshTriVertexHandle vh = tds.create_vertex();
+            vh->set_point( meshTriPoint( vr.x, vr.y ) );
+            vh->info().setElevation( vr.z );
+            vertexIndexToHandle[vr.id] = vh;
+        }
 
-            // create the first ( infinite vertex
-            vertexIndexToHandleMap[0] = tds.create_vertex();
+        // create every face up front, so neighbors can be linked as we go
+        for ( unsigned int i = 0; i < m; i++ ) {
+            faceIndexToHandle[i] = tds.create_face();
+        }
 
-            // read the rest from the array
-            for( i = 0; i < n; i++ ) {
-                index = points[i].getId();
+        for ( unsigned int i = 0; i < m; i++ ) {
+            const meshTdsFaceRecord& fr = faceRecords[i];
+            bool valid = ( fr.fid >= 0 && fr.fid < (int)m );
 
-                // index 0 is infinite vertex, so don't set it's position
-                vertexIndexToHandleMap[index] = tds.create_vertex();
-                if (index) {
-                    vertexIndexToHandleMap[index]->set_point( points[i].getPoint() );
-                }
+            for ( int j = 0; j < 3 && valid; j++ ) {
+                valid = ( fr.vid[j] >= 0 && fr.vid[j] <= (int)n && vertexIndexToHandle[fr.vid[j]] != meshTriVertexHandle() ) &&
+                        ( fr.nid[j] >= 0 && fr.nid[j] <  (int)m );
             }
 
-            for( i = 0; i < m; i++ ) {
-                int fid = faces[i].getFid();
-
-                faceIndexToHandleMap[fid] = tds.create_face();
-                for(int j = 0; j < 3; j++){
-                    int vid = faces[i].getVid(j);
-                    faceIndexToHandleMap[fid]->set_vertex(j, vertexIndexToHandleMap[vid]);
-                    // The face pointer of vertices is set too often,
-                    // but otherwise we had to use a further map
-                    vertexIndexToHandleMap[vid]->set_face( faceIndexToHandleMap[fid] );
-                }
+            if ( !valid ) {
+                SG_LOG(SG_GENERAL, SG_ALERT, "loadTDS - face " << i << " has indices out of range in " << filePath );
+                tds.clear();
+                vertexIndexToHandle.clear();
+                faceIndexToHandle.clear();
+                return TDS_CORRUPT;
             }
 
-            // Setting the neighbor pointers 
-            for( i = 0; i < m; i++ ) {
-                int fid = faces[i].getFid();
+            meshTriFaceHandle fh = faceIndexToHandle[fr.fid];
+            for ( int j = 0; j < 3; j++ ) {
+                meshTriVertexHandle vh = vertexIndexToHandle[fr.vid[j]];
 
-                for( int j = 0; j < tds.dimension()+1; j++ ){
-                    int nid = faces[i].getNid(j);
-                    faceIndexToHandleMap[fid]->set_neighbor(j, faceIndexToHandleMap[nid]);
-                }
-            }
+                fh->set_vertex( j, vh );
+                fh->set_neighbor( j, faceIndexToHandle[fr.nid[j]] );
+                fh->set_constraint( j, ( fr.con & (1 << j) ) ? true : false );
 
-            meshTriangulation.set_infinite_vertex(vertexIndexToHandleMap[0]);
-
-            meshTriCDT::All_faces_iterator fit, fit_end;
-            int i;
-            for ( fit = meshTriangulation.all_faces_begin(), fit_end = meshTriangulation.all_faces_end(), i = 0; fit != fit_end; fit++, i++ ) {
-                for ( int j=0; j<3; j++ ) {
-                    bool con = faces[i].getConstrained(j) ? true:false;
-                    fit->set_constraint(j, con?true:false);
-                }
+                // The face pointer of vertices is set too often,
+                // but otherwise we had to use a further map
+                vh->set_face( fh );
             }
+        }
 
-            SG_LOG(SG_GENERAL, SG_DEBUG, "LoadTDS - COMPLETE TDS valid: " << tds.is_valid() << " dimension: " << tds.dimension() << " verts: " << tds.number_of_vertices() );
-            meshTriangulation.is_valid(true);
+        meshTriangulation.set_infinite_vertex( vertexIndexToHandle[0] );
+        result = TDS_LOADED;
 
-        }
+        SG_LOG(SG_GENERAL, SG_DEBUG, "LoadTDS - COMPLETE TDS valid: " << tds.is_valid() << " dimension: " << tds.dimension() << " verts: " << tds.number_of_vertices() );
     }
 
-    return hasLand;
-}
\ No newline at end of file
+    return result;
+}
@@ -160,22 +160,22 @@ void tgMeshTriangulation::matchNodes( edgeType edge, std::vector<meshVertexInfo>
 
                             // moving thisNode to midpoint of this and next
                             index = boost::get<2>(thisNode);
-                            if ( vertexIndexToHandleMap.find(index) != vertexIndexToHandleMap.end() ) {
-                                meshTriTDS::Vertex_handle vHand = vertexIndexToHandleMap[index];
+                            if ( index >= 0 && index < (int)vertexIndexToHandle.size() ) {
+                                meshTriTDS::Vertex_handle vHand = vertexIndexToHandle[index];
                                 movedNodes.push_back( movedNode(vHand, boost::get<0>(thisNode), CGAL::midpoint( boost::get<0>(thisNode), boost::get<0>(nextNode)) ) );
                             } else {
-                                SG_LOG(SG_GENERAL, SG_INFO, "Can't find index " << index << " map size is " << vertexIndexToHandleMap.size() );
+                                SG_LOG(SG_GENERAL, SG_INFO, "Can't find index " << index << " map size is " << vertexIndexToHandle.size() );
                             }
                         } else if ( (boost::get<1>(thisNode) == NODE_NEIGHBOR) && (boost::get<1>(nextNode) == NODE_CURRENT) ) {
                             debugInfo += ": MERGE";
 
                             // moving nextNode to midpoint of this and next
                             index = boost::get<2>(nextNode);
-                            if ( vertexIndexToHandleMap.find(index) != vertexIndexToHandleMap.end() ) {
-                                meshTriTDS::Vertex_handle vHand = vertexIndexToHandleMap[index];
+                            if ( index >= 0 && index < (int)vertexIndexToHandle.size() ) {
+                                meshTriTDS::Vertex_handle vHand = vertexIndexToHandle[index];
                                 movedNodes.push_back( movedNode(vHand, boost::get<0>(nextNode), CGAL::midpoint( boost::get<0>(thisNode), boost::get<0>(nextNode)) ) );
                             } else {
-                                SG_LOG(SG_GENERAL, SG_INFO, "Can't find index " << index << " map size is " << vertexIndexToHandleMap.size() );
+                                SG_LOG(SG_GENERAL, SG_INFO, "Can't find index " << index << " map size is " << vertexIndexToHandle.size() );
                             }
                         } else {
                             // we've found 2 points that are very close in the same tile - if it's the neighbor tile, go ahead and add it
@@ -246,7 +246,7 @@ void tgMeshTriangulation::loadStage1SharedEdge( const std::string& p, const SGBu
 bool tgMeshTriangulation::loadTriangulation( const std::string& basePath, const SGBucket& bucket )
 {
     std::string bucketPath = basePath + "/" + bucket.gen_base_path() + "/" + bucket.gen_index_str();
-    bool hasLand = loadTds( bucketPath );
+    bool hasLand = ( loadTds( bucketPath ) == TDS_LOADED );
 
     if ( hasLand ) {
         SG_LOG(SG_GENERAL, SG_DEBUG, "LoadTriangulation - Triangulation valid? " << meshTriangulation.is_valid() );
@@ -575,7 +575,7 @@ void tgMeshTriangulation::saveIncidentFaces( const std::string& path, const char
             toShapefile( poTriangleLayer, faces[i], V, F );
         }
 
-        GDALClose( poDS );  
+        mesh->closeDatasource( poDS );
     }
 #endif
 }
@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <fstream>
+#include <list>
+#include <set>
 #include <sstream>
 
 #include <CGAL/Bbox_2.h>
@@ -477,110 +481,230 @@ void tgAccumulator::Add_cgal( const tgPolygon& subject )
 
 #endif
 
-// rewrite to use bounding boxes, and lists of polygons with holes 
-// need a few functions:
-// 1) generate a Polygon_set from the Polygons_with_holes in the list that intersect subject bounding box
-// 2) Add to the Polygons_with_holes list with a Polygon set ( and the bounding boxes )
-void tgAccumulator::GetAccumPolygonSet( const CGAL::Bbox_2& bbox, cgalPoly_PolygonSet& accumPs ) 
+#define DEBUG_ACCUM_VALIDITY    (0)
+
+// The accumulated area is a list of merged Polygon_with_holes regions,
+// each with its bounding box.  Regions are found through a grid of
+// cell x cell degree buckets, so a subject only joins the regions whose
+// boxes it overlaps.  Once clipped, the subject is merged with those
+// regions, and the result replaces them - so each call only pays for
+// the area it touches, instead of re-joining every overlapping polygon
+// added so far.  Regions too large for the grid are cut into pieces,
+// so that holds for them as well.
+bool tgAccumulator::getCells( const CGAL::Bbox_2& bb, int& x0, int& y0, int& x1, int& y1 ) const
 {
-    std::list<tgAccumEntry>::const_iterator it;
-    std::list<cgalPoly_PolygonWithHoles> accum;
-//  static int num_iter = 1;
-    
-    // traverse all of the Polygon_with_holes and accumulate their union
-    for ( it=accum_cgal_list.begin(); it!=accum_cgal_list.end(); it++ ) {
-        if ( CGAL::do_overlap( bbox, (*it).bbox ) ) {
-#if 0
-            if ( (*it).pwh.is_unbounded() ) {
-                SG_LOG(SG_GENERAL, SG_ALERT, "tgAccumulator::GetAccumPolygonSet - pwh is unbounded" );
-            } else {
-                SG_LOG(SG_GENERAL, SG_ALERT, "tgAccumulator::GetAccumPolygonSet - pwh is bounded" );
+    x0 = (int)floor( bb.xmin() / cell );
+    y0 = (int)floor( bb.ymin() / cell );
+    x1 = (int)floor( bb.xmax() / cell );
+    y1 = (int)floor( bb.ymax() / cell );
+
+    return ( (long)(x1-x0+1) * (long)(y1-y0+1) <= MAX_CELLS_PER_ENTRY );
+}
+
+static cgalPoly_Polygon accumRect( const cgalPoly_FT& xmin, const cgalPoly_FT& ymin, const cgalPoly_FT& xmax, const cgalPoly_FT& ymax )
+{
+    cgalPoly_Polygon rect;
+
+    rect.push_back( cgalPoly_Point( xmin, ymin ) );
+    rect.push_back( cgalPoly_Point( xmax, ymin ) );
+    rect.push_back( cgalPoly_Point( xmax, ymax ) );
+    rect.push_back( cgalPoly_Point( xmin, ymax ) );
+
+    return rect;
+}
+
+void tgAccumulator::insertEntry( const cgalPoly_PolygonWithHoles& pwh )
+{
+    int x0, y0, x1, y1;
+
+    if ( getCells( pwh.outer_boundary().bbox(), x0, y0, x1, y1 ) ) {
+        storeEntry( pwh );
+        return;
+    }
+
+    // too large for the grid - cut it in two on a cell border across its
+    // longer side, until the pieces fit.  A subject then only joins ( and
+    // replaces ) the pieces near it, instead of the whole region.
+    // The halves reach a cell past the bbox, so rounding loses nothing.
+    cgalPoly_FT      xmin = ( x0 - 1 ) * cell;
+    cgalPoly_FT      ymin = ( y0 - 1 ) * cell;
+    cgalPoly_FT      xmax = ( x1 + 2 ) * cell;
+    cgalPoly_FT      ymax = ( y1 + 2 ) * cell;
+    cgalPoly_Polygon halves[2];
+
+    if ( x1 - x0 >= y1 - y0 ) {
+        cgalPoly_FT xmid = ( x0 + ( x1 - x0 + 1 ) / 2 ) * cell;
+        halves[0] = accumRect( xmin, ymin, xmid, ymax );
+        halves[1] = accumRect( xmid, ymin, xmax, ymax );
+    } else {
+        cgalPoly_FT ymid = ( y0 + ( y1 - y0 + 1 ) / 2 ) * cell;
+        halves[0] = accumRect( xmin, ymin, xmax, ymid );
+        halves[1] = accumRect( xmin, ymid, xmax, ymax );
+    }
+
+    for ( unsigned int h=0; h<2; h++ ) {
+        cgalPoly_PolygonSet piece( pwh );
+        piece.intersection( halves[h] );
+
+        std::list<cgalPoly_PolygonWithHoles> pwh_list;
+        std::list<cgalPoly_PolygonWithHoles>::const_iterator it;
+
+        piece.polygons_with_holes( std::back_inserter(pwh_list) );
+        for ( it = pwh_list.begin(); it != pwh_list.end(); ++it ) {
+            if ( !it->is_unbounded() ) {
+                insertEntry( *it );
             }
-#endif            
-            accum.push_back( (*it).pwh );
         }
     }
-    
-#if 0
-    if ( num_iter == 44 ) {
-        GDALDataset* pDS    = tgPolygonSet::openDatasource( "./joinDbg" );
-        char layer[128];
-        int  poly = 1;
-        
-        std::list<cgalPoly_PolygonWithHoles>::const_iterator pwhit = accum.begin();
-        while ( pwhit != accum.end() ) {
-            sprintf( layer, "poly_%04d", poly++ );
-            OGRLayer* pLayer = tgPolygonSet::openLayer( pDS, wkbLineString25D, tgPolygonSet::LF_DEBUG, layer );
-            tgPolygonSet::toDebugShapefile( pLayer, (*pwhit), "poly" );
-     
-            pwhit++;
+}
+
+void tgAccumulator::storeEntry( const cgalPoly_PolygonWithHoles& pwh )
+{
+    unsigned int idx;
+    int          x0, y0, x1, y1;
+
+    if ( !freeEntries.empty() ) {
+        idx = freeEntries.back();
+        freeEntries.pop_back();
+    } else {
+        idx = entries.size();
+        entries.push_back( tgAccumEntry() );
+    }
+
+    entries[idx].pwh   = pwh;
+    entries[idx].bbox  = pwh.outer_boundary().bbox();
+    entries[idx].valid = true;
+
+    // insertEntry made sure it fits
+    getCells( entries[idx].bbox, x0, y0, x1, y1 );
+    for ( int x = x0; x <= x1; x++ ) {
+        for ( int y = y0; y <= y1; y++ ) {
+            grid[tgAccumCell(x, y)].push_back( idx );
         }
-        GDALClose( pDS );        
     }
-#endif
+}
 
-#if 0  
-    if ( num_iter == 44 ) {
-        std::ofstream output_file("./output_polys.txt");
-        if (!output_file.is_open()) {
-            std::cerr << "Failed to open the " << "./output_polys.txt" << std::endl;
-            exit(0);
+void tgAccumulator::removeEntry( unsigned int idx )
+{
+    int x0, y0, x1, y1;
+
+    getCells( entries[idx].bbox, x0, y0, x1, y1 );
+    for ( int x = x0; x <= x1; x++ ) {
+        for ( int y = y0; y <= y1; y++ ) {
+            tgAccumGrid::iterator git = grid.find( tgAccumCell(x, y) );
+            if ( git != grid.end() ) {
+                std::vector<unsigned int>& cellEntries = git->second;
+                cellEntries.erase( std::remove( cellEntries.begin(), cellEntries.end(), idx ), cellEntries.end() );
+                if ( cellEntries.empty() ) {
+                    grid.erase( git );
+                }
+            }
         }
-        
-        std::list<cgalPoly_PolygonWithHoles>::const_iterator pwhit = accum.begin();
-
-//      CGAL::set_pretty_mode(output_file);
-        output_file << std::setprecision(64);
-        output_file << accum.size() << "\n";
-        while ( pwhit != accum.end() ) {
-            output_file << (*pwhit);
-            pwhit++;
+    }
+
+    entries[idx].pwh   = cgalPoly_PolygonWithHoles();
+    entries[idx].valid = false;
+    freeEntries.push_back( idx );
+}
+
+void tgAccumulator::findEntries( const CGAL::Bbox_2& bbox, std::vector<unsigned int>& found ) const
+{
+    std::set<unsigned int> hits;
+    int                    x0, y0, x1, y1;
+
+    if ( getCells( bbox, x0, y0, x1, y1 ) ) {
+        for ( int x = x0; x <= x1; x++ ) {
+            for ( int y = y0; y <= y1; y++ ) {
+                tgAccumGrid::const_iterator git = grid.find( tgAccumCell(x, y) );
+                if ( git != grid.end() ) {
+                    hits.insert( git->second.begin(), git->second.end() );
+                }
+            }
+        }
+    } else {
+        // query covers more cells than we have entries to check
+        for ( unsigned int i=0; i<entries.size(); i++ ) {
+            if ( entries[i].valid ) {
+                hits.insert( i );
+            }
         }
-        output_file.close();
     }
-#endif
 
-//  SG_LOG(SG_GENERAL, SG_ALERT, "tgAccumulator::GetAccumPolygonSet " << num_iter << " join " << accum.size() << " Polygon_with_holes ");
+    found.clear();
+    for ( std::set<unsigned int>::const_iterator it = hits.begin(); it != hits.end(); it++ ) {
+        if ( CGAL::do_overlap( bbox, entries[*it].bbox ) ) {
+            found.push_back( *it );
+        }
+    }
+}
+
+void tgAccumulator::joinEntries( const std::vector<unsigned int>& found, cgalPoly_PolygonSet& accumPs ) const
+{
+    std::list<cgalPoly_PolygonWithHoles> accum;
+
+    for ( unsigned int i=0; i<found.size(); i++ ) {
+        accum.push_back( entries[found[i]].pwh );
+    }
+
     accumPs.join( accum.begin(), accum.end() );
+}
 
-#if 0    
-    std::list<cgalPoly_PolygonWithHoles>::const_iterator pwhit = accum.begin();
-    int joinNum = 1;
-    while ( pwhit != accum.end() ) {
-        SG_LOG(SG_GENERAL, SG_ALERT, "tgAccumulator::GetAccumPolygonSet " << num_iter << " join " << joinNum++ );
-        ps.join( (*pwhit) );
-        pwhit++;
+void tgAccumulator::replaceEntries( const std::vector<unsigned int>& found, const cgalPoly_PolygonSet& merged )
+{
+    for ( unsigned int i=0; i<found.size(); i++ ) {
+        removeEntry( found[i] );
     }
-#endif
 
-//  SG_LOG(SG_GENERAL, SG_ALERT, "tgAccumulator::GetAccumPolygonSet " << num_iter++ << " complete" );
+    AddAccumPolygonSet( merged );
+}
+
+void tgAccumulator::GetAccumPolygonSet( const CGAL::Bbox_2& bbox, cgalPoly_PolygonSet& accumPs ) 
+{
+    std::vector<unsigned int> found;
+
+    findEntries( bbox, found );
+    joinEntries( found, accumPs );
 }
 
 void tgAccumulator::AddAccumPolygonSet( const cgalPoly_PolygonSet& ps )
 {
     std::list<cgalPoly_PolygonWithHoles> pwh_list;
     std::list<cgalPoly_PolygonWithHoles>::const_iterator it;
-    CGAL::Bbox_2 bbox;
 
+#if DEBUG_ACCUM_VALIDITY
     // make sure polygonSet is valid
     cgalPoly_PolygonSet tmp(ps);
     if ( !tmp.is_valid() ) {
         SG_LOG(SG_GENERAL, SG_ALERT, "tgAccumulator::AddAccumPolygonSet - polygonSet is invalid" );
     }
+#endif
 
     ps.polygons_with_holes( std::back_inserter(pwh_list) );
     for (it = pwh_list.begin(); it != pwh_list.end(); ++it) {
-        tgAccumEntry entry;
-        entry.pwh  = (*it);
-        entry.bbox =  entry.pwh.outer_boundary().bbox();
-
-        accum_cgal_list.push_back( entry );
+        if ( !it->is_unbounded() ) {
+            insertEntry( *it );
+        }
     }    
 }
 
 void tgAccumulator::add( const tgPolygonSet& ps )
 {
-    AddAccumPolygonSet( ps.getPs() );
+    std::vector<unsigned int> touched;
+
+    if ( ps.getPs().is_empty() ) {
+        return;
+    }
+
+    findEntries( ps.getBoundingBox(), touched );
+    if ( !touched.empty() ) {
+        cgalPoly_PolygonSet merged;
+
+        joinEntries( touched, merged );
+        merged.join( ps.getPs() );
+        replaceEntries( touched, merged );
+    } else {
+        AddAccumPolygonSet( ps.getPs() );
+    }
 }
 
 #define DEBUG_DIFF_AND_ADD 0
@@ -591,50 +715,55 @@ void tgAccumulator::Diff_and_Add_cgal( tgPolygonSet& subject )
 #endif
     
     cgalPoly_PolygonSet subPs  = subject.getPs();
-    
+
+    if ( subPs.is_empty() ) {
+        return;
+    }
+
+#if DEBUG_ACCUM_VALIDITY
     // verify subject is valid
     if ( !subPs.is_valid() ) {
         SG_LOG(SG_GENERAL, SG_ALERT, "tgAccumulator::Diff_and_Add_cgal - subject is INVALID" );
     }
-    
-    cgalPoly_PolygonSet difPs;
-    GetAccumPolygonSet( subject.getBoundingBox(), difPs );
-    
+#endif
+
+    std::vector<unsigned int> touched;
+    findEntries( subject.getBoundingBox(), touched );
+
+    if ( !touched.empty() ) {
+        cgalPoly_PolygonSet difPs;
+        joinEntries( touched, difPs );
+
 #if DEBUG_DIFF_AND_ADD    
-    sprintf( layer, "clip_%03ld_pre_subject", subject.getId() );
-    toShapefile( add, layer );
+        sprintf( layer, "clip_%03ld_pre_subject", subject.getId() );
+        toShapefile( add, layer );
         
-    tgContour bb;
-    bb.AddPoint( tgPoint( cgBoundingBox.xmin(), cgBoundingBox.ymin() ) );
-    bb.AddPoint( tgPoint( cgBoundingBox.xmin(), cgBoundingBox.ymax() ) );
-    bb.AddPoint( tgPoint( cgBoundingBox.xmax(), cgBoundingBox.ymax() ) );
-    bb.AddPoint( tgPoint( cgBoundingBox.xmax(), cgBoundingBox.ymin() ) );
-        
-    sprintf( layer, "clip_%03ld_bbox", subject.getId() );
-    tgShapefile::FromContour( bb, false, false, "./clip_dbg", layer, "bbox" );
-        
-    sprintf( layer, "clip_%03ld_pre_accum", subject.getId() );
-    ToShapefile( diff, layer );
+        sprintf( layer, "clip_%03ld_pre_accum", subject.getId() );
+        ToShapefile( difPs, layer );
 #endif
 
-    if ( difPs.number_of_polygons_with_holes() ) {
         subPs.difference( difPs );
             
 #if DEBUG_DIFF_AND_ADD    
         sprintf( layer, "clip_%03ld_post_subject", subject.getId() );
-            ToShapefile( cgSubject, layer );            
+        ToShapefile( subPs, layer );            
 #endif
 
-        subject.setPs( subPs );            
-    }
+        subject.setPs( subPs );
 
-    // add the polygons_with_holes to the accumulator list
-    AddAccumPolygonSet( subPs );
+        // the clipped subject and the regions it touched become the new
+        // merged regions.
+        difPs.join( subPs );
+        replaceEntries( touched, difPs );
+    } else {
+        // add the polygons_with_holes to the accumulator list
+        AddAccumPolygonSet( subPs );
+    }
 }
 
 void tgAccumulator::toShapefile( const char* ds, const char* layer )
 {
-    CGAL::Bbox_2 bbox;
+    CGAL::Bbox_2 bbox( -180.0, -90.0, 180.0, 90.0 );
     cgalPoly_PolygonSet all;
     GetAccumPolygonSet( bbox, all );
     
@@ -1,34 +1,62 @@
 #ifndef _TGACCUMULATOR_HXX
 #define _TGACCUMULATOR_HXX
 
+#include <map>
+#include <utility>
+#include <vector>
+
 #include "tg_polygon_set.hxx"
 
+// one merged region of the accumulator
 struct tgAccumEntry
 {
 public:
     cgalPoly_PolygonWithHoles   pwh;
     CGAL::Bbox_2                bbox;
+    bool                        valid;
 };
 
+// The accumulator holds the union of everything added so far as a list
+// of merged regions.  Each region is indexed by the grid cells its
+// bounding box covers, so a new subject is only differenced against - and
+// merged with - the regions it may actually touch.
 class tgAccumulator
 {
 public:
-    tgAccumulator() { accumEmpty = true; }
+    // cellSize is in degrees.  Regions covering more than
+    // MAX_CELLS_PER_ENTRY cells are cut into pieces that don't,
+    // each indexed on its own.
+    tgAccumulator( double cellSize = 0.01 ) : cell( cellSize ) {}
 
     void      add(const tgPolygonSet& subject);
     void      Diff_and_Add_cgal( tgPolygonSet& subject );
-    
+
     void      toShapefile( const char* datasource, const char* layer );
-    
-    
+
+
 private:
+    typedef std::pair<int, int>                                 tgAccumCell;
+    typedef std::map< tgAccumCell, std::vector<unsigned int> >  tgAccumGrid;
+
+    static const int MAX_CELLS_PER_ENTRY = 256;
+
     void                    GetAccumPolygonSet( const CGAL::Bbox_2& bb, cgalPoly_PolygonSet& accumPs );
     void                    AddAccumPolygonSet( const cgalPoly_PolygonSet& ps );
 
-    bool                        accumEmpty;
-    cgalPoly_PolygonSet         accum_cgal;
+    void                    findEntries( const CGAL::Bbox_2& bb, std::vector<unsigned int>& found ) const;
+    void                    joinEntries( const std::vector<unsigned int>& found, cgalPoly_PolygonSet& accumPs ) const;
+    void                    replaceEntries( const std::vector<unsigned int>& found, const cgalPoly_PolygonSet& merged );
+
+    void                    insertEntry( const cgalPoly_PolygonWithHoles& pwh );
+    void                    storeEntry( const cgalPoly_PolygonWithHoles& pwh );
+    void                    removeEntry( unsigned int idx );
+    bool                    getCells( const CGAL::Bbox_2& bb, int& x0, int& y0, int& x1, int& y1 ) const;
+
+    double                      cell;
 
-    std::list<tgAccumEntry>     accum_cgal_list;
+    std::vector<tgAccumEntry>   entries;
+    std::vector<unsigned int>   freeEntries;
+    tgAccumGrid                 grid;
 };
 
-#endif // _TGACCUMULATOR_HXX
\ No newline at end of file
+#endif // _TGACCUMULATOR_HXX
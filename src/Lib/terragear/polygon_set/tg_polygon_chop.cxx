@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <list>
+
 #include <boost/interprocess/sync/scoped_lock.hpp>
 #include <boost/interprocess/sync/named_mutex.hpp>
 
@@ -7,6 +10,7 @@
 #include <simgear/io/lowlevel.hxx>
 
 #include "tg_polygon_chop.hxx"
+#include "tg_profile.hxx"
 #include "tg_shapefile.hxx"
 #include "tg_rectangle.hxx"
 #include "tg_misc.hxx"
@@ -25,6 +29,175 @@
 
 #define DEBUG_CHOPPER   0
 
+// Cheap, inexact sort of clip rectangles against a polygon set.
+//
+// A rectangle no edge of the subject comes near is either completely
+// inside it - so the intersection is the rectangle itself - or
+// completely outside, and the intersection is empty.  Only rectangles
+// an edge passes through need the exact boolean op.
+//
+// This is decided with doubles.  Anything within CLASSIFY_MARGIN of an
+// edge counts as crossed, so rounding can only send a rectangle to the
+// exact path, never skip it.  Cells come in rows ( buckets of the same
+// latitude ), so each edge is only tested against the cells of the rows
+// it spans, and inside / outside is a single scanline per row.
+#define CLASSIFY_MARGIN (0.0000001)
+
+typedef enum {
+    CELL_OUTSIDE,
+    CELL_BOUNDARY,
+    CELL_INSIDE
+} tgChopperCellClass;
+
+struct tgChopperEdge {
+    double x1, y1, x2, y2;
+};
+
+static void getEdges( const cgalPoly_Polygon& poly, std::vector<tgChopperEdge>& edges )
+{
+    cgalPoly_Polygon::Edge_const_iterator eit;
+
+    for ( eit = poly.edges_begin(); eit != poly.edges_end(); ++eit ) {
+        tgChopperEdge e;
+
+        e.x1 = CGAL::to_double( eit->source().x() );
+        e.y1 = CGAL::to_double( eit->source().y() );
+        e.x2 = CGAL::to_double( eit->target().x() );
+        e.y2 = CGAL::to_double( eit->target().y() );
+
+        edges.push_back( e );
+    }
+}
+
+// does the edge pass within margin of the cell
+static bool edgeCrossesCell( const tgChopperEdge& e, const CGAL::Bbox_2& cell )
+{
+    double xmin = cell.xmin() - CLASSIFY_MARGIN, xmax = cell.xmax() + CLASSIFY_MARGIN;
+    double ymin = cell.ymin() - CLASSIFY_MARGIN, ymax = cell.ymax() + CLASSIFY_MARGIN;
+
+    if ( std::max( e.x1, e.x2 ) < xmin || std::min( e.x1, e.x2 ) > xmax ||
+         std::max( e.y1, e.y2 ) < ymin || std::min( e.y1, e.y2 ) > ymax ) {
+        return false;
+    }
+
+    // the bounding boxes overlap - the edge misses only if all four
+    // corners are on the same side of its line
+    double dx = e.x2 - e.x1;
+    double dy = e.y2 - e.y1;
+    double s[4];
+
+    s[0] = dx * ( ymin - e.y1 ) - dy * ( xmin - e.x1 );
+    s[1] = dx * ( ymin - e.y1 ) - dy * ( xmax - e.x1 );
+    s[2] = dx * ( ymax - e.y1 ) - dy * ( xmax - e.x1 );
+    s[3] = dx * ( ymax - e.y1 ) - dy * ( xmin - e.x1 );
+
+    bool allAbove = ( s[0] > 0 && s[1] > 0 && s[2] > 0 && s[3] > 0 );
+    bool allBelow = ( s[0] < 0 && s[1] < 0 && s[2] < 0 && s[3] < 0 );
+
+    return !( allAbove || allBelow );
+}
+
+static bool cellXmaxLess( const std::pair<double, unsigned int>& a, double x )
+{
+    return a.first < x;
+}
+
+static void classifyCells( const cgalPoly_PolygonSet& ps, const std::vector<CGAL::Bbox_2>& cells, std::vector<tgChopperCellClass>& classes )
+{
+    std::vector<tgChopperEdge>                      edges;
+    std::list<cgalPoly_PolygonWithHoles>            pwh_list;
+    std::list<cgalPoly_PolygonWithHoles>::const_iterator it;
+
+    ps.polygons_with_holes( std::back_inserter(pwh_list) );
+    for ( it = pwh_list.begin(); it != pwh_list.end(); ++it ) {
+        getEdges( it->outer_boundary(), edges );
+
+        cgalPoly_PolygonWithHoles::Hole_const_iterator hit;
+        for ( hit = it->holes_begin(); hit != it->holes_end(); ++hit ) {
+            getEdges( *hit, edges );
+        }
+    }
+
+    // group the cells into rows, sorted by ( the right side of ) each cell
+    typedef std::vector< std::pair<double, unsigned int> >  tgChopperRow;
+    std::map< std::pair<double, double>, tgChopperRow >     rows;
+    std::map< std::pair<double, double>, tgChopperRow >::iterator rit;
+
+    for ( unsigned int i=0; i<cells.size(); i++ ) {
+        rows[ std::make_pair( cells[i].ymin(), cells[i].ymax() ) ].push_back( std::make_pair( cells[i].xmax(), i ) );
+    }
+    for ( rit = rows.begin(); rit != rows.end(); rit++ ) {
+        std::sort( rit->second.begin(), rit->second.end() );
+    }
+
+    classes.assign( cells.size(), CELL_OUTSIDE );
+
+    // mark every cell an edge passes through
+    for ( unsigned int e=0; e<edges.size(); e++ ) {
+        double eymin = std::min( edges[e].y1, edges[e].y2 ), eymax = std::max( edges[e].y1, edges[e].y2 );
+        double exmin = std::min( edges[e].x1, edges[e].x2 ), exmax = std::max( edges[e].x1, edges[e].x2 );
+
+        for ( rit = rows.begin(); rit != rows.end(); rit++ ) {
+            if ( eymax < rit->first.first - CLASSIFY_MARGIN || eymin > rit->first.second + CLASSIFY_MARGIN ) {
+                continue;
+            }
+
+            tgChopperRow& row = rit->second;
+            tgChopperRow::iterator cit = std::lower_bound( row.begin(), row.end(), exmin - CLASSIFY_MARGIN, cellXmaxLess );
+            for ( ; cit != row.end(); cit++ ) {
+                const CGAL::Bbox_2& cell = cells[cit->second];
+
+                if ( cell.xmin() - CLASSIFY_MARGIN > exmax ) {
+                    break;
+                }
+                if ( classes[cit->second] != CELL_BOUNDARY && edgeCrossesCell( edges[e], cell ) ) {
+                    classes[cit->second] = CELL_BOUNDARY;
+                }
+            }
+        }
+    }
+
+    // the rest are inside if a ray from their center crosses an odd
+    // number of edges.  One ray per row, through the cell centers.
+    for ( rit = rows.begin(); rit != rows.end(); rit++ ) {
+        double              y = ( rit->first.first + rit->first.second ) / 2.0;
+        std::vector<double> crossings;
+
+        for ( unsigned int e=0; e<edges.size(); e++ ) {
+            const tgChopperEdge& edge = edges[e];
+
+            if ( ( edge.y1 > y ) != ( edge.y2 > y ) ) {
+                crossings.push_back( edge.x1 + ( y - edge.y1 ) * ( edge.x2 - edge.x1 ) / ( edge.y2 - edge.y1 ) );
+            }
+        }
+        std::sort( crossings.begin(), crossings.end() );
+
+        tgChopperRow& row = rit->second;
+        for ( unsigned int c=0; c<row.size(); c++ ) {
+            unsigned int idx = row[c].second;
+
+            if ( classes[idx] != CELL_BOUNDARY ) {
+                double x = ( cells[idx].xmin() + cells[idx].xmax() ) / 2.0;
+                size_t numLeft = std::lower_bound( crossings.begin(), crossings.end(), x ) - crossings.begin();
+
+                classes[idx] = ( numLeft % 2 ) ? CELL_INSIDE : CELL_OUTSIDE;
+            }
+        }
+    }
+}
+
+static cgalPoly_Polygon cellPolygon( const CGAL::Bbox_2& cell )
+{
+    cgalPoly_Point pts[4];
+
+    pts[0] = cgalPoly_Point( cell.xmin(), cell.ymin() );
+    pts[1] = cgalPoly_Point( cell.xmax(), cell.ymin() );
+    pts[2] = cgalPoly_Point( cell.xmax(), cell.ymax() );
+    pts[3] = cgalPoly_Point( cell.xmin(), cell.ymax() );
+
+    return cgalPoly_Polygon( pts, pts+4 );
+}
+
 void tgChopperChunk::setBuckets( const SGGeod& min, const SGGeod& max, bool checkBorders )
 {
     if ( checkBorders ) {
@@ -61,7 +234,94 @@ void tgChopper::Add( const tgPolygonSet& subject )
     PreChop( subject, chunks);
 
     for ( unsigned int i=0; i < chunks.size(); i++ ) {
-        chunks[i].clip(bucket_id, root_path, &lock);
+        chunks[i].clip( *this );
+    }
+}
+
+void tgChopper::Output( const SGBucket& b, const tgPolygonSet& result )
+{
+    long int         id = b.gen_index();
+    tgChopperBucket* buffer;
+
+    // map entries never move, or go away - so the pointer stays valid
+    // once we let go of the map
+    {
+        SGGuard<SGMutex> g(lock);
+        buffer = &buffers[id];
+    }
+
+    dataset.Request( id );
+
+    buffer->bucket = b;
+    buffer->polys[result.getMeta().material].push_back( result );
+    buffer->count++;
+
+    if ( buffer->count >= TG_CHOPPER_FLUSH_COUNT ) {
+        WriteBucket( *buffer );
+    }
+
+    dataset.Release( id );
+}
+
+void tgChopper::WriteBucket( tgChopperBucket& buffer )
+{
+    if ( !buffer.count ) {
+        return;
+    }
+
+    TG_PROFILE_SCOPE( "tgChopper write" );
+
+    std::string path     = root_path + "/" + buffer.bucket.gen_base_path();
+    std::string polyfile = path + "/" + buffer.bucket.gen_index_str();
+
+    dataset.MakeDirectory( polyfile );
+
+    // one datasource for the bucket, one layer per material
+    GDALDataset* poDS = tgPolygonSet::openDatasource( polyfile.c_str() );
+    if ( poDS ) {
+        std::map<std::string, tgPolygonSetList>::iterator it;
+        for ( it = buffer.polys.begin(); it != buffer.polys.end(); it++ ) {
+            OGRLayer* poLayer = tgPolygonSet::openLayer( poDS, wkbPolygon25D, tgPolygonSet::LF_ALL, it->first.c_str() );
+
+            if ( poLayer ) {
+                for ( unsigned int i=0; i<it->second.size(); i++ ) {
+                    it->second[i].toShapefile( poLayer );
+                }
+            }
+        }
+
+        tgPolygonSet::closeDatasource( poDS );
+    } else {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgChopper - cannot open " << polyfile << " - dropping " << buffer.count << " polygons" );
+    }
+
+    buffer.polys.clear();
+    buffer.count = 0;
+}
+
+void tgChopper::Flush( void )
+{
+    std::vector<long int> ids;
+
+    {
+        SGGuard<SGMutex> g(lock);
+
+        std::map<long int, tgChopperBucket>::iterator it;
+        for ( it = buffers.begin(); it != buffers.end(); it++ ) {
+            ids.push_back( it->first );
+        }
+    }
+
+    for ( unsigned int i=0; i<ids.size(); i++ ) {
+        tgChopperBucket* buffer;
+        {
+            SGGuard<SGMutex> g(lock);
+            buffer = &buffers[ids[i]];
+        }
+
+        dataset.Request( ids[i] );
+        WriteBucket( *buffer );
+        dataset.Release( ids[i] );
     }
 }
 
@@ -106,46 +366,50 @@ void tgChopper::PreChop( const tgPolygonSet& subject, std::vector<tgChopperChunk
     chunks.clear();
     if ( width > CHUNK_X || height > CHUNK_Y ) {
         // break up the geometries, and add them to the queue
-        // use exact match
+        // we want each chunk slightly larger than what we need for chopping,
+        // but we don't want to include the partial buckets on the edges.
+        std::vector<CGAL::Bbox_2>       cells;
+        std::vector<tgChopperCellClass> classes;
+
         for ( double x=startx; x<endx; x+=CHUNK_X ) {
             for ( double y=starty; y<endy; y+=CHUNK_Y ) {
-                char chunkname[256];
-                
-                sprintf(chunkname, "%0f_%0f", x, y );
-                
-                // we need two rectangles.  1 for the chunk, and one for calculating the buckets
-                // for the chunk.  we want the chunk slightly larger than what we need for chopping,
-                // but we don't want to include the partial buckets on the edges.
-                double min_bucket_x = x, max_bucket_x = x + CHUNK_X;
-                double min_bucket_y = y, max_bucket_y = y + CHUNK_Y;
-             
-                double min_cor_x = min_bucket_x - PRECHOP_CORRECTION, max_cor_x = max_bucket_x + PRECHOP_CORRECTION;
-                double min_cor_y = min_bucket_y - PRECHOP_CORRECTION, max_cor_y = max_bucket_y + PRECHOP_CORRECTION;
-                tgPolygonSet result;
-                
-                // create the clipping geometry for this piece
-                cgalPoly_Point base_pts[4];
+                cells.push_back( CGAL::Bbox_2( x - PRECHOP_CORRECTION, y - PRECHOP_CORRECTION, 
+                                               x + CHUNK_X + PRECHOP_CORRECTION, y + CHUNK_Y + PRECHOP_CORRECTION ) );
+            }
+        }
+
+        // only chunks on the subject's boundary need the exact intersection
+        classifyCells( subject.getPs(), cells, classes );
+
+        for ( unsigned int i=0; i<cells.size(); i++ ) {
+            if ( classes[i] == CELL_OUTSIDE ) {
+                continue;
+            }
+
+            double min_bucket_x = cells[i].xmin() + PRECHOP_CORRECTION, max_bucket_x = cells[i].xmax() - PRECHOP_CORRECTION;
+            double min_bucket_y = cells[i].ymin() + PRECHOP_CORRECTION, max_bucket_y = cells[i].ymax() - PRECHOP_CORRECTION;
+            char   chunkname[256];
+            
+            sprintf(chunkname, "%0f_%0f", min_bucket_x, min_bucket_y );
+
+            tgPolygonSet result;
+            if ( classes[i] == CELL_INSIDE ) {
+                result = tgPolygonSet( cellPolygon( cells[i] ), subject.getMeta() );
+            } else {
+                result.intersection2( subject, cellPolygon( cells[i] ) );
+            }
+            
+            if ( !result.isEmpty() ) {
+                result.getMeta().setDescription( chunkname );
                 
-                base_pts[0] = cgalPoly_Point( min_cor_x, min_cor_y );
-                base_pts[1] = cgalPoly_Point( max_cor_x, min_cor_y );
-                base_pts[2] = cgalPoly_Point( max_cor_x, max_cor_y );
-                base_pts[3] = cgalPoly_Point( min_cor_x, max_cor_y );
+                tgChopperChunk chunk( result );
                 
-                cgalPoly_Polygon clip( base_pts, base_pts+4 );
-                result.intersection2( subject, clip );
+                // add the correct buckets to chunk ( without correction )
+                SGGeod gMin = SGGeod::fromDeg( min_bucket_x, min_bucket_y );
+                SGGeod gMax = SGGeod::fromDeg( max_bucket_x, max_bucket_y );
                 
-                if ( !result.isEmpty() ) {
-                    result.getMeta().setDescription( chunkname );
-                    
-                    tgChopperChunk chunk( result );
-                    
-                    // add the correct buckets to chunk ( without correction )
-                    SGGeod gMin = SGGeod::fromDeg( min_bucket_x, min_bucket_y );
-                    SGGeod gMax = SGGeod::fromDeg( max_bucket_x, max_bucket_y );
-                    
-                    chunk.setBuckets ( gMin, gMax, true );
-                    chunks.push_back( chunk );
-                }
+                chunk.setBuckets ( gMin, gMax, true );
+                chunks.push_back( chunk );
             }
         }
     } else {
@@ -163,30 +427,45 @@ void tgChopper::PreChop( const tgPolygonSet& subject, std::vector<tgChopperChunk
     }
 }
 
-void tgChopperChunk::clip( long int bucket_id, std::string& rootPath, SGMutex* lock )
+void tgChopperChunk::clip( tgChopper& chopper )
 {
+    std::vector<SGBucket>           clipBuckets;
+    std::vector<CGAL::Bbox_2>       cells;
+    std::vector<tgChopperCellClass> classes;
+
+    // the clipping tile of each bucket we are saving
     for ( unsigned int i=0; i<buckets.size(); i++ ) {
-        cgalPoly_Point    base_pts[4];
+        if ( ( chopper.bucket_id >= 0 ) && ( buckets[i].gen_index() != chopper.bucket_id ) ) {
+            continue;
+        }
+
+        SGGeod sw = buckets[i].get_corner( SG_BUCKET_SW );
+        SGGeod ne = buckets[i].get_corner( SG_BUCKET_NE );
+
+        clipBuckets.push_back( buckets[i] );
+        cells.push_back( CGAL::Bbox_2( sw.getLongitudeDeg()-CLIP_CORRECTION, sw.getLatitudeDeg()-CLIP_CORRECTION, 
+                                       ne.getLongitudeDeg()+CLIP_CORRECTION, ne.getLatitudeDeg()+CLIP_CORRECTION ) );
+    }
+
+    classifyCells( chunk.getPs(), cells, classes );
+
+    for ( unsigned int i=0; i<clipBuckets.size(); i++ ) {
         const std::string material = chunk.getMeta().material;
-        SGGeod            pt;
-        char              layer[256];
         tgPolygonSet      result;
     
         SGTimeStamp       chop_begin, chop_end, chop_time;
-    
-        static double     total_chop_time = 0;
-        static unsigned long num_chops = 1;
-    
-        // set up clipping tile
-        pt = buckets[i].get_corner( SG_BUCKET_SW );
-        base_pts[0] = cgalPoly_Point( pt.getLongitudeDeg()-CLIP_CORRECTION, pt.getLatitudeDeg()-CLIP_CORRECTION );
-        pt = buckets[i].get_corner( SG_BUCKET_SE );
-        base_pts[1] = cgalPoly_Point( pt.getLongitudeDeg()+CLIP_CORRECTION, pt.getLatitudeDeg()-CLIP_CORRECTION );
-        pt = buckets[i].get_corner( SG_BUCKET_NE );
-        base_pts[2] = cgalPoly_Point( pt.getLongitudeDeg()+CLIP_CORRECTION, pt.getLatitudeDeg()+CLIP_CORRECTION );
-        pt = buckets[i].get_corner( SG_BUCKET_NW );
-        base_pts[3] = cgalPoly_Point( pt.getLongitudeDeg()-CLIP_CORRECTION, pt.getLatitudeDeg()+CLIP_CORRECTION );
-        cgalPoly_Polygon base( base_pts, base_pts+4 );
+
+        if ( classes[i] == CELL_OUTSIDE ) {
+            tgProfile::addCount( "tgChopper buckets outside", 1 );
+            continue;
+        } else if ( classes[i] == CELL_INSIDE ) {
+            // covers the whole tile - no boolean op
+            tgProfile::addCount( "tgChopper buckets inside", 1 );
+            chopper.Output( clipBuckets[i], tgPolygonSet( cellPolygon( cells[i] ), chunk.getMeta() ) );
+            continue;
+        }
+
+        cgalPoly_Polygon base = cellPolygon( cells[i] );
     
 #if DEBUG_CHOPPER
         static unsigned int curClip=1;
@@ -219,7 +498,7 @@ void tgChopperChunk::clip( long int bucket_id, std::string& rootPath, SGMutex* l
         tgPolygonSet::toDebugShapefile( poLayerResult, result.getPs(), "result" );
     
         curClip++;
-        GDALClose( poDS );
+        tgPolygonSet::closeDatasource( poDS );
         lock->unlock();
 #endif
     
@@ -229,34 +508,12 @@ void tgChopperChunk::clip( long int bucket_id, std::string& rootPath, SGMutex* l
             //          result.SetPreserve3D( true );
             //      }
         
-            long int cur_bucket = buckets[i].gen_index();
-            if ( ( bucket_id < 0 ) || (cur_bucket == bucket_id ) ) {
-                std::string path = rootPath + "/" + buckets[i].gen_base_path();
-                std::string polyfile = path + "/" + buckets[i].gen_index_str();
-            
-                // lock mutex to simgear directory creation
-                lock->lock();
-                SGPath sgp( polyfile );
-                sgp.create_dir( 0755 );
-                //lock.unlock();
-            
-                // now get a per dataset lock
-                //dataset.Request( cur_bucket );
-            
-                snprintf( layer, 256, "%s_%s", material.c_str(), result.getMeta().getMetaType().c_str() );
-            
-                // save chopped polygon to a Shapefile in layer named from material
-                result.toShapefile( polyfile.c_str(), material.c_str() );
-            
-                // Release per dataset lock
-                //dataset.Release( cur_bucket );
-                lock->unlock();
-            }
+            // buffered - written to a Shapefile in layer named from material
+            chopper.Output( clipBuckets[i], result );
         }
 
         // dump debug...
-        total_chop_time += chop_time.toMSecs();
-        SG_LOG( SG_GENERAL, SG_DEBUG, "tgChopper Clip - avg chop time: " << total_chop_time/num_chops );
-        num_chops++;        
+        tgProfile::addTime( "tgChopper intersection", chop_time.toSecs() );
+        SG_LOG( SG_GENERAL, SG_DEBUG, "tgChopper Clip - chop time: " << chop_time.toMSecs() );
     }
 }
\ No newline at end of file
@@ -7,6 +7,11 @@
 #include <terragear/tg_dataset_protect.hxx>
 #include "tg_polygon_set.hxx"
 
+// polygons buffered per bucket are written once there are this many
+#define TG_CHOPPER_FLUSH_COUNT  (256)
+
+class tgChopper;
+
 class tgChopperChunk
 {
 public:
@@ -16,13 +21,28 @@ public:
     
     void setBuckets( const SGGeod& min, const SGGeod& max, bool checkBorders );
     
-    void clip( long int bucket_id, std::string& rootPath, SGMutex* lock );
+    void clip( tgChopper& chopper );
     
 private:
     std::vector<SGBucket>   buckets;
     tgPolygonSet            chunk;
 };
 
+// clipped polygons of one bucket, by material, waiting to be written
+struct tgChopperBucket
+{
+    tgChopperBucket() : count(0) {}
+
+    SGBucket                                bucket;
+    std::map<std::string, tgPolygonSetList> polys;
+    unsigned int                            count;
+};
+
+// Clipped polygons are buffered per bucket, and a bucket's buffer is
+// written in one go - one datasource open per flush, not per polygon.
+// Each bucket has its own lock, so threads clipping into different
+// buckets don't wait on each other's writes.  Whatever is left is
+// written by Flush(), or when the chopper is destroyed.
 class tgChopper
 {
 public:
@@ -31,13 +51,30 @@ public:
         bucket_id = bid;
     }
 
+    ~tgChopper() {
+        Flush();
+    }
+
     void Add( const tgPolygonSet& poly );
 
+    // write out all buffered polygons
+    void Flush( void );
+
 private:
+    friend class tgChopperChunk;
+
     void PreChop( const tgPolygonSet& subject, std::vector<tgChopperChunk>& chunks );
 
+    // buffer a clipped polygon for bucket b
+    void Output( const SGBucket& b, const tgPolygonSet& result );
+
+    // call with the bucket's dataset lock held
+    void WriteBucket( tgChopperBucket& buffer );
+
     long int         bucket_id;     // set if we only want to save a single bucket
     std::string      root_path;
-    SGMutex          lock;
-    tgDatasetAcess   dataset;
+
+    std::map<long int, tgChopperBucket> buffers;
+    SGMutex          lock;          // just the buffers map - not their contents
+    tgDatasetAccess  dataset;       // per bucket locks, and directory creation
 };
\ No newline at end of file
@@ -201,6 +201,7 @@ public:
     } PolygonSetLayerFields;
     
     static GDALDataset*                 openDatasource( const char* datasource_name );
+    static void                         closeDatasource( GDALDataset* poDS );
     static OGRLayer*                    openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, PolygonSetLayerFields lf, const char* layer_name );
     
     // Intermediate data file output
@@ -4,6 +4,9 @@
 
 #include <simgear/misc/sg_path.hxx> // for file i/o
 
+#include <terragear/tg_profile.hxx>
+#include <terragear/tg_shapefile_cache.hxx>
+
 // we are loading polygonal data from untrusted sources
 // high probability this will crash CGAL if we just load 
 // the points.  previous terragear would attempt to clean
@@ -124,22 +127,18 @@ tgPolygonSet::tgPolygonSet( OGRFeature* poFeature, OGRPolygon* poGeometry )
     ps.difference( holesUnion );
 }
 
+// datasources stay open in the shapefile cache - give them back with
+// closeDatasource, never GDALClose
 GDALDataset* tgPolygonSet::openDatasource( const char* datasource_name )
 {
-    GDALDataset*    poDS = NULL;
-    GDALDriver*     poDriver = NULL;
-    const char*     format_name = "ESRI Shapefile";
-    
     SG_LOG( SG_GENERAL, SG_DEBUG, "Open Datasource: " << datasource_name );
-    
-    GDALAllRegister();
-    
-    poDriver = GetGDALDriverManager()->GetDriverByName( format_name );
-    if ( poDriver ) {    
-        poDS = poDriver->Create( datasource_name, 0, 0, 0, GDT_Unknown, NULL );
-    }
-    
-    return poDS;
+
+    return tgShapefileCache::instance().acquire( datasource_name );
+}
+
+void tgPolygonSet::closeDatasource( GDALDataset* poDS )
+{
+    tgShapefileCache::instance().release( poDS );
 }
 
 OGRLayer* tgPolygonSet::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, PolygonSetLayerFields lf, const char* layer_name )
@@ -151,7 +150,7 @@ OGRLayer* tgPolygonSet::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, Pol
         exit(0);
     }
     
-    poLayer = poDS->GetLayerByName( layer_name );    
+    poLayer = tgShapefileCache::instance().getLayer( poDS, layer_name );
     if ( !poLayer ) {
         SG_LOG(SG_GENERAL, SG_DEBUG, "tgPolygonSet::toShapefile: layer " << layer_name << " doesn't exist - create" );
 
@@ -159,6 +158,11 @@ OGRLayer* tgPolygonSet::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, Pol
         srs.SetWellKnownGeogCS("WGS84");
         
         poLayer = poDS->CreateLayer( layer_name, &srs, lt, NULL );
+        if ( !poLayer ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "Creation of layer '" << layer_name << "' failed" );
+            return NULL;
+        }
+        tgShapefileCache::instance().addLayer( poDS, layer_name, poLayer );
 
         OGRFieldDefn descriptionField( "tg_desc", OFTString );
         descriptionField.SetWidth( 128 );
@@ -400,6 +404,8 @@ OGRLayer* tgPolygonSet::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, Pol
 
 void tgPolygonSet::toShapefile( const char* datasource, const char* layer ) const
 {
+    TG_PROFILE_SCOPE( "shapefile write" );
+
     // Open datasource and layer
     GDALDataset* poDS = openDatasource( datasource );
 
@@ -412,8 +418,7 @@ void tgPolygonSet::toShapefile( const char* datasource, const char* layer ) cons
         }
     }
     
-    // close datasource
-    GDALClose( poDS );
+    closeDatasource( poDS );
 }
 
 void tgPolygonSet::toShapefile( OGRLayer* poLayer ) const
@@ -636,12 +641,12 @@ void tgPolygonSet::processLayer(OGRLayer* poLayer, tgPolygonSetList& polys )
 
 void tgPolygonSet::fromShapefile( const SGPath& p, tgPolygonSetList& polys )
 {
+    TG_PROFILE_SCOPE( "shapefile read" );
+
     GDALDataset* poDS = NULL;
     OGRLayer*    poLayer = NULL;
         
-    GDALAllRegister();
-    
-    poDS = (GDALDataset*)GDALOpenEx( p.c_str(), GDAL_OF_VECTOR, NULL, NULL, NULL );
+    poDS = tgShapefileCache::instance().acquireForRead( p.str() );
     if( poDS == NULL )
     {
         SG_LOG( SG_GENERAL, SG_DEBUG, "Failed opening datasource " << p.c_str() );
@@ -658,7 +663,8 @@ void tgPolygonSet::fromShapefile( const SGPath& p, tgPolygonSetList& polys )
         processLayer(poLayer, polys );
     }
     
-    GDALClose( poDS );    
+    closeDatasource( poDS );
+    tgProfile::addCount( "shapefile polys read", polys.size() );
     
     for ( unsigned int i=0; i<polys.size(); i++ ) {
         SG_LOG( SG_GENERAL, SG_DEBUG, "return poly " << i << " with material " << polys[i].getMeta().getMaterial() );
@@ -132,7 +132,7 @@ tgPolygonSet tgPolygonSet::offset( double oset ) const
     boundaries.difference( holes );
     
     if ( poDs ) {
-        GDALClose( poDs );
+        closeDatasource( poDs );
     }
     
     return tgPolygonSet( boundaries, ti, 0 );
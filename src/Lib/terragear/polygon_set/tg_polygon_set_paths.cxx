@@ -318,7 +318,7 @@ void tgPolygonSetPaths::traversePaths( void )
                 } while ( !curPath->complete );
 
 #if DEBUG_PATHS                                
-                GDALClose( poDS );
+                tgPolygonSet::closeDatasource( poDS );
 #endif
                 
             }
@@ -432,7 +432,7 @@ void tgPolygonSetPaths::printFace( const char* layer, cgalPoly_FaceConstHandle f
         cgalPoly_Polygon poly( nodes.begin(), nodes.end()  );
         tgPolygonSet::toDebugShapefile( poLayerEdges, poly, "desc" );
         
-        GDALClose( poDS );
+        tgPolygonSet::closeDatasource( poDS );
         
     } else {
         SG_LOG(SG_GENERAL, SG_INFO, "tgPolygonSet::printFace - face has no outer ccb " );
@@ -491,6 +491,6 @@ void tgPolygonSetPath::toShapefile( const char* ds )
     // save Path
 
     
-    GDALClose(poDS);
+    tgPolygonSet::closeDatasource( poDS );
 #endif    
 }
\ No newline at end of file
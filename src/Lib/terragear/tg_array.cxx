@@ -23,9 +23,14 @@
 #  include <config.h>
 #endif
 
+#include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
+#include <limits>
 
 #include <simgear/compiler.h>
+#include <simgear/constants.h>
 #include <simgear/misc/sgstream.hxx>
 #include <simgear/debug/logstream.hxx>
 #include <simgear/misc/strutils.hxx>
@@ -33,13 +38,21 @@
 #include <simgear/io/lowlevel.hxx>
 
 #include "tg_array.hxx"
+#include "tg_mapped_file.hxx"
+#include "tg_profile.hxx"
 
 using std::string;
 
+// number of relaxation passes over void data in remove_voids
+#define VOID_RELAX_PASSES   (32)
+
 
 tgArray::tgArray( void ):
   array_in(NULL),
   fitted_in(NULL),
+  fitted_bin_in(NULL),
+  array_map(NULL),
+  grid(NULL),
   in_data(NULL)
 {
 
@@ -49,7 +62,10 @@ tgArray::tgArray( void ):
 tgArray::tgArray( const string &file ):
   array_in(NULL),
   fitted_in(NULL),
-      in_data(NULL)
+  fitted_bin_in(NULL),
+  array_map(NULL),
+  grid(NULL),
+  in_data(NULL)
 {
     tgArray::open(file);
 }
@@ -57,16 +73,43 @@ tgArray::tgArray( const string &file ):
 
 // open an Array file (and fitted file if it exists)
 bool tgArray::open( const string& file_base ) {
-    // open array data file
-    string array_name = file_base + ".arr.gz";
+    // drop the previous file - and its mapping - if we are reopened
+    unload();
 
-    array_in = gzopen( array_name.c_str(), "rb" );
-    if (array_in == NULL) {
-        return false;
+    // a raw array file is mapped, rather than decompressed
+    string raw_name = file_base + ".arr.raw";
+
+    array_map = new tgMappedFile();
+    if ( array_map->open( raw_name ) ) {
+        SG_LOG(SG_GENERAL, SG_DEBUG, "  Mapped raw array file: " << raw_name );
+    } else {
+        delete array_map;
+        array_map = NULL;
+
+        // open array data file
+        string array_name = file_base + ".arr.gz";
+
+        array_in = gzopen( array_name.c_str(), "rb" );
+        if (array_in == NULL) {
+            return false;
+        }
     }
 
-    // open fitted data file
+    // open fitted data file - binary if it starts with the header
     string fitted_name = file_base + ".fit.gz";
+    fitted_bin_in = gzopen( fitted_name.c_str(), "rb" );
+    if ( fitted_bin_in != NULL ) {
+        int32_t header = 0;
+        sgReadLong(fitted_bin_in, &header);
+        if ( header == TG_FIT_BIN_HEADER ) {
+            SG_LOG(SG_GENERAL, SG_DEBUG, "  Opening binary fitted data file: " << fitted_name );
+            return true;
+        }
+
+        gzclose(fitted_bin_in);
+        fitted_bin_in = NULL;
+    }
+
     fitted_in = new sg_gzifstream( fitted_name );
     if ( !fitted_in->is_open() ) {
         // not having a .fit file is unfortunate, but not fatal.  We
@@ -80,7 +123,7 @@ bool tgArray::open( const string& file_base ) {
         SG_LOG(SG_GENERAL, SG_DEBUG, "  Opening fitted data file: " << fitted_name );
     }
 
-    return (array_in != NULL) ? true : false;
+    return true;
 }
 
 
@@ -92,12 +135,23 @@ tgArray::close() {
         array_in = NULL;
     }
 
+    // keep the mapping while we sample from it
+    if ( array_map && ( grid == NULL || grid == in_data ) ) {
+        delete array_map;
+        array_map = NULL;
+    }
+
     if (fitted_in ) {
         fitted_in->close();
         delete fitted_in;
         fitted_in = NULL;
     }
 
+    if (fitted_bin_in) {
+        gzclose(fitted_bin_in);
+        fitted_bin_in = NULL;
+    }
+
     return true;
 }
 
@@ -114,11 +168,23 @@ tgArray::unload( void ) {
         fitted_in = NULL;
     }
 
+    if (fitted_bin_in) {
+        gzclose(fitted_bin_in);
+        fitted_bin_in = NULL;
+    }
+
     if (in_data) {
         delete[] in_data;
         in_data = NULL;
     }
 
+    if (array_map) {
+        delete array_map;
+        array_map = NULL;
+    }
+    grid = NULL;
+
+    nearest_nonvoid.clear();
     corner_list.clear();
     fitted_list.clear();
 }
@@ -127,10 +193,14 @@ tgArray::unload( void ) {
 // the file wasn't found.
 bool
 tgArray::parse( const SGBucket& b ) {
+    TG_PROFILE_SCOPE( "tgArray parse" );
+
     // Parse/load the array data file
     SG_LOG(SG_GENERAL, SG_DEBUG, " Parse bucket centered at " << b.get_center() );
     
-    if ( array_in ) {
+    if ( array_map ) {
+        parse_raw();
+    } else if ( array_in ) {
         parse_bin();
     } else {
         // file not open (not found?), fill with zero'd data        
@@ -152,11 +222,37 @@ tgArray::parse( const SGBucket& b ) {
 
         in_data = new short[cols * rows];
         memset(in_data, 0, sizeof(short) * cols * rows);
+        grid = in_data;
         SG_LOG(SG_GENERAL, SG_DEBUG, "    File not open, so using zero'd data" );
     }
 
+    find_nearest_nonvoid();
+
     // Parse/load the fitted data file
-    if ( fitted_in && fitted_in->is_open() ) {
+    if ( fitted_bin_in ) {
+        int fitted_size;
+        sgReadInt(fitted_bin_in, &fitted_size);
+
+        if ( fitted_size > 0 ) {
+            std::vector<double> x( fitted_size ), y( fitted_size );
+            std::vector<float>  z( fitted_size );
+
+            sgClearReadError();
+            sgReadDouble(fitted_bin_in, fitted_size, &x[0]);
+            sgReadDouble(fitted_bin_in, fitted_size, &y[0]);
+            sgReadFloat(fitted_bin_in, fitted_size, &z[0]);
+
+            if ( sgReadError() ) {
+                SG_LOG(SG_GENERAL, SG_ALERT, "  Error reading fitted data - ignoring it" );
+            } else {
+                fitted_list.reserve( fitted_size );
+                for ( int i = 0; i < fitted_size; ++i ) {
+                    fitted_list.push_back( SGGeod::fromDegM(x[i], y[i], z[i]) );
+                }
+            }
+        }
+        SG_LOG(SG_GENERAL, SG_DEBUG, " loaded " << fitted_list.size() << " fitted points" );
+    } else if ( fitted_in && fitted_in->is_open() ) {
         int fitted_size;
         double x, y, z;
         *fitted_in >> fitted_size;
@@ -196,6 +292,7 @@ void tgArray::parse_bin()
 
     in_data = new short[cols * rows];
     sgReadShort(array_in, cols * rows, in_data);
+    grid = in_data;
     
     SG_LOG(SG_GENERAL, SG_DEBUG, "    origin  = " << originx << "  " << originy );
     SG_LOG(SG_GENERAL, SG_DEBUG, "    cols = " << cols << "  rows = " << rows );
@@ -203,6 +300,114 @@ void tgArray::parse_bin()
     
 }
 
+void tgArray::parse_raw()
+{
+    const char* data = array_map->getData();
+    size_t      size = array_map->getSize();
+
+    tgArrayRawHeader header;
+    if ( size < sizeof(header) ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "\nThe raw array file is truncated." );
+        exit(1);
+    }
+    memcpy( &header, data, sizeof(header) );
+
+    bool swap = ( header.byteOrder != TG_ARRAY_RAW_BYTE_ORDER );
+    if ( swap ) {
+        sgEndianSwap( (uint32_t*)&header.magic );
+        sgEndianSwap( (uint32_t*)&header.byteOrder );
+        sgEndianSwap( (uint32_t*)&header.minx );
+        sgEndianSwap( (uint32_t*)&header.miny );
+        sgEndianSwap( (uint32_t*)&header.cols );
+        sgEndianSwap( (uint32_t*)&header.col_step );
+        sgEndianSwap( (uint32_t*)&header.rows );
+        sgEndianSwap( (uint32_t*)&header.row_step );
+    }
+
+    if ( header.magic != TG_ARRAY_RAW_MAGIC || header.byteOrder != TG_ARRAY_RAW_BYTE_ORDER ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "\nThe raw array file is not in the correct format."
+        << "\nPlease rebuild it using the latest TerraGear tools.");
+        exit(1);
+    }
+
+    originx  = header.minx;
+    originy  = header.miny;
+    cols     = header.cols;
+    col_step = header.col_step;
+    rows     = header.rows;
+    row_step = header.row_step;
+
+    if ( cols <= 0 || rows <= 0 || size < sizeof(header) + sizeof(short) * cols * rows ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "\nThe raw array file is truncated." );
+        exit(1);
+    }
+
+    // the header keeps the samples aligned - so we sample in place
+    grid = (const short*)( data + sizeof(header) );
+
+    if ( swap ) {
+        // written on a machine with the other byte order
+        make_writable();
+        for ( int i = 0; i < cols * rows; i++ ) {
+            sgEndianSwap( (uint16_t*)&in_data[i] );
+        }
+    }
+
+    SG_LOG(SG_GENERAL, SG_DEBUG, "    origin  = " << originx << "  " << originy );
+    SG_LOG(SG_GENERAL, SG_DEBUG, "    cols = " << cols << "  rows = " << rows );
+    SG_LOG(SG_GENERAL, SG_DEBUG, "    col_step = " << col_step << "  row_step = " << row_step );
+}
+
+void tgArray::make_writable()
+{
+    if ( in_data == NULL && grid != NULL ) {
+        in_data = new short[cols * rows];
+        memcpy( in_data, grid, sizeof(short) * cols * rows );
+        grid = in_data;
+    }
+}
+
+bool tgArray::write_raw( const std::string& file, int minx, int miny, int cols, int col_step, int rows, int row_step, const short* data )
+{
+    // write next to the file, then rename - so a reader mapping the old
+    // file keeps a consistent view
+    std::string tmp_file = file + ".new";
+    std::ofstream output_file( tmp_file.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+
+    if ( !output_file.is_open() ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "ERROR:  cannot open " << tmp_file << " for writing!" );
+        return false;
+    }
+
+    tgArrayRawHeader header;
+    header.magic     = TG_ARRAY_RAW_MAGIC;
+    header.byteOrder = TG_ARRAY_RAW_BYTE_ORDER;
+    header.minx      = minx;
+    header.miny      = miny;
+    header.cols      = cols;
+    header.col_step  = col_step;
+    header.rows      = rows;
+    header.row_step  = row_step;
+
+    output_file.write( (const char*)&header, sizeof(header) );
+    output_file.write( (const char*)data, sizeof(short) * cols * rows );
+    output_file.close();
+
+    if ( !output_file ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "ERROR:  writing " << tmp_file << " failed!" );
+        ::remove( tmp_file.c_str() );
+        return false;
+    }
+
+    if ( ::rename( tmp_file.c_str(), file.c_str() ) != 0 ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "ERROR:  cannot rename " << tmp_file << " to " << file );
+        ::remove( tmp_file.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
 // write an Array file
 bool tgArray::write( const string root_dir, SGBucket& b ) {
     // generate output file name
@@ -237,110 +442,240 @@ bool tgArray::write( const string root_dir, SGBucket& b ) {
 }
 
 
-// do our best to remove voids by picking data from the nearest neighbor.
-void tgArray::remove_voids( ) {
-    // need two passes to ensure that all voids are removed (unless entire
-    // array is a void.)
-    bool have_void = true;
-    int last_elev = -32768;
-    for ( int pass = 0; pass < 2 && have_void; ++pass ) {
-        // attempt to fill in any void data horizontally
-        for ( int i = 0; i < cols; i++ ) {
-            int j;
-
-            // fill in front ways
-            last_elev = -32768;
-            have_void = false;
-            for ( j = 0; j < rows; j++ ) {
-                if ( get_array_elev(i,j) > -9000 ) {
-                    last_elev = get_array_elev(i,j) ;
-                } else if ( last_elev > -9000 ) {
-                    set_array_elev(i, j, last_elev);
-                } else {
-                    have_void = true;
-                }
+// write a binary fitted point file
+bool tgArray::write_fitted( const string& file, const std::vector<SGGeod>& points, int level ) {
+    char mode[4];
+    sprintf( mode, "wb%d", level < 0 ? 0 : level > 9 ? 9 : level );
+
+    gzFile fp;
+    if ( (fp = gzopen( file.c_str(), mode )) == NULL ) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "ERROR:  cannot open " << file << " for writing!" );
+        return false;
+    }
+
+    int fitted_size = points.size();
+    std::vector<double> x( fitted_size ), y( fitted_size );
+    std::vector<float>  z( fitted_size );
+
+    for ( int i = 0; i < fitted_size; ++i ) {
+        x[i] = points[i].getLongitudeDeg();
+        y[i] = points[i].getLatitudeDeg();
+        z[i] = points[i].getElevationM();
+    }
+
+    sgWriteLong(fp, TG_FIT_BIN_HEADER);
+    sgWriteInt(fp, fitted_size);
+    if ( fitted_size > 0 ) {
+        sgWriteDouble(fp, fitted_size, &x[0]);
+        sgWriteDouble(fp, fitted_size, &y[0]);
+        sgWriteFloat(fp, fitted_size, &z[0]);
+    }
+
+    return ( gzclose(fp) == Z_OK );
+}
+
+
+// Find the closest non void grid point of every grid point.
+// This is an exact euclidean distance transform ( Felzenszwalb and
+// Huttenlocher ) done in two separable passes, so it is linear in the
+// number of grid points.  Column spacing is scaled by cos(lat) so the
+// distance is close to the distance on the ground.
+void tgArray::find_nearest_nonvoid() {
+    int size = cols * rows;
+    bool have_void = false;
+    bool have_data = false;
+
+    nearest_nonvoid.clear();
+
+    for ( int i = 0; i < size; i++ ) {
+        if ( grid[i] > -9000 ) {
+            have_data = true;
+        } else {
+            have_void = true;
+        }
+    }
+
+    if ( !have_void ) {
+        return;
+    }
+
+    nearest_nonvoid.assign( size, -1 );
+    if ( !have_data ) {
+        return;
+    }
+
+    const double inf = std::numeric_limits<double>::infinity();
+    double lat = ( originy + 0.5 * rows * row_step ) / 3600.0;
+    double wx  = col_step * cos( lat * SGD_DEGREES_TO_RADIANS );
+    double wx2 = wx * wx;
+    double wy2 = row_step * row_step;
+
+    // pass 1 : closest data point in the same column
+    std::vector<int>    col_nearest( size, -1 );
+    std::vector<double> col_dist( size, inf );
+
+    for ( int col = 0; col < cols; col++ ) {
+        int base = col * rows;
+        int last = -1;
+
+        for ( int row = 0; row < rows; row++ ) {
+            if ( grid[base + row] > -9000 ) {
+                last = row;
             }
-            // fill in back ways
-            last_elev = -32768;
-            have_void = false;
-            for ( j = rows - 1; j >= 0; j-- ) {
-                if ( get_array_elev(i,j) > -9000 ) {
-                    last_elev = get_array_elev(i,j);
-                } else if ( last_elev > -9000 ) {
-                    set_array_elev(i, j, last_elev);
-                } else {
-                    have_void = true;
-                }
+            col_nearest[base + row] = last;
+        }
+
+        last = -1;
+        for ( int row = rows - 1; row >= 0; row-- ) {
+            if ( grid[base + row] > -9000 ) {
+                last = row;
+            }
+
+            int& n = col_nearest[base + row];
+            if ( last >= 0 && ( n < 0 || last - row < row - n ) ) {
+                n = last;
+            }
+            if ( n >= 0 ) {
+                col_dist[base + row] = (row - n) * (row - n) * wy2;
             }
         }
+    }
 
-        // attempt to fill in any void data vertically
-        for ( int j = 0; j < rows; j++ ) {
-            int i;
-
-            // fill in front ways
-            last_elev = -32768;
-            have_void = false;
-            for ( i = 0; i < cols; i++ ) {
-                if ( get_array_elev(i,j) > -9999 ) {
-                    last_elev = get_array_elev(i,j);
-                } else if ( last_elev > -9999 ) {
-                    set_array_elev(i, j, last_elev);
-                } else {
-                    have_void = true;
-                }
+    // pass 2 : along each row, the lower envelope of the parabolas
+    // rooted at each column's distance
+    std::vector<int>    v( cols );
+    std::vector<double> z( cols + 1 );
+
+    for ( int row = 0; row < rows; row++ ) {
+        int k = -1;
+
+        for ( int q = 0; q < cols; q++ ) {
+            double fq = col_dist[q * rows + row];
+            if ( fq == inf ) {
+                continue;
+            }
+
+            if ( k < 0 ) {
+                k = 0;
+                v[0] = q;
+                z[0] = -inf;
+                z[1] = inf;
+                continue;
             }
 
-            // fill in back ways
-            last_elev = -32768;
-            have_void = false;
-            for ( i = cols - 1; i >= 0; i-- ) {
-                if ( get_array_elev(i,j) > -9999 ) {
-                    last_elev = get_array_elev(i,j);
-                } else if ( last_elev > -9999 ) {
-                    set_array_elev(i, j, last_elev);
-                } else {
-                    have_void = true;
+            double s;
+            while ( true ) {
+                int    p  = v[k];
+                double fp = col_dist[p * rows + row];
+
+                s = ( (fq + wx2 * q * q) - (fp + wx2 * p * p) ) / ( 2.0 * wx2 * (q - p) );
+                if ( s > z[k] ) {
+                    break;
                 }
+                k--;
+            }
+
+            k++;
+            v[k]   = q;
+            z[k]   = s;
+            z[k+1] = inf;
+        }
+
+        if ( k < 0 ) {
+            continue;
+        }
+
+        int j = 0;
+        for ( int p = 0; p < cols; p++ ) {
+            while ( z[j+1] < p ) {
+                j++;
             }
+
+            int q = v[j];
+            nearest_nonvoid[p * rows + row] = q * rows + col_nearest[q * rows + row];
         }
     }
+}
+
+// do our best to remove voids.  Each void starts with the elevation of
+// its nearest non void neighbor, then the voids are relaxed towards a
+// smooth surface, keeping the real data fixed.  This avoids the streaks
+// and terraces of just copying the nearest value.
+void tgArray::remove_voids( ) {
+    if ( nearest_nonvoid.empty() ) {
+        // no voids
+        return;
+    }
+
+    int size = cols * rows;
+
+    // we're about to fill the voids in
+    make_writable();
 
-    if ( have_void ) {
-        // after all that work we still have a void, likely the
-        // entire array is void.  Fill in the void areas with zero
+    if ( nearest_nonvoid[0] < 0 ) {
+        // the entire array is void.  Fill in the void areas with zero
         // as a panic fall back.
-        for ( int i = 0; i < cols; i++ ) {
-            for ( int j = 0; j < rows; j++ ) {
-                if ( get_array_elev(i,j) <= -9999 ) {
-                    set_array_elev(i, j, 0);
-                }
+        for ( int i = 0; i < size; i++ ) {
+            in_data[i] = 0;
+        }
+        nearest_nonvoid.clear();
+        return;
+    }
+
+    std::vector<int>   voids;
+    std::vector<float> elev( size );
+
+    for ( int i = 0; i < size; i++ ) {
+        if ( nearest_nonvoid[i] != i ) {
+            voids.push_back( i );
+        }
+        elev[i] = in_data[nearest_nonvoid[i]];
+    }
+
+    for ( int pass = 0; pass < VOID_RELAX_PASSES; pass++ ) {
+        for ( unsigned int v = 0; v < voids.size(); v++ ) {
+            int   col = voids[v] / rows;
+            int   row = voids[v] % rows;
+            float sum = 0.0f;
+            int   num = 0;
+
+            if ( col > 0 )        { sum += elev[voids[v] - rows]; num++; }
+            if ( col < cols - 1 ) { sum += elev[voids[v] + rows]; num++; }
+            if ( row > 0 )        { sum += elev[voids[v] - 1];    num++; }
+            if ( row < rows - 1 ) { sum += elev[voids[v] + 1];    num++; }
+
+            if ( num ) {
+                elev[voids[v]] = sum / num;
             }
         }
     }
+
+    for ( unsigned int v = 0; v < voids.size(); v++ ) {
+        in_data[voids[v]] = (short)floor( elev[voids[v]] + 0.5f );
+    }
+
+    nearest_nonvoid.clear();
 }
 
 
-// Return the elevation of the closest non-void grid point to lon, lat
+// Return the elevation of the closest non-void grid point to the grid
+// point nearest lon, lat
 double tgArray::closest_nonvoid_elev( double lon, double lat ) const {
-    double mindist = 99999999999.9;
-    double minelev = -9999.0;
-    SGGeod p0 = SGGeod::fromDeg( lon, lat );
+    int col = (int)floor( (lon - originx) / col_step + 0.5 );
+    int row = (int)floor( (lat - originy) / row_step + 0.5 );
 
-    for ( int row = 0; row < rows; row++ ) {
-        for ( int col = 0; col < cols; col++ ) {
-            SGGeod p1 = SGGeod::fromDeg( originx + col * col_step, originy + row * row_step );
-            double dist = SGGeodesy::distanceM( p0, p1 );
-            double elev = get_array_elev(col, row);
-            if ( dist < mindist && elev > -9000 ) {
-                mindist = dist;
-                minelev = elev;
-            }
-        }
+    if ( col < 0 )     { col = 0; }
+    if ( col >= cols ) { col = cols - 1; }
+    if ( row < 0 )     { row = 0; }
+    if ( row >= rows ) { row = rows - 1; }
+
+    int index = (col * rows) + row;
+    if ( !nearest_nonvoid.empty() ) {
+        index = nearest_nonvoid[index];
     }
 
-    if ( minelev > -9999.0 ) {
-        return minelev;
+    if ( index >= 0 && grid[index] > -9000 ) {
+        return grid[index];
     } else {
         return 0.0;
     }
@@ -465,6 +800,11 @@ tgArray::~tgArray( void )
         in_data = NULL;
     }
 
+    if (array_map) {
+        delete array_map;
+        array_map = NULL;
+    }
+
     if (array_in) {
         gzclose(array_in);
         array_in = NULL;
@@ -475,21 +815,40 @@ tgArray::~tgArray( void )
         delete fitted_in;
         fitted_in = NULL;
     }
+
+    if (fitted_bin_in) {
+        gzclose(fitted_bin_in);
+        fitted_bin_in = NULL;
+    }
+}
+
+size_t tgArray::get_memory_size() const
+{
+    size_t size = sizeof(tgArray);
+
+    if ( in_data ) {
+        size += sizeof(short) * cols * rows;
+    }
+    size += sizeof(int) * nearest_nonvoid.size();
+    size += sizeof(SGGeod) * ( corner_list.size() + fitted_list.size() );
+
+    return size;
 }
 
 int tgArray::get_array_elev( int col, int row ) const
 {
-    return in_data[(col * rows) + row];
+    return grid[(col * rows) + row];
 }
 
 void tgArray::set_array_elev( int col, int row, int val )
 {
+    make_writable();
     in_data[(col * rows) + row] = val;
 }
 
 bool tgArray::is_open() const
 {
-  if ( array_in != NULL ) {
+  if ( array_in != NULL || array_map != NULL ) {
       return true;
   } else {
       return false;
@@ -23,11 +23,36 @@
 #ifndef _TG_ARRAY_HXX
 #define _TG_ARRAY_HXX
 
+#include <stdint.h>
+#include <vector>
+
 #include <simgear/compiler.h>
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/math/sg_types.hxx>
 #include <simgear/misc/sgstream.hxx>
 
+// binary fitted point file : 'TGFT' header, point count, then
+// the lon ( float64 ), lat ( float64 ) and elevation ( float32 ) columns.
+// Files without the header are read as the legacy text format.
+#define TG_FIT_BIN_HEADER   (0x54474654)    // 'TGFT'
+
+// raw array file ( .arr.raw ) : tgArrayRawHeader, then cols * rows int16
+// samples, column major, in the byte order of the writer.  Not compressed,
+// so it is mapped read only and sampled in place.  If a bucket has both a
+// .arr.raw and a .arr.gz, the raw file is used.
+#define TG_ARRAY_RAW_MAGIC      (0x5447414d)    // 'TGAM'
+#define TG_ARRAY_RAW_BYTE_ORDER (0x01020304)
+
+struct tgArrayRawHeader {
+    int32_t     magic;
+    int32_t     byteOrder;
+    int32_t     minx, miny;         // arc seconds
+    int32_t     cols, col_step;
+    int32_t     rows, row_step;
+};
+
+class tgMappedFile;
+
 class tgArray {
 
 private:
@@ -35,6 +60,7 @@ private:
 
     // fitted file pointer
     sg_gzifstream *fitted_in;
+    gzFile fitted_bin_in;
 
     // coordinates (in arc seconds) of south west corner
     double originx, originy;
@@ -45,14 +71,31 @@ private:
     // Distance between column and row data points (in arc seconds)
     double col_step, row_step;
 
+    // raw array file, mapped read only
+    tgMappedFile *array_map;
+
+    // the grid we sample.  Points into array_map for a raw array file,
+    // otherwise ( or once it has been modified ) to in_data
+    const short *grid;
+
     // pointers to the actual grid data allocated here
     short *in_data;
 
+    // index ( into in_data ) of the closest non void grid point of each
+    // grid point, -1 if the whole array is void.  Empty if there are no
+    // voids.  Built on parse.
+    std::vector<int> nearest_nonvoid;
+
     // output nodes
     std::vector<SGGeod> corner_list;
     std::vector<SGGeod> fitted_list;
 
     void parse_bin();
+    void parse_raw();
+
+    // copy a mapped grid into in_data, so it can be modified
+    void make_writable();
+    void find_nearest_nonvoid();
 public:
 
     // Constructor
@@ -77,11 +120,18 @@ public:
     // write an Array file
     bool write( const std::string root_dir, SGBucket& b );
 
-    // do our best to remove voids by picking data from the nearest
-    // neighbor.
+    // write a raw array file of cols * rows samples, column major
+    static bool write_raw( const std::string& file, int minx, int miny, int cols, int col_step, int rows, int row_step, const short* data );
+
+    // write a binary fitted point file with gzip compression level 0 - 9
+    static bool write_fitted( const std::string& file, const std::vector<SGGeod>& points, int level );
+
+    // do our best to remove voids : start from the nearest neighbor,
+    // then smooth across the void.
     void remove_voids();
 
-    // Return the elevation of the closest non-void grid point to lon, lat
+    // Return the elevation of the closest non-void grid point to the
+    // grid point nearest lon, lat ( in arc seconds )
     double closest_nonvoid_elev( double lon, double lat ) const;
 
     // return the current altitude based on grid data.  We should
@@ -100,6 +150,9 @@ public:
     inline std::vector<SGGeod> const& get_corner_list() const { return corner_list; }
     inline std::vector<SGGeod> const& get_fitted_list() const { return fitted_list; }
 
+    // bytes held by the grid, void lookup and node lists
+    size_t get_memory_size() const;
+
     int get_array_elev( int col, int row ) const;
     void set_array_elev( int col, int row, int val );
 
@@ -0,0 +1,172 @@
+#include <simgear/threads/SGGuard.hxx>
+#include <simgear/debug/logstream.hxx>
+#include <simgear/structure/exception.hxx>
+
+#include "tg_array_cache.hxx"
+
+// constructed before main - so before any thread can use it
+tgArrayCache tgArrayCache::theCache;
+
+void tgArrayCache::setMaxSize( size_t bytes )
+{
+    SGGuard<SGMutex> g(lock);
+
+    maxSize = bytes;
+    trim();
+}
+
+void tgArrayCache::getStats( unsigned long& hits, unsigned long& loads ) const
+{
+    SGGuard<SGMutex> g(lock);
+
+    hits  = numHits;
+    loads = numLoads;
+}
+
+// move to the front of the lru.  call with the lock held
+void tgArrayCache::touch( const tgArrayKey& key, tgArrayCacheEntry& entry, tgArrayPtr array )
+{
+    if ( entry.cached ) {
+        lru.erase( entry.lruPos );
+    } else {
+        entry.cached = array;
+        curSize += entry.size;
+    }
+
+    lru.push_front( key );
+    entry.lruPos = lru.begin();
+
+    trim();
+}
+
+// drop least recently used arrays until we fit.  call with the lock held
+void tgArrayCache::trim( void )
+{
+    while ( curSize > maxSize && !lru.empty() ) {
+        tgArrayCacheMap::iterator it = arrays.find( lru.back() );
+        lru.pop_back();
+
+        curSize -= it->second.size;
+        it->second.cached.reset();
+
+        // forget it unless a caller still holds it
+        if ( it->second.array.expired() ) {
+            arrays.erase( it );
+        }
+    }
+}
+
+tgArrayPtr tgArrayCache::get( const std::string& dir, const SGBucket& b )
+{
+    tgArrayKey key( dir, b.gen_index() );
+    tgArrayPtr array;
+
+    {
+        SGGuard<SGMutex> g(lock);
+
+        for (;;) {
+            if ( missing.find( key ) != missing.end() ) {
+                return tgArrayPtr();
+            }
+            if ( failed.find( key ) != failed.end() ) {
+                throw sg_exception( "tgArrayCache - loading " + b.gen_index_str() + " from " + dir + " failed" );
+            }
+
+            tgArrayCacheMap::iterator it = arrays.find( key );
+            if ( it != arrays.end() ) {
+                array = it->second.array.lock();
+                if ( array ) {
+                    numHits++;
+                    touch( key, it->second, array );
+                    return array;
+                }
+
+                // evicted, and everyone let go - load it again
+                arrays.erase( it );
+            }
+
+            if ( loading.find( key ) == loading.end() ) {
+                break;
+            }
+
+            // another thread is loading this array - wait for it
+            loaded.wait( lock );
+        }
+
+        loading.insert( key );
+    }
+
+    // parsing is the expensive part - don't hold up other arrays
+    try {
+        array = load( dir, b );
+    } catch ( ... ) {
+        // don't leave the waiters waiting for a load that never finishes
+        {
+            SGGuard<SGMutex> g(lock);
+
+            failed.insert( key );
+            loading.erase( key );
+        }
+        loaded.broadcast();
+
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgArrayCache - loading " << b.gen_index_str() << " from " << dir << " failed" );
+        throw;
+    }
+
+    {
+        SGGuard<SGMutex> g(lock);
+
+        if ( array ) {
+            tgArrayCacheEntry& entry = arrays[key];
+
+            entry.array = array;
+            entry.size  = array->get_memory_size();
+            numLoads++;
+
+            touch( key, entry, array );
+        } else {
+            missing.insert( key );
+        }
+        loading.erase( key );
+    }
+    loaded.broadcast();
+
+    return array;
+}
+
+tgArrayPtr tgArrayCache::get( const std::string& root, const string_list& sources, const SGBucket& b )
+{
+    for ( unsigned int i=0; i<sources.size(); i++ ) {
+        tgArrayPtr array = get( root + "/" + sources[i], b );
+        if ( array ) {
+            return array;
+        }
+    }
+
+    // a few bytes - not worth caching
+    tgArray* zero = new tgArray();
+    zero->parse( b );
+
+    return tgArrayPtr( zero );
+}
+
+tgArrayPtr tgArrayCache::load( const std::string& dir, const SGBucket& b ) const
+{
+    std::string arrayPath = dir + "/" + b.gen_base_path() + "/" + b.gen_index_str();
+
+    // owned from the start, so a throwing parse doesn't leak it
+    boost::shared_ptr<tgArray> array( new tgArray() );
+
+    if ( !array->open( arrayPath ) ) {
+        SG_LOG( SG_GENERAL, SG_DEBUG, "tgArrayCache - no array file " << arrayPath );
+        return tgArrayPtr();
+    }
+
+    SG_LOG( SG_GENERAL, SG_DEBUG, "tgArrayCache - loading " << arrayPath );
+
+    array->parse( b );
+    array->remove_voids();
+    array->close();
+
+    return array;
+}
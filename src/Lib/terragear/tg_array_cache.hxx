@@ -0,0 +1,94 @@
+#ifndef __TG_ARRAY_CACHE_HXX__
+#define __TG_ARRAY_CACHE_HXX__
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <simgear/bucket/newbucket.hxx>
+#include <simgear/math/sg_types.hxx>
+#include <simgear/threads/SGThread.hxx>
+
+#include "tg_array.hxx"
+
+typedef boost::shared_ptr<const tgArray>    tgArrayPtr;
+
+// Parsed, void filled DEM arrays, shared by every consumer in the process.
+//
+// The same .arr.gz is wanted many times in a run : by stage 1 and stage 2
+// of its own tile, by the elevation pass of all of its neighbours, and by
+// every airport in it.  The cache hands out reference counted arrays keyed
+// by ( source directory, bucket ), so each file is decompressed and parsed
+// once.  A thread asking for an array that is being loaded waits for that
+// load rather than starting its own.  If the load throws, the exception
+// goes to the loading thread, and every get of that array - waiting or
+// later - throws an sg_exception.
+//
+// Every array handed out goes to the front of a least recently used list,
+// and the list is trimmed to maxSize bytes - whether or not a caller still
+// holds the arrays in it.  Trimming only drops the cache's reference : an
+// array a caller still holds stays shared, and is freed when the last
+// holder lets go.
+#define TG_ARRAY_CACHE_DEFAULT_SIZE (256 * 1024 * 1024)
+
+class tgArrayCache
+{
+public:
+    static tgArrayCache& instance( void ) { return theCache; }
+
+    // the array of bucket b in dir - empty if there is no array file
+    tgArrayPtr get( const std::string& dir, const SGBucket& b );
+
+    // the array of bucket b in the first of root/sources[i] that has one.
+    // A zero filled array of the bucket if none do - same as parsing an
+    // array that isn't open.
+    tgArrayPtr get( const std::string& root, const string_list& sources, const SGBucket& b );
+
+    // bytes of recently used arrays to keep around
+    void setMaxSize( size_t bytes );
+
+    // hit / load counts, for the log at the end of a run
+    void getStats( unsigned long& hits, unsigned long& loads ) const;
+
+private:
+    tgArrayCache() : maxSize( TG_ARRAY_CACHE_DEFAULT_SIZE ), curSize( 0 ), numHits( 0 ), numLoads( 0 ) {}
+
+    typedef std::pair<std::string, long>    tgArrayKey;
+
+    struct tgArrayCacheEntry {
+        boost::weak_ptr<const tgArray>      array;      // valid while anyone holds it
+        tgArrayPtr                          cached;     // set while in the lru list
+        std::list<tgArrayKey>::iterator     lruPos;
+        size_t                              size;
+    };
+
+    typedef std::map<tgArrayKey, tgArrayCacheEntry> tgArrayCacheMap;
+
+    tgArrayPtr load( const std::string& dir, const SGBucket& b ) const;
+
+    void touch( const tgArrayKey& key, tgArrayCacheEntry& entry, tgArrayPtr array );
+    void trim( void );
+
+    static tgArrayCache     theCache;
+
+    size_t                  maxSize;
+    size_t                  curSize;    // of the arrays in lru
+    unsigned long           numHits;
+    unsigned long           numLoads;
+
+    tgArrayCacheMap         arrays;
+    std::list<tgArrayKey>   lru;        // most recently used first
+    std::set<tgArrayKey>    loading;    // being loaded ( unlocked )
+    std::set<tgArrayKey>    missing;    // no array file
+    std::set<tgArrayKey>    failed;     // load threw
+
+    mutable SGMutex         lock;
+    SGWaitCondition         loaded;
+};
+
+#endif /* __TG_ARRAY_CACHE_HXX__ */
@@ -10,6 +10,7 @@
 #include <simgear/math/SGMath.hxx>
 
 #include "tg_cluster.hxx"
+#include "tg_shapefile_cache.hxx"
 #include "tg_shapefile.hxx"
 
 // TODO Voronoi convergence is a bit slow - anything faster?
@@ -17,10 +18,6 @@
 #define LOG_CLUSER      SG_DEBUG
 
 
-std::list<EPECSegment_2>::iterator it;
-std::vector<EPECPoint_2>::iterator vfrom,vto;
-std::vector<EPECPoint_2>::iterator fcit;
-
 EPECPoint_2 tgCluster::Locate(const EPECPoint_2& point) const
 {
     VDLocateResult lr = vd.locate(point);
@@ -182,7 +179,7 @@ tgCluster::tgCluster( std::list<tgClusterNode>& points, double err, const std::s
                 newcentroids.push_back( tgClusterNode( it->point, fixed ) );
 
 #if DEBUG_CLUSTER
-                GDALClose( poDs );
+                closeDatasource( poDs );
 #endif
 
             } else {
@@ -304,7 +301,7 @@ tgCluster::tgCluster( std::list<tgClusterNode>& points, double err, const std::s
                     }
 
     #if DEBUG_CLUSTER
-                    GDALClose( poDs );
+                    closeDatasource( poDs );
     #endif
 
                 } else {
@@ -440,20 +437,14 @@ void tgCluster::toShapefile( const char* datasource, const char* layer_prefix )
 
 GDALDataset* tgCluster::openDatasource( const std::string& datasource_name ) const
 {
-    GDALDataset*    poDS = NULL;
-    GDALDriver*     poDriver = NULL;
-    const char*     format_name = "ESRI Shapefile";
-
     SG_LOG( SG_GENERAL, SG_DEBUG, "Open Datasource: " << datasource_name );
 
-    GDALAllRegister();
-
-    poDriver = GetGDALDriverManager()->GetDriverByName( format_name );
-    if ( poDriver ) {
-        poDS = poDriver->Create( datasource_name.c_str(), 0, 0, 0, GDT_Unknown, NULL );
-    }
+    return tgShapefileCache::instance().acquire( datasource_name );
+}
 
-    return poDS;
+void tgCluster::closeDatasource( GDALDataset* poDS ) const
+{
+    tgShapefileCache::instance().release( poDS );
 }
 
 OGRLayer* tgCluster::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, const char* layer_name ) const
@@ -465,7 +456,7 @@ OGRLayer* tgCluster::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, const
         exit(0);
     }
 
-    poLayer = poDS->GetLayerByName( layer_name );
+    poLayer = tgShapefileCache::instance().getLayer( poDS, layer_name );
     if ( !poLayer ) {
         SG_LOG(SG_GENERAL, SG_DEBUG, "tgCluster::openLayer: layer " << layer_name << " doesn't exist - create" );
 
@@ -473,6 +464,11 @@ OGRLayer* tgCluster::openLayer( GDALDataset* poDS, OGRwkbGeometryType lt, const
         srs.SetWellKnownGeogCS("WGS84");
 
         poLayer = poDS->CreateLayer( layer_name, &srs, lt, NULL );
+        if ( !poLayer ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "Creation of layer '" << layer_name << "' failed" );
+            return NULL;
+        }
+        tgShapefileCache::instance().addLayer( poDS, layer_name, poLayer );
 
         OGRFieldDefn descriptionField( "tg_desc", OFTString );
         descriptionField.SetWidth( 128 );
@@ -495,7 +491,7 @@ void tgCluster::toShapefile( const std::string& ds, const char* layer, const std
         toShapefile( poLayer, nodes[i] );
     }
 
-    GDALClose( poDS );
+    closeDatasource( poDS );
 }
 
 void tgCluster::toShapefile( OGRLayer* poLayer, const tgClusterNode& node )
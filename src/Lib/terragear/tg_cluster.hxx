@@ -83,6 +83,8 @@ public:
     }
 };
 
+// all of the cluster state - including the kd-tree and voronoi diagram -
+// lives in the instance, so clusters may be built on several threads at once
 class tgCluster 
 {
 public:
@@ -96,6 +98,7 @@ private:
 
     // debug
     GDALDataset* openDatasource( const std::string& debug ) const;
+    void         closeDatasource( GDALDataset* poDS ) const;
     OGRLayer*    openLayer( GDALDataset* poDs, OGRwkbGeometryType type, const char* layer ) const;
 
     void toShapefile( const std::string& ds, const char* layer, const std::vector<tgClusterNode>& nodes );
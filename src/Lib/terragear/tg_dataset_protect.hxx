@@ -1,7 +1,12 @@
+#ifndef __TG_DATASET_PROTECT_HXX__
+#define __TG_DATASET_PROTECT_HXX__
+
 #include <map>
+#include <string>
 
 #include <simgear/threads/SGThread.hxx>
 #include <simgear/threads/SGGuard.hxx>
+#include <simgear/misc/sg_path.hxx>
 #include <simgear/debug/logstream.hxx>
 
 // This file is used to serialize access to GDAL DataSets.
@@ -11,7 +16,7 @@
 
 // we CAN open multiple datasets at the same time.
 
-// so we keep a map of tiles. 
+// so we keep a map of tiles.
 // if an entry is not in the map, it is available to use.
 // if an entry IS in the map, we will queue up on a condition
 // variable until it is ready
@@ -19,102 +24,156 @@
 // when a tile becomes available, we will signal a waiting task
 // so it can use it.
 
-// when the last task is finished with a tile,  it is remved from 
+// when the last task is finished with a tile,  it is remved from
 // the map.
 
+#define DEBUG_DATASET_PROTECT   (0)
 
 // structure containg information about a tile
 // in use, number of waiters, etc...
 struct tileInfo {
 public:
-    tileInfo( unsigned long id ) : tid( id ), numWaiting(1), inUse( true ) {}
+    tileInfo() : numWaiting(1), inUse( true ) {}
 
     void AddWaiter( SGMutex& m ) {
-        //SGGuard<SGMutex> g(mutex);
-
-        SG_LOG(SG_GENERAL, SG_INFO, "tgDataSetProtect task " << SGThread::current() << " waiting on tile " << tid << " num ahead is " << numWaiting );
-        
         numWaiting++;
-        while ( inUse ) {            
+        while ( inUse ) {
             available.wait( m );
-            SG_LOG(SG_GENERAL, SG_INFO, "tgDataSetProtect task " << SGThread::current() << " signalled for tile " << tid << " num waiting is " << numWaiting << " inUse is " << inUse );            
         }
+
+        // we own it now - anyone arriving after us has to wait
+        inUse = true;
     }
 
     bool RemoveWaiter( void ) {
-        //SGGuard<SGMutex> g(mutex);
-
-        SG_LOG(SG_GENERAL, SG_INFO, "tgDataSetProtect task " << SGThread::current() << " finished with tile " << tid << " num waiting is " << numWaiting );
-        
         numWaiting--;
         inUse = false;
-        
+
         if ( numWaiting ) {
             available.signal();
         }
-        
+
         return ( numWaiting == 0 );
     }
 
     SGWaitCondition available;
-    //SGMutex         mutex;
 
-    unsigned long   tid;
     int             numWaiting;     // when this is 0, we can remove tileInfo from the map
     bool            inUse;          // condition variable - cleared on release
 };
 
-typedef std::map< unsigned long, tileInfo* >	tile_map;
-
-class tgDatasetAcess
+// map of keys ( tile ids, or directory names ) to their waiters.
+// only the map itself is protected by the mutex - the work done
+// between Request and Release runs unlocked, so different keys
+// proceed in parallel.
+template <typename Key>
+class tgDatasetLockMap
 {
 public:
-    tgDatasetAcess(void) {}
+    tgDatasetLockMap(void) {}
 
-    // whenever you want to write to a tile, you need to Request it
-    void Request( unsigned long tileId ) {
+    // whenever you want to write to a key, you need to Request it
+    void Request( const Key& key ) {
         SGGuard<SGMutex> g(mutex);
-        
-        tile_map::iterator it = waitingTasks.find( tileId );
+
+        typename std::map<Key, tileInfo*>::iterator it = waitingTasks.find( key );
         if ( it == waitingTasks.end() ) {
-            // tile is not in the map, therefore it is not in use.
+            // key is not in the map, therefore it is not in use.
             // create tileInfo, and insert into the map
-            waitingTasks[tileId] = new tileInfo( tileId );
             // we can continue to use it - we're the first to ask for it
             // so no call to AddWaiter
-            SG_LOG(SG_GENERAL, SG_INFO, "tgDataSetProtect task " << SGThread::current() << " working on tile " << tileId );
+            waitingTasks[key] = new tileInfo();
         } else {
-            // tile is in the map, so it is already in use
-            // once AddWaiter returns, we have the tile for ourselves
-            tileInfo* ti = it->second;
-            ti->AddWaiter(mutex);
+            // key is in the map, so it is already in use
+            // once AddWaiter returns, we have it for ourselves
+#if DEBUG_DATASET_PROTECT
+            SG_LOG(SG_GENERAL, SG_INFO, "tgDataSetProtect task " << SGThread::current() << " waiting on " << key << " num ahead is " << it->second->numWaiting );
+#endif
+            it->second->AddWaiter(mutex);
         }
     }
 
-    // whenever you finish writing to a tile, you need to Release it
-    void Release( unsigned long tileId ) {
+    // whenever you finish writing to a key, you need to Release it
+    void Release( const Key& key ) {
         SGGuard<SGMutex> g(mutex);
 
-        tile_map::iterator it = waitingTasks.find( tileId );
+        typename std::map<Key, tileInfo*>::iterator it = waitingTasks.find( key );
         if ( it != waitingTasks.end() ) {
-            // tile is already in use ( as we are using it... duh )
+            // key is already in use ( as we are using it... duh )
             tileInfo* ti = it->second;
 
             // RemoveWaiter returns true if there are no more waiters
             if ( ti->RemoveWaiter() ) {
-                // if we were the only one using it, 
+                // if we were the only one using it,
                 // remove from the map, and delete
                 delete ti;
-                waitingTasks.erase( it );                
+                waitingTasks.erase( it );
             }
         } else {
-
             // uh-oh - this shouldn't happen
-            SG_LOG( SG_GENERAL, SG_INFO, "tgDatasetAccess::Released tile " << tileId << " NOT IN MAP - ERROR " );
+            SG_LOG( SG_GENERAL, SG_ALERT, "tgDatasetLockMap::Release " << key << " NOT IN MAP - ERROR " );
         }
     }
 
 private:
-    SGMutex  mutex;
-    tile_map waitingTasks;
+    SGMutex                     mutex;
+    std::map<Key, tileInfo*>    waitingTasks;
 };
+
+// per tile and per directory locking for tile output.
+// tiles are keyed by SGBucket index, so two threads writing
+// different tiles never wait on each other.
+class tgDatasetAccess
+{
+public:
+    tgDatasetAccess(void) {}
+
+    void Request( unsigned long tileId ) { tiles.Request( tileId ); }
+    void Release( unsigned long tileId ) { tiles.Release( tileId ); }
+
+    // create a directory ( and all of its parents ).  Siblings in the
+    // same parent directory are serialized.  A race with another thread
+    // creating a common ancestor makes create_dir fail even though the
+    // path now exists - so retry until it's there.
+    bool MakeDirectory( const std::string& directory ) {
+        SGPath      sgp( directory + "/dummy" );
+        std::string parent = SGPath( directory ).dir();
+        bool        created = false;
+
+        directories.Request( parent );
+        for ( int attempt = 0; attempt < 3 && !created; attempt++ ) {
+            sgp.create_dir( 0755 );
+            created = SGPath( directory ).exists();
+        }
+        directories.Release( parent );
+
+        if ( !created ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "tgDatasetAccess::MakeDirectory - failed to create " << directory );
+        }
+
+        return created;
+    }
+
+private:
+    tgDatasetLockMap<unsigned long> tiles;
+    tgDatasetLockMap<std::string>   directories;
+};
+
+// scoped tile lock
+class tgDatasetGuard
+{
+public:
+    tgDatasetGuard( tgDatasetAccess& a, unsigned long id ) : access(a), tileId(id) {
+        access.Request( tileId );
+    }
+
+    ~tgDatasetGuard() {
+        access.Release( tileId );
+    }
+
+private:
+    tgDatasetAccess&    access;
+    unsigned long       tileId;
+};
+
+#endif /* __TG_DATASET_PROTECT_HXX__ */
@@ -0,0 +1,91 @@
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <fstream>
+
+#ifdef HAVE_UNISTD_H
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+#include <simgear/debug/logstream.hxx>
+
+#include "tg_mapped_file.hxx"
+
+tgMappedFile::tgMappedFile() :
+    data(NULL),
+    size(0)
+{
+}
+
+tgMappedFile::~tgMappedFile()
+{
+    close();
+}
+
+bool tgMappedFile::open( const std::string& filename )
+{
+    close();
+
+#ifdef HAVE_UNISTD_H
+    int fd = ::open( filename.c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+        SG_LOG( SG_GENERAL, SG_DEBUG, "tgMappedFile::open - can't open " << filename );
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+        void* addr = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( addr != MAP_FAILED ) {
+            data = (const char*)addr;
+            size = (size_t)st.st_size;
+        } else {
+            SG_LOG( SG_GENERAL, SG_ALERT, "tgMappedFile::open - mmap failed for " << filename );
+        }
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    ::close( fd );
+#else
+    std::ifstream in( filename.c_str(), std::ios::in | std::ios::binary );
+    if ( !in.is_open() ) {
+        SG_LOG( SG_GENERAL, SG_DEBUG, "tgMappedFile::open - can't open " << filename );
+        return false;
+    }
+
+    in.seekg( 0, std::ios::end );
+    std::streamoff len = in.tellg();
+    in.seekg( 0, std::ios::beg );
+
+    if ( len > 0 ) {
+        char* buffer = new char[(size_t)len];
+        if ( in.read( buffer, len ) ) {
+            data = buffer;
+            size = (size_t)len;
+        } else {
+            SG_LOG( SG_GENERAL, SG_ALERT, "tgMappedFile::open - read failed for " << filename );
+            delete[] buffer;
+        }
+    }
+#endif
+
+    return data != NULL;
+}
+
+void tgMappedFile::close( void )
+{
+    if ( data ) {
+#ifdef HAVE_UNISTD_H
+        munmap( (void*)data, size );
+#else
+        delete[] data;
+#endif
+    }
+
+    data = NULL;
+    size = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef __TG_MAPPED_FILE_HXX__
+#define __TG_MAPPED_FILE_HXX__
+
+#include <cstddef>
+#include <string>
+
+// Read only view of a whole file.  On posix systems the file is mmapped,
+// so records can be read in place without copying.  Where mapping is not
+// available, the file is read into a private buffer instead - the API is
+// the same either way.
+class tgMappedFile
+{
+public:
+    tgMappedFile();
+    ~tgMappedFile();
+
+    bool open( const std::string& filename );
+    void close( void );
+
+    bool        isOpen( void ) const { return data != NULL; }
+    const char* getData( void ) const { return data; }
+    size_t      getSize( void ) const { return size; }
+
+private:
+    // no copies - we own the mapping
+    tgMappedFile( const tgMappedFile& );
+    tgMappedFile& operator=( const tgMappedFile& );
+
+    const char* data;
+    size_t      size;
+};
+
+#endif /* __TG_MAPPED_FILE_HXX__ */
@@ -0,0 +1,267 @@
+#include <fstream>
+#include <vector>
+
+#include <boost/thread/tss.hpp>
+
+#include <simgear/debug/logstream.hxx>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
+
+#include "tg_profile.hxx"
+
+bool tgProfile::enabled = false;
+
+namespace {
+
+struct tgProfileThread
+{
+    tgProfileThread() : id(0), current(NULL), parent(NULL) {}
+
+    unsigned int                    id;
+    tgProfileRecord*                current;
+    tgProfileRecord*                parent;     // helper threads only
+    tgProfileRecord                 unassigned;
+    std::vector<tgProfileRecord*>   finished;
+};
+
+// the registry owns the per thread data - it has to outlive the
+// threads so it can be dumped.  Helpers free theirs in detach
+void keepThread( tgProfileThread* ) {}
+
+boost::thread_specific_ptr<tgProfileThread> threadProfile( keepThread );
+std::vector<tgProfileThread*>               profileThreads;
+SGMutex                                     profileLock;
+
+tgProfileThread* getThread( void )
+{
+    tgProfileThread* t = threadProfile.get();
+
+    if ( !t ) {
+        t = new tgProfileThread;
+        t->unassigned.unit    = "-";
+        t->unassigned.stage   = "unassigned";
+        t->unassigned.elapsed = 0.0;
+
+        {
+            SGGuard<SGMutex> g(profileLock);
+            t->id = profileThreads.size();
+            profileThreads.push_back( t );
+        }
+
+        threadProfile.reset( t );
+    }
+
+    return t;
+}
+
+tgProfileRecord* getRecord( void )
+{
+    tgProfileThread* t = getThread();
+    return t->current ? t->current : &t->unassigned;
+}
+
+void mergeEntries( tgProfileEntryMap& to, const tgProfileEntryMap& from )
+{
+    for ( tgProfileEntryMap::const_iterator it = from.begin(); it != from.end(); it++ ) {
+        to[it->first].merge( it->second );
+    }
+}
+
+// move what the helpers collected into the record - profileLock held
+void mergeHelpers( tgProfileRecord& r )
+{
+    mergeEntries( r.timers, r.helperTimers );
+    mergeEntries( r.counters, r.helperCounters );
+    r.helperTimers.clear();
+    r.helperCounters.clear();
+}
+
+void writeCsv( std::ostream& out, unsigned int thread, const tgProfileRecord& r )
+{
+    tgProfileEntryMap::const_iterator it;
+
+    out << r.unit << "," << r.stage << "," << thread << ",unit,elapsed,1," << r.elapsed << "," << r.elapsed << "\n";
+    for ( it = r.timers.begin(); it != r.timers.end(); it++ ) {
+        out << r.unit << "," << r.stage << "," << thread << ",timer," << it->first << "," << it->second.count << "," << it->second.total << "," << it->second.max << "\n";
+    }
+    for ( it = r.counters.begin(); it != r.counters.end(); it++ ) {
+        out << r.unit << "," << r.stage << "," << thread << ",counter," << it->first << "," << it->second.count << "," << it->second.total << "," << it->second.max << "\n";
+    }
+}
+
+void writeJsonEntries( std::ostream& out, const tgProfileEntryMap& entries )
+{
+    tgProfileEntryMap::const_iterator it;
+
+    out << "{";
+    for ( it = entries.begin(); it != entries.end(); it++ ) {
+        out << ( it == entries.begin() ? " " : ", " );
+        out << "\"" << it->first << "\": { \"count\": " << it->second.count << ", \"total\": " << it->second.total << ", \"max\": " << it->second.max << " }";
+    }
+    out << " }";
+}
+
+void writeJson( std::ostream& out, unsigned int thread, const tgProfileRecord& r, bool first )
+{
+    out << ( first ? "    " : ",\n    " );
+    out << "{ \"unit\": \"" << r.unit << "\", \"stage\": \"" << r.stage << "\", \"thread\": " << thread << ", \"elapsed\": " << r.elapsed << ",\n";
+    out << "      \"timers\": ";
+    writeJsonEntries( out, r.timers );
+    out << ",\n      \"counters\": ";
+    writeJsonEntries( out, r.counters );
+    out << " }";
+}
+
+}
+
+void tgProfile::begin( const std::string& unit, const char* stage )
+{
+    if ( !enabled ) {
+        return;
+    }
+
+    tgProfileThread* t = getThread();
+    if ( t->current ) {
+        SG_LOG( SG_GENERAL, SG_WARN, "tgProfile::begin " << unit << " while " << t->current->unit << " is still open" );
+        end();
+    }
+
+    t->current = new tgProfileRecord;
+    t->current->unit    = unit;
+    t->current->stage   = stage;
+    t->current->elapsed = 0.0;
+    t->current->start.stamp();
+}
+
+void tgProfile::end( void )
+{
+    if ( !enabled ) {
+        return;
+    }
+
+    tgProfileThread* t = getThread();
+    if ( t->current ) {
+        t->current->elapsed = (SGTimeStamp::now() - t->current->start).toSecs();
+        {
+            SGGuard<SGMutex> g(profileLock);
+            mergeHelpers( *t->current );
+        }
+        t->finished.push_back( t->current );
+        t->current = NULL;
+    }
+}
+
+void tgProfile::addTime( const char* name, double seconds )
+{
+    if ( enabled ) {
+        getRecord()->timers[name].add( seconds );
+    }
+}
+
+void tgProfile::addCount( const char* name, double value )
+{
+    if ( enabled ) {
+        getRecord()->counters[name].add( value );
+    }
+}
+
+tgProfileRecord* tgProfile::current( void )
+{
+    return enabled ? getRecord() : NULL;
+}
+
+void tgProfile::attach( tgProfileRecord* parent )
+{
+    if ( !enabled || !parent ) {
+        return;
+    }
+
+    tgProfileThread* t = threadProfile.get();
+    if ( t ) {
+        // run on the parent thread itself ( no threads started ), or on a
+        // thread that already has records of its own - just keep using them
+        if ( t->current != parent && &t->unassigned != parent ) {
+            SG_LOG( SG_GENERAL, SG_WARN, "tgProfile::attach on a thread that is already profiled" );
+        }
+        return;
+    }
+
+    // not registered - it collects into unassigned until detach
+    t = new tgProfileThread;
+    t->parent = parent;
+    threadProfile.reset( t );
+}
+
+void tgProfile::detach( void )
+{
+    tgProfileThread* t = threadProfile.get();
+    if ( !t || !t->parent ) {
+        return;
+    }
+
+    {
+        SGGuard<SGMutex> g(profileLock);
+        mergeEntries( t->parent->helperTimers, t->unassigned.timers );
+        mergeEntries( t->parent->helperCounters, t->unassigned.counters );
+    }
+
+    threadProfile.reset();
+    delete t;
+}
+
+bool tgProfile::dump( const std::string& filename )
+{
+    if ( !enabled ) {
+        return true;
+    }
+
+    std::ofstream out( filename.c_str(), std::ios::out | std::ios::trunc );
+    if ( !out.is_open() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "tgProfile: cannot write " << filename );
+        return false;
+    }
+
+    bool json = ( filename.size() > 5 && filename.compare( filename.size()-5, 5, ".json" ) == 0 );
+    bool first = true;
+
+    out.precision( 9 );
+    if ( json ) {
+        out << "{\n  \"records\": [\n";
+    } else {
+        out << "unit,stage,thread,kind,name,count,total,max\n";
+    }
+
+    SGGuard<SGMutex> g(profileLock);
+    for ( unsigned int i = 0; i < profileThreads.size(); i++ ) {
+        tgProfileThread* t = profileThreads[i];
+
+        // helpers of threads that didn't open a unit
+        mergeHelpers( t->unassigned );
+
+        for ( unsigned int j = 0; j <= t->finished.size(); j++ ) {
+            const tgProfileRecord* r;
+            if ( j < t->finished.size() ) {
+                r = t->finished[j];
+            } else if ( !t->unassigned.timers.empty() || !t->unassigned.counters.empty() ) {
+                r = &t->unassigned;
+            } else {
+                break;
+            }
+
+            if ( json ) {
+                writeJson( out, t->id, *r, first );
+            } else {
+                writeCsv( out, t->id, *r );
+            }
+            first = false;
+        }
+    }
+
+    if ( json ) {
+        out << "\n  ]\n}\n";
+    }
+
+    SG_LOG( SG_GENERAL, SG_INFO, "tgProfile: wrote " << filename );
+
+    return true;
+}
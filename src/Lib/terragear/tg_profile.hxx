@@ -0,0 +1,139 @@
+#ifndef __TG_PROFILE_HXX__
+#define __TG_PROFILE_HXX__
+
+#include <map>
+#include <string>
+
+#include <simgear/timing/timestamp.hxx>
+
+// Lightweight timers and counters for the tile pipeline.
+//
+// Each thread collects into its own records, without locking.  A record
+// covers one unit of work - one stage of one tile, or one airport - from
+// tgProfile::begin to tgProfile::end.  Timers hit outside of a unit are
+// collected in a per thread 'unassigned' record.  The lock is only taken
+// the first time a thread profiles anything, to register it, and when a
+// unit ends.
+//
+// Short lived helper threads of a unit ( tgProfileHelper ) are not
+// registered.  They collect into a record of their own, which is merged
+// into the unit that started them when they finish.
+//
+// tgProfile::dump writes every record as csv, or as json if the file
+// name ends in .json.  Call it once the worker threads have finished.
+// Nothing is collected unless tgProfile::enable was called at startup.
+
+struct tgProfileEntry
+{
+    tgProfileEntry() : count(0), total(0.0), max(0.0) {}
+
+    void add( double v ) {
+        count++;
+        total += v;
+        if ( v > max ) {
+            max = v;
+        }
+    }
+
+    void merge( const tgProfileEntry& e ) {
+        count += e.count;
+        total += e.total;
+        if ( e.max > max ) {
+            max = e.max;
+        }
+    }
+
+    unsigned long   count;
+    double          total;      // seconds for timers
+    double          max;
+};
+
+typedef std::map<std::string, tgProfileEntry> tgProfileEntryMap;
+
+struct tgProfileRecord
+{
+    std::string         unit;
+    std::string         stage;
+    double              elapsed;
+    SGTimeStamp         start;
+    tgProfileEntryMap   timers;
+    tgProfileEntryMap   counters;
+
+    // merged in by helper threads, under the registry lock - the owning
+    // thread moves them into timers / counters when the unit ends
+    tgProfileEntryMap   helperTimers;
+    tgProfileEntryMap   helperCounters;
+};
+
+class tgProfile
+{
+public:
+    static void enable( void ) { enabled = true; }
+    static bool isEnabled( void ) { return enabled; }
+
+    // start / finish a unit of work on the calling thread
+    static void begin( const std::string& unit, const char* stage );
+    static void end( void );
+
+    static void addTime( const char* name, double seconds );
+    static void addCount( const char* name, double value );
+
+    // the record the calling thread collects into - for helper threads
+    // started by it.  NULL when profiling is off
+    static tgProfileRecord* current( void );
+
+    // collect on a new helper thread for the record of its parent, and
+    // merge into it / free the helper's data when done
+    static void attach( tgProfileRecord* parent );
+    static void detach( void );
+
+    static bool dump( const std::string& filename );
+
+private:
+    static bool enabled;
+};
+
+// profile a unit for the lifetime of the object
+class tgProfileUnit
+{
+public:
+    tgProfileUnit( const std::string& unit, const char* stage ) { tgProfile::begin( unit, stage ); }
+    ~tgProfileUnit() { tgProfile::end(); }
+};
+
+// profile a helper thread for the lifetime of the object.  Get parent
+// with tgProfile::current() on the thread that creates the helper
+class tgProfileHelper
+{
+public:
+    tgProfileHelper( tgProfileRecord* parent ) { tgProfile::attach( parent ); }
+    ~tgProfileHelper() { tgProfile::detach(); }
+};
+
+// time the lifetime of the object
+class tgProfileTimer
+{
+public:
+    tgProfileTimer( const char* n ) : name(n) {
+        if ( tgProfile::isEnabled() ) {
+            start.stamp();
+        }
+    }
+    ~tgProfileTimer() {
+        if ( tgProfile::isEnabled() ) {
+            tgProfile::addTime( name, (SGTimeStamp::now() - start).toSecs() );
+        }
+    }
+
+private:
+    const char* name;
+    SGTimeStamp start;
+};
+
+#define TG_PROFILE_CAT2(a, b)   a##b
+#define TG_PROFILE_CAT(a, b)    TG_PROFILE_CAT2(a, b)
+
+// time the rest of the enclosing scope
+#define TG_PROFILE_SCOPE(name)  tgProfileTimer TG_PROFILE_CAT(tgProfileTimer_, __LINE__)( name )
+
+#endif /* __TG_PROFILE_HXX__ */
@@ -4,32 +4,20 @@
 #include <simgear/misc/sg_path.hxx>
 
 #include "tg_shapefile.hxx"
+#include "tg_shapefile_cache.hxx"
 
-bool tgShapefile::initialized = false;
-
+// datasources stay open in the shapefile cache - so debug dumps of many
+// small objects to the same datasource don't reopen it every time
 void* tgShapefile::OpenDatasource( const char* datasource_name )
 {
     GDALDataset*    poDS;
-    GDALDriver*     poDriver;
-    const char*     format_name = "ESRI Shapefile";
     
     SG_LOG( SG_GENERAL, SG_DEBUG, "Open Datasource: " << datasource_name );
     
-    if (!tgShapefile::initialized) {
-        GDALAllRegister();
-        tgShapefile::initialized = true;
-    }
-    
     SGPath sgp( datasource_name );
     sgp.create_dir( 0755 );
     
-    poDriver = GetGDALDriverManager()->GetDriverByName( format_name );
-    if ( !poDriver ) {
-        SG_LOG( SG_GENERAL, SG_ALERT, "Unknown datasource format driver: " << format_name );
-        exit(1);
-    }
-    
-    poDS = poDriver->Create( datasource_name, 0, 0, 0, GDT_Unknown, NULL );
+    poDS = tgShapefileCache::instance().acquire( datasource_name );
     if ( !poDS ) {
         SG_LOG( SG_GENERAL, SG_ALERT, "Unable to open or create datasource: " << datasource_name );
     }
@@ -60,10 +48,15 @@ void* tgShapefile::OpenLayer( void* ds_id, const char* layer_name, shapefile_lay
             break;
     }
     
-    layer = poDS->GetLayerByName( layer_name );
+    layer = tgShapefileCache::instance().getLayer( poDS, layer_name );
     
     if ( !layer ) {
         layer = poDS->CreateLayer( layer_name, &srs, ogr_type, NULL );
+        if ( !layer ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "Creation of layer '" << layer_name << "' failed" );
+            return NULL;
+        }
+        tgShapefileCache::instance().addLayer( poDS, layer_name, layer );
         
         OGRFieldDefn descriptionField( "tg_desc", OFTString );
         descriptionField.SetWidth( 128 );
@@ -174,8 +167,7 @@ void* tgShapefile::OpenLayer( void* ds_id, const char* layer_name, shapefile_lay
 
 void* tgShapefile::CloseDatasource( void* ds_id )
 {
-    GDALDataset* poDS = ( GDALDataset * )ds_id;
-    GDALClose( poDS );
+    tgShapefileCache::instance().release( ( GDALDataset * )ds_id );
     
     return (void *)-1;
 }
@@ -1474,12 +1466,7 @@ void tgShapefile::ToPolygons( const SGPath& p, tgpolygon_list& polys )
     GDALDataset* poDS = NULL;
     OGRLayer*    poLayer = NULL;
     
-    if (!tgShapefile::initialized) {
-        GDALAllRegister();
-        tgShapefile::initialized = true;
-    }
-        
-    poDS = (GDALDataset*)GDALOpenEx( p.c_str(), GDAL_OF_VECTOR, NULL, NULL, NULL );
+    poDS = tgShapefileCache::instance().acquireForRead( p.str() );
     if( poDS == NULL )
     {
         SG_LOG( SG_GENERAL, SG_ALERT, "Failed opening datasource " << p.c_str() );
@@ -1496,7 +1483,7 @@ void tgShapefile::ToPolygons( const SGPath& p, tgpolygon_list& polys )
         processLayer(poLayer, polys );
     }
     
-    GDALClose( poDS );    
+    tgShapefileCache::instance().release( poDS );
     
     for ( unsigned int i=0; i<polys.size(); i++ ) {
         SG_LOG( SG_GENERAL, SG_ALERT, "return poly " << i << " with material " << polys[i].GetMaterial() );
@@ -67,9 +67,6 @@ public:
     static void  FromSegment( void* lid, const tgSegment& subject, bool show_dir, const std::string& description );
     static void  FromRay( void* lid, const tgRay& subject, const std::string& description );
     static void  FromLine( void* lid, const tgLine& subject, const std::string& description );
-    
-private:
-    static bool initialized;
 };
 
 #endif // _TGSHAPEFILE_HXX
\ No newline at end of file
@@ -0,0 +1,333 @@
+#include <algorithm>
+
+#ifndef _MSC_VER
+#  include <sys/resource.h>
+#endif
+
+#include <simgear/threads/SGGuard.hxx>
+#include <simgear/debug/logstream.hxx>
+#include <simgear/misc/sg_path.hxx>
+
+#include "tg_shapefile_cache.hxx"
+
+// constructed before main - so before any thread can use it
+tgShapefileCache tgShapefileCache::theCache;
+
+// shapefile layers write their headers on sync, not per feature
+static void syncLayers( GDALDataset* poDS )
+{
+    for ( int i=0; i<poDS->GetLayerCount(); i++ ) {
+        poDS->GetLayer(i)->SyncToDisk();
+    }
+}
+
+// the cache may use a quarter of the descriptors - the rest are the tool's
+#define TG_SHAPEFILE_CACHE_FILE_SHARE   (4)
+#define TG_SHAPEFILE_CACHE_LAYER_FILES  (3)
+
+tgShapefileCache::tgShapefileCache() : numLayers( 0 ), registered( false )
+{
+    unsigned long maxFiles = TG_SHAPEFILE_CACHE_MAX_LAYERS * TG_SHAPEFILE_CACHE_LAYER_FILES;
+
+#ifdef _MSC_VER
+    // the C runtime's stdio limit
+    maxFiles = std::min( maxFiles, 512ul / TG_SHAPEFILE_CACHE_FILE_SHARE );
+#else
+    struct rlimit rl;
+    if ( getrlimit( RLIMIT_NOFILE, &rl ) == 0 && rl.rlim_cur != RLIM_INFINITY ) {
+        maxFiles = std::min( maxFiles, (unsigned long)rl.rlim_cur / TG_SHAPEFILE_CACHE_FILE_SHARE );
+    }
+#endif
+
+    maxLayers = std::max( 1, (int)( maxFiles / TG_SHAPEFILE_CACHE_LAYER_FILES ) );
+}
+
+tgShapefileCache::~tgShapefileCache()
+{
+    // no logging - the log may already be gone
+    SGGuard<SGMutex> g(lock);
+
+    while ( !entries.empty() ) {
+        remove( entries.begin() );
+    }
+}
+
+GDALDataset* tgShapefileCache::acquire( const std::string& name )
+{
+    return acquire( name, true );
+}
+
+GDALDataset* tgShapefileCache::acquireForRead( const std::string& name )
+{
+    return acquire( name, false );
+}
+
+GDALDataset* tgShapefileCache::acquire( const std::string& name, bool update )
+{
+    GDALDataset* poDS = NULL;
+    bool         nested = false;
+
+    {
+        SGGuard<SGMutex> g(lock);
+
+        if ( !registered ) {
+            GDALAllRegister();
+            registered = true;
+        }
+
+        // nested acquire by the owner
+        tgShapefileMap::iterator it = entries.find( name );
+        if ( it != entries.end() && it->second.depth && it->second.owner == SGThread::current() ) {
+            if ( update && !it->second.update ) {
+                SG_LOG( SG_GENERAL, SG_ALERT, "tgShapefileCache - " << name << " is open for reading - can't write to it" );
+            }
+            it->second.depth++;
+            poDS   = it->second.poDS;
+            nested = true;
+        } else {
+            sync( name, update );
+
+            tgShapefileEntry& entry = wait( name );
+            if ( entry.poDS && update && !entry.update ) {
+                // read only - reopen for writing
+                names.erase( entry.poDS );
+                numLayers -= entry.numLayers;
+                GDALClose( entry.poDS );
+
+                entry.poDS      = NULL;
+                entry.numLayers = 0;
+                entry.layers.clear();
+            }
+            poDS = entry.poDS;
+        }
+    }
+
+    if ( poDS ) {
+        if ( !update && !nested ) {
+            for ( int i=0; i<poDS->GetLayerCount(); i++ ) {
+                poDS->GetLayer(i)->ResetReading();
+            }
+        }
+        return poDS;
+    }
+
+    // we own the entry - others wait while we open it
+    SG_LOG( SG_GENERAL, SG_DEBUG, "tgShapefileCache - open " << name << ( update ? " for writing" : " for reading" ) );
+
+    if ( update ) {
+        GDALDriver* poDriver = GetGDALDriverManager()->GetDriverByName( "ESRI Shapefile" );
+        if ( poDriver ) {
+            poDS = poDriver->Create( name.c_str(), 0, 0, 0, GDT_Unknown, NULL );
+        }
+    } else {
+        poDS = (GDALDataset*)GDALOpenEx( name.c_str(), GDAL_OF_VECTOR, NULL, NULL, NULL );
+    }
+
+    {
+        SGGuard<SGMutex> g(lock);
+
+        tgShapefileMap::iterator it = entries.find( name );
+        if ( poDS ) {
+            tgShapefileEntry& entry = it->second;
+
+            entry.poDS      = poDS;
+            entry.update    = update;
+            entry.numLayers = poDS->GetLayerCount();
+            numLayers      += entry.numLayers;
+            names[poDS]     = name;
+
+            trim();
+        } else {
+            entries.erase( it );
+        }
+    }
+
+    if ( !poDS ) {
+        released.broadcast();
+    }
+
+    return poDS;
+}
+
+void tgShapefileCache::release( GDALDataset* poDS )
+{
+    if ( !poDS ) {
+        return;
+    }
+
+    {
+        SGGuard<SGMutex> g(lock);
+
+        std::map<GDALDataset*, std::string>::iterator nit = names.find( poDS );
+        if ( nit == names.end() ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "tgShapefileCache::release - dataset not from the cache" );
+            return;
+        }
+
+        tgShapefileEntry& entry = entries[nit->second];
+        if ( --entry.depth ) {
+            return;
+        }
+
+        lru.push_front( nit->second );
+        entry.lruPos = lru.begin();
+        entry.owner  = 0;
+
+        trim();
+    }
+
+    released.broadcast();
+}
+
+OGRLayer* tgShapefileCache::getLayer( GDALDataset* poDS, const char* layer_name )
+{
+    {
+        SGGuard<SGMutex> g(lock);
+
+        std::map<GDALDataset*, std::string>::iterator nit = names.find( poDS );
+        if ( nit != names.end() ) {
+            tgShapefileEntry& entry = entries[nit->second];
+
+            std::map<std::string, OGRLayer*>::iterator lit = entry.layers.find( layer_name );
+            if ( lit != entry.layers.end() ) {
+                return lit->second;
+            }
+        }
+    }
+
+    // first use - the caller owns the dataset, so no lock
+    OGRLayer* poLayer = poDS->GetLayerByName( layer_name );
+    if ( poLayer ) {
+        addLayer( poDS, layer_name, poLayer );
+    }
+
+    return poLayer;
+}
+
+void tgShapefileCache::addLayer( GDALDataset* poDS, const char* layer_name, OGRLayer* poLayer )
+{
+    SGGuard<SGMutex> g(lock);
+
+    std::map<GDALDataset*, std::string>::iterator nit = names.find( poDS );
+    if ( nit != names.end() ) {
+        tgShapefileEntry& entry = entries[nit->second];
+
+        entry.layers[layer_name] = poLayer;
+
+        // a created layer adds its files to the open count
+        numLayers      += poDS->GetLayerCount() - entry.numLayers;
+        entry.numLayers = poDS->GetLayerCount();
+    }
+}
+
+void tgShapefileCache::flush( void )
+{
+    SGGuard<SGMutex> g(lock);
+
+    for ( tgShapefileMap::iterator it = entries.begin(); it != entries.end(); it++ ) {
+        if ( !it->second.depth && it->second.update ) {
+            syncLayers( it->second.poDS );
+        }
+    }
+}
+
+void tgShapefileCache::closeAll( void )
+{
+    SGGuard<SGMutex> g(lock);
+
+    tgShapefileMap::iterator it = entries.begin();
+    while ( it != entries.end() ) {
+        if ( it->second.depth ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "tgShapefileCache::closeAll - " << it->first << " is still in use" );
+            it++;
+        } else {
+            remove( it++ );
+        }
+    }
+}
+
+// wait until no other thread has name, and take it.  call with the lock held
+tgShapefileCache::tgShapefileEntry& tgShapefileCache::wait( const std::string& name )
+{
+    for (;;) {
+        tgShapefileMap::iterator it = entries.find( name );
+
+        if ( it == entries.end() ) {
+            tgShapefileEntry& entry = entries[name];
+
+            entry.owner = SGThread::current();
+            entry.depth = 1;
+            return entry;
+        }
+
+        if ( !it->second.depth ) {
+            lru.erase( it->second.lruPos );
+
+            it->second.owner = SGThread::current();
+            it->second.depth = 1;
+            return it->second;
+        }
+
+        released.wait( lock );
+    }
+}
+
+// a shapefile can also be opened as part of its directory's datasource.
+// Readers of the file must see what was written through the directory,
+// and a directory opened for writing must not have stale readers of its
+// files.  call with the lock held
+void tgShapefileCache::sync( const std::string& name, bool update )
+{
+    if ( update ) {
+        tgShapefileMap::iterator it = entries.begin();
+        while ( it != entries.end() ) {
+            if ( !it->second.depth && !it->second.update && SGPath( it->first ).dir() == name ) {
+                remove( it++ );
+            } else {
+                it++;
+            }
+        }
+    } else {
+        std::string parent = SGPath( name ).dir();
+
+        for (;;) {
+            tgShapefileMap::iterator it = entries.find( parent );
+            if ( it == entries.end() || !it->second.update ) {
+                break;
+            }
+
+            if ( !it->second.depth || it->second.owner == SGThread::current() ) {
+                syncLayers( it->second.poDS );
+                break;
+            }
+
+            released.wait( lock );
+        }
+    }
+}
+
+// close idle datasources until we fit.  call with the lock held
+void tgShapefileCache::trim( void )
+{
+    while ( numLayers > maxLayers && !lru.empty() ) {
+        remove( entries.find( lru.back() ) );
+    }
+}
+
+// close an idle datasource, and forget it.  call with the lock held
+void tgShapefileCache::remove( tgShapefileMap::iterator it )
+{
+    tgShapefileEntry& entry = it->second;
+
+    if ( !entry.depth ) {
+        lru.erase( entry.lruPos );
+    }
+
+    if ( entry.poDS ) {
+        names.erase( entry.poDS );
+        numLayers -= entry.numLayers;
+        GDALClose( entry.poDS );
+    }
+
+    entries.erase( it );
+}
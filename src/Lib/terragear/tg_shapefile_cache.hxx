@@ -0,0 +1,102 @@
+#ifndef __TG_SHAPEFILE_CACHE_HXX__
+#define __TG_SHAPEFILE_CACHE_HXX__
+
+#include <list>
+#include <map>
+#include <string>
+
+#include <ogrsf_frmts.h>
+
+#include <simgear/threads/SGThread.hxx>
+
+// Open GDAL datasources, shared by every shapefile writer and reader in
+// the process.
+//
+// Creating a datasource, and looking up its layers, costs far more than
+// writing the handful of features most callers have - and a tile is
+// written thousands of times.  The cache keeps each datasource open
+// between uses, along with the layers looked up in it, so the next
+// caller for the same path gets the handle back instead of reopening.
+//
+// A GDAL dataset may only be used by one thread at a time.  acquire()
+// hands the dataset to the calling thread until it calls release() -
+// other threads asking for the same path wait.  The owning thread may
+// acquire it again ( a debug dump nested in a write ), as long as each
+// acquire is released.
+//
+// Features written through a cached dataset are only guaranteed to be
+// on disk once it is flushed or closed.  Every tool writing shapefiles
+// should closeAll() before it exits.
+//
+// Idle datasources are closed least recently used first, once the open
+// layers ( 3 files each ) of all datasources would use more than a quarter
+// of the process's file descriptor limit - and never more layers than below.
+#define TG_SHAPEFILE_CACHE_MAX_LAYERS   (128)
+
+class tgShapefileCache
+{
+public:
+    static tgShapefileCache& instance( void ) { return theCache; }
+
+    ~tgShapefileCache();
+
+    // datasource for writing - created if it doesn't exist
+    GDALDataset* acquire( const std::string& name );
+
+    // existing datasource for reading - NULL if it can't be opened.
+    // Layers are rewound, so reading starts at the first feature.
+    GDALDataset* acquireForRead( const std::string& name );
+
+    // give a dataset back.  It stays open for the next caller
+    void release( GDALDataset* poDS );
+
+    // a layer of an acquired dataset, from the cache, or by name.
+    // NULL if the dataset has no such layer - create it, and addLayer()
+    OGRLayer* getLayer( GDALDataset* poDS, const char* layer_name );
+    void      addLayer( GDALDataset* poDS, const char* layer_name, OGRLayer* poLayer );
+
+    // write buffered features of all idle datasources to disk
+    void flush( void );
+
+    // close all idle datasources
+    void closeAll( void );
+
+private:
+    tgShapefileCache();
+
+    struct tgShapefileEntry {
+        tgShapefileEntry() : poDS( NULL ), update( false ), owner( 0 ), depth( 0 ), numLayers( 0 ) {}
+
+        GDALDataset*                        poDS;
+        bool                                update;     // opened for writing
+        long                                owner;      // thread using it
+        int                                 depth;      // nested acquires - 0 when idle
+        int                                 numLayers;  // counted against maxLayers
+        std::map<std::string, OGRLayer*>    layers;
+        std::list<std::string>::iterator    lruPos;     // valid when idle
+    };
+
+    typedef std::map<std::string, tgShapefileEntry>  tgShapefileMap;
+
+    GDALDataset* acquire( const std::string& name, bool update );
+
+    // call with the lock held
+    tgShapefileEntry& wait( const std::string& name );
+    void              sync( const std::string& name, bool update );
+    void              trim( void );
+    void              remove( tgShapefileMap::iterator it );
+
+    static tgShapefileCache theCache;
+
+    tgShapefileMap                      entries;
+    std::map<GDALDataset*, std::string> names;
+    std::list<std::string>              lru;        // idle datasources, most recently used first
+    int                                 numLayers;  // of all open datasources
+    int                                 maxLayers;
+    bool                                registered;
+
+    SGMutex                             lock;
+    SGWaitCondition                     released;
+};
+
+#endif /* __TG_SHAPEFILE_CACHE_HXX__ */
@@ -29,7 +29,7 @@
 #include <simgear/math/SGMath.hxx>
 #include <simgear/debug/logstream.hxx>
 
-#include <terragear/tg_array.hxx>
+#include <terragear/tg_array_cache.hxx>
 
 #include "TNT/jama_qr.h"
 #include "tg_surface.hxx"
@@ -94,7 +94,6 @@ static void tgCalcElevations( const std::string &root, const string_list elev_sr
 {
     bool done = false;
     int i, j;
-    tgArray array;
 
     // just bail if no work to do
     if ( Pts.rows() == 0 || Pts.cols() == 0 ) {
@@ -126,28 +125,10 @@ static void tgCalcElevations( const std::string &root, const string_list elev_sr
 
         if ( found_one ) {
             SGBucket b( first );
-            std::string base = b.gen_base_path();
 
-            // try the various elevation sources
-            j = 0;
-            bool found_file = false;
-            while ( !found_file && j < (int)elev_src.size() ) {
-                std::string array_path = root + "/" + elev_src[j] + "/" + base + "/" + b.gen_index_str();
-
-                if ( array.open(array_path) ) {
-                    found_file = true;
-                    SG_LOG( SG_GENERAL, SG_INFO, "Using array_path = " << array_path );
-                }
-                j++;
-            }
-
-            // this will fill in a zero structure if no array data
-            // found/opened
-            array.parse( b );
-
-            // this will do a hasty job of removing voids by inserting
-            // data from the nearest neighbor (sort of)
-            array.remove_voids();
+            // the first source with an array for this bucket - or zero'd
+            // data if there isn't one
+            tgArrayPtr array = tgArrayCache::instance().get( root, elev_src, b );
 
             // update all the non-updated elevations that are inside
             // this array file
@@ -158,8 +139,8 @@ static void tgCalcElevations( const std::string &root, const string_list elev_sr
                     SGGeod p = Pts.element(i,j);
                     if ( p.getElevationM() < -9000.0 ) {
                         done = false;
-                        elev = array.altitude_from_grid( p.getLongitudeDeg() * 3600.0,
-                                                         p.getLatitudeDeg() * 3600.0 );
+                        elev = array->altitude_from_grid( p.getLongitudeDeg() * 3600.0,
+                                                          p.getLatitudeDeg() * 3600.0 );
                         if ( elev > -9000 ) {
                             p.setElevationM( elev );
                             Pts.set(i, j, p);
@@ -167,9 +148,6 @@ static void tgCalcElevations( const std::string &root, const string_list elev_sr
                     }
                 }
             }
-
-            array.close();
-
         } else {
             done = true;
         }
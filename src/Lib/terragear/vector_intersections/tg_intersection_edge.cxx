@@ -1,5 +1,7 @@
 #include <simgear/sg_inlines.h>
 #include <simgear/timing/timestamp.hxx>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
 #include "tg_polygon.hxx"
 #include "tg_shapefile.hxx" 
@@ -7,6 +9,10 @@
 #include "tg_intersection_node.hxx"
 #include "tg_misc.hxx"
 
+// edge ids are compared within a generator - and generators of
+// different buckets may run at the same time
+static SGMutex ge_count_lock;
+
 tgIntersectionEdge::tgIntersectionEdge( tgIntersectionNode* s, tgIntersectionNode* e, double w, int z, unsigned int t, const std::string& db ) : constraints()
 {
     static unsigned int ge_count = 0;
@@ -17,7 +23,10 @@ tgIntersectionEdge::tgIntersectionEdge( tgIntersectionNode* s, tgIntersectionNod
     zorder = z;
     type   = t;
     
-    id     = ++ge_count;
+    {
+        SGGuard<SGMutex> g(ge_count_lock);
+        id = ++ge_count;
+    }
     flags  = 0;
 
     // we need to add this edge between start and end to handle multiple edges at a node
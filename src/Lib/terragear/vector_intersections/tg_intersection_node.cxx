@@ -1,4 +1,6 @@
 #include <simgear/sg_inlines.h>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
 #include "tg_polygon.hxx"
 #include "tg_shapefile.hxx" 
@@ -6,30 +8,37 @@
 #include "tg_intersection_edge.hxx"
 #include "tg_misc.hxx"
 
+// node ids are shared by every generator in the process - and
+// generators of different buckets may run at the same time
+static SGMutex      node_id_lock;
+static unsigned int node_cur_id = 1;
+
+static unsigned int nextNodeId( void )
+{
+    SGGuard<SGMutex> g(node_id_lock);
+    return node_cur_id++;
+}
+
 tgIntersectionNode::tgIntersectionNode( const SGGeod& pos )
 {
-    static unsigned int cur_id = 1;
-    
     position = pos;
     position2 = edgeArrPoint( pos.getLongitudeDeg(), pos.getLatitudeDeg() );
     
     edgeList.clear();
     start_v = NODE_UNTEXTURED;
     endpoint = false;
-    id = cur_id++;
+    id = nextNodeId();
 }
 
 tgIntersectionNode::tgIntersectionNode( const edgeArrPoint& pos )
 {
-    static unsigned int cur_id = 1;
-    
     position = SGGeod::fromDeg( CGAL::to_double( pos.x() ), CGAL::to_double( pos.y() ) );
     position2 = pos;
     
     edgeList.clear();
     start_v = NODE_UNTEXTURED;
     endpoint = false;
-    id = cur_id++;
+    id = nextNodeId();
 }
 
 void tgIntersectionNode::CheckEndpoint( void )
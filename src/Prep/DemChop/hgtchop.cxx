@@ -1,4 +1,4 @@
-// hgtchop.cxx -- chop up a hgt file into it's corresponding pieces and stuff
+// hgtchop.cxx -- chop up hgt files into their corresponding pieces and stuff
 //                them into the workspace directory
 //
 // Written by Curtis Olson, started March 1999.
@@ -26,55 +26,116 @@
 
 #include <simgear/compiler.h>
 
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <set>
 #include <string>
+#include <vector>
 #include <iostream>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/debug/logstream.hxx>
 #include <simgear/misc/sg_path.hxx>
 #include <simgear/misc/sg_dir.hxx>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
 #include <Include/version.h>
 #include <HGT/hgt.hxx>
+#include <terragear/tg_dataset_protect.hxx>
 
 #include <stdlib.h>
+#include <string.h>
 
 using std::cout;
 using std::endl;
 using std::string;
 
+typedef boost::shared_ptr<TGHgt> TGHgtPtr;
 
-int main(int argc, char **argv) {
-    sglog().setLogLevels( SG_ALL, SG_WARN );
-    SG_LOG( SG_GENERAL, SG_ALERT, "hgtchop version " << getTGVersion() << "\n" );
+// a bucket of a loaded hgt file, still to be written
+struct HgtBucketJob {
+    TGHgtPtr    hgt;
+    SGBucket    bucket;
+};
 
-    if ( argc != 4 ) {
-	cout << "Usage " << argv[0] << " <resolution> <hgt_file> <work_dir>"
-             << endl;
-        cout << endl;
- 	cout << "\tresolution must be either 1 or 3 for 1arcsec or 3arcsec"
-             << endl;       
-	exit(-1);
-    }
+// Files are loaded one per thread, and their buckets are queued for any
+// thread to write.  A thread looking for work takes a queued bucket
+// before it loads another file, so only about one file per thread is
+// in memory at a time.
+static std::vector<SGPath>          hgtFiles;
+static unsigned int                 nextFile = 0;
+static unsigned int                 numLoading = 0;
+static std::deque<HgtBucketJob>     bucketJobs;
+static SGMutex                      jobLock;
+static SGWaitCondition              jobsChanged;
 
-    int resolution = atoi( argv[1] );
-    string hgt_name = argv[2];
-    string work_dir = argv[3];
+// buckets written by this run - a second input covering the same bucket
+// is merged with what is already there, rather than replacing it
+static std::set<long>               writtenBuckets;
+static unsigned int                 failedWrites = 0;
+static SGMutex                      writtenLock;
 
-    // determine if file is 1arcsec or 3arcsec variety
-    if ( resolution != 1 && resolution != 3 ) {
-        cout << "ERROR: resolution must be 1 or 3." << endl;
-        exit( -1 );
+static tgDatasetAccess              bucketAccess;
+static SGMutex                      coutLock;
+
+static int                          resolution = 3;
+static string                       work_dir;
+
+// a bucket to write if there is one, otherwise ( hgt empty ) the next
+// file to load.  false once all files are loaded, and all buckets written.
+static bool get_next_job( HgtBucketJob& job, SGPath& file )
+{
+    SGGuard<SGMutex> g(jobLock);
+
+    for (;;) {
+        if ( !bucketJobs.empty() ) {
+            job = bucketJobs.front();
+            bucketJobs.pop_front();
+            return true;
+        }
+
+        if ( nextFile < hgtFiles.size() ) {
+            job.hgt.reset();
+            file = hgtFiles[nextFile++];
+            numLoading++;
+            return true;
+        }
+
+        if ( numLoading == 0 ) {
+            return false;
+        }
+
+        // a file is still loading - its buckets may be ours to write
+        jobsChanged.wait( jobLock );
     }
+}
 
-    SGPath sgp( work_dir );
-    simgear::Dir workDir(sgp);
-    workDir.create(0755);
+static void add_bucket_jobs( TGHgtPtr hgt, const std::vector<SGBucket>& buckets )
+{
+    {
+        SGGuard<SGMutex> g(jobLock);
 
-    TGHgt hgt(resolution, hgt_name);
-    hgt.load();
-    hgt.close();
+        for ( unsigned int i = 0; hgt && i < buckets.size(); i++ ) {
+            HgtBucketJob job;
+            job.hgt    = hgt;
+            job.bucket = buckets[i];
+            bucketJobs.push_back( job );
+        }
+        numLoading--;
+    }
+    jobsChanged.broadcast();
+}
 
+// the buckets an hgt file covers
+static bool get_buckets( const TGHgt& hgt, std::vector<SGBucket>& buckets )
+{
     SGGeod min = SGGeod::fromDeg( hgt.get_originx() / 3600.0 + SG_HALF_BUCKET_SPAN,
                                   hgt.get_originy() / 3600.0 + SG_HALF_BUCKET_SPAN );
     SGGeod max = SGGeod::fromDeg( (hgt.get_originx() + hgt.get_cols() * hgt.get_col_step()) / 3600.0 - SG_HALF_BUCKET_SPAN,
@@ -83,26 +144,266 @@ int main(int argc, char **argv) {
     SGBucket b_max( max );
 
     if ( b_min == b_max ) {
-        hgt.write_area( work_dir, b_min );
+        buckets.push_back( b_min );
     } else {
-        SGBucket b_cur;
-        int dx, dy, i, j;
+        int dx, dy;
 
         sgBucketDiff(b_min, b_max, &dx, &dy);
-        cout << "HGT file spans tile boundaries (ok)" << endl;
-        cout << "  dx = " << dx << "  dy = " << dy << endl;
-
         if ( (dx > 20) || (dy > 20) ) {
-            cout << "somethings really wrong!!!!" << endl;
-            exit(-1);
+            return false;
         }
 
-        for ( j = 0; j <= dy; j++ ) {
-            for ( i = 0; i <= dx; i++ ) {
-                b_cur = b_min.sibling(i, j);
-                hgt.write_area( work_dir, b_cur );
+        for ( int j = 0; j <= dy; j++ ) {
+            for ( int i = 0; i <= dx; i++ ) {
+                buckets.push_back( b_min.sibling(i, j) );
+            }
+        }
+    }
+
+    return true;
+}
+
+// a bucket covered by more than one input.  On the same grid, samples
+// already written win, and the new data fills their voids.  On
+// different grids, the finer one is kept whole.
+static void merge_area( const TGSrtmArea& existing, TGSrtmArea& area )
+{
+    if ( existing.same_grid( area ) ) {
+        for ( unsigned int i = 0; i < area.samples.size(); i++ ) {
+            if ( existing.samples[i] != SRTM_VOID ) {
+                area.samples[i] = existing.samples[i];
             }
         }
+    } else if ( existing.col_step <= area.col_step && existing.row_step <= area.row_step ) {
+        area = existing;
+    }
+}
+
+static void write_bucket( const TGHgt& hgt, SGBucket& b )
+{
+    TGSrtmArea area;
+
+    // partially outside the data, or all ocean
+    if ( !hgt.extract_area( b, area ) ) {
+        return;
+    }
+
+    string path       = work_dir + "/" + b.gen_base_path();
+    string array_file = path + "/" + b.gen_index_str() + ".arr.gz";
+    string raw_file   = path + "/" + b.gen_index_str() + ".arr.raw";
+
+    tgDatasetGuard guard( bucketAccess, b.gen_index() );
+
+    bool merge;
+    {
+        SGGuard<SGMutex> g(writtenLock);
+        merge = !writtenBuckets.insert( b.gen_index() ).second;
+    }
+
+    if ( merge ) {
+        TGSrtmArea existing;
+        if ( TGSrtmBase::read_area_file( array_file, existing ) ) {
+            merge_area( existing, area );
+
+            SGGuard<SGMutex> g(coutLock);
+            cout << "  merged " << array_file << endl;
+        }
+    } else {
+        bucketAccess.MakeDirectory( path );
+    }
+
+    if ( !TGSrtmBase::write_area_file( array_file, area ) ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: could not write " << array_file );
+
+        SGGuard<SGMutex> g(writtenLock);
+        failedWrites++;
+        return;
+    }
+
+    // a raw array file would shadow the one we just wrote
+    ::remove( raw_file.c_str() );
+}
+
+class HgtChopWorker : public SGThread
+{
+public:
+    HgtChopWorker() {}
+
+private:
+    virtual void run();
+};
+
+void HgtChopWorker::run()
+{
+    HgtBucketJob job;
+    SGPath       file;
+
+    while ( get_next_job( job, file ) ) {
+        if ( job.hgt ) {
+            write_bucket( *job.hgt, job.bucket );
+
+            // the last bucket of a file frees it
+            job.hgt.reset();
+            continue;
+        }
+
+        TGHgtPtr              hgt( new TGHgt( resolution ) );
+        std::vector<SGBucket> buckets;
+
+        bool loaded = hgt->open( file ) && hgt->load();
+        hgt->close();
+
+        if ( !loaded ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: could not load " << file.str() );
+            hgt.reset();
+        } else if ( !get_buckets( *hgt, buckets ) ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: " << file.str() << " spans too many buckets - skipping" );
+            hgt.reset();
+        } else {
+            SGGuard<SGMutex> g(coutLock);
+            cout << "Loaded " << file.str() << " : " << buckets.size() << " buckets" << endl;
+        }
+
+        add_bucket_jobs( hgt, buckets );
+    }
+}
+
+static bool is_hgt_file( const SGPath& p )
+{
+    string ext = p.lower_extension();
+
+    if ( ext == "gz" ) {
+        ext = SGPath( p.base() ).lower_extension();
+    }
+
+    return ( ext == "hgt" || ext == "zip" );
+}
+
+static bool path_less( const SGPath& a, const SGPath& b )
+{
+    return a.str() < b.str();
+}
+
+// a file, a directory of hgt files, or @list - a file naming one input per line
+static void add_input( const string& input )
+{
+    if ( !input.empty() && input[0] == '@' ) {
+        std::ifstream list( input.c_str() + 1 );
+        if ( !list.is_open() ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "ERROR: cannot open list " << input.substr(1) );
+            exit( -1 );
+        }
+
+        string line;
+        while ( std::getline( list, line ) ) {
+            while ( !line.empty() && isspace( (unsigned char)line[line.size()-1] ) ) {
+                line.erase( line.size()-1 );
+            }
+            if ( !line.empty() ) {
+                add_input( line );
+            }
+        }
+        return;
+    }
+
+    SGPath p( input );
+    if ( input != "-" && p.isDir() ) {
+        simgear::PathList files = simgear::Dir( p ).children( simgear::Dir::TYPE_FILE | simgear::Dir::NO_DOT_OR_DOTDOT );
+        std::sort( files.begin(), files.end(), path_less );
+
+        for ( unsigned int i = 0; i < files.size(); i++ ) {
+            if ( is_hgt_file( files[i] ) ) {
+                hgtFiles.push_back( files[i] );
+            }
+        }
+    } else {
+        hgtFiles.push_back( p );
+    }
+}
+
+static void usage( const char* name )
+{
+    cout << "Usage " << name << " [--threads[=n]] <resolution> <hgt_file|dir|@list> ... <work_dir>"
+         << endl;
+    cout << endl;
+    cout << "\tresolution must be either 1 or 3 for 1arcsec or 3arcsec"
+         << endl;
+    cout << "\tdirectories are searched for .hgt, .hgt.gz and .zip files"
+         << endl;
+    cout << "\t@list reads the inputs from a file, one per line"
+         << endl;
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    sglog().setLogLevels( SG_ALL, SG_WARN );
+    SG_LOG( SG_GENERAL, SG_ALERT, "hgtchop version " << getTGVersion() << "\n" );
+
+    int num_threads = 1;
+    int arg_pos = 1;
+
+    while ( arg_pos < argc && !strncmp(argv[arg_pos], "--", 2) ) {
+        if ( !strncmp(argv[arg_pos], "--threads", 9) ) {
+            if ( argv[arg_pos][9] == '=' ) {
+                num_threads = atoi( argv[arg_pos] + 10 );
+            } else {
+                num_threads = boost::thread::hardware_concurrency();
+            }
+        } else {
+            usage( argv[0] );
+        }
+        arg_pos++;
+    }
+
+    if ( num_threads < 1 ) {
+        num_threads = 1;
+    }
+
+    if ( argc - arg_pos < 3 ) {
+        usage( argv[0] );
+    }
+
+    resolution = atoi( argv[arg_pos] );
+    work_dir = argv[argc - 1];
+
+    // determine if file is 1arcsec or 3arcsec variety
+    if ( resolution != 1 && resolution != 3 ) {
+        cout << "ERROR: resolution must be 1 or 3." << endl;
+        exit( -1 );
+    }
+
+    for ( int i = arg_pos + 1; i < argc - 1; i++ ) {
+        add_input( argv[i] );
+    }
+
+    if ( hgtFiles.empty() ) {
+        cout << "ERROR: no hgt files to chop." << endl;
+        exit( -1 );
+    }
+
+    SGPath sgp( work_dir );
+    simgear::Dir workDir(sgp);
+    workDir.create(0755);
+
+    cout << "Chopping " << hgtFiles.size() << " hgt files with " << num_threads << " threads" << endl;
+
+    std::vector<HgtChopWorker*> workers;
+    for ( int i = 0; i < num_threads; i++ ) {
+        workers.push_back( new HgtChopWorker() );
+    }
+    for ( int i = 0; i < num_threads; i++ ) {
+        workers[i]->start();
+    }
+    for ( int i = 0; i < num_threads; i++ ) {
+        workers[i]->join();
+        delete workers[i];
+    }
+
+    cout << "Wrote " << writtenBuckets.size() << " buckets" << endl;
+
+    if ( failedWrites ) {
+        cout << "ERROR: " << failedWrites << " bucket writes failed" << endl;
+        return 1;
     }
 
     return 0;
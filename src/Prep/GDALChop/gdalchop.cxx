@@ -26,12 +26,20 @@
 //#  include <config.h>
 //#endif
 
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
 #include <simgear/compiler.h>
 #include <simgear/bucket/newbucket.hxx>
 #include <simgear/debug/logstream.hxx>
 #include <simgear/io/lowlevel.hxx>
 #include <simgear/misc/sg_path.hxx>
+#include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
 
+#include <Lib/terragear/tg_array.hxx>
 #include <Lib/terragear/tg_rectangle.hxx>
 
 #include <ogrsf_frmts.h> 
@@ -40,6 +48,7 @@
 #include <ogr_spatialref.h>
 
 #include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
 
 /*
  * A simple benchmark using a 5x5 degree package
@@ -65,6 +74,13 @@
  * - Ralf Gerlich
  */
 
+/*
+ * Buckets are independent of each other, so they are handed out to a
+ * pool of worker threads.  GDAL datasets must not be shared between
+ * threads, so every worker opens its own handles, and keeps its own
+ * cache of image -> WGS84 transformers.
+ */
+
 struct SimpleRasterTransformerInfo {
     GDALTransformerFunc pfnTransformer;
     void* pTransformerArg;
@@ -106,6 +122,12 @@ int SimpleRasterTransformer(void *pTransformerArg,
 class ImageInfo {
 public:
     ImageInfo(GDALDataset *dataset);
+    ~ImageInfo();
+
+    /* false if the bounds of the dataset couldn't be determined */
+    bool IsValid() const {
+        return valid;
+    }
 
     void GetBounds(double &n, double &s, double &e, double &w) const {
         n = north;
@@ -139,9 +161,18 @@ public:
                       int srcband = 1, int nodata = -32768);
 
 protected:
+    /* cached GenImgProj transformer from the image to dstWKT */
+    void* GetTransformer(const std::string& dstWKT);
+
     /* The dataset */
     GDALDataset *dataset;
 
+    /* WKT of the WGS84 target srs */
+    std::string wgs84WKT;
+
+    /* GenImgProj transformers, keyed by target srs WKT */
+    std::map<std::string, void*> transformers;
+
     /* Source spatial reference system */
     OGRSpatialReference srs;
 
@@ -159,11 +190,15 @@ protected:
 
     /* Pixel size in degs */
     double pxSizeX, pxSizeY;
+
+    bool valid;
 };
 
 ImageInfo::ImageInfo(GDALDataset *dataset) :
     dataset(dataset),
-    srs(dataset->GetProjectionRef())
+    srs(dataset->GetProjectionRef()),
+    wgs84xform(NULL),
+    valid(false)
 {
     OGRSpatialReference wgs84SRS;
 
@@ -171,6 +206,11 @@ ImageInfo::ImageInfo(GDALDataset *dataset) :
     // GDAL knows this well known projection already
     wgs84SRS.SetWellKnownGeogCS( "EPSG:4326" );
 
+    char* wkt = NULL;
+    wgs84SRS.exportToWkt(&wkt);
+    wgs84WKT = wkt;
+    CPLFree(wkt);
+
     /* Determine the bounds of the input file in WGS84 */
     int w = dataset->GetRasterXSize();
     int h = dataset->GetRasterYSize();
@@ -180,7 +220,7 @@ ImageInfo::ImageInfo(GDALDataset *dataset) :
                "Could not determine transform matrix for dataset "
                "'" << dataset->GetDescription() << "'"
                ":" << CPLGetLastErrorMsg());
-        exit(1);
+        return;
     }
 
     /* calculate pixel size */
@@ -203,12 +243,12 @@ ImageInfo::ImageInfo(GDALDataset *dataset) :
 
     wgs84xform = OGRCreateCoordinateTransformation( &srs, &wgs84SRS );
 
-    if (!wgs84xform->Transform(4, geoX, geoY)) {
+    if (wgs84xform == NULL || !wgs84xform->Transform(4, geoX, geoY)) {
         SG_LOG(SG_GENERAL, SG_ALERT,
                "Could not transform edge points of dataset "
                "'" << dataset->GetDescription() << "'"
                ":" << CPLGetLastErrorMsg());
-        exit(1);
+        return;
     }
 
     east = west = geoX[0];
@@ -225,30 +265,50 @@ ImageInfo::ImageInfo(GDALDataset *dataset) :
            "INFO: Bounds for '" << dataset->GetDescription() << "' are"
            " n=" << north << " s=" << south <<
            " e=" << east << " w=" << west);
+
+    valid = true;
 }
 
-void ImageInfo::GetDataChunk(int *buffer,
-                             double x, double y,
-                             double colstep, double rowstep,
-                             int w, int h,
-                             int srcband, int nodata)
+ImageInfo::~ImageInfo()
 {
-    OGRSpatialReference wgs84SRS;
+    std::map<std::string, void*>::iterator it;
+    for (it = transformers.begin(); it != transformers.end(); it++) {
+        GDALDestroyGenImgProjTransformer( it->second );
+    }
 
-    wgs84SRS.SetWellKnownGeogCS( "EPSG:4326" );
+    OCTDestroyCoordinateTransformation( wgs84xform );
+    GDALClose( dataset );
+}
 
-    char* wgs84WKT;
-    wgs84SRS.exportToWkt(&wgs84WKT);
+void* ImageInfo::GetTransformer(const std::string& dstWKT)
+{
+    std::map<std::string, void*>::iterator it = transformers.find(dstWKT);
+    if (it != transformers.end()) {
+        return it->second;
+    }
 
-    /* Setup a raster transformation from WGS84 to raster coordinates of the array files */
-    SimpleRasterTransformerInfo xformData;
-    xformData.pTransformerArg = GDALCreateGenImgProjTransformer(
+    void* xform = GDALCreateGenImgProjTransformer(
         dataset, NULL,
-        NULL, wgs84WKT,
+        NULL, dstWKT.c_str(),
         FALSE,
         0.0,
         1);
 
+    transformers[dstWKT] = xform;
+
+    return xform;
+}
+
+void ImageInfo::GetDataChunk(int *buffer,
+                             double x, double y,
+                             double colstep, double rowstep,
+                             int w, int h,
+                             int srcband, int nodata)
+{
+    /* Setup a raster transformation from WGS84 to raster coordinates of the array files */
+    SimpleRasterTransformerInfo xformData;
+    xformData.pTransformerArg = GetTransformer( wgs84WKT );
+
     xformData.pfnTransformer = GDALGenImgProjTransform;
     xformData.x0 = x - pxSizeX * 0.5;
     xformData.y0 = y - pxSizeY * 0.5;
@@ -302,11 +362,17 @@ void ImageInfo::GetDataChunk(int *buffer,
     psWarpOptions->padfSrcNoDataImag = NULL;
     psWarpOptions->padfDstNoDataReal = NULL;
 
-    GDALDestroyGenImgProjTransformer( xformData.pTransformerArg );
     GDALDestroyWarpOptions( psWarpOptions );
 }
 
-void write_bucket(const std::string& work_dir, SGBucket bucket,
+// neighbouring buckets share a directory
+static SGMutex dir_lock;
+
+// write uncompressed .arr.raw files, rather than .arr.gz
+static bool write_raw = false;
+
+// returns false if the array couldn't be written
+bool write_bucket(const std::string& work_dir, SGBucket bucket,
                   int* buffer,
                   int min_x, int min_y,
                   int span_x, int span_y,
@@ -317,14 +383,38 @@ void write_bucket(const std::string& work_dir, SGBucket bucket,
     std::string path = work_dir + "/" + base;
     SGPath sgp( path );
     sgp.append( "dummy" );
-    sgp.create_dir( 0755 );
+    {
+        SGGuard<SGMutex> g(dir_lock);
+        sgp.create_dir( 0755 );
+    }
 
-    std::string array_file = path + "/" + bucket.gen_index_str() + ".arr.gz";
+    std::string array_base = path + "/" + bucket.gen_index_str();
+
+    // the array is column major
+    std::vector<short> samples( span_x * span_y );
+    for ( int x = 0; x < span_x; ++x ) {
+        for ( int y = 0; y < span_y; ++y ) {
+            samples[ x * span_y + y ] = buffer[ y * span_x + x ];
+        }
+    }
+
+    if ( write_raw ) {
+        if ( !tgArray::write_raw( array_base + ".arr.raw", min_x, min_y, span_x, col_step, span_y, row_step, &samples[0] ) ) {
+            SG_LOG(SG_GENERAL, SG_ALERT, "cannot write " << array_base << ".arr.raw");
+            return false;
+        }
+
+        // readers prefer the raw file - but don't leave a stale one around
+        ::remove( (array_base + ".arr.gz").c_str() );
+        return true;
+    }
+
+    std::string array_file = array_base + ".arr.gz";
 
     gzFile fp;
     if ( (fp = gzopen(array_file.c_str(), "wb9")) == NULL ) {
         SG_LOG(SG_GENERAL, SG_ALERT, "cannot open " << array_file << " for writing!");
-        exit(-1);
+        return false;
     }
 
     int32_t header = 0x54474152; // 'TGAR'
@@ -333,16 +423,18 @@ void write_bucket(const std::string& work_dir, SGBucket bucket,
     sgWriteInt(fp, span_x); sgWriteInt(fp, col_step);
     sgWriteInt(fp, span_y); sgWriteInt(fp, row_step);
 
-    for ( int x = 0; x < span_x; ++x ) {
-        for ( int y = 0; y < span_y; ++y ) {
-            sgWriteShort(fp, buffer[ y * span_x + x ]);
-        }
-    }
+    sgWriteShort(fp, samples.size(), (int16_t*)&samples[0]);
 
     gzclose(fp);
+
+    // a raw file would shadow the one we just wrote
+    ::remove( (array_base + ".arr.raw").c_str() );
+
+    return true;
 }
 
-void process_bucket(const SGPath& work_dir, SGBucket bucket,
+// returns false if the bucket should have been written, but couldn't be
+bool process_bucket(const SGPath& work_dir, SGBucket bucket,
                     ImageInfo* images[], int imagecount,
                     bool forceWrite = false)
 {
@@ -410,28 +502,126 @@ void process_bucket(const SGPath& work_dir, SGBucket bucket,
         SG_LOG(SG_GENERAL, SG_INFO, "    there is not enough data available to cover this cell (limit for non-covered cells is " << nodataPercLimit << "%)");
         /* don't write out if not forced to */
         if (!forceWrite)
-            return;
+            return true;
     }
 
     /* ...and write it out */
-    write_bucket(work_dir.str(), bucket,
+    return write_bucket(work_dir.str(), bucket,
                  buffer.get(),
                  min_x, min_y,
                  span_x, span_y,
                  col_step, row_step);
 }
 
+/* buckets still to be chopped - shared by all workers */
+static std::vector<SGBucket> bucketList;
+static unsigned int          nextBucket = 0;
+static SGMutex               bucketLock;
+
+static bool get_next_bucket(SGBucket& bucket)
+{
+    SGGuard<SGMutex> g(bucketLock);
+
+    if (nextBucket >= bucketList.size()) {
+        return false;
+    }
+
+    bucket = bucketList[nextBucket++];
+    return true;
+}
+
+class ChopWorker : public SGThread
+{
+public:
+    ChopWorker(const SGPath& work, const char** names, int count, bool force) :
+        work_dir(work), datasetnames(names), datasetcount(count), forceWrite(force), failed(false) {}
+
+    /* true if a dataset couldn't be opened, or a bucket couldn't be written */
+    bool Failed() const {
+        return failed;
+    }
+
+private:
+    virtual void run();
+
+    SGPath          work_dir;
+    const char**    datasetnames;
+    int             datasetcount;
+    bool            forceWrite;
+    bool            failed;
+};
+
+void ChopWorker::run()
+{
+    /* GDAL handles can't be shared across threads - open our own */
+    boost::scoped_array<ImageInfo *> images( new ImageInfo *[datasetcount] );
+
+    for (int i = 0; i < datasetcount; i++) {
+        images[i] = NULL;
+    }
+
+    for (int i = 0; i < datasetcount && !failed; i++) {
+        GDALDataset* dataset = (GDALDataset*)GDALOpen(datasetnames[i], GA_ReadOnly);
+
+        if (dataset == NULL) {
+            SG_LOG(SG_GENERAL, SG_ALERT,
+                   "Could not open dataset '" << datasetnames[i] << "'"
+                   ":" << CPLGetLastErrorMsg());
+            failed = true;
+        } else {
+            images[i] = new ImageInfo(dataset);
+            failed = !images[i]->IsValid();
+        }
+    }
+
+    /* leave the buckets to the other workers - main reports the failure */
+    if (!failed) {
+        SGBucket bucket;
+        while ( get_next_bucket(bucket) ) {
+            if (!process_bucket(work_dir, bucket, images.get(), datasetcount, forceWrite)) {
+                failed = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < datasetcount; i++) {
+        delete images[i];
+    }
+}
+
 int main(int argc, const char **argv)
 {
     sglog().setLogLevels( SG_ALL, SG_INFO );
 
-    if ( argc < 3 ) {
+    int num_threads = 1;
+    int arg_pos = 1;
+
+    while ( arg_pos < argc && !strncmp(argv[arg_pos], "--", 2) && strcmp(argv[arg_pos], "--") ) {
+        if ( !strncmp(argv[arg_pos], "--threads", 9) ) {
+            if ( argv[arg_pos][9] == '=' ) {
+                num_threads = atoi( argv[arg_pos] + 10 );
+            } else {
+                num_threads = boost::thread::hardware_concurrency();
+            }
+        } else if ( !strcmp(argv[arg_pos], "--raw") ) {
+            write_raw = true;
+        } else {
+            break;
+        }
+        arg_pos++;
+    }
+
+    if ( num_threads < 1 ) {
+        num_threads = 1;
+    }
+
+    if ( argc - arg_pos < 2 ) {
         SG_LOG(SG_GENERAL, SG_ALERT,
-               "Usage " << argv[0] << " <work_dir> <datasetname...> [-- <bucket-idx> ...]");
+               "Usage " << argv[0] << " [--threads[=n]] [--raw] <work_dir> <datasetname...> [-- <bucket-idx> ...]");
         exit(-1);
     }
 
-    SGPath work_dir(argv[1]);
+    SGPath work_dir(argv[arg_pos]);
     work_dir.create_dir( 0755 );
 
     GDALAllRegister();
@@ -439,11 +629,11 @@ int main(int argc, const char **argv)
     int datasetcount = 0, tilecount = 0;
     int dashpos;
 
-    for (dashpos = 2; dashpos < argc; dashpos++)
+    for (dashpos = arg_pos+1; dashpos < argc; dashpos++)
         if (!strcmp(argv[dashpos], "--"))
             break;
 
-    datasetcount = dashpos - 2;
+    datasetcount = dashpos - (arg_pos+1);
     tilecount = (dashpos == argc ? 0 : argc - dashpos - 1);
 
     if (datasetcount == 0) {
@@ -453,7 +643,7 @@ int main(int argc, const char **argv)
     }
 
     const char** tilenames = argv + dashpos + 1;
-    const char** datasetnames = argv + 2;
+    const char** datasetnames = argv + arg_pos + 1;
 
     boost::scoped_array<ImageInfo *> images( new ImageInfo *[datasetcount] );
 
@@ -477,6 +667,9 @@ int main(int argc, const char **argv)
         }
 
         images[i] = new ImageInfo(dataset);
+        if (!images[i]->IsValid()) {
+            exit(1);
+        }
 
         double inorth, isouth, ieast, iwest;
         images[i]->GetBounds(inorth, isouth, ieast, iwest);
@@ -489,6 +682,11 @@ int main(int argc, const char **argv)
 
     SG_LOG(SG_GENERAL, SG_INFO, "Bounds of all datasets: n=" << north << " s=" << south << " e=" << east << " w=" << west);
 
+    /* the workers open their own handles */
+    for (int i = 0; i < datasetcount; i++) {
+        delete images[i];
+    }
+
     /*
      * Step 2: If no tiles were specified, go through all tiles contained in
      *         the common bounds of all datasets and find those which have
@@ -513,9 +711,7 @@ int main(int argc, const char **argv)
 
         for (int x = 0; x <= dx; x++) {
             for (int y = 0; y <= dy; y++) {
-                SGBucket bucket = start.sibling(x, y);
-
-                process_bucket(work_dir, bucket, images.get(), datasetcount);
+                bucketList.push_back( start.sibling(x, y) );
             }
         }
     } else {
@@ -524,10 +720,31 @@ int main(int argc, const char **argv)
          * data is available, but write them in any case.
          */
         for (int i = 0; i < tilecount; i++) {
-            SGBucket bucket(atol(tilenames[i]));
+            bucketList.push_back( SGBucket(atol(tilenames[i])) );
+        }
+    }
 
-            process_bucket(work_dir, bucket, images.get(), datasetcount, true);
+    SG_LOG(SG_GENERAL, SG_INFO, "Chopping " << bucketList.size() << " buckets with " << num_threads << " threads");
+
+    std::vector<ChopWorker *> workers;
+    for (int i = 0; i < num_threads; i++) {
+        ChopWorker* worker = new ChopWorker( work_dir, datasetnames, datasetcount, tilecount != 0 );
+        worker->start();
+        workers.push_back( worker );
+    }
+
+    bool failed = false;
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        workers[i]->join();
+        if (workers[i]->Failed()) {
+            failed = true;
         }
+        delete workers[i];
+    }
+
+    if (failed) {
+        SG_LOG(SG_GENERAL, SG_ALERT, "Some buckets could not be chopped");
+        return 1;
     }
 
     return 0;
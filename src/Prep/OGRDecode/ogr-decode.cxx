@@ -22,16 +22,20 @@
 // Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
 //
 
+#include <cmath>
+#include <deque>
 #include <string>
 #include <map>
+#include <vector>
 
 #include <boost/thread.hpp>
 #include <ogrsf_frmts.h>
 #include <gdal_priv.h>
 
 #include <simgear/compiler.h>
+#include <simgear/bucket/newbucket.hxx>
 #include <simgear/threads/SGThread.hxx>
-#include <simgear/threads/SGQueue.hxx>
+#include <simgear/threads/SGGuard.hxx>
 #include <simgear/debug/logstream.hxx>
 #include <simgear/math/sg_geodesy.hxx>
 #include <simgear/misc/sg_path.hxx>
@@ -39,12 +43,19 @@
 #include <Include/version.h>
 
 #include <terragear/tg_polygon.hxx>
-#include <terragear/tg_chopper.hxx>
-#include <terragear/tg_shapefile.hxx>
+#include <terragear/polygon_set/tg_polygon_set.hxx>
+#include <terragear/polygon_set/tg_polygon_chop.hxx>
+#include <terragear/tg_shapefile_cache.hxx>
 
 /* stretch endpoints to reduce slivers in linear data ~.1 meters */
 #define EP_STRETCH  (0.1)
 
+/* features waiting for each decoder - the reader blocks when full */
+#define DECODER_QUEUE_SIZE  (256)
+
+/* features are handed out in blocks of N x N buckets */
+#define DECODER_BLOCK_BUCKETS   (4)
+
 using std::string;
 
 // scope?
@@ -64,12 +75,83 @@ string attribute_query;
 bool use_spatial_query=false;
 double spat_min_x, spat_min_y, spat_max_x, spat_max_y;
 int num_threads = 1;
-bool save_shapefiles=false;
 std::string ds_name=".";
 
 const double gSnap = 0.00000001;      // approx 1 mm
 
-SGLockedQueue<OGRFeature *> global_workQueue;
+// features waiting for the decoders.  Each decoder has its own bounded
+// queue, filled with the features of its blocks - so reading a huge
+// layer doesn't hold the whole layer in memory, the reader waits for the
+// decoder to catch up instead.  A decoder whose queue runs dry takes
+// features from the back of the longest other queue, so one dense block
+// doesn't leave the other threads idle.
+class FeatureQueues
+{
+public:
+    FeatureQueues( unsigned int n ) : features(n), closed(false) {}
+
+    void push( unsigned int q, OGRFeature* poFeature ) {
+        SGGuard<SGMutex> g(lock);
+
+        while ( features[q].size() >= DECODER_QUEUE_SIZE ) {
+            notFull.wait( lock );
+        }
+        features[q].push_back( poFeature );
+
+        // an idle decoder may take it, not just the owner
+        notEmpty.broadcast();
+    }
+
+    // NULL once the queues are closed, and empty
+    OGRFeature* pop( unsigned int q ) {
+        SGGuard<SGMutex> g(lock);
+
+        while ( true ) {
+            OGRFeature* poFeature = NULL;
+
+            if ( !features[q].empty() ) {
+                poFeature = features[q].front();
+                features[q].pop_front();
+            } else {
+                unsigned int victim = q;
+                for ( unsigned int i=0; i<features.size(); i++ ) {
+                    if ( features[i].size() > features[victim].size() ) {
+                        victim = i;
+                    }
+                }
+                if ( victim != q ) {
+                    poFeature = features[victim].back();
+                    features[victim].pop_back();
+                }
+            }
+
+            if ( poFeature ) {
+                notFull.broadcast();
+                return poFeature;
+            }
+            if ( closed ) {
+                return NULL;
+            }
+
+            notEmpty.wait( lock );
+        }
+    }
+
+    // no more features for this layer
+    void close( void ) {
+        SGGuard<SGMutex> g(lock);
+
+        closed = true;
+        notEmpty.broadcast();
+    }
+
+private:
+    std::vector< std::deque<OGRFeature*> >  features;
+    bool                                    closed;
+    SGMutex                                 lock;
+    SGWaitCondition                         notEmpty;
+    SGWaitCondition                         notFull;
+};
 
 /* very GDAL specific here... */
 inline static bool is_ocean_area( const std::string &area ) {
@@ -87,24 +169,38 @@ inline static bool is_null_area( const std::string& area ) {
 class Decoder : public SGThread
 {
 public:
-    Decoder( OGRCoordinateTransformation *poct, int atf, int pwf, int lwf, tgChopper& c ) : chopper(c) {
-        poCT = poct;
+    Decoder( OGRSpatialReference *src, int atf, int pwf, int lwf, tgChopper& c, FeatureQueues& q, unsigned int i ) : queues(q), id(i), chopper(c) {
+        OGRSpatialReference oTargetSRS;
+        oTargetSRS.SetWellKnownGeogCS( "WGS84" );
+
+        // transformations aren't safe to share between threads
+        poCT = OGRCreateCoordinateTransformation(src, &oTargetSRS);
         area_type_field = atf;
         point_width_field = pwf;
         line_width_field = lwf;
     }
 
+    ~Decoder() {
+        OCTDestroyCoordinateTransformation ( poCT );
+    }
+
 private:
     virtual void run();
 
     void processPoint(OGRPoint* poGeometry, const string& area_type, int width );
     void processLineString(OGRLineString* poGeometry, const string& area_type, int width, int with_texture );
-    void processPolygon(OGRPolygon* poGeometry, const string& area_type );
+    void processPolygon(OGRFeature* poFeature, OGRPolygon* poGeometry, const string& area_type );
+
+    void addShape( const tgPolygon& shape, const string& area_type, tgPolygonSetMeta::TextureMethod_e method );
 
 private:
     // The transformation for each geometry object
     OGRCoordinateTransformation *poCT;
 
+    // the features of the layer, and which queue is ours
+    FeatureQueues& queues;
+    unsigned int id;
+
     // Store the reults per tile
     tgChopper& chopper;
 
@@ -113,6 +209,34 @@ private:
     int line_width_field;
 };
 
+// expanded points and line segments are a single outer contour
+void Decoder::addShape( const tgPolygon& shape, const string& area_type, tgPolygonSetMeta::TextureMethod_e method )
+{
+    if ( shape.Contours() == 0 || shape.ContourSize(0) < 3 ) {
+        return;
+    }
+
+    std::vector<cgalPoly_Point> nodes;
+    for ( unsigned int i=0; i<shape.ContourSize(0); i++ ) {
+        SGGeod node = shape.GetNode( 0, i );
+        nodes.push_back( cgalPoly_Point( node.getLongitudeDeg(), node.getLatitudeDeg() ) );
+    }
+
+    cgalPoly_Polygon poly( nodes.begin(), nodes.end() );
+    if ( !poly.is_simple() ) {
+        SG_LOG( SG_GENERAL, SG_INFO, "Decoder::addShape - skipping non simple shape" );
+        return;
+    }
+    if ( poly.orientation() == CGAL::CLOCKWISE ) {
+        poly.reverse_orientation();
+    }
+
+    tgPolygonSetMeta meta( tgPolygonSetMeta::META_TEXTURED, area_type );
+    meta.setTextureMethod( method );
+
+    chopper.Add( tgPolygonSet( poly, meta ) );
+}
+
 void Decoder::processPoint(OGRPoint* poGeometry, const string& area_type, int width )
 {
     SGGeod point = SGGeod::fromDeg( poGeometry->getX(),poGeometry->getY() );
@@ -121,11 +245,8 @@ void Decoder::processPoint(OGRPoint* poGeometry, const string& area_type, int wi
     if ( max_segment_length > 0  ) {
         shape = tgPolygon::SplitLongEdges( shape, max_segment_length );
     }
-    shape.SetMaterial( area_type );
-    shape.SetTexMethod( TG_TEX_BY_GEODE );
-    shape.SetPreserve3D( false );
 
-    chopper.Add( shape );
+    addShape( shape, area_type, tgPolygonSetMeta::TEX_BY_GEODE );
 }
 
 void Decoder::processLineString(OGRLineString* poGeometry, const string& area_type, int width, int with_texture )
@@ -186,173 +307,169 @@ void Decoder::processLineString(OGRLineString* poGeometry, const string& area_ty
     // make a plygons from the line segments
     segments = tgContour::ExpandToPolygons( line, width );
     for ( unsigned int i=0; i<segments.size(); i++ ) {
-        segments[i].SetMaterial( area_type );
-        segments[i].SetPreserve3D( false );
         if (with_texture) {
-            segments[i].SetTexMethod( TG_TEX_BY_TPS_CLIPU );
+            addShape( segments[i], area_type, tgPolygonSetMeta::TEX_BY_TPS_CLIPU );
         } else {
-            segments[i].SetTexMethod( TG_TEX_BY_GEODE );
+            addShape( segments[i], area_type, tgPolygonSetMeta::TEX_BY_GEODE );
         }
-
-        chopper.Add( segments[i] );
     }
 }
 
-void Decoder::processPolygon(OGRPolygon* poGeometry, const string& area_type )
+void Decoder::processPolygon(OGRFeature* poFeature, OGRPolygon* poGeometry, const string& area_type )
 {
-    // bool preserve3D = ((poGeometry->getGeometryType()&wkb25DBit)==wkb25DBit);
-
-    // first add the outer ring
-    tgPolygon shape = tgShapefile::ToPolygon( poGeometry );
-    //shape = tgPolygon::Simplify( shape );
+    // generate metadata info from GDAL feature info
+    tgPolygonSetMeta meta( tgPolygonSetMeta::META_TEXTURED, area_type );
+    meta.getFeatureFields( poFeature );
+    meta.setTextureMethod( tgPolygonSetMeta::TEX_BY_GEODE );
+
+    tgPolygonSet shapes( poGeometry, meta );
+    if ( shapes.isEmpty() ) {
+        SG_LOG( SG_GENERAL, SG_INFO, "Decoder::processPolygon shape empty " );
+        return;
+    }
 
     if ( max_segment_length > 0 ) {
-        shape = tgPolygon::SplitLongEdges( shape, max_segment_length );
+        shapes.splitLongEdges( max_segment_length );
     }
-    // shape.SetPreserve3D( preserve3D );
-    shape.SetMaterial( area_type );
-    shape.SetTexMethod( TG_TEX_BY_GEODE );
-    shape.SetPreserve3D( false );
 
-    chopper.Add( shape  );
+    chopper.Add( shapes );
 }
 
 void Decoder::run()
 {
-    // as long as we have geometry to parse, do so
-    while (!global_workQueue.empty()) {
-        OGRFeature *poFeature = global_workQueue.pop();
-        // SG_LOG( SG_GENERAL, SG_INFO, " remaining features is " << global_workQueue.size() );
-
-        if ( poFeature ) {
-            OGRGeometry *poGeometry = poFeature->GetGeometryRef();
-
-            if (poGeometry==NULL) {
-                SG_LOG( SG_GENERAL, SG_INFO, "Found feature without geometry!" );
-                if (!continue_on_errors) {
-                    SG_LOG( SG_GENERAL, SG_ALERT, "Aborting!" );
-                    exit( 1 );
-                } else {
-                    continue;
-                }
-            }
-
-            OGRwkbGeometryType geoType=wkbFlatten(poGeometry->getGeometryType());
-            if (geoType!=wkbPoint && geoType!=wkbMultiPoint &&
-                geoType!=wkbLineString && geoType!=wkbMultiLineString &&
-                geoType!=wkbPolygon && geoType!=wkbMultiPolygon) {
-                    SG_LOG( SG_GENERAL, SG_INFO, "Unknown feature" );
-                    continue;
-            }
+    // as long as the reader gives us geometry to parse, do so
+    OGRFeature *poFeature;
+    while ( (poFeature = queues.pop( id )) != NULL ) {
+        OGRGeometry *poGeometry = poFeature->GetGeometryRef();
 
-            string area_type_name=area_type;
-            if (area_type_field!=-1) {
-                area_type_name=poFeature->GetFieldAsString(area_type_field);
+        if (poGeometry==NULL) {
+            SG_LOG( SG_GENERAL, SG_INFO, "Found feature without geometry!" );
+            if (!continue_on_errors) {
+                SG_LOG( SG_GENERAL, SG_ALERT, "Aborting!" );
+                exit( 1 );
+            } else {
+                OGRFeature::DestroyFeature( poFeature );
+                continue;
             }
+        }
 
-            if ( is_ocean_area(area_type_name) ) {
-                // interior of polygon is ocean, holes are islands
+        OGRwkbGeometryType geoType=wkbFlatten(poGeometry->getGeometryType());
+        if (geoType!=wkbPoint && geoType!=wkbMultiPoint &&
+            geoType!=wkbLineString && geoType!=wkbMultiLineString &&
+            geoType!=wkbPolygon && geoType!=wkbMultiPolygon) {
+                SG_LOG( SG_GENERAL, SG_INFO, "Unknown feature" );
+                OGRFeature::DestroyFeature( poFeature );
+                continue;
+        }
 
-                SG_LOG(  SG_GENERAL, SG_ALERT, "Ocean area ... SKIPPING!" );
+        string area_type_name=area_type;
+        if (area_type_field!=-1) {
+            area_type_name=poFeature->GetFieldAsString(area_type_field);
+        }
 
-                // Ocean data now comes from GSHHS so we want to ignore
-                // all other ocean data
-                continue;
-            } else if ( is_void_area(area_type_name) ) {
-                // interior is ????
+        if ( is_ocean_area(area_type_name) ) {
+            // interior of polygon is ocean, holes are islands
 
-                // skip for now
-                SG_LOG(  SG_GENERAL, SG_ALERT, "Void area ... SKIPPING!" );
+            SG_LOG(  SG_GENERAL, SG_ALERT, "Ocean area ... SKIPPING!" );
 
-                continue;
-            } else if ( is_null_area(area_type_name) ) {
-                // interior is ????
+            // Ocean data now comes from GSHHS so we want to ignore
+            // all other ocean data
+            OGRFeature::DestroyFeature( poFeature );
+            continue;
+        } else if ( is_void_area(area_type_name) ) {
+            // interior is ????
 
-                // skip for now
-                SG_LOG(  SG_GENERAL, SG_ALERT, "Null area ... SKIPPING!" );
+            // skip for now
+            SG_LOG(  SG_GENERAL, SG_ALERT, "Void area ... SKIPPING!" );
+            OGRFeature::DestroyFeature( poFeature );
+            continue;
+        } else if ( is_null_area(area_type_name) ) {
+            // interior is ????
 
-                continue;
-            }
+            // skip for now
+            SG_LOG(  SG_GENERAL, SG_ALERT, "Null area ... SKIPPING!" );
+            OGRFeature::DestroyFeature( poFeature );
+            continue;
+        }
 
-            poGeometry->transform( poCT );
+        poGeometry->transform( poCT );
 
-            switch (geoType) {
-            case wkbPoint: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "Point feature" );
-                int width=point_width;
-                if (point_width_field!=-1) {
-                    width=poFeature->GetFieldAsInteger(point_width_field);
-                    if (width == 0) {
-                        width=point_width;
-                    }
+        switch (geoType) {
+        case wkbPoint: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "Point feature" );
+            int width=point_width;
+            if (point_width_field!=-1) {
+                width=poFeature->GetFieldAsInteger(point_width_field);
+                if (width == 0) {
+                    width=point_width;
                 }
-                processPoint((OGRPoint*)poGeometry, area_type_name, width);
-                break;
             }
-            case wkbMultiPoint: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "MultiPoint feature" );
-                int width=point_width;
-                if (point_width_field!=-1) {
-                    width=poFeature->GetFieldAsInteger(point_width_field);
-                    if (width == 0) {
-                        width=point_width;
-                    }
-                }
-                OGRMultiPoint* multipt=(OGRMultiPoint*)poGeometry;
-                for (int i=0;i<multipt->getNumGeometries();i++) {
-                    processPoint((OGRPoint*)(multipt->getGeometryRef(i)), area_type_name, width);
+            processPoint((OGRPoint*)poGeometry, area_type_name, width);
+            break;
+        }
+        case wkbMultiPoint: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "MultiPoint feature" );
+            int width=point_width;
+            if (point_width_field!=-1) {
+                width=poFeature->GetFieldAsInteger(point_width_field);
+                if (width == 0) {
+                    width=point_width;
                 }
-                break;
             }
-            case wkbLineString: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "LineString feature" );
-                int width=line_width;
-                if (line_width_field!=-1) {
-                    width=poFeature->GetFieldAsInteger(line_width_field);
-                    if (width == 0) {
-                        width=line_width;
-                    }
-                }
-
-                processLineString((OGRLineString*)poGeometry, area_type_name, width, texture_lines);
-                break;
+            OGRMultiPoint* multipt=(OGRMultiPoint*)poGeometry;
+            for (int i=0;i<multipt->getNumGeometries();i++) {
+                processPoint((OGRPoint*)(multipt->getGeometryRef(i)), area_type_name, width);
             }
-            case wkbMultiLineString: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "MultiLineString feature" );
-                int width=line_width;
-                if (line_width_field!=-1) {
-                    width=poFeature->GetFieldAsInteger(line_width_field);
-                    if (width == 0) {
-                        width=line_width;
-                    }
+            break;
+        }
+        case wkbLineString: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "LineString feature" );
+            int width=line_width;
+            if (line_width_field!=-1) {
+                width=poFeature->GetFieldAsInteger(line_width_field);
+                if (width == 0) {
+                    width=line_width;
                 }
+            }
 
-                OGRMultiLineString* multilines=(OGRMultiLineString*)poGeometry;
-                for (int i=0;i<multilines->getNumGeometries();i++) {
-                    processLineString((OGRLineString*)(multilines->getGeometryRef(i)), area_type_name, width, texture_lines);
+            processLineString((OGRLineString*)poGeometry, area_type_name, width, texture_lines);
+            break;
+        }
+        case wkbMultiLineString: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "MultiLineString feature" );
+            int width=line_width;
+            if (line_width_field!=-1) {
+                width=poFeature->GetFieldAsInteger(line_width_field);
+                if (width == 0) {
+                    width=line_width;
                 }
-                break;
-            }
-            case wkbPolygon: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "Polygon feature" );
-                processPolygon((OGRPolygon*)poGeometry, area_type_name);
-                break;
             }
-            case wkbMultiPolygon: {
-                SG_LOG( SG_GENERAL, SG_DEBUG, "MultiPolygon feature" );
-                OGRMultiPolygon* multipoly=(OGRMultiPolygon*)poGeometry;
-                for (int i=0;i<multipoly->getNumGeometries();i++) {
-                    processPolygon((OGRPolygon*)(multipoly->getGeometryRef(i)), area_type_name);
-                }
-                break;
+
+            OGRMultiLineString* multilines=(OGRMultiLineString*)poGeometry;
+            for (int i=0;i<multilines->getNumGeometries();i++) {
+                processLineString((OGRLineString*)(multilines->getGeometryRef(i)), area_type_name, width, texture_lines);
             }
-            default:
-                /* Ignore unhandled objects */
-                break;
+            break;
+        }
+        case wkbPolygon: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "Polygon feature" );
+            processPolygon(poFeature, (OGRPolygon*)poGeometry, area_type_name);
+            break;
+        }
+        case wkbMultiPolygon: {
+            SG_LOG( SG_GENERAL, SG_DEBUG, "MultiPolygon feature" );
+            OGRMultiPolygon* multipoly=(OGRMultiPolygon*)poGeometry;
+            for (int i=0;i<multipoly->getNumGeometries();i++) {
+                processPolygon(poFeature, (OGRPolygon*)(multipoly->getGeometryRef(i)), area_type_name);
             }
-
-            OGRFeature::DestroyFeature( poFeature );
+            break;
         }
+        default:
+            /* Ignore unhandled objects */
+            break;
+        }
+
+        OGRFeature::DestroyFeature( poFeature );
     }
 }
 
@@ -413,6 +530,7 @@ void processLayer(OGRLayer* poLayer, tgChopper& results )
 
     oTargetSRS.SetWellKnownGeogCS( "WGS84" );
 
+    // the reader's own transformation - to find where features are
     OGRCoordinateTransformation *poCT = OGRCreateCoordinateTransformation(oSourceSRS, &oTargetSRS);
 
     /* setup attribute and spatial queries */
@@ -433,6 +551,8 @@ void processLayer(OGRLayer* poLayer, tgChopper& results )
 
         poLayer->SetSpatialFilterRect(trans_min_x, trans_min_y,
                                       trans_max_x, trans_max_y);
+
+        OCTDestroyCoordinateTransformation ( poCTinverse );
     }
 
     if (use_attribute_query) {
@@ -442,26 +562,51 @@ void processLayer(OGRLayer* poLayer, tgChopper& results )
         }
     }
 
-    // Generate the work queue for this layer
+    // start the decoders first, so they chop while we read
+    FeatureQueues queues( num_threads );
+    std::vector<Decoder *> decoders;
+    for (int i=0; i<num_threads; i++) {
+        Decoder* decoder = new Decoder( oSourceSRS, area_type_field, point_width_field, line_width_field, results, queues, i );
+        decoder->start();
+        decoders.push_back( decoder );
+    }
+
+    // hand each feature to the decoder owning the block of buckets at its
+    // center.  Neighbouring features mostly land in the same buckets -
+    // keeping them on one thread keeps the threads out of each other's
+    // tiles.  Idle decoders still take work from busy ones.
     OGRFeature *poFeature;
     poLayer->SetNextByIndex(start_record);
     while ( ( poFeature = poLayer->GetNextFeature()) != NULL )
     {
-        global_workQueue.push( poFeature );
-    }
+        unsigned int target = 0;
+        OGRGeometry* poGeometry = poFeature->GetGeometryRef();
 
-    // Now process the workqueue with threads
-    // this just generates all the tgPolygons
-    std::vector<Decoder *> decoders;
-    for (int i=0; i<num_threads; i++) {
-        Decoder* decoder = new Decoder( poCT, area_type_field, point_width_field, line_width_field, results );
-        decoder->start();
-        decoders.push_back( decoder );
+        if ( poGeometry && decoders.size() > 1 ) {
+            OGREnvelope env;
+            poGeometry->getEnvelope( &env );
+
+            double x = ( env.MinX + env.MaxX ) / 2.0;
+            double y = ( env.MinY + env.MaxY ) / 2.0;
+
+            if ( poCT->Transform( 1, &x, &y ) && std::fabs(y) <= 90.0 && std::fabs(x) <= 180.0 ) {
+                SGBucket b( SGGeod::fromDeg( x, y ) );
+                unsigned long bx = (unsigned long)std::floor( ( b.get_center_lon() + 180.0 ) / ( b.get_width()  * DECODER_BLOCK_BUCKETS ) );
+                unsigned long by = (unsigned long)std::floor( ( b.get_center_lat() +  90.0 ) / ( b.get_height() * DECODER_BLOCK_BUCKETS ) );
+
+                // spread neighbouring blocks over different decoders
+                target = ( bx * 7919 + by ) % decoders.size();
+            }
+        }
+
+        queues.push( target, poFeature );
     }
 
     // Then wait until they are finished
+    queues.close();
     for (unsigned int i=0; i<decoders.size(); i++) {
         decoders[i]->join();
+        delete decoders[i];
     }
 
     OCTDestroyCoordinateTransformation ( poCT );
@@ -502,6 +647,9 @@ void usage(char* progname) {
     SG_LOG( SG_GENERAL, SG_ALERT, "        Enable multithreading with user specified number of threads" );
     SG_LOG( SG_GENERAL, SG_ALERT, "--all-threads" );
     SG_LOG( SG_GENERAL, SG_ALERT, "        Enable multithreading with all available cpu cores" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "        Features are read while the threads chop.  Each thread" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "        takes the features of its own blocks of " << DECODER_BLOCK_BUCKETS << "x" << DECODER_BLOCK_BUCKETS << " tiles," );
+    SG_LOG( SG_GENERAL, SG_ALERT, "        and helps the others once its own are done" );
     SG_LOG( SG_GENERAL, SG_ALERT, "" );
     SG_LOG( SG_GENERAL, SG_ALERT, "<work_dir>" );
     SG_LOG( SG_GENERAL, SG_ALERT, "        Directory to put the polygon files in" );
@@ -618,10 +766,6 @@ int main( int argc, char **argv ) {
             num_threads=boost::thread::hardware_concurrency(); 
             argv+=1;
             argc-=1;
-        } else if (!strcmp(argv[1],"--debug")) {
-            argv++;
-            argc--;
-            save_shapefiles=true;
         } else if (!strcmp(argv[1],"--help")) {
             usage(progname);
         } else {
@@ -631,6 +775,10 @@ int main( int argc, char **argv ) {
 
     SG_LOG( SG_GENERAL, SG_ALERT, "\nogr-decode version " << getTGVersion() );
 
+    if ( num_threads < 1 ) {
+        num_threads = 1;
+    }
+
     if (argc<3) {
         usage(progname);
     }
@@ -689,8 +837,9 @@ int main( int argc, char **argv ) {
 
     GDALClose(poDS);
 
-    SG_LOG(SG_GENERAL, SG_ALERT, "Saving to buckets");
-    results.Save( save_shapefiles );
+    // the tiles are only complete on disk once closed
+    results.Flush();
+    tgShapefileCache::instance().closeAll();
 
     return 0;
 }
@@ -41,6 +41,7 @@
 
 #include <terragear/polygon_set/tg_polygon_set.hxx>
 #include <terragear/polygon_set/tg_polygon_chop.hxx>
+#include <terragear/tg_shapefile_cache.hxx>
 
 #define SUPPORT_MULTITHREADING 1
 
@@ -566,5 +567,9 @@ int main( int argc, char **argv ) {
 
     GDALClose(poDS);
 
+    // the tiles are only complete on disk once closed
+    results.Flush();
+    tgShapefileCache::instance().closeAll();
+
     return 0;
 }
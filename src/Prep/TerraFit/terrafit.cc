@@ -119,6 +119,8 @@ Terra::real error_threshold=40.0;
 unsigned int min_points=50;
 unsigned int point_limit=1000;
 bool force=false;
+bool text_output=false;
+int compression=9;
 unsigned int num_threads = 1;
 
 inline int goal_not_met(Terra::GreedySubdivision* mesh)
@@ -182,30 +184,53 @@ void fit_file(const SGPath& path) {
 
     greedy_insertion(mesh);
 
-    gzFile fp;
-    if ( (fp = gzopen( outPath.c_str(), "wb9" )) == NULL ) {
-        SG_LOG(SG_GENERAL, SG_ALERT, "ERROR: opening " << outPath << " for writing!");
-        return;
-    }
+    if (text_output) {
+        gzFile fp;
+        char mode[4];
+        sprintf(mode, "wb%d", compression);
+        if ( (fp = gzopen( outPath.c_str(), mode )) == NULL ) {
+            SG_LOG(SG_GENERAL, SG_ALERT, "ERROR: opening " << outPath << " for writing!");
+            delete mesh;
+            delete DEM;
+            return;
+        }
+
+        gzprintf(fp,"%d\n",mesh->pointCount());
+
+        for (int x=0;x<DEM->width;x++) {
+            for (int y=0;y<DEM->height;y++) {
+                if (mesh->is_used(x,y) != DATA_POINT_USED)
+                    continue;
+                double vx,vy,vz;
+                vx=(inarray.get_originx()+x*inarray.get_col_step())/3600.0;
+                vy=(inarray.get_originy()+y*inarray.get_row_step())/3600.0;
+                vz=DEM->eval(x,y);
+                gzprintf(fp,"%+03.8f %+02.8f %0.2f\n",vx,vy,vz);
+            }
+        }
+
+        gzclose(fp);
+    } else {
+        std::vector<SGGeod> points;
+        points.reserve(mesh->pointCount());
+
+        for (int x=0;x<DEM->width;x++) {
+            for (int y=0;y<DEM->height;y++) {
+                if (mesh->is_used(x,y) != DATA_POINT_USED)
+                    continue;
+                points.push_back( SGGeod::fromDegM( (inarray.get_originx()+x*inarray.get_col_step())/3600.0,
+                                                    (inarray.get_originy()+y*inarray.get_row_step())/3600.0,
+                                                    DEM->eval(x,y) ) );
+            }
+        }
 
-    gzprintf(fp,"%d\n",mesh->pointCount());
-
-    for (int x=0;x<DEM->width;x++) {
-        for (int y=0;y<DEM->height;y++) {
-            if (mesh->is_used(x,y) != DATA_POINT_USED)
-                continue;
-            double vx,vy,vz;
-            vx=(inarray.get_originx()+x*inarray.get_col_step())/3600.0;
-            vy=(inarray.get_originy()+y*inarray.get_row_step())/3600.0;
-            vz=DEM->eval(x,y);
-            gzprintf(fp,"%+03.8f %+02.8f %0.2f\n",vx,vy,vz);
+        if ( !tgArray::write_fitted( outPath.str(), points, compression ) ) {
+            SG_LOG(SG_GENERAL, SG_ALERT, "ERROR: writing " << outPath);
         }
     }
 
     delete mesh;
     delete DEM;
-
-    gzclose(fp);
 }
 
 void queue_fit_file(const SGPath& path)
@@ -268,6 +293,8 @@ void usage(char* progname, const std::string& msg) {
     SG_LOG(SG_GENERAL,SG_INFO, "\t -e | --maxerror 40");
     SG_LOG(SG_GENERAL,SG_INFO, "\t -f | --force");
     SG_LOG(SG_GENERAL,SG_INFO, "\t -j | --threads <number>");
+    SG_LOG(SG_GENERAL,SG_INFO, "\t -z | --compression 9");
+    SG_LOG(SG_GENERAL,SG_INFO, "\t -t | --text");
     SG_LOG(SG_GENERAL,SG_INFO, "\t -v | --version");
     SG_LOG(SG_GENERAL,SG_INFO, "");
     SG_LOG(SG_GENERAL,SG_INFO, "Algorithm will produce at least <minnodes> fitted nodes, but no");
@@ -290,6 +317,9 @@ void usage(char* progname, const std::string& msg) {
     SG_LOG(SG_GENERAL,SG_INFO, "The output file(s) is/are called .fit.gz and is simply a list of");
     SG_LOG(SG_GENERAL,SG_INFO, "from the resulting fitted surface nodes.  The user of the");
     SG_LOG(SG_GENERAL,SG_INFO, ".fit.gz file will need to retriangulate the surface.");
+    SG_LOG(SG_GENERAL,SG_INFO, "");
+    SG_LOG(SG_GENERAL,SG_INFO, "The list is binary, gzipped at <compression> level ( 0 - 9 ).");
+    SG_LOG(SG_GENERAL,SG_INFO, "Text writes the old text format instead.");
 }
 
 struct option options[]={
@@ -300,6 +330,8 @@ struct option options[]={
     {"force",no_argument,NULL,'f'},
     {"version",no_argument,NULL,'v'},
     {"threads",required_argument,NULL,'j'},
+    {"compression",required_argument,NULL,'z'},
+    {"text",no_argument,NULL,'t'},
     {NULL,0,NULL,0}
 };
 
@@ -307,7 +339,7 @@ int main(int argc, char** argv) {
     sglog().setLogLevels( SG_ALL, SG_INFO );
     int option;
 
-    while ((option=getopt_long(argc,argv,"hm:x:e:fvj:",options,NULL))!=-1) {
+    while ((option=getopt_long(argc,argv,"hm:x:e:fvj:z:t",options,NULL))!=-1) {
         switch (option) {
             case 'h':
                 usage(argv[0],"");
@@ -331,6 +363,16 @@ int main(int argc, char** argv) {
             case 'j':
                 num_threads = atoi(optarg);
                 break;
+            case 'z':
+                compression = atoi(optarg);
+                if (compression < 0 || compression > 9) {
+                    usage(argv[0],"Compression level must be 0 - 9");
+                    exit(1);
+                }
+                break;
+            case 't':
+                text_output = true;
+                break;
             case '?':
                 usage(argv[0],std::string("Unknown option:")+(char)optopt);
                 exit(1);
@@ -341,6 +383,7 @@ int main(int argc, char** argv) {
     SG_LOG(SG_GENERAL, SG_INFO, "Min points = " << min_points);
     SG_LOG(SG_GENERAL, SG_INFO, "Max points = " << point_limit);
     SG_LOG(SG_GENERAL, SG_INFO, "Max error  = " << error_threshold);
+    SG_LOG(SG_GENERAL, SG_INFO, "Output     = " << (text_output ? "text" : "binary") << ", compression " << compression);
 
     if (optind<argc) {
         while (optind<argc) {
@@ -20,9 +20,14 @@
 // Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
 //
 
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
 #include <string>
 #include <map>
 #include <limits>
+#include <vector>
 
 #include <boost/thread.hpp>
 
@@ -30,6 +35,7 @@
 
 #include <simgear/compiler.h>
 #include <simgear/threads/SGThread.hxx>
+#include <simgear/threads/SGGuard.hxx>
 #include <simgear/threads/SGQueue.hxx>
 #include <simgear/debug/logstream.hxx>
 #include <simgear/math/sg_geodesy.hxx>
@@ -42,15 +48,9 @@
 #include <terragear/polygon_set/tg_polygon_set.hxx>
 #include <terragear/polygon_set/tg_polygon_accumulator.hxx>
 #include <terragear/polygon_set/tg_polygon_chop.hxx>
+#include <terragear/tg_shapefile_cache.hxx>
 //#include <terragear/tg_shapefile.hxx>
 
-#ifdef _MSC_VER
-#  include <windows.h>
-#  define tgSleep(x) Sleep(x*1000)
-#else
-#  define tgSleep(x) sleep(x)
-#endif
-
 using std::string;
 
 int line_width=50;
@@ -80,7 +80,7 @@ std::vector<areaDef>    areaDefs;
 
 int GetTextureInfo( unsigned int type, bool cap, std::string& material, double& atlas_startu, double& atlas_endu, double& atlas_startv, double& atlas_endv, double& v_dist )
 {
-    SG_LOG( SG_GENERAL, SG_WARN, "setting material to  idx " << type << " name " << areaDefs[type].material );
+    SG_LOG( SG_GENERAL, SG_DEBUG, "setting material to  idx " << type << " name " << areaDefs[type].material );
     
     material = areaDefs[type].material;
     atlas_startu = 0;
@@ -91,28 +91,46 @@ int GetTextureInfo( unsigned int type, bool cap, std::string& material, double&
     return 0;
 }
 
-void processLineString(OGRLineString* poGeometry, unsigned int idx, int width, int zorder, tgIntersectionGenerator* pig )
+// a line feature, read once and kept in WGS84 for every bucket it touches
+struct vectorLine
 {
-    SGGeod p0, p1;
-    int i, numPoints;
-    double dbl_w = width;
+    std::vector<SGGeod> points;
+    double              width;
+    int                 zorder;
+    unsigned int        idx;
+};
 
-    numPoints = poGeometry->getNumPoints();
+// all line features of all datasources, and the lines each bucket needs
+std::vector<vectorLine>                 lines;
+std::vector<SGBucket>                   bucketList;
+std::vector< std::vector<unsigned int> > bucketLines;
+std::map<long, unsigned int>            bucketSlot;
+
+void readLineString(OGRLineString* poGeometry, unsigned int idx, int width, int zorder )
+{
+    int numPoints = poGeometry->getNumPoints();
     if (numPoints < 2) {
         SG_LOG( SG_GENERAL, SG_WARN, "Skipping line with less than two points" );
         return;
     }
 
-    // add the points
-    for ( i=1;i<numPoints;i++) {
-        p0 = SGGeod::fromDeg( poGeometry->getX(i-1), poGeometry->getY(i-1) );
-        p1 = SGGeod::fromDeg( poGeometry->getX(i),   poGeometry->getY(i) );
+    vectorLine line;
+    line.width  = width;
+    line.zorder = zorder;
+    line.idx    = idx;
 
-        pig->Insert( p0, p1, dbl_w, zorder, idx );
+    for ( int i=0; i<numPoints; i++ ) {
+        line.points.push_back( SGGeod::fromDeg( poGeometry->getX(i), poGeometry->getY(i) ) );
     }
+
+    lines.push_back( line );
 }
 
-void processLayer(OGRLayer* poLayer, const SGBucket& bucket, tgChopper& results, unsigned int idx, tgIntersectionGenerator* pig )
+// read every feature of the layer once - no per bucket spatial filter.
+// Features are binned into buckets afterwards, rather than reading the
+// layer again for each bucket.
+// The lines of all layers stay in memory until every bucket is decoded.
+void readLayer(OGRLayer* poLayer, unsigned int idx )
 {
     int feature_count=poLayer->GetFeatureCount();
     int zorder;
@@ -134,8 +152,8 @@ void processLayer(OGRLayer* poLayer, const SGBucket& bucket, tgChopper& results,
         line_width_field=poFDefn->GetFieldIndex(line_width_col.c_str());
         if (line_width_field==-1) {
             SG_LOG( SG_GENERAL, SG_ALERT, "Field " << line_width_col << " for line-width not found in layer" );
-        if (!continue_on_errors)
-            exit( 1 );
+            if (!continue_on_errors)
+                exit( 1 );
         }
     }
 
@@ -158,28 +176,45 @@ void processLayer(OGRLayer* poLayer, const SGBucket& bucket, tgChopper& results,
     OGRCoordinateTransformation *poCT;
 
     poCT = OGRCreateCoordinateTransformation(oSourceSRS, &oTargetSRS);
+    if (poCT == NULL) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "Layer " << layername << " can't be transformed to WGS84 : " << CPLGetLastErrorMsg() );
+        exit( 1 );
+    }
 
     /* setup attribute and spatial queries */
-    double trans_min_x,trans_min_y,trans_max_x,trans_max_y;
-    /* do a simple reprojection of the source SRS */
-    OGRCoordinateTransformation *poCTinverse;
+    if (use_spatial_query) {
+        double trans_min_x,trans_min_y,trans_max_x,trans_max_y;
+        /* do a simple reprojection of the source SRS */
+        OGRCoordinateTransformation *poCTinverse;
+
+        poCTinverse = OGRCreateCoordinateTransformation(&oTargetSRS, oSourceSRS);
+        if (poCTinverse == NULL) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "Spatial query can't be transformed to the srs of layer " << layername << " : " << CPLGetLastErrorMsg() );
+            exit( 1 );
+        }
 
-    poCTinverse = OGRCreateCoordinateTransformation(&oTargetSRS, oSourceSRS);
+        trans_min_x=spat_min_x;
+        trans_min_y=spat_min_y;
+        trans_max_x=spat_max_x;
+        trans_max_y=spat_max_y;
 
-    SGGeod min, max;
-    min = bucket.get_corner( SG_BUCKET_SW );
-    max = bucket.get_corner( SG_BUCKET_NE );
-    
-    trans_min_x=min.getLongitudeDeg();
-    trans_min_y=min.getLatitudeDeg();
-    trans_max_x=max.getLongitudeDeg();
-    trans_max_y=max.getLatitudeDeg();
+        poCTinverse->Transform(1,&trans_min_x,&trans_min_y);
+        poCTinverse->Transform(1,&trans_max_x,&trans_max_y);
 
-    poCTinverse->Transform(1,&trans_min_x,&trans_min_y);
-    poCTinverse->Transform(1,&trans_max_x,&trans_max_y);
+        poLayer->SetSpatialFilterRect(trans_min_x, trans_min_y,
+                                      trans_max_x, trans_max_y);
 
-    poLayer->SetSpatialFilterRect(trans_min_x, trans_min_y,
-                                  trans_max_x, trans_max_y);
+        OCTDestroyCoordinateTransformation ( poCTinverse );
+    } else {
+        poLayer->SetSpatialFilter(NULL);
+    }
+
+    if (use_attribute_query) {
+        if (poLayer->SetAttributeFilter(attribute_query.c_str()) != OGRERR_NONE) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "Error in query expression '" << attribute_query << "'" );
+            exit( 1 );
+        }
+    }
 
     OGRFeature *poFeature;
     poLayer->SetNextByIndex(start_record);
@@ -226,7 +261,7 @@ void processLayer(OGRLayer* poLayer, const SGBucket& bucket, tgChopper& results,
                 }
             }
 
-            processLineString((OGRLineString*)poGeometry, idx, width, zorder, pig);
+            readLineString((OGRLineString*)poGeometry, idx, width, zorder);
             break;
         }
         case wkbMultiLineString: {
@@ -241,7 +276,7 @@ void processLayer(OGRLayer* poLayer, const SGBucket& bucket, tgChopper& results,
 
             OGRMultiLineString* multils=(OGRMultiLineString*)poGeometry;
             for (int i=0;i<multils->getNumGeometries();i++) {
-                processLineString((OGRLineString*)poGeometry, idx, width, zorder, pig);
+                readLineString((OGRLineString*)multils->getGeometryRef(i), idx, width, zorder);
             }
             break;
         }
@@ -254,45 +289,167 @@ void processLayer(OGRLayer* poLayer, const SGBucket& bucket, tgChopper& results,
     OCTDestroyCoordinateTransformation ( poCT );
 }
 
+// add each line to the buckets its bounding box touches.  The buckets
+// form a regular grid, so the lookup is just sgGetBuckets on the box.
+// Lines are added in read order, so each bucket sees its lines in the
+// same order a per bucket spatial filter would have returned them.
+void binLines( void )
+{
+    for ( unsigned int i=0; i<bucketList.size(); i++ ) {
+        bucketSlot[bucketList[i].gen_index()] = i;
+    }
+    bucketLines.resize( bucketList.size() );
+
+    for ( unsigned int l=0; l<lines.size(); l++ ) {
+        const std::vector<SGGeod>& points = lines[l].points;
+        double minx = points[0].getLongitudeDeg(), maxx = minx;
+        double miny = points[0].getLatitudeDeg(),  maxy = miny;
+
+        for ( unsigned int p=1; p<points.size(); p++ ) {
+            minx = std::min( minx, points[p].getLongitudeDeg() );
+            maxx = std::max( maxx, points[p].getLongitudeDeg() );
+            miny = std::min( miny, points[p].getLatitudeDeg() );
+            maxy = std::max( maxy, points[p].getLatitudeDeg() );
+        }
+
+        std::vector<SGBucket> touched;
+        sgGetBuckets( SGGeod::fromDeg( minx, miny ), SGGeod::fromDeg( maxx, maxy ), touched );
+
+        for ( unsigned int t=0; t<touched.size(); t++ ) {
+            std::map<long, unsigned int>::iterator it = bucketSlot.find( touched[t].gen_index() );
+            if ( it != bucketSlot.end() ) {
+                bucketLines[it->second].push_back( l );
+            }
+        }
+    }
+}
+
+// run the intersection generator on one bucket's lines, and chop the result
+void decodeBucket( const string& work_dir, unsigned int slot )
+{
+    SGBucket bucket = bucketList[slot];
+    const std::vector<unsigned int>& bucketLineIdx = bucketLines[slot];
+
+    if ( bucketLineIdx.empty() ) {
+        return;
+    }
+
+    SG_LOG( SG_GENERAL, SG_ALERT, "Decode bucket " << bucket.gen_index_str() << " : " << bucketLineIdx.size() << " lines" );
+    std::string debugdir = "./vectordecode/" + bucket.gen_index_str();
+
+    tgIntersectionGenerator* pig = new tgIntersectionGenerator( debugdir.c_str(), 0, 1, GetTextureInfo );
+    tgChopper results( work_dir, bucket.gen_index() );
+
+    for ( unsigned int i=0; i<bucketLineIdx.size(); i++ ) {
+        const vectorLine& line = lines[bucketLineIdx[i]];
+
+        for ( unsigned int p=1; p<line.points.size(); p++ ) {
+            pig->Insert( line.points[p-1], line.points[p], line.width, line.zorder, line.idx );
+        }
+    }
+
+    // add some additional Variables to the intersection generator
+    // cleaning parameters
+    // texture mode
+    // simplify parameters
+    // and add some data access
+    // get skeleton segments
+    // get skin segments
+    // delta height info may be needed....
+    // maybe needs a new class entirely based on intersectiongenerator.
+    
+    // we have all of the data - execute the intersection generator
+    // don't clean the OSM map data - as we don't want to generate intersections
+    // that don't really exist ( bridges and tunnels )
+    // OSM data should have correct intersection nodes already.
+    // - they need them to do routing.        
+    pig->Execute();
+    
+    // now retreive the polygons in reverse z-order.  store them in lists
+    std::map<int, tgPolygonSetList> polygons;
+    
+    for ( tgintersectionedge_it it = pig->edges_begin(); it != pig->edges_end(); it++ ) {
+        tgPolygonSet poly = (*it)->GetPoly("complete");
+        int          zo   = (*it)->GetZorder();
+        
+        polygons[zo].push_back( poly );
+    }
+    
+    // clip them in z order
+    tgAccumulator accum;    
+    std::map<int, tgPolygonSetList>::reverse_iterator pmap_it;
+    
+    for ( pmap_it = polygons.rbegin(); pmap_it != polygons.rend(); pmap_it++ ) {
+        std::vector<tgPolygonSet>::iterator poly_it;            
+        for ( poly_it = (*pmap_it).second.begin(); poly_it != (*pmap_it).second.end(); poly_it++ ) {
+            tgPolygonSet current = (*poly_it);
+
+            accum.Diff_and_Add_cgal( current );
+            
+            // only add to output list if the clip left us with a polygon
+            if ( !current.isEmpty() ) {
+                results.Add( current );
+            }
+        }
+    }
+    
+    delete pig;
+}
+
+// buckets are handed out one at a time - neighbouring buckets can
+// have very different amounts of data
+SGMutex      bucketLock;
+unsigned int nextBucket = 0;
+
+bool getNextBucket( unsigned int& slot )
+{
+    SGGuard<SGMutex> g(bucketLock);
+
+    if ( nextBucket >= bucketList.size() ) {
+        return false;
+    }
+
+    slot = nextBucket++;
+    return true;
+}
+
+class DecodeWorker : public SGThread
+{
+public:
+    DecodeWorker( const string& work ) : work_dir(work) {}
+
+private:
+    virtual void run() {
+        unsigned int slot;
+
+        while ( getNextBucket( slot ) ) {
+            decodeBucket( work_dir, slot );
+        }
+    }
+
+    string work_dir;
+};
+
 void usage(char* progname) {
     SG_LOG( SG_GENERAL, SG_ALERT, "Usage: " <<
-              progname << " [options...] <work_dir> <datasource> [<layername>...]" );
+              progname << " [options...] --config=<file> --work-dir=<dir>" );
     SG_LOG( SG_GENERAL, SG_ALERT, "Options:" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "--line-width width" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Width in meters for the lines" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "--line-width-column colname" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Use value from colname as width for lines" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Overrides --line-width if present" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "--point-width width" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Size in meters of the squares generated from points" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "--point-width-column colname" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Use value from colname as width for points" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Overrides --point-width if present" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "--area-type type" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Area type for all objects from file" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "--area-type-column colname" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Use string from colname as area type" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Overrides --area-type if present" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "--continue-on-errors" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Continue even if the file seems fishy" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "--max-segment max_segment_length" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Maximum segment length in meters" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "--start-record record_no" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Start processing at the specified record number (first record num=0)" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "--config=file" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "        One line per datasource : material width datasource" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "--data-dir=dir" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "        Directory the datasources are in" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "--work-dir=dir" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "        Directory to put the polygon files in" );
     SG_LOG( SG_GENERAL, SG_ALERT, "--where attrib_query" );
     SG_LOG( SG_GENERAL, SG_ALERT, "        Use an attribute query (like SQL WHERE)" );
     SG_LOG( SG_GENERAL, SG_ALERT, "--spat xmin ymin xmax ymax" );
     SG_LOG( SG_GENERAL, SG_ALERT, "        spatial query extents" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "--texture-lines" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Enable textured lines" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "--threads[=n]" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "        Decode n buckets at a time ( default all cores )" );
     SG_LOG( SG_GENERAL, SG_ALERT, "" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "<work_dir>" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        Directory to put the polygon files in" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "<datasource>" );
-    SG_LOG( SG_GENERAL, SG_ALERT, "        The datasource from which to fetch the data" );
-//    SG_LOG( SG_GENERAL, SG_ALERT, "<layername>..." );
-//    SG_LOG( SG_GENERAL, SG_ALERT, "        The layers to process." );
-//    SG_LOG( SG_GENERAL, SG_ALERT, "        If no layer is given, all layers in the datasource are used" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "The lines of every layer of every datasource are read into memory" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "before any bucket is decoded.  Use --spat to decode a large" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "dataset an area at a time." );
     exit(-1);
 }
     
@@ -331,10 +488,7 @@ void CreateWorkDirs( const std::string work_dir, const std::vector<SGBucket>& bu
     for ( unsigned int i=0; i<bucketList.size(); i++ ) {
         SGBucket b = bucketList[i];
         std::string path = work_dir + "/" + b.gen_base_path();
-        char tile_name[16];
-        
-        sprintf( tile_name, "%ld", b.gen_index() );
-        std::string polyfile = path + "/" + tile_name;
+        std::string polyfile = path + "/" + b.gen_index_str();
     
         SGPath sgp( polyfile );
         sgp.create_dir( 0755 );
@@ -371,12 +525,27 @@ int main( int argc, char **argv ) {
             num_threads = atoi( arg.substr(10).c_str() );
         } else if (arg.find("--threads") == 0) {
             num_threads = boost::thread::hardware_concurrency();
+        } else if (arg == "--where") {
+            if (arg_pos + 1 >= argc) {
+                usage(progname);
+            }
+            use_attribute_query = true;
+            attribute_query = argv[++arg_pos];
+        } else if (arg == "--spat") {
+            if (arg_pos + 4 >= argc) {
+                usage(progname);
+            }
+            use_spatial_query = true;
+            spat_min_x = atof(argv[++arg_pos]);
+            spat_min_y = atof(argv[++arg_pos]);
+            spat_max_x = atof(argv[++arg_pos]);
+            spat_max_y = atof(argv[++arg_pos]);
         }
     }
 
     SG_LOG( SG_GENERAL, SG_ALERT, "vector-decode version " << getTGVersion() << "\n" );
     
-    if (argc<4) {
+    if (argc<3) {
         usage(progname);
     }
 
@@ -386,45 +555,41 @@ int main( int argc, char **argv ) {
     GDALAllRegister();
     GDALDataset       *poDS;
 
-    // if we haven't specified an spacial query - get the extents from the area defs.
+    // read each layer once - the extents come from the lines themselves
     for ( unsigned int i=0; i<areaDefs.size(); i++ ) {
-        char pathname[256];
-        
-        sprintf( pathname, "%s/%s", data_dir.c_str(), areaDefs[i].datasource.c_str() );
+        std::string pathname = data_dir + "/" + areaDefs[i].datasource;
+
         SG_LOG( SG_GENERAL, SG_ALERT, "Opening datasource " << pathname << " for reading." );
-        poDS = (GDALDataset*) GDALOpenEx( pathname, GDAL_OF_VECTOR, NULL, NULL, NULL );
-        
+        poDS = (GDALDataset*)GDALOpenEx( pathname.c_str(), GDAL_OF_VECTOR, NULL, NULL, NULL );
+
         if( poDS != NULL ) {
-            OGRLayer  *poLayer;
             for (int j=0;j<poDS->GetLayerCount();j++) {
-                OGREnvelope oEnvelope;
-                poLayer = poDS->GetLayer(j);
-                poLayer->GetExtent( &oEnvelope );
-                
-                if ( oEnvelope.MinX < minx ) { 
-                    minx = oEnvelope.MinX;
-                }
-                if ( oEnvelope.MinY < miny ) { 
-                    miny = oEnvelope.MinY;
-                }
-                if ( oEnvelope.MaxX > maxx ) { 
-                    maxx = oEnvelope.MaxX;
-                }
-                if ( oEnvelope.MaxY > maxy ) { 
-                    maxy = oEnvelope.MaxY;
-                }
+                readLayer( poDS->GetLayer(j), i );
             }
             
-            GDALClose( poDS );         
+            GDALClose( poDS );
         } else {
             SG_LOG( SG_GENERAL, SG_ALERT, "Failed opening datasource " << pathname );
         }
     }
 
+    for ( unsigned int l=0; l<lines.size(); l++ ) {
+        for ( unsigned int p=0; p<lines[l].points.size(); p++ ) {
+            minx = std::min( minx, lines[l].points[p].getLongitudeDeg() );
+            miny = std::min( miny, lines[l].points[p].getLatitudeDeg() );
+            maxx = std::max( maxx, lines[l].points[p].getLongitudeDeg() );
+            maxy = std::max( maxy, lines[l].points[p].getLatitudeDeg() );
+        }
+    }
+
+    if ( lines.empty() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "No lines read" );
+        return 0;
+    }
+
     SG_LOG( SG_GENERAL, SG_ALERT, "Area extents: (" << minx << "," << miny << ") - (" << maxx << "," << maxy << ")" );
     
     // now generate the WorkDirs - based on the buckets that cover the extents.
-    std::vector<SGBucket> bucketList;    
     SGGeod min = SGGeod::fromDeg( minx, miny );
     SGGeod max = SGGeod::fromDeg( maxx, maxy );
     sgGetBuckets( min, max, bucketList );
@@ -433,97 +598,29 @@ int main( int argc, char **argv ) {
 
     // I don't think this is threadsafe - pre create the workdir tree
     CreateWorkDirs( work_dir, bucketList);
-        
-    // as long as we have buckets to parse, do so
-    for (unsigned int i=0; i<bucketList.size(); i++) {
-        SGBucket bucket = bucketList[i];
-        char debugdir[128];
 
-        SG_LOG( SG_GENERAL, SG_ALERT, "Decode bucket " << bucket.gen_index_str() );        
-        sprintf( debugdir, "./vectordecode/%s", bucket.gen_index_str().c_str() );
-        
-        tgIntersectionGenerator* pig = new tgIntersectionGenerator( debugdir, 0, 1, GetTextureInfo );
-        tgChopper results( work_dir, bucket.gen_index() );
+    binLines();
+    SG_LOG( SG_GENERAL, SG_ALERT, "Read " << lines.size() << " lines" );
 
-        GDALDataset *poDS;        
-        for ( unsigned int i=0; i<areaDefs.size(); i++ ) {
-            char pathname[256];
-            
-            sprintf( pathname, "%s/%s", data_dir.c_str(), areaDefs[i].datasource.c_str() );
-            SG_LOG( SG_GENERAL, SG_ALERT, "Opening datasource " << pathname << " for reading." );
-            poDS = (GDALDataset*)GDALOpenEx( pathname, GDAL_OF_VECTOR, NULL, NULL, NULL );
-
-            if( poDS != NULL ) {
-                OGRLayer  *poLayer;
-                for (int j=0;j<poDS->GetLayerCount();j++) {
-                    poLayer = poDS->GetLayer(j);
-                    processLayer(poLayer, bucket, results, i, pig );
-                }
-                
-                GDALClose( poDS );
-            } else {
-                SG_LOG( SG_GENERAL, SG_ALERT, "Failed opening datasource " << pathname );
-            }
-        }        
-        
-        // add some additional Variables to the intersection generator
-        // cleaning parameters
-        // texture mode
-        // simplify parameters
-        // and add some data access
-        // get skeleton segments
-        // get skin segments
-        // delta height info may be needed....
-        // maybe needs a new class entirely based on intersectiongenerator.
-        
-        // we have all of the data - execute the intersection generator
-        // don't clean the OSM map data - as we don't want to generate intersections
-        // that don't really exist ( bridges and tunnels )
-        // OSM data should have correct intersection nodes already.
-        // - they need them to do routing.        
-        // lockOgr->lock();
-        pig->Execute();
-        
-        // now retreive the polygons in reverse z-order.  store them in lists
-        std::map<int, tgPolygonSetList*> polygons;
-        
-        for ( tgintersectionedge_it it = pig->edges_begin(); it != pig->edges_end(); it++ ) {
-            tgPolygonSet poly = (*it)->GetPoly("complete");
-            int          zo   = (*it)->GetZorder();
-            
-            if ( polygons.find( zo ) == polygons.end() ) {
-                // add new polygon list at this zorder
-                polygons[zo] = new tgPolygonSetList;
-            }
-            polygons[zo]->push_back( poly );
-        }
-        
-        // clip them in z order
-        tgAccumulator accum;    
-        std::map<int, tgPolygonSetList*>::reverse_iterator pmap_it;
-        
-        for ( pmap_it = polygons.rbegin(); pmap_it != polygons.rend(); pmap_it++ ) {
-            std::vector<tgPolygonSet>::iterator poly_it;            
-            for ( poly_it = (*pmap_it).second->begin(); poly_it != (*pmap_it).second->end(); poly_it++ ) {
-                tgPolygonSet current = (*poly_it);
-                //current.RemoveDups();
-
-	        SGTimeStamp stamp;
-                stamp.stamp();
-
-                accum.Diff_and_Add_cgal( current );
-                
-                // only add to output list if the clip left us with a polygon
-                if ( !current.isEmpty() ) {
-                    results.Add( current, stamp );
-                }
-            }
-        }
-        
-        results.Save(false);
-        
-        delete pig;
+    // and decode the buckets in parallel
+    if ( num_threads < 1 ) {
+        num_threads = 1;
+    }
+
+    std::vector<DecodeWorker*> workers;
+    for ( int i=0; i<num_threads; i++ ) {
+        workers.push_back( new DecodeWorker( work_dir ) );
     }
+    for ( int i=0; i<num_threads; i++ ) {
+        workers[i]->start();
+    }
+    for ( int i=0; i<num_threads; i++ ) {
+        workers[i]->join();
+        delete workers[i];
+    }
+
+    // the tiles are only complete on disk once closed
+    tgShapefileCache::instance().closeAll();
     
     return 0;
 }
@@ -0,0 +1,290 @@
+// tgBench.cxx -- repeatable timings of the tgMesh generation steps
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+
+// Runs tgMesh::generate ( clipPolys, arrangePolys, cleanArrangement,
+// constrainedTriangulateWithEdgeModification and prepareTds ) over a
+// fixed set of synthetic tiles, and writes the time of each step of
+// each run as csv or json.  The tiles are generated from fixed seeds,
+// so every run - on any machine - meshes exactly the same polygons.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <simgear/compiler.h>
+#include <simgear/constants.h>
+#include <simgear/debug/logstream.hxx>
+#include <simgear/bucket/newbucket.hxx>
+
+#include <Include/version.h>
+
+#include <terragear/mesh/tg_mesh.hxx>
+
+// a synthetic tile : every priority gets a number of random star shaped
+// polygons, on top of a base polygon covering the whole bucket
+struct benchTile {
+    const char*     name;
+    double          lon;
+    double          lat;
+    unsigned int    seed;
+    unsigned int    numPriorities;
+    unsigned int    polysPerPriority;
+    unsigned int    numVertices;
+};
+
+static const benchTile benchTiles[] = {
+    { "sparse",     -122.25, 37.50, 1,  4,  8, 12 },
+    { "dense",         8.50, 47.25, 2,  8, 32, 24 },
+    { "high_lat",     20.00, 68.00, 3,  6, 16, 16 },
+    { "many_small",   14.25, 35.75, 4, 10, 48, 32 },
+};
+
+static const unsigned int numBenchTiles = sizeof(benchTiles) / sizeof(benchTiles[0]);
+
+// our own generator - rand() differs between platforms
+static double benchRand( unsigned int& state )
+{
+    state = state * 1664525u + 1013904223u;
+    return ( state >> 8 ) / 16777216.0;
+}
+
+static cgalPoly_Polygon benchStar( const SGBucket& b, unsigned int numVertices, unsigned int& state )
+{
+    double cx = b.get_center_lon() + ( benchRand( state ) - 0.5 ) * b.get_width();
+    double cy = b.get_center_lat() + ( benchRand( state ) - 0.5 ) * b.get_height();
+    double r  = b.get_height() * ( 0.02 + 0.2 * benchRand( state ) );
+
+    // increasing angles around the center - so the polygon is simple and ccw
+    cgalPoly_Polygon poly;
+    for ( unsigned int i = 0; i < numVertices; i++ ) {
+        double a  = SGD_2PI * ( i + 0.8 * benchRand( state ) ) / numVertices;
+        double ri = r * ( 0.4 + 0.6 * benchRand( state ) );
+
+        poly.push_back( cgalPoly_Point( cx + ri * cos( a ), cy + ri * sin( a ) ) );
+    }
+
+    return poly;
+}
+
+static void benchPolys( const benchTile& tile, const SGBucket& b, std::vector<tgPolygonSetList>& polys )
+{
+    unsigned int state = tile.seed;
+
+    polys.clear();
+    polys.resize( tile.numPriorities + 1 );
+
+    for ( unsigned int p = 0; p < tile.numPriorities; p++ ) {
+        char material[32];
+        sprintf( material, "bench_%u", p );
+
+        for ( unsigned int i = 0; i < tile.polysPerPriority; i++ ) {
+            tgPolygonSetMeta meta( tgPolygonSetMeta::META_TEXTURED, material );
+            polys[p].push_back( tgPolygonSet( benchStar( b, tile.numVertices, state ), meta ) );
+        }
+    }
+
+    // the base covers the bucket - same as the ocean poly of tg-construct
+    cgalPoly_Polygon base;
+    base.push_back( cgalPoly_Point( b.get_corner( SG_BUCKET_SW ).getLongitudeDeg()-0.0005, b.get_corner( SG_BUCKET_SW ).getLatitudeDeg()-0.0005 ) );
+    base.push_back( cgalPoly_Point( b.get_corner( SG_BUCKET_SE ).getLongitudeDeg()+0.0005, b.get_corner( SG_BUCKET_SE ).getLatitudeDeg()-0.0005 ) );
+    base.push_back( cgalPoly_Point( b.get_corner( SG_BUCKET_NE ).getLongitudeDeg()+0.0005, b.get_corner( SG_BUCKET_NE ).getLatitudeDeg()+0.0005 ) );
+    base.push_back( cgalPoly_Point( b.get_corner( SG_BUCKET_NW ).getLongitudeDeg()-0.0005, b.get_corner( SG_BUCKET_NW ).getLatitudeDeg()+0.0005 ) );
+
+    tgPolygonSetMeta meta( tgPolygonSetMeta::META_TEXTURED, "bench_base" );
+    polys[tile.numPriorities].push_back( tgPolygonSet( base, meta ) );
+}
+
+// the time of each step of one run
+struct benchRun {
+    double phase[TG_MESH_NUM_PHASES];
+};
+
+static double benchTotal( const benchRun& run )
+{
+    double total = 0.0;
+    for ( unsigned int i = 0; i < TG_MESH_NUM_PHASES; i++ ) {
+        total += run.phase[i];
+    }
+    return total;
+}
+
+static void writeCsv( std::ostream& out, const std::vector<const benchTile*>& tiles, const std::vector< std::vector<benchRun> >& runs )
+{
+    out << "tile,run,phase,seconds\n";
+
+    for ( unsigned int t = 0; t < tiles.size(); t++ ) {
+        for ( unsigned int r = 0; r < runs[t].size(); r++ ) {
+            for ( unsigned int p = 0; p < TG_MESH_NUM_PHASES; p++ ) {
+                out << tiles[t]->name << "," << r << "," << tgMesh::getPhaseName( (tgMeshPhase)p ) << "," << runs[t][r].phase[p] << "\n";
+            }
+            out << tiles[t]->name << "," << r << ",total," << benchTotal( runs[t][r] ) << "\n";
+        }
+    }
+}
+
+static void writeJson( std::ostream& out, const std::vector<const benchTile*>& tiles, const std::vector< std::vector<benchRun> >& runs )
+{
+    out << "{\n  \"version\": \"" << getTGVersion() << "\",\n  \"tiles\": [\n";
+
+    for ( unsigned int t = 0; t < tiles.size(); t++ ) {
+        out << "    { \"name\": \"" << tiles[t]->name << "\", \"runs\": [\n";
+
+        for ( unsigned int r = 0; r < runs[t].size(); r++ ) {
+            out << "      {";
+            for ( unsigned int p = 0; p < TG_MESH_NUM_PHASES; p++ ) {
+                out << " \"" << tgMesh::getPhaseName( (tgMeshPhase)p ) << "\": " << runs[t][r].phase[p] << ",";
+            }
+            out << " \"total\": " << benchTotal( runs[t][r] ) << " }" << ( r + 1 < runs[t].size() ? "," : "" ) << "\n";
+        }
+
+        out << "    ] }" << ( t + 1 < tiles.size() ? "," : "" ) << "\n";
+    }
+
+    out << "  ]\n}\n";
+}
+
+static void usage( const char* progname )
+{
+    SG_LOG( SG_GENERAL, SG_ALERT, "Usage: " << progname << " [--repeat <n>] [--warmup <n>] [--tile <name>]... [--format csv|json] [--output <file>]" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "  --repeat  timed runs per tile ( default 5 )" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "  --warmup  untimed runs per tile before timing ( default 1 )" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "  --tile    only run the named tile - may be repeated" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "  --format  csv ( default ) or json" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "  --output  write timings to file instead of stdout" );
+    SG_LOG( SG_GENERAL, SG_ALERT, "Tiles:" );
+    for ( unsigned int i = 0; i < numBenchTiles; i++ ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "  " << benchTiles[i].name );
+    }
+    exit(-1);
+}
+
+int main( int argc, char **argv )
+{
+    unsigned int             repeat = 5;
+    unsigned int             warmup = 1;
+    std::string              format = "csv";
+    std::string              output;
+    std::vector<std::string> names;
+
+    sglog().setLogLevels( SG_ALL, SG_WARN );
+
+    for ( int i = 1; i < argc; i++ ) {
+        std::string arg = argv[i];
+
+        if ( arg == "--repeat" && i+1 < argc ) {
+            repeat = atoi( argv[++i] );
+        } else if ( arg == "--warmup" && i+1 < argc ) {
+            warmup = atoi( argv[++i] );
+        } else if ( arg == "--tile" && i+1 < argc ) {
+            names.push_back( argv[++i] );
+        } else if ( arg == "--format" && i+1 < argc ) {
+            format = argv[++i];
+        } else if ( arg == "--output" && i+1 < argc ) {
+            output = argv[++i];
+        } else {
+            usage( argv[0] );
+        }
+    }
+
+    if ( format != "csv" && format != "json" ) {
+        usage( argv[0] );
+    }
+
+    std::vector<const benchTile*> tiles;
+    for ( unsigned int i = 0; i < numBenchTiles; i++ ) {
+        if ( names.empty() || std::find( names.begin(), names.end(), benchTiles[i].name ) != names.end() ) {
+            tiles.push_back( &benchTiles[i] );
+        }
+    }
+
+    if ( tiles.empty() ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "No tiles selected" );
+        usage( argv[0] );
+    }
+
+    std::vector< std::vector<benchRun> > runs( tiles.size() );
+
+    for ( unsigned int t = 0; t < tiles.size(); t++ ) {
+        const benchTile& tile = *tiles[t];
+        SGBucket         b( SGGeod::fromDeg( tile.lon, tile.lat ) );
+
+        std::vector<tgPolygonSetList> polys;
+        benchPolys( tile, b, polys );
+
+        std::vector<std::string> priorities;
+        for ( unsigned int p = 0; p < polys.size(); p++ ) {
+            char name[32];
+            sprintf( name, "bench_%u", p );
+            priorities.push_back( name );
+        }
+
+        tgMesh mesh;
+        mesh.initPriorities( priorities );
+
+        for ( unsigned int r = 0; r < warmup + repeat; r++ ) {
+            mesh.clear();
+            mesh.clipAgainstBucket( b );
+            for ( unsigned int p = 0; p < polys.size(); p++ ) {
+                mesh.addPolys( p, polys[p] );
+            }
+
+            mesh.generate();
+
+            if ( r >= warmup ) {
+                benchRun run;
+                for ( unsigned int p = 0; p < TG_MESH_NUM_PHASES; p++ ) {
+                    run.phase[p] = mesh.getPhaseTime( (tgMeshPhase)p );
+                }
+                runs[t].push_back( run );
+            }
+        }
+
+        // quick summary - the fastest run
+        if ( !runs[t].empty() ) {
+            double best = benchTotal( runs[t][0] );
+            for ( unsigned int r = 1; r < runs[t].size(); r++ ) {
+                best = std::min( best, benchTotal( runs[t][r] ) );
+            }
+            SG_LOG( SG_GENERAL, SG_ALERT, tile.name << " ( " << b.gen_index_str() << " ) : best of " << runs[t].size() << " runs " << best << " s" );
+        }
+    }
+
+    std::ofstream file;
+    if ( !output.empty() ) {
+        file.open( output.c_str() );
+        if ( !file.is_open() ) {
+            SG_LOG( SG_GENERAL, SG_ALERT, "Cannot open " << output );
+            return EXIT_FAILURE;
+        }
+    }
+    std::ostream& out = output.empty() ? std::cout : file;
+
+    out.precision( 9 );
+    if ( format == "json" ) {
+        writeJson( out, tiles, runs );
+    } else {
+        writeCsv( out, tiles, runs );
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -42,6 +42,7 @@
 #include <terragear/polygon_set/tg_polygon_accumulator.hxx>
 #include <terragear/polygon_set/tg_polygon_set.hxx>
 #include <terragear/polygon_set/tg_polygon_chop.hxx>
+#include <terragear/tg_shapefile_cache.hxx>
 
 using std::string;
 
@@ -292,6 +293,9 @@ int main( int argc, char **argv ) {
 
     GDALClose(poDS);
 
+    // the chopped tiles are read back below
+    results.Flush();
+
     char resDatasource[64];
     sprintf(resDatasource, "./%s", resultname.c_str() );
     
@@ -333,5 +337,7 @@ int main( int argc, char **argv ) {
     
     SG_LOG( SG_GENERAL, SG_ALERT, "total area of difference for " << resultname << " is " << total_sp_area - total_cp_area );
 
+    tgShapefileCache::instance().closeAll();
+
     return 0;
 }
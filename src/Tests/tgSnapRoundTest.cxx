@@ -0,0 +1,271 @@
+// tgSnapRoundTest.cxx -- compare tgSnapRound with CGAL::snap_rounding_2
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+
+// Builds arrangements from fixed degenerate inputs ( collinear, overlapping
+// and near pixel corner segments ), and from any polygon datasources given
+// on the command line ( e.g. landclass shapefiles or a stage1 arrangement ),
+// then snap rounds the edges with both tgSnapRound and CGAL, with the
+// pixel size doSnapRound uses.  The links between hot pixels must match.
+// Exits with 1 if any input differs.
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ogrsf_frmts.h>
+#include <gdal_priv.h>
+
+#include <simgear/compiler.h>
+#include <simgear/debug/logstream.hxx>
+
+#include <terragear/mesh/tg_mesh.hxx>
+
+// same as doSnapRound
+#define PIXEL_SIZE  (0.0000002)
+
+typedef std::pair<long, long>       srPixel;
+typedef std::pair<srPixel, srPixel> srLink;
+
+// fixed origin, so every run tests the same pixel borders
+#define ORIGIN_LON  (-122.5)
+#define ORIGIN_LAT  (37.5)
+
+static meshArrPoint pixelPoint( double px, double py )
+{
+    return meshArrPoint( ORIGIN_LON + px * PIXEL_SIZE, ORIGIN_LAT + py * PIXEL_SIZE );
+}
+
+static void addSegment( std::vector<meshArrSegment>& segs, double x1, double y1, double x2, double y2 )
+{
+    meshArrPoint p1 = pixelPoint( x1, y1 );
+    meshArrPoint p2 = pixelPoint( x2, y2 );
+
+    if ( p1 != p2 ) {
+        segs.push_back( meshArrSegment( p1, p2 ) );
+    }
+}
+
+// output polylines hold pixel centers - so the pixel is unambiguous
+static void getLinks( const tgSnapRoundPolylineList& polylines, std::set<srLink>& links )
+{
+    for ( unsigned int i=0; i<polylines.size(); i++ ) {
+        const tgSnapRoundPolyline& pl = polylines[i];
+
+        for ( unsigned int j=1; j<pl.size(); j++ ) {
+            srPixel p1( (long)floor( CGAL::to_double( pl[j-1].x() ) / PIXEL_SIZE ), (long)floor( CGAL::to_double( pl[j-1].y() ) / PIXEL_SIZE ) );
+            srPixel p2( (long)floor( CGAL::to_double( pl[j].x() )   / PIXEL_SIZE ), (long)floor( CGAL::to_double( pl[j].y() )   / PIXEL_SIZE ) );
+
+            if ( p1 < p2 ) {
+                links.insert( srLink( p1, p2 ) );
+            } else if ( p2 < p1 ) {
+                links.insert( srLink( p2, p1 ) );
+            }
+        }
+    }
+}
+
+static bool compare( const std::string& name, const std::vector<meshArrSegment>& input )
+{
+    // snap rounding runs on the arrangement edges
+    meshArrangement arr;
+    CGAL::insert( arr, input.begin(), input.end() );
+
+    std::vector<meshArrSegment> segs;
+    for ( meshArrEdgeConstIterator eit = arr.edges_begin(); eit != arr.edges_end(); ++eit ) {
+        segs.push_back( eit->curve() );
+    }
+
+    tgSnapRoundPolylineList ours, cgal;
+    if ( !tgSnapRound( segs, PIXEL_SIZE, ours ) ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, name << ": tgSnapRound did not converge on " << segs.size() << " edges" );
+        return false;
+    }
+    tgSnapRoundCgal( segs, PIXEL_SIZE, cgal );
+
+    std::set<srLink> ourLinks, cgalLinks;
+    getLinks( ours, ourLinks );
+    getLinks( cgal, cgalLinks );
+
+    unsigned int missing = 0, extra = 0;
+    for ( std::set<srLink>::const_iterator it = cgalLinks.begin(); it != cgalLinks.end(); ++it ) {
+        if ( ourLinks.find( *it ) == ourLinks.end() ) {
+            SG_LOG( SG_GENERAL, SG_DEBUG, name << ": missing link " << it->first.first << "," << it->first.second << " - " << it->second.first << "," << it->second.second );
+            missing++;
+        }
+    }
+    for ( std::set<srLink>::const_iterator it = ourLinks.begin(); it != ourLinks.end(); ++it ) {
+        if ( cgalLinks.find( *it ) == cgalLinks.end() ) {
+            SG_LOG( SG_GENERAL, SG_DEBUG, name << ": extra link " << it->first.first << "," << it->first.second << " - " << it->second.first << "," << it->second.second );
+            extra++;
+        }
+    }
+
+    if ( missing || extra ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, name << ": FAILED - " << segs.size() << " edges, " << cgalLinks.size() << " CGAL links, " << missing << " missing, " << extra << " extra" );
+        return false;
+    }
+
+    SG_LOG( SG_GENERAL, SG_INFO, name << ": ok - " << segs.size() << " edges, " << ourLinks.size() << " links" );
+    return true;
+}
+
+// collinear chains, and parallel lines a pixel or less apart
+static void collinear( std::vector<meshArrSegment>& segs )
+{
+    for ( int i=0; i<8; i++ ) {
+        addSegment( segs, i * 3.3, i * 1.7, ( i + 1 ) * 3.3, ( i + 1 ) * 1.7 );
+    }
+    for ( int i=0; i<4; i++ ) {
+        double off = 0.25 + i * 0.5;
+        addSegment( segs, 0.1, 5.0 + off, 40.3, 5.0 + off );
+        addSegment( segs, 2.0 + off, -3.1, 2.0 + off, 30.7 );
+    }
+}
+
+// segments on the same lines, overlapping each other and crossing
+static void overlapping( std::vector<meshArrSegment>& segs )
+{
+    addSegment( segs, 0.0,  0.0, 20.0, 10.0 );
+    addSegment( segs, 4.0,  2.0, 30.0, 15.0 );
+    addSegment( segs, 10.0, 5.0, 14.0,  7.0 );
+    addSegment( segs, 0.5, 12.5, 25.5, -0.5 );
+    addSegment( segs, 6.5,  9.5, 19.5,  3.0 );
+    addSegment( segs, 12.3, -4.0, 12.3, 20.0 );
+    addSegment( segs, 12.3,  1.0, 12.3, 30.0 );
+}
+
+// end points on pixel corners, and edges passing just by them
+static void corners( std::vector<meshArrSegment>& segs )
+{
+    const double eps[] = { 0.0, 1e-9, -1e-9, 1e-6, -1e-6 };
+
+    for ( int i=0; i<5; i++ ) {
+        addSegment( segs, 0.0 + eps[i], 10.0 * i, 8.0, 10.0 * i + 8.0 + eps[i] );
+        addSegment( segs, 0.0, 10.0 * i + 4.0 - eps[i], 8.0 + eps[i], 10.0 * i + 4.0 );
+        addSegment( segs, 3.0 + eps[i], 10.0 * i - 1.0, 3.0 - eps[i], 10.0 * i + 9.0 );
+        addSegment( segs, 20.0, 10.0 * i + eps[i], 20.5 + eps[i], 10.0 * i + 7.0 );
+    }
+}
+
+// many short crossing segments - lots of hot pixels close together
+static void crossing( std::vector<meshArrSegment>& segs )
+{
+    unsigned long seed = 12345;
+
+    for ( int i=0; i<200; i++ ) {
+        double c[4];
+
+        for ( int j=0; j<4; j++ ) {
+            seed = ( seed * 1103515245 + 12345 ) & 0x7fffffff;
+            c[j] = ( seed % 100000 ) / 1000.0;
+        }
+        addSegment( segs, c[0], c[1], c[2], c[3] );
+    }
+}
+
+static bool fromDatasource( const std::string& datasource, std::vector<meshArrSegment>& segs )
+{
+    GDALDataset* poDS = (GDALDataset*)GDALOpenEx( datasource.c_str(), GDAL_OF_VECTOR, NULL, NULL, NULL );
+    if ( poDS == NULL ) {
+        SG_LOG( SG_GENERAL, SG_ALERT, "Failed opening datasource " << datasource );
+        return false;
+    }
+
+    for ( int l=0; l<poDS->GetLayerCount(); l++ ) {
+        OGRLayer*   poLayer = poDS->GetLayer( l );
+        OGRFeature* poFeature;
+
+        poLayer->ResetReading();
+        while ( ( poFeature = poLayer->GetNextFeature() ) != NULL ) {
+            OGRGeometry* poGeometry = poFeature->GetGeometryRef();
+            std::vector<OGRPolygon*> polys;
+
+            if ( poGeometry != NULL ) {
+                OGRwkbGeometryType geoType = wkbFlatten( poGeometry->getGeometryType() );
+
+                if ( geoType == wkbPolygon ) {
+                    polys.push_back( (OGRPolygon*)poGeometry );
+                } else if ( geoType == wkbMultiPolygon ) {
+                    OGRMultiPolygon* multipoly = (OGRMultiPolygon*)poGeometry;
+                    for ( int i=0; i<multipoly->getNumGeometries(); i++ ) {
+                        polys.push_back( (OGRPolygon*)multipoly->getGeometryRef( i ) );
+                    }
+                }
+            }
+
+            for ( unsigned int p=0; p<polys.size(); p++ ) {
+                for ( int r=-1; r<polys[p]->getNumInteriorRings(); r++ ) {
+                    OGRLinearRing* ring = ( r < 0 ) ? polys[p]->getExteriorRing() : polys[p]->getInteriorRing( r );
+
+                    for ( int i=1; i<ring->getNumPoints(); i++ ) {
+                        meshArrPoint p1( ring->getX( i-1 ), ring->getY( i-1 ) );
+                        meshArrPoint p2( ring->getX( i ),   ring->getY( i ) );
+
+                        if ( p1 != p2 ) {
+                            segs.push_back( meshArrSegment( p1, p2 ) );
+                        }
+                    }
+                }
+            }
+
+            OGRFeature::DestroyFeature( poFeature );
+        }
+    }
+
+    GDALClose( poDS );
+    return true;
+}
+
+int main( int argc, char **argv )
+{
+    sglog().setLogLevels( SG_ALL, SG_INFO );
+
+    bool ok = true;
+    std::vector<meshArrSegment> segs;
+
+    collinear( segs );
+    ok &= compare( "collinear", segs );
+    segs.clear();
+
+    overlapping( segs );
+    ok &= compare( "overlapping", segs );
+    segs.clear();
+
+    corners( segs );
+    ok &= compare( "corners", segs );
+    segs.clear();
+
+    crossing( segs );
+    ok &= compare( "crossing", segs );
+    segs.clear();
+
+    GDALAllRegister();
+    for ( int i=1; i<argc; i++ ) {
+        if ( fromDatasource( argv[i], segs ) ) {
+            ok &= compare( argv[i], segs );
+        } else {
+            ok = false;
+        }
+        segs.clear();
+    }
+
+    return ok ? 0 : 1;
+}